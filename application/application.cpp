@@ -7,6 +7,13 @@
 #include "gbuffer.h"
 #include <unistd.h>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <limits>
+#include <cstring>
+#include <cassert>
 
 
 Game::Game(unsigned int width, unsigned int height) 
@@ -33,10 +40,13 @@ void Game::Init()
     ResourceManager::LoadShader("shaders/hitbox.vs", "shaders/hitbox.fs", nullptr, "hitbox");
     hitboxShader = ResourceManager::GetShader("hitbox");
 
-    ResourceManager::LoadShader("shaders/lights.vs", "shaders/lights.fs", nullptr, "lights");
+    // decodeNormalXY() and the layout of the cooked maps, for the shaders sampling them
+    std::string cookedMaps = ResourceManager::LoadShaderPrelude("shaders/cookedMaps.glsl");
+
+    ResourceManager::LoadShader("shaders/lights.vs", "shaders/lights.fs", nullptr, "lights", cookedMaps);
     lightShader = ResourceManager::GetShader("lights");
 
-    ResourceManager::LoadShader("shaders/PBR.vs", "shaders/PBR.fs", nullptr, "PBR");
+    ResourceManager::LoadShader("shaders/PBR.vs", "shaders/PBR.fs", nullptr, "PBR", cookedMaps);
     PBR = ResourceManager::GetShader("PBR");
 
     ResourceManager::LoadShader("shaders/PBR_notext.vs", "shaders/PBR_notext.fs", nullptr, "PBR_notext");
@@ -57,16 +67,30 @@ void Game::Init()
     ResourceManager::LoadShader("shaders/height.vs", "shaders/height.fs", nullptr, "height");
     terrainShader = ResourceManager::GetShader("height");
 
-    ResourceManager::LoadShader("shaders/animation.vs", "shaders/animation.fs", nullptr, "animation");
+    // as many characters per instanced draw as a uniform block holds here,
+    // one if the driver still can't link that many
+    unsigned int paletteCharacters = BonePaletteBuffer::getMaxBatchCharacters();
+    ResourceManager::LoadShader("shaders/animation.vs", "shaders/animation.fs", nullptr, "animation", BonePaletteBuffer::getShaderDefines(paletteCharacters));
+    if (!ResourceManager::GetShader("animation").Linked && paletteCharacters > 1) {
+        glDeleteProgram(ResourceManager::GetShader("animation").ID);
+        paletteCharacters = 1;
+        ResourceManager::LoadShader("shaders/animation.vs", "shaders/animation.fs", nullptr, "animation", BonePaletteBuffer::getShaderDefines(paletteCharacters));
+    }
     animationShader = ResourceManager::GetShader("animation");
+    if (animationShader.Linked) {
+        BonePaletteBuffer::bindShader(animationShader);
+        bonePalette.setBatchCharacters(paletteCharacters);
+    } else {
+        std::cout << "Animation shader failed to link, animated characters are not drawn" << std::endl;
+    }
 
-    ResourceManager::LoadShader("shaders/SSGI/gbufferSSGI.vs", "shaders/SSGI/gbufferSSGI.fs", nullptr, "gbuffer");
+    ResourceManager::LoadShader("shaders/SSGI/gbufferSSGI.vs", "shaders/SSGI/gbufferSSGI.fs", nullptr, "gbuffer", cookedMaps);
     Gbuffer_shader = ResourceManager::GetShader("gbuffer");
 
     ResourceManager::LoadShader("shaders/SSGI/lightPass.vs", "shaders/SSGI/lightPass.fs", nullptr, "lightPass");
     lightpass = ResourceManager::GetShader("lightPass");
 
-    ResourceManager::LoadShader("shaders/default.vs", "shaders/default.fs", nullptr, "default");
+    ResourceManager::LoadShader("shaders/default.vs", "shaders/default.fs", nullptr, "default", cookedMaps);
     defaultShader = ResourceManager::GetShader("default");
 
     ResourceManager::LoadShader("shaders/SSGI/ssao.vs", "shaders/SSGI/ssao.fs", nullptr, "ssao");
@@ -85,7 +109,7 @@ void Game::Init()
     ResourceManager::LoadShader("shaders/shadows/point_shadows_depth.vs", "shaders/shadows/point_shadows_depth.fs", "shaders/shadows/point_shadows_depth.gs", "simpleDepthShaderPoint");
     simpleDepthShaderPoint = ResourceManager::GetShader("simpleDepthShaderPoint");
 
-    ResourceManager::LoadShader("shaders/shadows/pbr_shadows.vs", "shaders/shadows/pbr_shadows.fs", nullptr, "pbr_shadows");
+    ResourceManager::LoadShader("shaders/shadows/pbr_shadows.vs", "shaders/shadows/pbr_shadows.fs", nullptr, "pbr_shadows", cookedMaps);
     pbr_shadows = ResourceManager::GetShader("pbr_shadows");
 
     antialiasing = new Antialiasing(Width, Height, Antialiasing::Type::NONE);
@@ -101,23 +125,23 @@ void Game::Init()
 
     //Cube object
     cube = new Cube();
-    cube->collisionEnabled = true;
-    cube->isStatic = false;
+    cube->setCollisionEnabled(true);
+    cube->setStatic(false);
     cube->setPosition(glm::vec3(0.0f, 7.0f, 0.0f));
     cube->setScale(glm::vec3(1.0f, 1.0f, 1.0f));
     primitives.push_back(cube);
 
     ////big cube for environment
     cube = new Cube();
-    cube->collisionEnabled = false;
-    cube->isStatic = true;
+    cube->setCollisionEnabled(false);
+    cube->setStatic(true);
     cube->setPosition(glm::vec3(0.0f, 0.0f, 0.0f));
     cube->setScale(glm::vec3(10.0f, 10.0f, 10.0f));
     primitives.push_back(cube);
 
     plane = new Plane();
-    plane->collisionEnabled = true;
-    plane->isStatic = true;
+    plane->setCollisionEnabled(true);
+    plane->setStatic(true);
     plane->setScale(glm::vec3(10.0f, 1.0f, 10.0f));
     plane->setPosition(glm::vec3(0.0f, 0.0f, 0.0f));
     primitives.push_back(plane);
@@ -129,20 +153,21 @@ void Game::Init()
 
     //for pointlight
     sphere_light = new Sphere();
-    sphere_light->collisionEnabled = false;
-    sphere_light->isStatic = true;
+    sphere_light->setCollisionEnabled(false);
+    sphere_light->setStatic(true);
     sphere_light->setPosition(glm::vec3(-5.0f, 5.0f, -5.0));
     primitives.push_back(sphere_light);
 
     //for spotlight
     sphere_light = new Sphere();
-    sphere_light->collisionEnabled = false;
-    sphere_light->isStatic = true;
+    sphere_light->setCollisionEnabled(false);
+    sphere_light->setStatic(true);
     sphere_light->setPosition(glm::vec3(5.0f, 5.0f, 5.0f));
     primitives.push_back(sphere_light);
 
     //terrain
     terrain = new Terrain(1.0f);
+    collision.terrain = terrain;
 
     ////
     light.addSpotlight(glm::vec3(5.0f, 5.0f, 5.0f), glm::normalize(glm::vec3(-1.0f, -1.0f, -1.0f)), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), 10.0f, glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(25.0f)));
@@ -169,9 +194,6 @@ void Game::Init()
     player = new Player(glm::vec3(0.0f, 10.0f, 2.0f), glm::vec3(1.0f, 2.0f, 1.0f), *myCamera);
     //primitives.push_back(player);
 
-    //vertices for collision detection
-    vertices_terrain = terrain->getVertices();
-
     //make string from ../models/wooden_axe_02_1k.gltf
     //std::string filename = "models/wooden_axe_02_1k.gltf";
     //load lemon
@@ -193,11 +215,17 @@ void Game::Init()
     //reduce scale
     //modelLoader.scale = glm::vec3(0.1f, 0.1f, 0.1f);
 
+    //static collision mesh of the model, cooked once and cached next to the gltf
+    CollisionMesh modelCollision;
+    if (modelLoader.getCollisionMesh(modelCollision)) {
+        collision.addStaticMesh(modelCollision, modelLoader.getModelMatrix());
+    }
+
     //load with assimp
     model_animation = Model("models/michel.fbx");
  
     animation = Animation("models/michel.fbx", &model_animation);
-    animator = Animator(&animation);
+    animationSystem.addCharacter(&animation);
 
 
     // Setup Dear ImGui context
@@ -217,14 +245,17 @@ void Game::Init()
 
 void Game::Update(float dt)
 {
-    collision.update(primitives);
-    collision.updatePlayer(player, primitives, vertices_terrain);
+    //physics at a fixed tick rate, independent of the frame rate
+    collision.step(dt, primitives, player);
 
     //update player
     player->update(dt);
 
+    //terrain chunks for this frame's camera, the passes in Render only draw them
+    terrain->update(*myCamera);
+
     //update animation
-    animator.UpdateAnimation(dt);
+    animationSystem.update(dt);
 
     //std::cout << "PLayer colliding with primitives" << collision.getCollisionWithPlayerwithPrimitives() << std::endl;
     //std::cout << "PLayer colliding with terrain" << collision.getCollisionWithPlayerwithTerrain() << std::endl;
@@ -233,6 +264,9 @@ void Game::Update(float dt)
 
 void Game::Render()
 {
+    //textures decoded since the last frame replace their placeholders
+    TextureLoader::Update();
+
     //imgui
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -316,6 +350,165 @@ void Game::Render()
     
 
 
+    //physics counters
+    if (ImGui::CollapsingHeader("Physics")) {
+        const Collision::Stats& stats = collision.getStats();
+        ImGui::Text("Primitives: %zu", stats.primitives);
+        ImGui::Text("Awake bodies: %zu, sleeping: %zu", stats.awakeBodies, stats.sleepingBodies);
+        ImGui::Text("Ticks this frame: %d at %.0f Hz (dropped %d)", stats.steps, collision.getTickRate(), stats.droppedSteps);
+        float tickRate = collision.getTickRate();
+        if (ImGui::SliderFloat("Tick rate", &tickRate, 15.0f, 240.0f)) {
+            collision.setTickRate(tickRate);
+        }
+        ImGui::Text("Pair tests: %zu (brute force %zu), %s kernel", stats.pairTests, stats.bruteForcePairs, BroadPhase::getKernelName());
+        ImGui::Text("Candidate pairs: %zu, contacts: %zu", stats.candidatePairs, stats.contacts);
+        ImGui::Text("Islands: %zu", stats.islands);
+        int solverThreads = static_cast<int>(collision.getSolverThreads());
+        if (ImGui::SliderInt("Solver threads", &solverThreads, 0, 16)) {
+            collision.setSolverThreads(static_cast<unsigned int>(solverThreads));
+        }
+        ImGui::Text("Broad phase: %.3f ms, narrow phase: %.3f ms", stats.broadPhaseMs, stats.narrowPhaseMs);
+        ImGui::Text("Terrain queries: %zu in %.3f ms", stats.terrainQueries, stats.terrainMs);
+        ImGui::Text("Swept moves: %zu, stopped at impact: %zu", stats.sweeps, stats.sweepHits);
+        ImGui::Text("Mesh queries: %zu, contacts: %zu in %.3f ms", stats.meshQueries, stats.meshContacts, stats.meshMs);
+        ImGui::Text("Heap allocations this frame: %zu", stats.allocations);
+        if (ImGui::Button("Ray benchmark")) {
+            RunRayBenchmark();
+        }
+        ImGui::Text("Rays/s: %.0f single, %.0f batched on %u threads", raysPerSecondSingle, raysPerSecondBatch, collision.getSolverThreads());
+        if (ImGui::Button("Broad phase benchmark")) {
+            RunBroadPhaseBenchmark();
+        }
+        for (int i = 0; i < 4; ++i) {
+            ImGui::Text("%zu boxes: first frame %.2f ms, then %.2f ms/frame", broadPhaseSizes[i], broadPhaseFirstMs[i], broadPhaseFrameMs[i]);
+            ImGui::Text("    broad %.2f ms, narrow %.2f ms (%s kernel)", broadPhaseSweepMs[i], broadPhaseNarrowMs[i], BroadPhase::getKernelName());
+            ImGui::Text("    %zu pair tests (brute force %zu), %zu candidates", broadPhasePairTests[i], broadPhaseSizes[i] * (broadPhaseSizes[i] - 1) / 2, broadPhaseCandidates[i]);
+        }
+        if (ImGui::Button("Solver scaling benchmark")) {
+            RunSolverScalingBenchmark();
+        }
+        for (size_t i = 0; i < solverScalingMs.size(); ++i) {
+            ImGui::Text("%zu cubes, %zu workers: solve %.3f ms/tick, %.2fx", solverScalingCubes, i, solverScalingMs[i], solverScalingSpeedup[i]);
+        }
+        if (!solverScalingMs.empty()) {
+            ImGui::Text("Final positions: %s for every thread count", solverScalingDeterministic ? "identical" : "DIFFERENT");
+        }
+        if (ImGui::Button("Mesh collision benchmark")) {
+            RunMeshCollisionBenchmark();
+        }
+        for (int m = 0; m < 2; ++m) {
+            ImGui::Text("%s, %zu triangles:", meshBenchNames[m], meshBenchTriangles[m]);
+            ImGui::Text("    player boxes %.0f queries/ms, %zu contacts", meshBoxQueriesPerMs[m], meshBoxContacts[m]);
+            ImGui::Text("    swept boxes %.0f queries/ms, %zu contacts", meshSweptQueriesPerMs[m], meshSweptContacts[m]);
+            ImGui::Text("    26-DOP hulls %.0f queries/ms, %zu contacts", meshHullQueriesPerMs[m], meshHullContacts[m]);
+        }
+    }
+
+    //terrain level of detail
+    if (ImGui::CollapsingHeader("Terrain")) {
+        bool lodEnabled = terrain->isLodEnabled();
+        if (ImGui::Checkbox("Chunked LOD", &lodEnabled)) {
+            terrain->setLodEnabled(lodEnabled);
+        }
+        bool batchedDraw = terrain->isBatchedDraw();
+        if (ImGui::Checkbox("Batched draws", &batchedDraw)) {
+            terrain->setBatchedDraw(batchedDraw);
+        }
+        bool gpuHeights = terrain->isGpuHeights();
+        if (ImGui::Checkbox("Heights from texture", &gpuHeights)) {
+            terrain->setGpuHeights(gpuHeights);
+        }
+        ImGui::Text("Full resolution vertex memory: %.2f MB", terrain->getVertexMemory() / (1024.0f * 1024.0f));
+        const Terrain::DrawStats& drawStats = terrain->getDrawStats();
+        ImGui::Text("Terrain draw calls: %zu, triangles: %zu, CPU: %.3f ms", drawStats.drawCalls, drawStats.triangles, drawStats.cpuMs);
+        TerrainLod* lod = terrain->getLod();
+        if (lod) {
+            ImGui::SliderFloat("LOD distance", &lod->lodDistance, 0.5f, 8.0f);
+            const TerrainLod::Stats& lodStats = lod->getStats();
+            ImGui::Text("Chunks drawn: %zu of %zu resident, %zu loading", lodStats.chunksDrawn, lodStats.chunksResident, lodStats.chunksLoading);
+            ImGui::Text("Triangles: %zu (full resolution %zu) in %zu draw calls", lodStats.trianglesSubmitted, lod->getFullTriangleCount(), lodStats.drawCalls);
+            ImGui::Text("Select: %.3f ms, upload: %.3f ms", lodStats.selectMs, lodStats.uploadMs);
+        }
+        if (ImGui::Button("Fly-through benchmark")) {
+            RunTerrainBenchmark();
+        }
+        ImGui::Text("16k map: %.0f triangles/frame (full resolution %zu)", terrainBenchTriangles, terrainBenchFullTriangles);
+        ImGui::Text("CPU: %.3f ms/frame, worst %.3f ms, %zu chunks streamed", terrainBenchFrameMs, terrainBenchMaxFrameMs, terrainBenchChunks);
+        if (ImGui::Button("Generation benchmark")) {
+            RunTerrainGenerationBenchmark();
+        }
+        ImGui::Text("Mesh generation: 1k %.1f ms, 4k %.1f ms, 8k %.1f ms on %u threads", terrainGenerationMs[0], terrainGenerationMs[1], terrainGenerationMs[2], terrainGenerationThreads + 1);
+        if (ImGui::Button("Height query benchmark")) {
+            RunHeightQueryBenchmark();
+        }
+        const char* heightSizes[] = { "512", "2048", "8192" };
+        for (int i = 0; i < 3; ++i) {
+            ImGui::Text("%s map: vertex scan %.1f us, heightfield %.3f us per query", heightSizes[i], heightScanUs[i], heightLookupUs[i]);
+        }
+        const char* brushModes[] = { "Raise", "Lower", "Smooth", "Flatten" };
+        ImGui::Combo("Brush (hold B)", &brushMode, brushModes, IM_ARRAYSIZE(brushModes));
+        ImGui::SliderFloat("Brush radius", &brushRadius, 1.0f, 64.0f);
+        ImGui::SliderFloat("Brush strength", &brushStrength, 0.1f, 16.0f);
+        ImGui::Text("Last edit: %.3f ms", terrain->getLastEditMs());
+        if (ImGui::Button("Brush benchmark")) {
+            RunBrushBenchmark();
+        }
+        ImGui::Text("8k map, 64x64 edit: raise %.3f ms, lower %.3f ms, smooth %.3f ms, flatten %.3f ms",
+                    brushEditMs[0], brushEditMs[1], brushEditMs[2], brushEditMs[3]);
+        ImGui::Text("Collision refit: %.3f ms per edit", brushRefitMs);
+    }
+
+    //asynchronous texture loading
+    if (ImGui::CollapsingHeader("Textures")) {
+        ImGui::Text("Pending: %zu, decode threads: %u", TextureLoader::GetPendingCount(), TextureLoader::GetDecodeThreads());
+        if (ImGui::Button("Startup benchmark")) {
+            RunTextureBenchmark();
+        }
+        ImGui::Text("Sync: %.1f ms on the GL thread", textureSyncMs);
+        ImGui::Text("Async: %.1f ms total, %.1f ms on the GL thread to issue", textureAsyncMs, textureAsyncIssueMs);
+        ImGui::Text("Cooked: %.1f ms total, %zu textures had a cooked file", textureCookedMs, textureCookedCount);
+        ImGui::Text("VRAM: %.1f MB decoded, %.1f MB cooked", textureDecodedBytes / (1024.0f * 1024.0f), textureCookedBytes / (1024.0f * 1024.0f));
+        ImGui::Checkbox("Use cooked textures", &TextureLoader::UseCooked);
+        ResourceManager::TextureCacheStats cacheStats = ResourceManager::GetTextureCacheStats();
+        ImGui::Text("Cache: %zu textures, %zu references, %.1f MB on the GPU", cacheStats.textures, cacheStats.references, cacheStats.bytesUploaded / (1024.0f * 1024.0f));
+        ImGui::Text("Saved by sharing: %.1f MB", cacheStats.bytesSaved / (1024.0f * 1024.0f));
+    }
+
+    //cooked models
+    if (ImGui::CollapsingHeader("Models")) {
+        if (ImGui::Button("Load benchmark")) {
+            RunModelLoadBenchmark();
+        }
+        ImGui::Text("Sources: %.1f ms, FBX imported twice, glTF parsed", modelSourceMs);
+        ImGui::Text("Cooked: %.2f ms, %zu models had a cooked file", modelCookedMs, modelCookedCount);
+    }
+
+    //skeletal animation
+    if (ImGui::CollapsingHeader("Animation")) {
+        if (ImGui::Button("Skeleton benchmark")) {
+            RunAnimationBenchmark();
+        }
+        ImGui::Text("Rig: %zu nodes, %zu animated", animationNodeCount, animationChannelCount);
+        ImGui::Text("Scene: %zu characters in %zu instanced draws of %u", animationSystem.getCharacterCount(), bonePalette.getBatchCount(), bonePalette.getBatchCharacters());
+        ImGui::Text("%.1f characters/ms", animationCharactersPerMs);
+        if (ImGui::Button("Keyframe benchmark")) {
+            RunKeyframeBenchmark();
+        }
+        ImGui::Text("Scan: %.2f ms, cursor: %.2f ms", keyframeLinearMs, keyframeCursorMs);
+        ImGui::Text("Seeks: %.2f ms, resampled: %.2f ms", keyframeSeekMs, keyframeUniformMs);
+        if (ImGui::Button("Crowd benchmark")) {
+            RunCrowdBenchmark();
+        }
+        for (int i = 0; i < 4; ++i) {
+            ImGui::Text("%zu characters: %.1f characters/ms, %.1f per thread", crowdSizes[i], crowdCharactersPerMs[i], crowdCharactersPerMs[i] / (crowdThreads + 1));
+        }
+        ImGui::Text("1000 characters on one thread: %.1f characters/ms", crowdSingleThreadPerMs);
+        ImGui::Text("1000 blending 2 clips: %.1f characters/ms", crowdBlendPerMs);
+        ImGui::Text("One character on one thread: %.4f ms playing, %.4f ms blending (%.2fx)", crowdPlayMsPerCharacter, crowdBlendMsPerCharacter,
+                    crowdPlayMsPerCharacter > 0.0f ? crowdBlendMsPerCharacter / crowdPlayMsPerCharacter : 0.0f);
+        ImGui::Text("1000 holding their pose: %.1f characters/ms", crowdHeldPerMs);
+    }
+
     //slider for sample radius
     if (ImGui::SliderFloat("Sample ao", &aoSlider, 0.0f, 1.0f)){
         ao = aoSlider;
@@ -343,14 +536,14 @@ void Game::Render()
             }
             modelLoader.drawModel(PBR, *myCamera);
 
-            //animation NEED TO PUT THOSE IN A FUNCTION INSIDE THE MODEL CLASS
-            animationShader.Use();
-            auto transforms = animator.GetFinalBoneMatrices();
-	    	//for loop transforms
-	    	for (unsigned int i = 0; i < transforms.size(); i++){
-	    		animationShader.SetMatrix4(("finalBonesMatrices[" + std::to_string(i) + "]").c_str(), transforms[i]);
-	    	}
-            model_animation.Draw(animationShader, *myCamera);
+            //animated characters, every palette uploaded at once then drawn instanced a batch at a time
+            if (animationShader.Linked) {
+                animationShader.Use();
+                bonePalette.upload(animationSystem.getPalette(), animationSystem.getTransforms(), animationSystem.getCharacterCount());
+                for (size_t batch = 0; batch < bonePalette.getBatchCount(); ++batch) {
+                    model_animation.Draw(animationShader, *myCamera, bonePalette.bindBatch(batch));
+                }
+            }
 
         }
         else
@@ -545,7 +738,7 @@ void Game::ProcessInput(float dt)
         //spacebar to jump
         if (this->Keys[GLFW_KEY_SPACE])
         {
-            player->jump(window, dt, terrain, vertices_terrain, collision);
+            player->jump(window, dt, terrain, terrain->getVertices(), collision);
         }
         
         //player->jump(window, dt, terrain, vertices_terrain);
@@ -577,7 +770,7 @@ void Game::ProcessInput(float dt)
         //key c to make all primitives static
         if (this->Keys[GLFW_KEY_C]){
             for (int i = 0; i < primitives.size(); i++) {
-                primitives[i]->isStatic = true;
+                primitives[i]->setStatic(true);
             }
             std::cout << "All primitives are static" << std::endl;
         }
@@ -585,9 +778,9 @@ void Game::ProcessInput(float dt)
         if (this->Keys[GLFW_KEY_X]){
             for (int i = 0; i < primitives.size(); i++) {
                 if (primitives[i]->getInfo() != "Plane") {
-                    primitives[i]->isStatic = false;
+                    primitives[i]->setStatic(false);
                 } else {
-                    primitives[i]->isStatic = true;
+                    primitives[i]->setStatic(true);
                 }
             }
             std::cout << "All primitives are dynamic" << std::endl;
@@ -630,6 +823,12 @@ void Game::ProcessInput(float dt)
         if (this->Keys[GLFW_KEY_9]){
             shadowsActive = true;
         }
+        //b to edit the terrain with the brush of the Terrain panel
+        if (this->Keys[GLFW_KEY_B]){
+            ApplyTerrainBrush(dt);
+        } else {
+            brushStroke = false;
+        }
 
     }
     if (this->State == GAME_WIN)
@@ -691,8 +890,793 @@ void Game::SetCameraWindowSize(unsigned int width, unsigned int height) {
     antialiasing->Update(width, height);
 }
 
+// Rays from the camera spread evenly over the sphere, cast one by one then as a batch
+void Game::RunRayBenchmark()
+{
+    const size_t rayCount = 100000;
+    std::vector<QueryRay> rays(rayCount);
+    for (size_t i = 0; i < rayCount; ++i) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / rayCount;
+        float radius = std::sqrt(1.0f - y * y);
+        float angle = 2.39996323f * i;  // golden angle
+        rays[i].origin = myCamera->Position;
+        rays[i].direction = glm::vec3(radius * std::cos(angle), y, radius * std::sin(angle));
+        rays[i].maxDistance = 500.0f;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    QueryHit hit;
+    for (size_t i = 0; i < rayCount; ++i) {
+        collision.raycast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit);
+    }
+    auto singleEnd = std::chrono::high_resolution_clock::now();
+    std::vector<QueryHit> hits;
+    collision.raycastBatch(rays, hits);
+    auto batchEnd = std::chrono::high_resolution_clock::now();
+
+    raysPerSecondSingle = rayCount / std::chrono::duration<float>(singleEnd - start).count();
+    raysPerSecondBatch = rayCount / std::chrono::duration<float>(batchEnd - singleEnd).count();
+}
+
+// Lattice value in [0, 1] for the procedural benchmark heightmap
+static float latticeNoise(int x, int z)
+{
+    uint32_t h = static_cast<uint32_t>(x) * 374761393u + static_cast<uint32_t>(z) * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return (h ^ (h >> 16)) / 4294967295.0f;
+}
+
+// Fractal value noise, sampled on demand so the 16k map is never stored
+static float benchmarkHeight(int row, int column)
+{
+    float height = 0.0f;
+    float amplitude = 256.0f;
+    int period = 2048;
+    for (int octave = 0; octave < 6; ++octave) {
+        int x = row / period;
+        int z = column / period;
+        float fx = static_cast<float>(row % period) / period;
+        float fz = static_cast<float>(column % period) / period;
+        float h0 = latticeNoise(x, z) + (latticeNoise(x + 1, z) - latticeNoise(x, z)) * fx;
+        float h1 = latticeNoise(x, z + 1) + (latticeNoise(x + 1, z + 1) - latticeNoise(x, z + 1)) * fx;
+        height += (h0 + (h1 - h0) * fz) * amplitude;
+        amplitude *= 0.5f;
+        period /= 4;
+    }
+    return height;
+}
+
+// Physics only primitive for the collision benchmarks, never drawn
+class BenchmarkBody : public Primitives {
+public:
+    BenchmarkBody(glm::vec3 pos, glm::vec3 vel) : Primitives(pos, glm::vec3(0.5f), glm::vec4(1.0f), false, true, 1.0f, vel) {}
+    void setup() override {}
+    void draw(Shader& shader, Camera& camera) override {}
+    void drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap) override {}
+    void drawTest(Shader& shader, Camera& camera) override {}
+    std::string getInfo() const override { return "Benchmark body"; }
+};
+
+// Boxes drifting without gravity in a volume growing with their count, so every
+// size has the same density. The first frame sorts the bodies from scratch,
+// the next ones only fix last frame's order
+void Game::RunBroadPhaseBenchmark()
+{
+    const int frameCount = 60;
+    for (int s = 0; s < 4; ++s) {
+        size_t count = broadPhaseSizes[s];
+        float side = 4.0f * std::cbrt(static_cast<float>(count));
+        std::vector<std::unique_ptr<BenchmarkBody>> bodies;
+        std::vector<Primitives*> scene;
+        for (size_t i = 0; i < count; ++i) {
+            int id = static_cast<int>(i);
+            glm::vec3 position(latticeNoise(id, 0), latticeNoise(id, 1), latticeNoise(id, 2));
+            glm::vec3 velocity(latticeNoise(id, 3), latticeNoise(id, 4), latticeNoise(id, 5));
+            bodies.push_back(std::unique_ptr<BenchmarkBody>(new BenchmarkBody(position * side, velocity * 4.0f - 2.0f)));
+            scene.push_back(bodies.back().get());
+        }
+
+        Collision world(glm::vec3(0.0f), deltaTime);
+        world.timeToSleep = std::numeric_limits<float>::max();
+
+        float totalMs = 0.0f;
+        float sweepMs = 0.0f;
+        float narrowMs = 0.0f;
+        for (int frame = 0; frame < frameCount; ++frame) {
+            auto start = std::chrono::high_resolution_clock::now();
+            world.update(scene);
+            auto end = std::chrono::high_resolution_clock::now();
+            float frameMs = std::chrono::duration<float, std::milli>(end - start).count();
+            if (frame == 0) {
+                broadPhaseFirstMs[s] = frameMs;
+            } else {
+                totalMs += frameMs;
+                sweepMs += world.getStats().broadPhaseMs;
+                narrowMs += world.getStats().narrowPhaseMs;
+            }
+        }
+        broadPhaseFrameMs[s] = totalMs / (frameCount - 1);
+        broadPhaseSweepMs[s] = sweepMs / (frameCount - 1);
+        broadPhaseNarrowMs[s] = narrowMs / (frameCount - 1);
+        broadPhasePairTests[s] = world.getStats().pairTests;
+        broadPhaseCandidates[s] = world.getStats().candidatePairs;
+    }
+}
+
+// Columns of cubes dropped on a plane, jittered so neighbouring columns lean
+// on each other and the islands come in many sizes. The same scene is run
+// with 0 to every worker of the shared pool solving the islands, timing the
+// solve (the narrow phase) of each tick, and the final positions of every
+// run must match the calling thread's alone bit for bit
+void Game::RunSolverScalingBenchmark()
+{
+    const int columns = 24;
+    const int layers = 8;
+    const int tickCount = 180;
+    const float spacing = 1.1f;
+    unsigned int maxThreads = WorkerPool::shared().getThreadCount();
+    solverScalingCubes = static_cast<size_t>(columns) * columns * layers;
+    solverScalingMs.assign(maxThreads + 1, 0.0f);
+    solverScalingSpeedup.assign(maxThreads + 1, 0.0f);
+    solverScalingDeterministic = true;
+
+    Plane ground;
+    ground.setCollisionEnabled(true);
+    ground.setStatic(true);
+    ground.setScale(glm::vec3(columns * spacing, 1.0f, columns * spacing));
+    ground.setPosition(glm::vec3(0.0f));
+
+    std::vector<glm::vec3> reference;
+    for (unsigned int threads = 0; threads <= maxThreads; ++threads) {
+        std::vector<std::unique_ptr<BenchmarkBody>> cubes;
+        std::vector<Primitives*> scene;
+        scene.push_back(&ground);
+        for (int i = 0; i < static_cast<int>(solverScalingCubes); ++i) {
+            int column = i % (columns * columns);
+            int layer = i / (columns * columns);
+            glm::vec3 jitter(latticeNoise(i, 6) - 0.5f, latticeNoise(i, 7), latticeNoise(i, 8) - 0.5f);
+            glm::vec3 position((column % columns - columns / 2) * spacing + jitter.x * 0.3f,
+                               2.0f + layer * 1.2f + jitter.y * 0.2f,
+                               (column / columns - columns / 2) * spacing + jitter.z * 0.3f);
+            cubes.push_back(std::unique_ptr<BenchmarkBody>(new BenchmarkBody(position, glm::vec3(0.0f))));
+            scene.push_back(cubes.back().get());
+        }
+
+        Collision world(gravity, deltaTime);
+        world.timeToSleep = std::numeric_limits<float>::max();  // keep every island in the solve
+        world.setSolverThreads(threads);
+
+        float solveMs = 0.0f;
+        for (int tick = 0; tick < tickCount; ++tick) {
+            world.update(scene);
+            solveMs += world.getStats().narrowPhaseMs;
+        }
+        solverScalingMs[threads] = solveMs / tickCount;
+        solverScalingSpeedup[threads] = solverScalingMs[threads] > 0.0f ? solverScalingMs[0] / solverScalingMs[threads] : 0.0f;
+
+        std::vector<glm::vec3> positions(scene.size());
+        for (size_t i = 0; i < scene.size(); ++i) {
+            positions[i] = scene[i]->getPosition();
+        }
+        if (threads == 0) {
+            reference = positions;
+        } else if (std::memcmp(positions.data(), reference.data(), positions.size() * sizeof(glm::vec3)) != 0) {
+            solverScalingDeterministic = false;
+        }
+    }
+    assert(solverScalingDeterministic && "the island solve depends on the thread count");
+}
+
+// Bodies dropped on the mesh of the world for frameCount ticks: mesh queries
+// per ms of the mesh pass and the triangles they were pushed out of
+static void dropOnMesh(Collision& world, std::vector<Primitives*>& scene, int frameCount, float& queriesPerMs, size_t& contacts)
+{
+    size_t queries = 0;
+    float meshMs = 0.0f;
+    contacts = 0;
+    for (int frame = 0; frame < frameCount; ++frame) {
+        world.update(scene);
+        queries += world.getStats().meshQueries;
+        contacts += world.getStats().meshContacts;
+        meshMs += world.getStats().meshMs;
+    }
+    queriesPerMs = meshMs > 0.0f ? queries / meshMs : 0.0f;
+}
+
+// The cooked lemon and michel collision meshes, scaled to meshSize and standing
+// on a ground box. Three loads on the triangle BVH for a fixed number of frames:
+// player sized boxes dropped on it (the box corners against the triangles),
+// swept boxes (the box covering a fast move across it, as a long move enters
+// the broad phase) and small copies of the model carrying its 26-DOP hull
+void Game::RunMeshCollisionBenchmark()
+{
+    const int bodyCount = 256;
+    const int frameCount = 120;
+    const float meshSize = 8.0f;
+    const float hullSize = 1.0f;
+    const glm::vec3 playerHalfExtents(0.5f, 1.0f, 0.5f);  // the player's hitbox
+
+    CollisionMesh meshes[2];
+    bool loaded[2] = { modelLoader.getCollisionMesh(meshes[0]), model_animation.GetCollisionMesh(meshes[1]) };
+    for (int m = 0; m < 2; ++m) {
+        meshBenchTriangles[m] = 0;
+        meshBoxQueriesPerMs[m] = meshSweptQueriesPerMs[m] = meshHullQueriesPerMs[m] = 0.0f;
+        meshBoxContacts[m] = meshSweptContacts[m] = meshHullContacts[m] = 0;
+        if (!loaded[m]) continue;
+        const CollisionMesh& mesh = meshes[m];
+        meshBenchTriangles[m] = mesh.getTriangleCount();
+
+        // Largest side to meshSize, centered on X and Z, standing on y = 0
+        glm::vec3 extent = mesh.boundsMax - mesh.boundsMin;
+        float largest = std::max(extent.x, std::max(extent.y, extent.z));
+        if (largest <= 0.0f) continue;
+        glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+        float fit = meshSize / largest;
+        glm::mat4 placement = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, extent.y * fit * 0.5f, 0.0f)), glm::vec3(fit));
+        placement = glm::translate(placement, -center);
+        glm::vec3 footprint = extent * fit * 0.5f;
+
+        BenchmarkBody ground(glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.0f));
+        ground.setStatic(true);
+        ground.setScale(glm::vec3(meshSize * 2.0f, 0.5f, meshSize * 2.0f));
+
+        // Spread over the footprint, layered above the top of the mesh
+        std::vector<glm::vec3> spawn(bodyCount);
+        for (int i = 0; i < bodyCount; ++i) {
+            spawn[i] = glm::vec3((latticeNoise(i, 9) * 2.0f - 1.0f) * footprint.x,
+                                 extent.y * fit + 1.5f + 2.5f * (i / 64) + latticeNoise(i, 10),
+                                 (latticeNoise(i, 11) * 2.0f - 1.0f) * footprint.z);
+        }
+
+        // Player boxes
+        {
+            std::vector<std::unique_ptr<BenchmarkBody>> boxes;
+            std::vector<Primitives*> scene;
+            scene.push_back(&ground);
+            for (int i = 0; i < bodyCount; ++i) {
+                boxes.push_back(std::unique_ptr<BenchmarkBody>(new BenchmarkBody(spawn[i], glm::vec3(0.0f))));
+                boxes.back()->setScale(playerHalfExtents);
+                scene.push_back(boxes.back().get());
+            }
+            Collision world(gravity, deltaTime);
+            world.timeToSleep = std::numeric_limits<float>::max();  // every box queries every frame
+            world.addStaticMesh(mesh, placement);
+            dropOnMesh(world, scene, frameCount, meshBoxQueriesPerMs[m], meshBoxContacts[m]);
+        }
+
+        // Swept boxes, flying straight across the mesh at 40 m/s in every direction
+        {
+            std::vector<Primitives*> scene(1, &ground);
+            Collision world(gravity, deltaTime);
+            world.addStaticMesh(mesh, placement);
+            world.buildQueryTree(scene);
+
+            std::vector<QueryHit> overlaps;
+            size_t queries = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int frame = 0; frame < frameCount; ++frame) {
+                for (int i = 0; i < bodyCount; ++i) {
+                    float angle = latticeNoise(i, 12) * 6.2831853f;
+                    glm::vec3 direction(std::cos(angle), 0.0f, std::sin(angle));
+                    float height = latticeNoise(i, 13) * extent.y * fit;
+                    float along = (static_cast<float>(frame) / frameCount * 2.0f - 1.0f) * meshSize;
+                    glm::vec3 from = glm::vec3(0.0f, height, 0.0f) + direction * along;
+                    glm::vec3 to = from + direction * (40.0f * deltaTime);
+                    overlaps.clear();
+                    world.overlapBox(glm::min(from, to) - playerHalfExtents, glm::max(from, to) + playerHalfExtents, overlaps);
+                    for (size_t k = 0; k < overlaps.size(); ++k) {
+                        if (overlaps[k].mesh >= 0) meshSweptContacts[m]++;
+                    }
+                    queries++;
+                }
+            }
+            float sweptMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            meshSweptQueriesPerMs[m] = sweptMs > 0.0f ? queries / sweptMs : 0.0f;
+        }
+
+        // Copies of the model hullSize across, resting on their 26-DOP hull points
+        {
+            float hullFit = hullSize / largest;
+            glm::mat4 hullTransform = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(hullFit)), -center);
+            std::vector<std::unique_ptr<BenchmarkBody>> copies;
+            std::vector<Primitives*> scene;
+            scene.push_back(&ground);
+            for (int i = 0; i < bodyCount; ++i) {
+                copies.push_back(std::unique_ptr<BenchmarkBody>(new BenchmarkBody(spawn[i], glm::vec3(0.0f))));
+                copies.back()->setScale(extent * hullFit * 0.5f);
+                copies.back()->setCollisionHull(&mesh.hull, hullTransform);
+                scene.push_back(copies.back().get());
+            }
+            Collision world(gravity, deltaTime);
+            world.timeToSleep = std::numeric_limits<float>::max();
+            world.addStaticMesh(mesh, placement);
+            dropOnMesh(world, scene, frameCount, meshHullQueriesPerMs[m], meshHullContacts[m]);
+        }
+    }
+}
+
+void Game::RunTerrainBenchmark()
+{
+    const int mapSize = 16384;
+    const int frameCount = 600;
+    TerrainLod lod(mapSize, mapSize, benchmarkHeight);
+    terrainBenchFullTriangles = lod.getFullTriangleCount();
+
+    // Diagonal flight from corner to corner, looking ahead and slightly down
+    glm::vec3 from(-0.45f * mapSize, 600.0f, -0.45f * mapSize);
+    glm::vec3 to(0.45f * mapSize, 600.0f, 0.45f * mapSize);
+    glm::vec3 forward = glm::normalize(to - from);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(Width) / Height, 0.1f, 10000.0f);
+
+    terrainShader.Use();
+    terrainShader.SetMatrix4("model", glm::mat4(1.0f));
+    terrainShader.SetMatrix4("projection", projection);
+
+    size_t triangles = 0;
+    size_t chunks = 0;
+    float totalMs = 0.0f;
+    terrainBenchMaxFrameMs = 0.0f;
+    for (int frame = 0; frame < frameCount; ++frame) {
+        glm::vec3 position = from + (to - from) * (frame / static_cast<float>(frameCount - 1));
+        glm::mat4 view = glm::lookAt(position, position + forward + glm::vec3(0.0f, -0.3f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        auto start = std::chrono::high_resolution_clock::now();
+        terrainShader.SetMatrix4("view", view);
+        lod.update(position, projection * view);
+        lod.draw();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        float frameMs = std::chrono::duration<float, std::milli>(end - start).count();
+        totalMs += frameMs;
+        terrainBenchMaxFrameMs = std::max(terrainBenchMaxFrameMs, frameMs);
+        triangles += lod.getStats().trianglesSubmitted;
+        chunks += lod.getStats().chunksUploaded;
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    terrainBenchTriangles = static_cast<float>(triangles) / frameCount;
+    terrainBenchFrameMs = totalMs / frameCount;
+    terrainBenchChunks = chunks;
+}
+
+// Brush under the point the camera looks at. Raise and lower go at strength
+// per second, smooth and flatten blend by strength * dt. Flatten keeps the
+// height where the stroke started
+void Game::ApplyTerrainBrush(float dt)
+{
+    QueryHit hit;
+    if (!collision.raycast(myCamera->Position, myCamera->Front, 1000.0f, hit) || !hit.terrain) return;
+    if (!brushStroke) {
+        brushFlattenHeight = hit.point.y;
+        brushStroke = true;
+    }
+    Terrain::BrushMode mode = static_cast<Terrain::BrushMode>(brushMode);
+    float strength = brushStrength * dt;
+    Terrain::Region region = terrain->applyBrush(mode, hit.point.x, hit.point.z, brushRadius, strength, brushFlattenHeight);
+    collision.refitTerrain(region.rowBegin, region.rowEnd, region.columnBegin, region.columnEnd);
+}
+
+// The terrain and primitive PBR sets loaded both ways. A synchronous load
+// holds the GL thread for all of it, the loader only to issue the loads
+// (Finish() waits here so the totals compare, a frame would go on drawing).
+// The last run maps the cooked files instead of decoding the images, the
+// ao, rough and met images of a set as their one ARM texture
+void Game::RunTextureBenchmark()
+{
+    const char* files[] = {
+        "texture/terrain/diff.jpg", "texture/terrain/norm.jpg", "texture/terrain/met.jpg",
+        "texture/terrain/rough.jpg", "texture/terrain/ao.jpg",
+        "texture/PBR_textures_2/diff.jpg", "texture/PBR_textures_2/norm.jpg", "texture/PBR_textures_2/met.jpg",
+        "texture/PBR_textures_2/rough.jpg", "texture/PBR_textures_2/ao.jpg", "texture/PBR_textures_2/disp.jpg",
+    };
+    const size_t count = sizeof(files) / sizeof(files[0]);
+    const char* cookedFiles[] = {
+        "texture/terrain/diff.jpg", "texture/terrain/norm.jpg",
+        "texture/PBR_textures_2/diff.jpg", "texture/PBR_textures_2/norm.jpg", "texture/PBR_textures_2/disp.jpg",
+    };
+    const char* armSets[] = { "texture/terrain/", "texture/PBR_textures_2/" };
+    std::vector<unsigned int> loaded;
+
+    // Nothing of the scene left in flight
+    TextureLoader::Finish();
+    glFinish();
+    bool useCooked = TextureLoader::UseCooked;
+    TextureLoader::UseCooked = false;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        loaded.push_back(TextureLoader::LoadSync(files[i]));
+    }
+    glFinish();
+    textureSyncMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        loaded.push_back(TextureLoader::Load(files[i]));
+    }
+    textureAsyncIssueMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    TextureLoader::Finish();
+    glFinish();
+    textureAsyncMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    textureDecodedBytes = 0;
+    for (size_t i = count; i < loaded.size(); ++i) {
+        textureDecodedBytes += TextureLoader::GetTextureBytes(loaded[i]);
+    }
+
+    TextureLoader::UseCooked = true;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < sizeof(cookedFiles) / sizeof(cookedFiles[0]); ++i) {
+        loaded.push_back(TextureLoader::Load(cookedFiles[i]));
+    }
+    for (size_t i = 0; i < sizeof(armSets) / sizeof(armSets[0]); ++i) {
+        std::string directory = armSets[i];
+        loaded.push_back(TextureLoader::LoadPacked(directory + "arm",
+            { directory + "ao.jpg", directory + "rough.jpg", directory + "met.jpg" }));
+    }
+    TextureLoader::Finish();
+    glFinish();
+    textureCookedMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    TextureLoader::UseCooked = useCooked;
+    textureCookedCount = 0;
+    textureCookedBytes = 0;
+    for (size_t i = 2 * count; i < loaded.size(); ++i) {
+        textureCookedCount += TextureLoader::IsCooked(loaded[i]) ? 1 : 0;
+        textureCookedBytes += TextureLoader::GetTextureBytes(loaded[i]);
+    }
+
+    // Failed synchronous loads are 0, deleting them does nothing
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        TextureLoader::Delete(loaded[i]);
+    }
+}
+
+// The models of the scene loaded from their sources the way it was done
+// before the cook step (the FBX imported by the model, then again by the
+// animation) against mapping their cooked files. CPU side only, both end up
+// in the same buffers
+void Game::RunModelLoadBenchmark()
+{
+    const char* files[] = { "models/michel.fbx", "models/michel.fbx", "models/lemon_1k.gltf" };
+    const size_t count = sizeof(files) / sizeof(files[0]);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        ModelData data;
+        ModelCooker::Import(files[i], data);
+    }
+    modelSourceMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Model and animation map the same file
+    modelCookedCount = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        CookedModel model;
+        modelCookedCount += model.map(files[i]) ? 1 : 0;
+    }
+    modelCookedMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Run from main's --benchmark after Init, like the animation ones
+void Game::PrintPhysicsBenchmarks()
+{
+    RunSolverScalingBenchmark();
+    for (size_t i = 0; i < solverScalingMs.size(); ++i) {
+        std::cout << "Solver, " << solverScalingCubes << " cubes on " << i << " workers: " << solverScalingMs[i]
+                  << " ms/tick, " << solverScalingSpeedup[i] << "x" << std::endl;
+    }
+    std::cout << "Solver final positions: " << (solverScalingDeterministic ? "identical" : "DIFFERENT")
+              << " for every thread count" << std::endl;
+    RunMeshCollisionBenchmark();
+    for (int m = 0; m < 2; ++m) {
+        std::cout << "Mesh " << meshBenchNames[m] << " (" << meshBenchTriangles[m] << " triangles): player boxes "
+                  << meshBoxQueriesPerMs[m] << " queries/ms, " << meshBoxContacts[m] << " contacts; swept boxes "
+                  << meshSweptQueriesPerMs[m] << " queries/ms, " << meshSweptContacts[m] << " contacts; hulls "
+                  << meshHullQueriesPerMs[m] << " queries/ms, " << meshHullContacts[m] << " contacts" << std::endl;
+    }
+}
+
+// Run from main's --benchmark after Init, so the numbers can be taken
+// without opening the UI
+void Game::PrintAnimationBenchmarks()
+{
+    RunAnimationBenchmark();
+    std::cout << "Rig: " << animationNodeCount << " nodes, " << animationChannelCount << " animated" << std::endl;
+    std::cout << "Skeleton: " << animationCharactersPerMs << " characters/ms" << std::endl;
+    RunKeyframeBenchmark();
+    std::cout << "Keyframes: scan " << keyframeLinearMs << " ms, cursor " << keyframeCursorMs << " ms, seeks "
+              << keyframeSeekMs << " ms, resampled " << keyframeUniformMs << " ms" << std::endl;
+    RunCrowdBenchmark();
+    for (int i = 0; i < 4; ++i) {
+        std::cout << "Crowd of " << crowdSizes[i] << ": " << crowdCharactersPerMs[i] << " characters/ms on "
+                  << crowdThreads + 1 << " threads" << std::endl;
+    }
+    std::cout << "Crowd of 1000 on one thread: " << crowdSingleThreadPerMs << " characters/ms" << std::endl;
+    std::cout << "Crowd of 1000 blending: " << crowdBlendPerMs << " characters/ms, holding: " << crowdHeldPerMs << " characters/ms" << std::endl;
+    std::cout << "One character on one thread: " << crowdPlayMsPerCharacter << " ms playing one clip, "
+              << crowdBlendMsPerCharacter << " ms blending two" << std::endl;
+}
+
+// Updates of the scene rig, each one a full evaluation of the skeleton at a
+// different time like as many characters out of step would cost
+void Game::RunAnimationBenchmark()
+{
+    const int updates = 1000;
+    Animator benchmarkAnimator(&animation);
+    animationNodeCount = animation.GetSkeleton().size();
+    animationChannelCount = animation.GetBones().size();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < updates; ++i) {
+        benchmarkAnimator.UpdateAnimation(0.0137f);
+    }
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    animationCharactersPerMs = ms > 0.0f ? updates / ms : 0.0f;
+}
+
+// Crowds of the scene rig, the characters out of step so they don't all
+// sample the same keys. Every worker plus the main thread, then the largest
+// crowd again on the main thread alone for the scaling. Last the largest
+// crowd blending the clip with itself half a loop apart, standing for a
+// cross-fade, and holding still so the pose cache skips them. The cost of a
+// character playing and blending is taken on the main thread alone, so it
+// is the time of one update rather than a throughput
+void Game::RunCrowdBenchmark()
+{
+    enum Playback { PLAY, BLEND, HOLD };
+    const int updates = 100;
+    AnimationSystem crowd;
+    crowdThreads = crowd.getThreadCount();
+    float duration = animation.GetDuration();
+
+    auto runCrowd = [&](size_t characters, Playback playback) {
+        crowd.clear();
+        for (size_t i = 0; i < characters; ++i) {
+            crowd.addCharacter(&animation, duration * i / characters);
+            Animator& animator = crowd.getAnimator(i);
+            if (playback == BLEND) {
+                size_t layer = animator.AddLayer(&animation, 0.5f);
+                animator.SetLayerTime(layer, std::fmod(duration * i / characters + duration * 0.5f, duration));
+            } else if (playback == HOLD) {
+                animator.SetSpeed(0.0f);
+            }
+        }
+        crowd.update(0.0f);  // first touch of the palette and the per character buffers
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < updates; ++i) {
+            crowd.update(0.0137f);
+        }
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return ms > 0.0f ? characters * updates / ms : 0.0f;
+    };
+
+    for (int i = 0; i < 4; ++i) {
+        crowdCharactersPerMs[i] = runCrowd(crowdSizes[i], PLAY);
+    }
+    crowdBlendPerMs = runCrowd(crowdSizes[3], BLEND);
+    crowdHeldPerMs = runCrowd(crowdSizes[3], HOLD);
+    crowd.setThreadCount(0);
+    crowdSingleThreadPerMs = runCrowd(crowdSizes[3], PLAY);
+    float singleThreadBlendPerMs = runCrowd(crowdSizes[3], BLEND);
+    crowdPlayMsPerCharacter = crowdSingleThreadPerMs > 0.0f ? 1.0f / crowdSingleThreadPerMs : 0.0f;
+    crowdBlendMsPerCharacter = singleThreadBlendPerMs > 0.0f ? 1.0f / singleThreadBlendPerMs : 0.0f;
+}
+
+// Key lookup the bones did before the cursors, from the first key every time
+static int linearKeyIndex(const std::vector<float>& times, float animationTime)
+{
+    for (int index = 0; index < static_cast<int>(times.size()) - 1; ++index) {
+        if (animationTime < times[index + 1])
+            return index;
+    }
+    return static_cast<int>(times.size()) - 2;
+}
+
+// Lookups of a 10k key clip with unevenly spaced keys, played three times
+// through about a key per frame, then at random times, then resampled to
+// one key per tick. Only the lookups, the interpolation is the same for all
+void Game::RunKeyframeBenchmark()
+{
+    const int keyCount = 10000;
+    const int frames = 3 * keyCount;
+    KeyTrack<glm::vec3> positions;
+    for (int i = 0; i < keyCount; ++i) {
+        positions.times.push_back(i + 0.4f * (latticeNoise(i, 0) - 0.5f));
+        positions.values.push_back(glm::vec3(static_cast<float>(i), 0.0f, 0.0f));
+    }
+    float duration = positions.times.back();
+    KeyTrack<glm::quat> rotations;
+    rotations.times.push_back(0.0f);
+    rotations.values.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    KeyTrack<glm::vec3> scales;
+    scales.times.push_back(0.0f);
+    scales.values.push_back(glm::vec3(1.0f));
+    Bone bone("benchmark", 0, positions, rotations, scales);
+    const std::vector<float>& times = bone.GetPositions().times;
+
+    std::vector<float> playback(frames);
+    std::vector<float> seeks(frames);
+    for (int i = 0; i < frames; ++i) {
+        playback[i] = std::fmod(i * 1.0137f, duration);
+        seeks[i] = latticeNoise(i, 1) * duration;
+    }
+
+    // summed so the lookups aren't optimized away
+    long long indexSum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        indexSum += linearKeyIndex(times, playback[i]);
+    }
+    keyframeLinearMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    int cursor = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        indexSum -= bone.GetPositions().Find(playback[i], cursor);
+    }
+    keyframeCursorMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        indexSum += bone.GetPositions().Find(seeks[i], cursor);
+    }
+    keyframeSeekMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    bone.Resample(1.0f);
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        indexSum += bone.GetPositions().Find(playback[i], cursor);
+    }
+    keyframeUniformMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    volatile long long sink = indexSum;
+    (void)sink;
+}
+
+void Game::RunTerrainGenerationBenchmark()
+{
+    const int sizes[3] = { 1024, 4096, 8192 };
+    WorkerPool& pool = WorkerPool::shared();
+    terrainGenerationThreads = pool.getThreadCount();
+    for (int s = 0; s < 3; ++s) {
+        int size = sizes[s];
+        size_t count = static_cast<size_t>(size) * size;
+        std::vector<float> heights(count);
+        pool.parallelFor(size, [&](size_t row) {
+            for (int column = 0; column < size; ++column) {
+                heights[row * size + column] = benchmarkHeight(static_cast<int>(row), column);
+            }
+        });
+
+        // Allocating the arrays counts as part of the generation
+        auto start = std::chrono::high_resolution_clock::now();
+        std::unique_ptr<glm::vec3[]> positions(new glm::vec3[count]);
+        std::unique_ptr<glm::vec2[]> uvs(new glm::vec2[count]);
+        std::unique_ptr<glm::vec3[]> normals(new glm::vec3[count]);
+        std::unique_ptr<glm::vec3[]> tangents(new glm::vec3[count]);
+        Terrain::generateVertices(heights.data(), size, size, pool, positions.get(), uvs.get(), normals.get(), tangents.get());
+        auto end = std::chrono::high_resolution_clock::now();
+        terrainGenerationMs[s] = std::chrono::duration<float, std::milli>(end - start).count();
+    }
+}
+
+// Height under (x, z) as the terrain collision found it before the heightfield
+// lookup: inverse distance weighted heights of every vertex within the radius,
+// blended with the closest one
+static float scanTerrainHeight(const std::vector<glm::vec3>& vertices, float x, float z, float radius)
+{
+    float weightedHeightSum = 0.0f;
+    float weightSum = 0.0f;
+    float closestDistanceSquared = std::numeric_limits<float>::max();
+    float closestHeight = 0.0f;
+    for (const glm::vec3& vertex : vertices) {
+        float distanceX = x - vertex.x;
+        float distanceZ = z - vertex.z;
+        float distanceSquared = distanceX * distanceX + distanceZ * distanceZ;
+        if (distanceSquared <= radius * radius) {
+            float weight = 1.0f / (distanceSquared + 0.001f);
+            weightedHeightSum += vertex.y * weight;
+            weightSum += weight;
+            if (distanceSquared < closestDistanceSquared) {
+                closestDistanceSquared = distanceSquared;
+                closestHeight = vertex.y;
+            }
+        }
+    }
+    if (weightSum == 0.0f) return 0.0f;
+    return 0.7f * (weightedHeightSum / weightSum) + 0.3f * closestHeight;
+}
+
+// Heights under the same random points of each map, the scan is slow enough
+// at 8192 that it only gets a few of them
+void Game::RunHeightQueryBenchmark()
+{
+    const int sizes[3] = { 512, 2048, 8192 };
+    const int scanQueries = 16;
+    const int lookupQueries = 1000000;
+    WorkerPool& pool = WorkerPool::shared();
+    for (int s = 0; s < 3; ++s) {
+        int size = sizes[s];
+        size_t count = static_cast<size_t>(size) * size;
+        std::vector<float> heights(count);
+        std::vector<glm::vec3> vertices(count);
+        pool.parallelFor(size, [&](size_t row) {
+            for (int column = 0; column < size; ++column) {
+                size_t index = row * size + column;
+                heights[index] = benchmarkHeight(static_cast<int>(row), column);
+                vertices[index] = glm::vec3(row - size / 2.0f, heights[index], column - size / 2.0f);
+            }
+        });
+
+        std::vector<glm::vec2> points(lookupQueries);
+        for (int i = 0; i < lookupQueries; ++i) {
+            points[i] = glm::vec2(latticeNoise(i, 0) - 0.5f, latticeNoise(i, 1) - 0.5f) * (size - 2.0f);
+        }
+
+        float sum = 0.0f;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < scanQueries; ++i) {
+            sum += scanTerrainHeight(vertices, points[i].x, points[i].y, 1.5f);
+        }
+        auto scanEnd = std::chrono::high_resolution_clock::now();
+        float height;
+        glm::vec3 normal;
+        for (int i = 0; i < lookupQueries; ++i) {
+            Terrain::sampleHeights(heights.data(), size, size, points[i].x, points[i].y, height, normal);
+            sum += height + normal.y;
+        }
+        auto lookupEnd = std::chrono::high_resolution_clock::now();
+        volatile float sink = sum;
+        (void)sink;
+
+        heightScanUs[s] = std::chrono::duration<float, std::micro>(scanEnd - start).count() / scanQueries;
+        heightLookupUs[s] = std::chrono::duration<float, std::micro>(lookupEnd - scanEnd).count() / lookupQueries;
+    }
+}
+
+void Game::RunBrushBenchmark()
+{
+    const int size = 8192;
+    const int edits = 64;
+    const float radius = 32.0f;  // 64x64 heights under the brush
+    std::unique_ptr<Terrain> map;
+    {
+        std::vector<float> heights(static_cast<size_t>(size) * size);
+        WorkerPool::shared().parallelFor(size, [&](size_t row) {
+            for (int column = 0; column < size; ++column) {
+                heights[row * size + column] = benchmarkHeight(static_cast<int>(row), column);
+            }
+        });
+        map.reset(new Terrain(size, size, heights));
+    }
+    Collision mapCollision;
+    mapCollision.terrain = map.get();
+    mapCollision.buildQueryTree(std::vector<Primitives*>());
+
+    // Same spots for every mode, away from the borders
+    float refitMs = 0.0f;
+    for (int mode = 0; mode < 4; ++mode) {
+        float editMs = 0.0f;
+        for (int i = 0; i < edits; ++i) {
+            float x = (latticeNoise(i, 2) - 0.5f) * (size - 4.0f * radius);
+            float z = (latticeNoise(i, 3) - 0.5f) * (size - 4.0f * radius);
+            Terrain::Region edited = map->applyBrush(static_cast<Terrain::BrushMode>(mode), x, z, radius, 1.0f, 0.0f);
+            editMs += map->getLastEditMs();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            mapCollision.refitTerrain(edited.rowBegin, edited.rowEnd, edited.columnBegin, edited.columnEnd);
+            refitMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+        brushEditMs[mode] = editMs / edits;
+    }
+    brushRefitMs = refitMs / (4 * edits);
+}
+
 void Game::cleanup()
 {
+    bonePalette.destroy();
+    ResourceManager::Clear();
+    TextureLoader::Clear();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
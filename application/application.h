@@ -15,6 +15,7 @@
 #include "../primitives/sphere.h"
 #include "../primitives/plane.h"
 #include "../world_objects/terrain.h"
+#include "../texture/textureLoader.h"
 #include "../collision/collision.h"
 #include "../lights/lights.h"
 #include "antialiasing.h"
@@ -23,6 +24,8 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "../models/assimp/animator.h"
+#include "../models/animationSystem.h"
+#include "../models/bonePalette.h"
 #include "../models/assimp/model_animation.h"
 #include "gbuffer.h"
 #include "ssaobuffer.h"
@@ -91,7 +94,6 @@ public:
     Plane* plane;
     Sphere* sphere;
     Terrain* terrain;
-    std::vector<glm::vec3> vertices_terrain;
 
     //cube light
     Sphere* sphere_light;
@@ -114,7 +116,8 @@ public:
 
     Model model_animation;
     Animation animation;
-    Animator animator;
+    AnimationSystem animationSystem;
+    BonePaletteBuffer bonePalette;
     Shader animationShader;
 
     glm::vec3 gravity = glm::vec3(0.0f, -9.8f, 0.0f); // Gravity force
@@ -146,6 +149,121 @@ public:
 
     float ao = 0.0f;
     float aoSlider = 0.0f;
+
+    //ray query benchmark, rays per second one by one and batched on the solver threads
+    float raysPerSecondSingle = 0.0f;
+    float raysPerSecondBatch = 0.0f;
+    void RunRayBenchmark();
+
+    //broad phase with 1k to 100k drifting boxes: first frame (full sort), then ms/frame and pair tests,
+    //with the broad (sweep) and narrow (island solve) phases of those frames apart
+    size_t broadPhaseSizes[4] = { 1000, 10000, 50000, 100000 };
+    float broadPhaseFirstMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float broadPhaseFrameMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float broadPhaseSweepMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float broadPhaseNarrowMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    size_t broadPhasePairTests[4] = { 0, 0, 0, 0 };
+    size_t broadPhaseCandidates[4] = { 0, 0, 0, 0 };
+    void RunBroadPhaseBenchmark();
+
+    //island solver scaling, a few thousand cubes falling on a plane solved with 0 to every worker
+    //of the shared pool: solve ms per tick and speedup over the calling thread alone, indexed by workers
+    size_t solverScalingCubes = 0;
+    std::vector<float> solverScalingMs;
+    std::vector<float> solverScalingSpeedup;
+    bool solverScalingDeterministic = true;  //same final positions, bit for bit, for every thread count
+    void RunSolverScalingBenchmark();
+
+    //player-vs-mesh queries on the cooked lemon and michel collision meshes: player sized boxes dropped on
+    //the triangle BVH, swept boxes queried against it and small copies carrying the 26-DOP hull, for a
+    //fixed number of frames. Queries/ms and contacts (mesh triangles touched), indexed by mesh
+    const char* meshBenchNames[2] = { "lemon", "michel" };
+    size_t meshBenchTriangles[2] = { 0, 0 };
+    float meshBoxQueriesPerMs[2] = { 0.0f, 0.0f };
+    size_t meshBoxContacts[2] = { 0, 0 };
+    float meshSweptQueriesPerMs[2] = { 0.0f, 0.0f };
+    size_t meshSweptContacts[2] = { 0, 0 };
+    float meshHullQueriesPerMs[2] = { 0.0f, 0.0f };
+    size_t meshHullContacts[2] = { 0, 0 };
+    void RunMeshCollisionBenchmark();
+    //the physics benchmarks above printed to the console, for main's --benchmark
+    void PrintPhysicsBenchmarks();
+
+    //terrain LOD benchmark, flying across a 16k x 16k heightmap
+    float terrainBenchTriangles = 0.0f;
+    size_t terrainBenchFullTriangles = 0;
+    float terrainBenchFrameMs = 0.0f;
+    float terrainBenchMaxFrameMs = 0.0f;
+    size_t terrainBenchChunks = 0;
+    void RunTerrainBenchmark();
+
+    //terrain mesh generation time for 1k, 4k and 8k heightmaps
+    float terrainGenerationMs[3] = { 0.0f, 0.0f, 0.0f };
+    unsigned int terrainGenerationThreads = 0;
+    void RunTerrainGenerationBenchmark();
+
+    //terrain height under a point on 512, 2048 and 8192 maps: scanning every vertex vs the heightfield lookup
+    float heightScanUs[3] = { 0.0f, 0.0f, 0.0f };
+    float heightLookupUs[3] = { 0.0f, 0.0f, 0.0f };
+    void RunHeightQueryBenchmark();
+
+    //64x64 brush edits on an 8k map: heights, vertices and normals per mode, then the collision refit
+    float brushEditMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float brushRefitMs = 0.0f;
+    void RunBrushBenchmark();
+
+    //terrain brush, applied where the camera looks while B is held
+    int brushMode = Terrain::BRUSH_RAISE;
+    float brushRadius = 8.0f;
+    float brushStrength = 4.0f;
+    bool brushStroke = false;
+    float brushFlattenHeight = 0.0f;
+    void ApplyTerrainBrush(float dt);
+
+    //texture startup, the PBR sets decoded on the GL thread vs on the loader workers
+    float textureSyncMs = 0.0f;
+    float textureAsyncMs = 0.0f;
+    float textureAsyncIssueMs = 0.0f;
+    //same set from the cooked files (tools/textureCooker), VRAM of both ways
+    float textureCookedMs = 0.0f;
+    size_t textureCookedCount = 0;
+    size_t textureDecodedBytes = 0;
+    size_t textureCookedBytes = 0;
+    void RunTextureBenchmark();
+
+    //model startup, importing the sources as the loaders did vs mapping the cooked files
+    float modelSourceMs = 0.0f;
+    float modelCookedMs = 0.0f;
+    size_t modelCookedCount = 0;
+    void RunModelLoadBenchmark();
+
+    //skeleton evaluation of the scene rig, characters updated per ms
+    float animationCharactersPerMs = 0.0f;
+    size_t animationNodeCount = 0;
+    size_t animationChannelCount = 0;
+    void RunAnimationBenchmark();
+
+    //key lookups over a 10k key clip: scan from the first key, cursor, seeks, resampled
+    float keyframeLinearMs = 0.0f;
+    float keyframeCursorMs = 0.0f;
+    float keyframeSeekMs = 0.0f;
+    float keyframeUniformMs = 0.0f;
+    void RunKeyframeBenchmark();
+
+    //crowd of 1 to 1000 characters on the scene rig, characters/ms with every worker and per thread
+    size_t crowdSizes[4] = { 1, 10, 100, 1000 };
+    float crowdCharactersPerMs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float crowdSingleThreadPerMs = 0.0f;
+    unsigned int crowdThreads = 0;
+    //1000 characters blending two clips, then holding their pose (skipped by the pose cache)
+    float crowdBlendPerMs = 0.0f;
+    float crowdHeldPerMs = 0.0f;
+    //ms one update of a character takes on one thread, playing one clip and blending two
+    float crowdPlayMsPerCharacter = 0.0f;
+    float crowdBlendMsPerCharacter = 0.0f;
+    void RunCrowdBenchmark();
+    //the animation benchmarks above printed to the console, for main's --benchmark
+    void PrintAnimationBenchmarks();
     //audio
 
     // constructor/destructor
@@ -0,0 +1,104 @@
+#include "bodyStore.h"
+#include "../primitives/primitives.h"
+#include <type_traits>
+
+BodyStore::~BodyStore() {
+    clear();
+}
+
+void BodyStore::sync(const std::vector<Primitives*>& primitives) {
+    if (owner == primitives) return;
+
+    // Everything in the list joins the end of this store, then the bodies
+    // that aren't in it anymore are given back
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        Primitives* primitive = primitives[i];
+        if (primitive->bodyStore == this) continue;
+        if (primitive->bodyStore) primitive->bodyStore->detach(primitive->body);
+        attach(primitive);
+    }
+    source.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        source[i] = primitives[i]->body;
+        owner[source[i]] = nullptr;  // kept
+    }
+    for (size_t body = 0; body < owner.size(); ++body) {
+        if (owner[body]) release(body);
+    }
+
+    // Gather the kept bodies in the order of the list, the list changes
+    // rarely enough to build new arrays
+    forEachArray([this](auto& array) {
+        typename std::remove_reference<decltype(array)>::type gathered(source.size());
+        for (size_t i = 0; i < source.size(); ++i) {
+            gathered[i] = array[source[i]];
+        }
+        array.swap(gathered);
+    });
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        owner[i] = primitives[i];
+        primitives[i]->body = i;
+    }
+}
+
+void BodyStore::attach(Primitives* primitive) {
+    primitive->bodyStore = this;
+    primitive->body = owner.size();
+
+    position.push_back(primitive->position);
+    previousPosition.push_back(primitive->previousPosition);
+    velocity.push_back(primitive->velocity);
+    halfExtents.push_back(primitive->scale);
+    mass.push_back(primitive->mass);
+    minX.push_back(0.0f); minY.push_back(0.0f); minZ.push_back(0.0f);
+    maxX.push_back(0.0f); maxY.push_back(0.0f); maxZ.push_back(0.0f);
+    isStatic.push_back(primitive->staticBody ? -1 : 0);
+    collisionEnabled.push_back(primitive->collidable ? -1 : 0);
+    isSleeping.push_back(0);
+    sleepTimer.push_back(0.0f);
+    sleepGroup.push_back(-1);
+    owner.push_back(primitive);
+    updateBounds(primitive->body);
+}
+
+void BodyStore::release(size_t body) {
+    Primitives* primitive = owner[body];
+    primitive->position = position[body];
+    primitive->previousPosition = previousPosition[body];
+    primitive->velocity = velocity[body];
+    primitive->mass = mass[body];
+    primitive->staticBody = isStatic[body] != 0;
+    primitive->collidable = collisionEnabled[body] != 0;
+    primitive->bodyStore = nullptr;
+    primitive->body = 0;
+    primitive->updateHitbox();
+    owner[body] = nullptr;
+}
+
+void BodyStore::detach(size_t body) {
+    release(body);
+    size_t last = owner.size() - 1;
+    forEachArray([body, last](auto& array) {
+        array[body] = array[last];
+        array.pop_back();
+    });
+    if (body < owner.size()) owner[body]->body = body;
+}
+
+void BodyStore::clear() {
+    for (size_t body = 0; body < owner.size(); ++body) {
+        if (owner[body]) release(body);
+    }
+    forEachArray([](auto& array) { array.clear(); });
+}
+
+void BodyStore::updateBounds(size_t body) {
+    glm::vec3 min = position[body] - halfExtents[body];
+    glm::vec3 max = position[body] + halfExtents[body];
+    minX[body] = min.x; minY[body] = min.y; minZ[body] = min.z;
+    maxX[body] = max.x; maxY[body] = max.y; maxZ[body] = max.z;
+}
+
+size_t BodyStore::size() const {
+    return owner.size();
+}
@@ -0,0 +1,73 @@
+#ifndef BODY_STORE_H
+#define BODY_STORE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+class Primitives;
+
+// Physics state of the bodies a Collision simulates, in structure-of-arrays
+// layout: body i is entry i of every array. A primitive taken in by the store
+// keeps only a handle (the store and its index), its accessors read and write
+// the arrays here, so the solver walks contiguous memory instead of chasing
+// Primitives pointers across the heap. When the body leaves the store its
+// state is copied back into the primitive.
+class BodyStore {
+public:
+    std::vector<glm::vec3> position;
+    std::vector<glm::vec3> previousPosition;  // before the last tick, for the interpolated draw
+    std::vector<glm::vec3> velocity;
+    std::vector<glm::vec3> halfExtents;       // the primitive's scale
+    std::vector<float> mass;
+    // Hitbox bounds, position -/+ halfExtents
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+    // All bits set when true, so they can be used directly as SIMD masks
+    std::vector<int32_t> isStatic;
+    std::vector<int32_t> collisionEnabled;
+    std::vector<int32_t> isSleeping;
+    std::vector<float> sleepTimer;  // time spent resting, in seconds
+    std::vector<int> sleepGroup;    // island it fell asleep with, woken together, -1 if none
+    std::vector<Primitives*> owner;
+
+    BodyStore() {}
+    ~BodyStore();
+
+    BodyStore(const BodyStore&) = delete;
+    BodyStore& operator=(const BodyStore&) = delete;
+
+    // Make body i primitive i of the list: primitives new to the store are
+    // taken in (from another store too), the bodies not in the list anymore
+    // are given back. Only compares the owners when the list didn't change
+    void sync(const std::vector<Primitives*>& primitives);
+
+    // Give the body back to its primitive, the last body takes its index
+    void detach(size_t body);
+    void clear();
+
+    // Bounds of the body from its position and half extents
+    void updateBounds(size_t body);
+
+    size_t size() const;
+
+private:
+    // Append the state the primitive holds while it is in no store
+    void attach(Primitives* primitive);
+    // Copy the body's state into its primitive and drop the handle
+    void release(size_t body);
+
+    // Same call on every array, in the order they are declared
+    template <typename Function>
+    void forEachArray(Function function) {
+        function(position); function(previousPosition); function(velocity); function(halfExtents); function(mass);
+        function(minX); function(minY); function(minZ);
+        function(maxX); function(maxY); function(maxZ);
+        function(isStatic); function(collisionEnabled); function(isSleeping);
+        function(sleepTimer); function(sleepGroup); function(owner);
+    }
+
+    std::vector<size_t> source;  // body each entry of the list comes from, while syncing
+};
+
+#endif // BODY_STORE_H
@@ -0,0 +1,317 @@
+#include "broadphase.h"
+#include <algorithm>
+#include <limits>
+
+// The kernel is picked at runtime from what the CPU supports, so the build
+// doesn't need -march=native: the AVX and SSE paths are compiled for their
+// instruction set with target attributes and only called when it is there
+#if defined(__x86_64__) || defined(__i386__)
+#define BROADPHASE_X86
+#include <immintrin.h>
+#endif
+
+// Boxes tested together by the sweep kernel
+static const size_t BLOCK_SIZE = 8;
+
+// Tests box a against the 8 boxes starting at index j of the list.
+// startMask gets the boxes starting before a ends on X, the return value the full overlaps.
+struct ScalarKernel {
+    static inline unsigned int overlapBlock(const float* minX, const float* minY, const float* minZ,
+                                            const float* maxX, const float* maxY, const float* maxZ, size_t j,
+                                            float aMinX, float aMaxX, float aMinY, float aMaxY, float aMinZ, float aMaxZ,
+                                            unsigned int& startMask) {
+        unsigned int hitMask = 0;
+        startMask = 0;
+        for (size_t lane = 0; lane < BLOCK_SIZE; ++lane) {
+            size_t k = j + lane;
+            if (minX[k] > aMaxX) continue;
+            startMask |= 1u << lane;
+            if (maxX[k] >= aMinX && minY[k] <= aMaxY && maxY[k] >= aMinY && minZ[k] <= aMaxZ && maxZ[k] >= aMinZ) {
+                hitMask |= 1u << lane;
+            }
+        }
+        return hitMask;
+    }
+};
+
+#ifdef BROADPHASE_X86
+struct SseKernel {
+    __attribute__((target("sse2")))
+    static inline unsigned int overlapBlock(const float* minX, const float* minY, const float* minZ,
+                                            const float* maxX, const float* maxY, const float* maxZ, size_t j,
+                                            float aMinX, float aMaxX, float aMinY, float aMaxY, float aMinZ, float aMaxZ,
+                                            unsigned int& startMask) {
+        unsigned int hitMask = 0;
+        startMask = 0;
+        for (size_t half = 0; half < BLOCK_SIZE; half += 4) {
+            size_t k = j + half;
+            __m128 start = _mm_cmple_ps(_mm_loadu_ps(minX + k), _mm_set1_ps(aMaxX));
+            __m128 x = _mm_and_ps(start, _mm_cmpge_ps(_mm_loadu_ps(maxX + k), _mm_set1_ps(aMinX)));
+            __m128 y = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minY + k), _mm_set1_ps(aMaxY)),
+                                  _mm_cmpge_ps(_mm_loadu_ps(maxY + k), _mm_set1_ps(aMinY)));
+            __m128 z = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minZ + k), _mm_set1_ps(aMaxZ)),
+                                  _mm_cmpge_ps(_mm_loadu_ps(maxZ + k), _mm_set1_ps(aMinZ)));
+            __m128 hit = _mm_and_ps(x, _mm_and_ps(y, z));
+            startMask |= static_cast<unsigned int>(_mm_movemask_ps(start)) << half;
+            hitMask |= static_cast<unsigned int>(_mm_movemask_ps(hit)) << half;
+        }
+        return hitMask;
+    }
+};
+
+struct AvxKernel {
+    __attribute__((target("avx,popcnt")))
+    static inline unsigned int overlapBlock(const float* minX, const float* minY, const float* minZ,
+                                            const float* maxX, const float* maxY, const float* maxZ, size_t j,
+                                            float aMinX, float aMaxX, float aMinY, float aMaxY, float aMinZ, float aMaxZ,
+                                            unsigned int& startMask) {
+        __m256 start = _mm256_cmp_ps(_mm256_loadu_ps(minX + j), _mm256_set1_ps(aMaxX), _CMP_LE_OQ);
+        __m256 x = _mm256_and_ps(start, _mm256_cmp_ps(_mm256_loadu_ps(maxX + j), _mm256_set1_ps(aMinX), _CMP_GE_OQ));
+        __m256 y = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(minY + j), _mm256_set1_ps(aMaxY), _CMP_LE_OQ),
+                                 _mm256_cmp_ps(_mm256_loadu_ps(maxY + j), _mm256_set1_ps(aMinY), _CMP_GE_OQ));
+        __m256 z = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(minZ + j), _mm256_set1_ps(aMaxZ), _CMP_LE_OQ),
+                                 _mm256_cmp_ps(_mm256_loadu_ps(maxZ + j), _mm256_set1_ps(aMinZ), _CMP_GE_OQ));
+        __m256 hit = _mm256_and_ps(x, _mm256_and_ps(y, z));
+        startMask = static_cast<unsigned int>(_mm256_movemask_ps(start));
+        return static_cast<unsigned int>(_mm256_movemask_ps(hit));
+    }
+};
+#endif
+
+enum KernelType { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX };
+
+static KernelType detectKernel() {
+#ifdef BROADPHASE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("popcnt")) return KERNEL_AVX;
+    if (__builtin_cpu_supports("sse2")) return KERNEL_SSE;
+#endif
+    return KERNEL_SCALAR;
+}
+
+// Checked once, the first time a broad phase runs
+static KernelType getKernel() {
+    static const KernelType kernel = detectKernel();
+    return kernel;
+}
+
+BroadPhase::BroadPhase() : pairTests(0) {}
+
+const char* BroadPhase::getKernelName() {
+    switch (getKernel()) {
+    case KERNEL_AVX: return "AVX";
+    case KERNEL_SSE: return "SSE";
+    default: return "scalar";
+    }
+}
+
+void BroadPhase::SortedList::begin(size_t capacity) {
+    size_t padded = capacity + BLOCK_SIZE;
+    minX.resize(padded); minY.resize(padded); minZ.resize(padded);
+    maxX.resize(padded); maxY.resize(padded); maxZ.resize(padded);
+    prefixMaxX.resize(padded);
+    handle.resize(padded);
+    count = 0;
+}
+
+void BroadPhase::SortedList::add(const BodyStore& bodies, size_t body) {
+    minX[count] = bodies.minX[body];
+    minY[count] = bodies.minY[body];
+    minZ[count] = bodies.minZ[body];
+    maxX[count] = bodies.maxX[body];
+    maxY[count] = bodies.maxY[body];
+    maxZ[count] = bodies.maxZ[body];
+    prefixMaxX[count] = count > 0 ? std::max(prefixMaxX[count - 1], maxX[count]) : maxX[count];
+    handle[count] = body;
+    count++;
+}
+
+// Padding boxes are empty and start at infinity on X so they end every sweep
+void BroadPhase::SortedList::end() {
+    for (size_t i = count; i < count + BLOCK_SIZE; ++i) {
+        minX[i] = minY[i] = minZ[i] = std::numeric_limits<float>::infinity();
+        maxX[i] = maxY[i] = maxZ[i] = -std::numeric_limits<float>::infinity();
+    }
+}
+
+// Keeps order sorted on minX. When the body list changed the order is rebuilt
+// with a full sort, otherwise an insertion sort fixes the few entries that
+// moved since last frame
+void BroadPhase::sortAxis(const BodyStore& bodies) {
+    const std::vector<float>& minX = bodies.minX;
+    if (order.size() != bodies.size()) {
+        order.resize(bodies.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&minX](size_t a, size_t b) {
+            return minX[a] < minX[b];
+        });
+        return;
+    }
+
+    for (size_t i = 1; i < order.size(); ++i) {
+        size_t current = order[i];
+        float key = minX[current];
+        size_t j = i;
+        while (j > 0 && minX[order[j - 1]] > key) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = current;
+    }
+}
+
+// Awake bodies against each other: everything after i starts further on X,
+// stop once a block starts past a's max. The arrays, a's box and the test
+// count are kept in locals: through this, every push_back would make the
+// compiler reload them for each block
+template <typename Kernel>
+void BroadPhase::sweepAwake() {
+    const float* minX = awake.minX.data();
+    const float* minY = awake.minY.data();
+    const float* minZ = awake.minZ.data();
+    const float* maxX = awake.maxX.data();
+    const float* maxY = awake.maxY.data();
+    const float* maxZ = awake.maxZ.data();
+    const size_t* handle = awake.handle.data();
+    size_t count = awake.count;
+    size_t tests = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        float aMinX = minX[i], aMaxX = maxX[i];
+        float aMinY = minY[i], aMaxY = maxY[i];
+        float aMinZ = minZ[i], aMaxZ = maxZ[i];
+        for (size_t j = i + 1; j < count; j += BLOCK_SIZE) {
+            unsigned int startMask;
+            unsigned int hitMask = Kernel::overlapBlock(minX, minY, minZ, maxX, maxY, maxZ, j,
+                                                        aMinX, aMaxX, aMinY, aMaxY, aMinZ, aMaxZ, startMask);
+            tests += __builtin_popcount(startMask);
+
+            while (hitMask) {
+                unsigned int lane = __builtin_ctz(hitMask);
+                hitMask &= hitMask - 1;
+                pairs.push_back(std::minmax(handle[i], handle[j + lane]));
+            }
+
+            // Sorted on X: a lane failing means everything after it fails too
+            if (startMask != (1u << BLOCK_SIZE) - 1) break;
+        }
+    }
+    pairTests += tests;
+}
+
+// Awake bodies against a list of resting bodies. The list is sorted on minX,
+// so the entries that can overlap a on X are between the first one whose
+// prefixMaxX reaches a's min and the last one starting before a's max
+template <typename Kernel>
+void BroadPhase::queryList(const SortedList& list) {
+    if (list.count == 0) return;
+    const float* prefixBegin = list.prefixMaxX.data();
+    const float* minX = list.minX.data();
+    const float* minY = list.minY.data();
+    const float* minZ = list.minZ.data();
+    const float* maxX = list.maxX.data();
+    const float* maxY = list.maxY.data();
+    const float* maxZ = list.maxZ.data();
+    const size_t* handle = list.handle.data();
+    size_t tests = 0;
+
+    for (size_t i = 0; i < awake.count; ++i) {
+        float aMinX = awake.minX[i], aMaxX = awake.maxX[i];
+        float aMinY = awake.minY[i], aMaxY = awake.maxY[i];
+        float aMinZ = awake.minZ[i], aMaxZ = awake.maxZ[i];
+        size_t aHandle = awake.handle[i];
+        size_t first = std::lower_bound(prefixBegin, prefixBegin + list.count, aMinX) - prefixBegin;
+        size_t last = std::upper_bound(minX, minX + list.count, aMaxX) - minX;
+
+        for (size_t j = first; j < last; j += BLOCK_SIZE) {
+            unsigned int startMask;
+            unsigned int hitMask = Kernel::overlapBlock(minX, minY, minZ, maxX, maxY, maxZ, j,
+                                                        aMinX, aMaxX, aMinY, aMaxY, aMinZ, aMaxZ, startMask);
+            // Drop the lanes past the range
+            if (last - j < BLOCK_SIZE) {
+                unsigned int rangeMask = (1u << (last - j)) - 1;
+                hitMask &= rangeMask;
+                startMask &= rangeMask;
+            }
+            tests += __builtin_popcount(startMask);
+
+            while (hitMask) {
+                unsigned int lane = __builtin_ctz(hitMask);
+                hitMask &= hitMask - 1;
+                pairs.push_back(std::minmax(aHandle, handle[j + lane]));
+            }
+        }
+    }
+    pairTests += tests;
+}
+
+template <typename Kernel>
+void BroadPhase::findPairs() {
+    sweepAwake<Kernel>();
+    queryList<Kernel>(sleeping);
+    queryList<Kernel>(statics);
+}
+
+#ifdef BROADPHASE_X86
+// Built for the kernel's instruction set, flatten inlines the whole search so
+// the sweep loops are compiled with it too instead of calling the kernel per block
+__attribute__((target("avx,popcnt"), flatten))
+void BroadPhase::findPairsAvx() {
+    findPairs<AvxKernel>();
+}
+
+__attribute__((target("sse2"), flatten))
+void BroadPhase::findPairsSse() {
+    findPairs<SseKernel>();
+}
+#endif
+
+void BroadPhase::update(const BodyStore& bodies) {
+    pairs.clear();
+    pairTests = 0;
+
+    sortAxis(bodies);
+
+    // Split the enabled bodies, each list stays sorted on minX
+    awake.begin(bodies.size());
+    sleeping.begin(bodies.size());
+    statics.begin(bodies.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t body = order[i];
+        if (!bodies.collisionEnabled[body]) continue;
+        if (bodies.isStatic[body]) {
+            statics.add(bodies, body);
+        } else if (bodies.isSleeping[body]) {
+            sleeping.add(bodies, body);
+        } else {
+            awake.add(bodies, body);
+        }
+    }
+    awake.end();
+    sleeping.end();
+    statics.end();
+
+    // Resting bodies never need testing against each other
+    if (awake.count > 0) {
+        switch (getKernel()) {
+#ifdef BROADPHASE_X86
+        case KERNEL_AVX: findPairsAvx(); break;
+        case KERNEL_SSE: findPairsSse(); break;
+#endif
+        default: findPairs<ScalarKernel>(); break;
+        }
+    }
+
+    // Resolve in the same order as the old i < j double loop
+    std::sort(pairs.begin(), pairs.end());
+}
+
+const std::vector<std::pair<size_t, size_t>>& BroadPhase::getPairs() const {
+    return pairs;
+}
+
+size_t BroadPhase::getPairTests() const {
+    return pairTests;
+}
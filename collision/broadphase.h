@@ -0,0 +1,68 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "bodyStore.h"
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Sweep-and-prune broad phase over the body store hitboxes.
+// Keeps the sort order between frames so the insertion sort only has
+// to fix the few entries that moved, the order is fully sorted again
+// when bodies are added or removed. Bodies are split in three lists
+// kept in that order: awake dynamic bodies, sleeping bodies and static
+// bodies. Only pairs with at least one awake body are looked for, so a
+// scene at rest costs almost nothing. Boxes are tested 8 at a time
+// (AVX, SSE or scalar fallback, picked at runtime from the CPU).
+class BroadPhase {
+public:
+    BroadPhase();
+
+    // Build the candidate pairs (body indices in the store, first < second)
+    // The store must be synced with the primitives before calling this
+    void update(const BodyStore& bodies);
+
+    const std::vector<std::pair<size_t, size_t>>& getPairs() const;
+
+    // Number of AABB overlap tests done by the last update
+    size_t getPairTests() const;
+
+    // Name of the overlap kernel picked for this CPU ("AVX", "SSE" or "scalar")
+    static const char* getKernelName();
+
+private:
+    // Bodies gathered in sweep order, padded so a block of 8 can always be loaded
+    struct SortedList {
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+        std::vector<float> prefixMaxX;  // largest maxX up to each entry, to find where a range starts
+        std::vector<size_t> handle;
+        size_t count;
+
+        void begin(size_t capacity);
+        void add(const BodyStore& bodies, size_t body);
+        void end();
+    };
+
+    std::vector<size_t> order;                      // body indices sorted on minX
+    std::vector<std::pair<size_t, size_t>> pairs;   // candidate pairs of the last update
+    size_t pairTests;
+
+    SortedList awake;
+    SortedList sleeping;
+    SortedList statics;
+
+    void sortAxis(const BodyStore& bodies);
+
+    // Pair search with one overlap kernel. The x86 entry points are built
+    // for AVX and SSE and only called when the CPU has them
+    template <typename Kernel> void findPairs();
+    template <typename Kernel> void sweepAwake();
+    template <typename Kernel> void queryList(const SortedList& list);
+#if defined(__x86_64__) || defined(__i386__)
+    void findPairsAvx();
+    void findPairsSse();
+#endif
+};
+
+#endif // BROADPHASE_H
@@ -0,0 +1,226 @@
+#include "bvh.h"
+#include <algorithm>
+#include <limits>
+
+// Centroid bins tried per axis when looking for a split
+static const int SAH_BINS = 12;
+// Leaves never get bigger than this, smaller if the SAH says so. Items the
+// SAH can't separate (centroids at the same point) are split by halves
+static const uint32_t MAX_LEAF_ITEMS = 4;
+static const uint32_t NO_PARENT = 0xFFFFFFFF;
+
+static float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+    glm::vec3 extent = max - min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void Bvh::build(const std::vector<glm::vec3>& itemMin, const std::vector<glm::vec3>& itemMax) {
+    size_t count = itemMin.size();
+    nodes.clear();
+    parents.clear();
+    depth = 0;
+    items.resize(count);
+    centroids.resize(count);
+    if (count == 0) return;
+
+    for (size_t i = 0; i < count; ++i) {
+        items[i] = static_cast<uint32_t>(i);
+        centroids[i] = (itemMin[i] + itemMax[i]) * 0.5f;
+    }
+
+    // A binary tree with n leaves has at most 2n - 1 nodes
+    nodes.reserve(2 * count);
+    Node root;
+    root.leftOrFirst = 0;
+    root.count = static_cast<uint32_t>(count);
+    nodes.push_back(root);
+    updateBounds(nodes[0], itemMin, itemMax);
+    subdivide(0, 0, itemMin, itemMax);
+
+    // Links back up the tree for refit()
+    parents.assign(nodes.size(), NO_PARENT);
+    itemLeaf.resize(count);
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        const Node& node = nodes[i];
+        if (node.count == 0) {
+            parents[node.leftOrFirst] = i;
+            parents[node.leftOrFirst + 1] = i;
+        } else {
+            for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; ++k) {
+                itemLeaf[items[k]] = i;
+            }
+        }
+    }
+}
+
+void Bvh::refit(const std::vector<uint32_t>& changedItems, const std::vector<glm::vec3>& itemMin,
+                const std::vector<glm::vec3>& itemMax) {
+    for (size_t i = 0; i < changedItems.size(); ++i) {
+        uint32_t nodeIndex = itemLeaf[changedItems[i]];
+        updateBounds(nodes[nodeIndex], itemMin, itemMax);
+
+        // Stop as soon as a node keeps its bounds, the ones above can't change either
+        for (uint32_t parent = parents[nodeIndex]; parent != NO_PARENT; parent = parents[parent]) {
+            Node& node = nodes[parent];
+            const Node& left = nodes[node.leftOrFirst];
+            const Node& right = nodes[node.leftOrFirst + 1];
+            glm::vec3 min = glm::min(left.min, right.min);
+            glm::vec3 max = glm::max(left.max, right.max);
+            if (min == node.min && max == node.max) break;
+            node.min = min;
+            node.max = max;
+        }
+    }
+}
+
+bool Bvh::empty() const {
+    return nodes.empty();
+}
+
+uint32_t Bvh::getDepth() const {
+    return depth;
+}
+
+void Bvh::updateBounds(Node& node, const std::vector<glm::vec3>& itemMin, const std::vector<glm::vec3>& itemMax) {
+    node.min = glm::vec3(std::numeric_limits<float>::max());
+    node.max = glm::vec3(-std::numeric_limits<float>::max());
+    for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+        node.min = glm::min(node.min, itemMin[items[i]]);
+        node.max = glm::max(node.max, itemMax[items[i]]);
+    }
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, uint32_t nodeDepth, const std::vector<glm::vec3>& itemMin,
+                    const std::vector<glm::vec3>& itemMax) {
+    depth = std::max(depth, nodeDepth);
+    Node node = nodes[nodeIndex];
+    if (node.count <= 1) return;
+
+    // Bounds of the centroids, the bins split them evenly
+    glm::vec3 centroidMin(std::numeric_limits<float>::max());
+    glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+    for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+        centroidMin = glm::min(centroidMin, centroids[items[i]]);
+        centroidMax = glm::max(centroidMax, centroids[items[i]]);
+    }
+
+    // Cheapest split over the bin boundaries of the three axes
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f) continue;
+
+        glm::vec3 binMin[SAH_BINS];
+        glm::vec3 binMax[SAH_BINS];
+        uint32_t binCount[SAH_BINS];
+        for (int bin = 0; bin < SAH_BINS; ++bin) {
+            binMin[bin] = glm::vec3(std::numeric_limits<float>::max());
+            binMax[bin] = glm::vec3(-std::numeric_limits<float>::max());
+            binCount[bin] = 0;
+        }
+
+        float scale = SAH_BINS / extent;
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+            uint32_t item = items[i];
+            int bin = std::min(SAH_BINS - 1, static_cast<int>((centroids[item][axis] - centroidMin[axis]) * scale));
+            binCount[bin]++;
+            binMin[bin] = glm::min(binMin[bin], itemMin[item]);
+            binMax[bin] = glm::max(binMax[bin], itemMax[item]);
+        }
+
+        // Sweep from both sides to get the area and count left and right of each boundary
+        float leftArea[SAH_BINS - 1];
+        uint32_t leftCount[SAH_BINS - 1];
+        glm::vec3 sweepMin(std::numeric_limits<float>::max());
+        glm::vec3 sweepMax(-std::numeric_limits<float>::max());
+        uint32_t sweepCount = 0;
+        for (int bin = 0; bin < SAH_BINS - 1; ++bin) {
+            sweepCount += binCount[bin];
+            if (binCount[bin]) {
+                sweepMin = glm::min(sweepMin, binMin[bin]);
+                sweepMax = glm::max(sweepMax, binMax[bin]);
+            }
+            leftCount[bin] = sweepCount;
+            leftArea[bin] = sweepCount ? surfaceArea(sweepMin, sweepMax) : 0.0f;
+        }
+        sweepMin = glm::vec3(std::numeric_limits<float>::max());
+        sweepMax = glm::vec3(-std::numeric_limits<float>::max());
+        sweepCount = 0;
+        for (int bin = SAH_BINS - 1; bin > 0; --bin) {
+            sweepCount += binCount[bin];
+            if (binCount[bin]) {
+                sweepMin = glm::min(sweepMin, binMin[bin]);
+                sweepMax = glm::max(sweepMax, binMax[bin]);
+            }
+            if (sweepCount == 0 || leftCount[bin - 1] == 0) continue;
+            float cost = leftArea[bin - 1] * leftCount[bin - 1] + surfaceArea(sweepMin, sweepMax) * sweepCount;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = bin;
+            }
+        }
+    }
+
+    // Splitting must beat testing every item of the leaf, unless the leaf is too big
+    float leafCost = surfaceArea(node.min, node.max) * node.count;
+    if (bestAxis >= 0 && bestCost >= leafCost && node.count <= MAX_LEAF_ITEMS) return;
+
+    // Partition the items around the chosen boundary
+    uint32_t leftItems = 0;
+    if (bestAxis >= 0) {
+        float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+        float scale = SAH_BINS / extent;
+        uint32_t* first = items.data() + node.leftOrFirst;
+        uint32_t* last = first + node.count;
+        uint32_t* middle = std::partition(first, last, [&](uint32_t item) {
+            int bin = std::min(SAH_BINS - 1, static_cast<int>((centroids[item][bestAxis] - centroidMin[bestAxis]) * scale));
+            return bin < bestSplit;
+        });
+        leftItems = static_cast<uint32_t>(middle - first);
+    }
+    if (leftItems == 0 || leftItems == node.count) {
+        // No boundary separates the centroids, they all sit at the same point:
+        // any split is as good as another, halves keep the tree balanced
+        if (node.count <= MAX_LEAF_ITEMS) return;
+        leftItems = node.count / 2;
+    }
+
+    uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+    Node left;
+    left.leftOrFirst = node.leftOrFirst;
+    left.count = leftItems;
+    Node right;
+    right.leftOrFirst = node.leftOrFirst + leftItems;
+    right.count = node.count - leftItems;
+    nodes.push_back(left);
+    nodes.push_back(right);
+    updateBounds(nodes[leftIndex], itemMin, itemMax);
+    updateBounds(nodes[leftIndex + 1], itemMin, itemMax);
+
+    nodes[nodeIndex].leftOrFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+
+    subdivide(leftIndex, nodeDepth + 1, itemMin, itemMax);
+    subdivide(leftIndex + 1, nodeDepth + 1, itemMin, itemMax);
+}
+
+// Slab test, a ray starting inside the box enters it at 0
+bool Bvh::intersectRay(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection,
+                       float maxDistance, float& tNear) {
+    glm::vec3 t0 = (node.min - origin) * invDirection;
+    glm::vec3 t1 = (node.max - origin) * invDirection;
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+    float entry = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+    float exit = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, maxDistance));
+    tNear = entry;
+    return entry <= exit;
+}
+
+float Bvh::distanceSquared(const Node& node, const glm::vec3& point) {
+    glm::vec3 outside = glm::max(node.min - point, glm::max(point - node.max, glm::vec3(0.0f)));
+    return glm::dot(outside, outside);
+}
@@ -0,0 +1,56 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Bounding volume hierarchy over a set of item bounds, built top down with
+// the binned surface area heuristic. The tree only knows the bounds, the
+// owner tests the items in the leaves. Once built it is only read, so any
+// number of threads can traverse it at the same time.
+class Bvh {
+public:
+    // 32 bytes, two nodes per cache line
+    struct Node {
+        glm::vec3 min;
+        uint32_t leftOrFirst;  // first child (the second is next to it) or first item of a leaf
+        glm::vec3 max;
+        uint32_t count;        // items in the leaf, 0 for an inner node
+    };
+
+    std::vector<Node> nodes;        // nodes[0] is the root
+    std::vector<uint32_t> items;    // item indices, leaves refer to ranges of it
+
+    // Build the tree over the item bounds (one entry per item)
+    void build(const std::vector<glm::vec3>& itemMin, const std::vector<glm::vec3>& itemMax);
+
+    bool empty() const;
+
+    // Levels below the root of the deepest leaf, a traversal stack needs one more entry
+    uint32_t getDepth() const;
+
+    // Fit the leaves holding the changed items and their ancestors to the new
+    // item bounds. The shape of the tree stays, fine for small local changes
+    void refit(const std::vector<uint32_t>& changedItems, const std::vector<glm::vec3>& itemMin,
+               const std::vector<glm::vec3>& itemMax);
+
+    // Ray against a node, tNear gets the entry distance. invDirection is 1 / direction
+    static bool intersectRay(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection,
+                             float maxDistance, float& tNear);
+
+    // Squared distance from a point to a node box, 0 inside
+    static float distanceSquared(const Node& node, const glm::vec3& point);
+
+private:
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> parents;   // per node, the root has none
+    std::vector<uint32_t> itemLeaf;  // per item, the leaf holding it
+    uint32_t depth = 0;
+
+    void updateBounds(Node& node, const std::vector<glm::vec3>& itemMin, const std::vector<glm::vec3>& itemMax);
+    void subdivide(uint32_t nodeIndex, uint32_t nodeDepth, const std::vector<glm::vec3>& itemMin,
+                   const std::vector<glm::vec3>& itemMax);
+};
+
+#endif // BVH_H
@@ -1,13 +1,19 @@
 #include "collision.h"
 #include <iostream>
 #include <glm/gtx/string_cast.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "../debug/allocationCounter.h"
 
 // Constructor to initialize gravity and time step
-Collision::Collision(glm::vec3 g, float dt) : gravity(g), deltaTime(dt), PlayerCollidingWithPrimitives(false) {}
+Collision::Collision(glm::vec3 g, float dt) : gravity(g), deltaTime(dt), maxStepsPerFrame(5), sweepThreshold(0.5f), sleepVelocity(0.1f), timeToSleep(0.5f), terrain(nullptr), stats(), accumulator(0.0f), solverThreads(WorkerPool::defaultThreadCount()), islandCount(0), queryTreeDirty(true), PlayerCollidingWithPrimitives(false), PlayerCollidingWithTerrain(false) {}
 
 // Check for a collision between two primitives (using Axis-Aligned Bounding Box - AABB)
 bool Collision::checkCollision(Primitives* a, Primitives* b) {
-    if (!a->collisionEnabled || !b->collisionEnabled) {
+    if (!a->isCollisionEnabled() || !b->isCollisionEnabled()) {
         return false;  // If collision is disabled for either object, no collision
     }
 
@@ -15,16 +21,11 @@ bool Collision::checkCollision(Primitives* a, Primitives* b) {
     a->updateHitbox();
     b->updateHitbox();
 
-    // Use the updated hitboxes to check for overlap
-    glm::vec3 aMin = a->hitbox.min;
-    glm::vec3 aMax = a->hitbox.max;
-    glm::vec3 bMin = b->hitbox.min;
-    glm::vec3 bMax = b->hitbox.max;
-
-    // Check for overlap
-    bool collisionDetected = (aMin.x <= bMax.x && aMax.x >= bMin.x) &&
-                             (aMin.y <= bMax.y && aMax.y >= bMin.y) &&
-                             (aMin.z <= bMax.z && aMax.z >= bMin.z);
+    Primitives::Hitbox aBox = a->getHitbox();
+    Primitives::Hitbox bBox = b->getHitbox();
+    bool collisionDetected = (aBox.min.x <= bBox.max.x && aBox.max.x >= bBox.min.x) &&
+                             (aBox.min.y <= bBox.max.y && aBox.max.y >= bBox.min.y) &&
+                             (aBox.min.z <= bBox.max.z && aBox.max.z >= bBox.min.z);
 
     // Debugging output
     if (collisionDetected) {
@@ -33,107 +34,681 @@ bool Collision::checkCollision(Primitives* a, Primitives* b) {
     return collisionDetected;
 }
 
-// Calculate the collision normal based on the positions of the two primitives
-glm::vec3 Collision::calculateNormal(Primitives* a, Primitives* b) {
+// Overlap test on the bounds of two bodies as they are, the caller keeps them up to date
+bool Collision::overlaps(size_t a, size_t b) const {
+    return (bodies.minX[a] <= bodies.maxX[b] && bodies.maxX[a] >= bodies.minX[b]) &&
+           (bodies.minY[a] <= bodies.maxY[b] && bodies.maxY[a] >= bodies.minY[b]) &&
+           (bodies.minZ[a] <= bodies.maxZ[b] && bodies.maxZ[a] >= bodies.minZ[b]);
+}
+
+Primitives::Hitbox Collision::getBounds(size_t body) const {
+    return { glm::vec3(bodies.minX[body], bodies.minY[body], bodies.minZ[body]),
+             glm::vec3(bodies.maxX[body], bodies.maxY[body], bodies.maxZ[body]) };
+}
+
+// Calculate the collision normal based on the hitboxes of the two
+glm::vec3 Collision::calculateNormal(const Primitives::Hitbox& a, const Primitives::Hitbox& b) {
     // Use the centers of the hitboxes to calculate the collision normal
-    glm::vec3 aCenter = (a->hitbox.min + a->hitbox.max) * 0.5f;
-    glm::vec3 bCenter = (b->hitbox.min + b->hitbox.max) * 0.5f;
-    return glm::normalize(aCenter - bCenter);
+    glm::vec3 aCenter = (a.min + a.max) * 0.5f;
+    glm::vec3 bCenter = (b.min + b.max) * 0.5f;
+    glm::vec3 direction = aCenter - bCenter;
+    if (glm::dot(direction, direction) < 1e-12f) {
+        return glm::vec3(0.0f, 1.0f, 0.0f);  // Same center, push A up
+    }
+    return glm::normalize(direction);
 }
 
-// Slide the moving primitive along the surface of the other
-void Collision::slideAlongSurface(Primitives* moving, glm::vec3 normal) {
-    float dotProduct = glm::dot(moving->velocity, normal);
+// Slide a velocity along the surface it hit
+void Collision::slideAlongSurface(glm::vec3& velocity, glm::vec3 normal) {
+    float dotProduct = glm::dot(velocity, normal);
     if (dotProduct < 0) { // Only slide if moving towards the surface
-        glm::vec3 slideVelocity = moving->velocity - (dotProduct * normal);
-        moving->velocity = slideVelocity;
+        glm::vec3 slideVelocity = velocity - (dotProduct * normal);
+        velocity = slideVelocity;
     }
 }
 
 // Resolve the collision by separating the objects and adjusting their velocities
-void Collision::resolveCollision(Primitives* a, Primitives* b) {
-    if (!checkCollision(a, b)) return;
+// Bounds must be up to date, update() refreshes them once per frame
+// Only the dynamic body (or bodies) of the pair is written, which the island solver relies on
+bool Collision::resolveCollision(size_t a, size_t b) {
+    if (!bodies.collisionEnabled[a] || !bodies.collisionEnabled[b]) return false;
+    if (!overlaps(a, b)) return false;
 
     glm::vec3 overlap;
-    // Use the hitboxes for calculations
-    glm::vec3 aMin = a->hitbox.min;
-    glm::vec3 aMax = a->hitbox.max;
-    glm::vec3 bMin = b->hitbox.min;
-    glm::vec3 bMax = b->hitbox.max;
+    // Use the bounds for calculations
+    Primitives::Hitbox aBox = getBounds(a);
+    Primitives::Hitbox bBox = getBounds(b);
+    glm::vec3 aMin = aBox.min;
+    glm::vec3 aMax = aBox.max;
+    glm::vec3 bMin = bBox.min;
+    glm::vec3 bMax = bBox.max;
 
     // Compute overlap on each axis
     overlap.x = std::min(aMax.x, bMax.x) - std::max(aMin.x, bMin.x);
     overlap.y = std::min(aMax.y, bMax.y) - std::max(aMin.y, bMin.y);
     overlap.z = std::min(aMax.z, bMax.z) - std::max(aMin.z, bMin.z);
 
-    glm::vec3 normal = calculateNormal(a, b);
+    glm::vec3 normal = calculateNormal(aBox, bBox);
+    bool aStatic = bodies.isStatic[a] != 0;
+    bool bStatic = bodies.isStatic[b] != 0;
+    glm::vec3& aPosition = bodies.position[a];
+    glm::vec3& bPosition = bodies.position[b];
 
     // Check if A is static and B is dynamic
-    if (a->isStatic && !b->isStatic) {
+    if (aStatic && !bStatic) {
         if (overlap.y < overlap.x && overlap.y < overlap.z) {
-            b->position.y = aMax.y + b->scale.y / 2.0f; // Move B out of A
-            b->velocity.y = 0.0f; // Stop downward movement
-            slideAlongSurface(b, normal); // Slide B along the surface
+            bPosition.y = aMax.y + bodies.halfExtents[b].y / 2.0f; // Move B out of A
+            bodies.velocity[b].y = 0.0f; // Stop downward movement
+            slideAlongSurface(bodies.velocity[b], normal); // Slide B along the surface
         } else if (overlap.x < overlap.z) {
-            b->position.x += (aMax.x < b->position.x) ? overlap.x : -overlap.x;
-            slideAlongSurface(b, normal);
+            bPosition.x += (aMax.x < bPosition.x) ? overlap.x : -overlap.x;
+            slideAlongSurface(bodies.velocity[b], normal);
         } else {
-            b->position.z += (aMax.z < b->position.z) ? overlap.z : -overlap.z;
-            slideAlongSurface(b, normal);
+            bPosition.z += (aMax.z < bPosition.z) ? overlap.z : -overlap.z;
+            slideAlongSurface(bodies.velocity[b], normal);
         }
-    } else if (!a->isStatic && b->isStatic) {
+    } else if (!aStatic && bStatic) {
         if (overlap.y < overlap.x && overlap.y < overlap.z) {
-            a->position.y = bMax.y + a->scale.y / 2.0f; // Move A out of B
-            a->velocity.y = 0.0f; // Stop upward movement
-            slideAlongSurface(a, normal);
+            aPosition.y = bMax.y + bodies.halfExtents[a].y / 2.0f; // Move A out of B
+            bodies.velocity[a].y = 0.0f; // Stop upward movement
+            slideAlongSurface(bodies.velocity[a], normal);
         } else if (overlap.x < overlap.z) {
-            a->position.x += (bMax.x < a->position.x) ? overlap.x : -overlap.x;
-            slideAlongSurface(a, normal);
+            aPosition.x += (bMax.x < aPosition.x) ? overlap.x : -overlap.x;
+            slideAlongSurface(bodies.velocity[a], normal);
         } else {
-            a->position.z += (bMax.z < a->position.z) ? overlap.z : -overlap.z;
-            slideAlongSurface(a, normal);
+            aPosition.z += (bMax.z < aPosition.z) ? overlap.z : -overlap.z;
+            slideAlongSurface(bodies.velocity[a], normal);
         }
-    } else if (!a->isStatic && !b->isStatic) {
+    } else if (!aStatic && !bStatic) {
     // Handle both objects being dynamic
     // Separate the objects and adjust their velocities appropriately
+    // (the normal points from B to A)
     glm::vec3 correction = normal * overlap;
-    a->position -= correction * 0.5f;
-    b->position += correction * 0.5f;
+    aPosition += correction * 0.5f;
+    bPosition -= correction * 0.5f;
     
-    slideAlongSurface(a, normal);
-    slideAlongSurface(b, normal);
+    slideAlongSurface(bodies.velocity[a], normal);
+    slideAlongSurface(bodies.velocity[b], -normal);
     }
+
+    // Positions moved, keep the bounds in sync for the next pairs
+    if (!aStatic) bodies.updateBounds(a);
+    if (!bStatic) bodies.updateBounds(b);
+    return true;
 }
 
-// Apply gravity to a primitive (modifying its velocity and position)
-void Collision::applyGravity(Primitives* primitive) {
-    if (primitive->collisionEnabled && !primitive->isStatic) {
-        // Gravity affects the primitive's velocity over time if it's dynamic
-        primitive->velocity += gravity * deltaTime;
-        primitive->position += primitive->velocity * deltaTime;
-        //std::cout << "Gravity applied to: " << primitive->getInfo() << " | New position: " << glm::to_string(primitive->position) << std::endl;
+// Apply gravity to a body (modifying its velocity and position)
+void Collision::applyGravity(size_t body) {
+    if (bodies.collisionEnabled[body] && !bodies.isStatic[body]) {
+        // Gravity affects the body's velocity over time if it's dynamic
+        bodies.velocity[body] += gravity * deltaTime;
+        moveSwept(bodies.position[body], bodies.velocity[body], bodies.halfExtents[body]);
     }
 }
 
 
 
 // Update function: Apply gravity and check collisions between all primitives
+// The primitives' physics state lives in the body store from the first update
+// on, body i being primitives[i], and the whole update works on its arrays
 void Collision::update(std::vector<Primitives*>& primitives) {
-    // Apply gravity to all primitives first
-    for (size_t i = 0; i < primitives.size(); ++i) {
-        applyGravity(primitives[i]);
+    size_t allocationsStart = AllocationCounter::getCount();
+    stats.sweeps = 0;
+    stats.sweepHits = 0;
+    bodies.sync(primitives);
+    gatherStatics();
+    if (queryTreeDirty || staticPrimitives.size() != queryGeometry.getBoxCount() || terrain != queryGeometry.getTerrain()) {
+        queryGeometry.build(staticPrimitives, terrain);
+        queryTreeDirty = false;
+    }
+
+    size_t count = bodies.size();
+    stats.primitives = count;
+    stats.bruteForcePairs = count > 1 ? count * (count - 1) / 2 : 0;
+    stats.contacts = 0;
+    stats.terrainQueries = 0;
+    stats.terrainMs = 0.0f;
+
+    // Bodies woken since the last tick bring the rest of their group with them
+    supported.assign(count, 0);
+    groupsToWake.resize(count, 0);  // wakeMarkedGroups leaves it cleared
+    for (size_t i = 0; i < count; ++i) {
+        if (!bodies.isSleeping[i] && bodies.sleepGroup[i] >= 0) {
+            markGroupToWake(i);
+        }
+    }
+    // Sleeping bodies over an edited part of the terrain may have lost their support
+    for (size_t e = 0; e < terrainEdits.size(); ++e) {
+        const glm::vec4& edit = terrainEdits[e];
+        for (size_t i = 0; i < count; ++i) {
+            if (bodies.isSleeping[i] && bodies.maxX[i] >= edit.x && bodies.minX[i] <= edit.y &&
+                bodies.maxZ[i] >= edit.z && bodies.minZ[i] <= edit.w) {
+                markGroupToWake(i);
+            }
+        }
+    }
+    terrainEdits.clear();
+    wakeMarkedGroups();
+
+    // Apply gravity to all awake bodies first
+    size_t awakeCount = 0;
+    size_t sleepingCount = 0;
+    tickStart.resize(count);
+    longMove.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        tickStart[i] = bodies.position[i];
+        if (bodies.isSleeping[i]) {
+            sleepingCount++;
+            continue;
+        }
+        if (bodies.collisionEnabled[i] && !bodies.isStatic[i]) awakeCount++;
+        applyGravity(i);
+        bodies.updateBounds(i);
+        if (!bodies.isStatic[i] && isLongMove(bodies.position[i] - tickStart[i], bodies.halfExtents[i])) {
+            longMove[i] = 1;
+        }
+    }
+
+    // Everything is resting, nothing can move until a body is woken from outside
+    if (awakeCount == 0) {
+        islandCount = 0;
+        stats.pairTests = 0;
+        stats.candidatePairs = 0;
+        stats.islands = 0;
+        stats.awakeBodies = 0;
+        stats.sleepingBodies = sleepingCount;
+        stats.broadPhaseMs = 0.0f;
+        stats.narrowPhaseMs = 0.0f;
+        stats.meshQueries = 0;
+        stats.meshContacts = 0;
+        stats.meshMs = 0.0f;
+        stats.allocations = AllocationCounter::getCount() - allocationsStart;
+        return;
+    }
+
+    // Broad phase: only overlapping bounds come out of the sweep. A long
+    // move enters it with the box covering the whole move, the bounds go back
+    // to the end of the move after
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        if (!longMove[i]) continue;
+        glm::vec3 startMin = tickStart[i] - bodies.halfExtents[i];
+        glm::vec3 startMax = tickStart[i] + bodies.halfExtents[i];
+        bodies.minX[i] = std::min(bodies.minX[i], startMin.x);
+        bodies.minY[i] = std::min(bodies.minY[i], startMin.y);
+        bodies.minZ[i] = std::min(bodies.minZ[i], startMin.z);
+        bodies.maxX[i] = std::max(bodies.maxX[i], startMax.x);
+        bodies.maxY[i] = std::max(bodies.maxY[i], startMax.y);
+        bodies.maxZ[i] = std::max(bodies.maxZ[i], startMax.z);
+    }
+    broadPhase.update(bodies);
+    for (size_t i = 0; i < count; ++i) {
+        if (longMove[i]) bodies.updateBounds(i);
+    }
+    auto broadEnd = std::chrono::high_resolution_clock::now();
+
+    // An awake body touching a sleeping one wakes it, the broad phase only
+    // returns pairs with an awake body so the other side is the sleeper
+    const std::vector<std::pair<size_t, size_t>>& pairs = broadPhase.getPairs();
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (bodies.isSleeping[pairs[i].first]) markGroupToWake(pairs[i].first);
+        if (bodies.isSleeping[pairs[i].second]) markGroupToWake(pairs[i].second);
+    }
+    wakeMarkedGroups();
+
+    // Then resolve collisions on the candidate pairs, a run of islands per job
+    buildIslands();
+    WorkerPool::shared().parallelFor(islandJobStart.size() - 1, [this](size_t job) {
+        const std::vector<std::pair<size_t, size_t>>& islandCandidates = broadPhase.getPairs();
+        for (size_t island = islandJobStart[job]; island < islandJobStart[job + 1]; ++island) {
+            size_t contacts = 0;
+            for (size_t k = islandPairStart[island]; k < islandPairStart[island + 1]; ++k) {
+                const std::pair<size_t, size_t>& pair = islandCandidates[islandPairs[k]];
+                if (resolveCollision(pair.first, pair.second)) {
+                    // Static bodies are shared between islands, only flag the dynamic ones
+                    if (!bodies.isStatic[pair.first]) supported[pair.first] = 1;
+                    if (!bodies.isStatic[pair.second]) supported[pair.second] = 1;
+                    contacts++;
+                } else if ((longMove[pair.first] || longMove[pair.second]) && resolveSweptPair(pair.first, pair.second)) {
+                    contacts++;
+                }
+            }
+            islandContacts[island] = contacts;
+        }
+    }, solverThreads);
+    for (size_t island = 0; island < islandCount; ++island) {
+        stats.contacts += islandContacts[island];
+    }
+    auto narrowEnd = std::chrono::high_resolution_clock::now();
+
+    // Dynamic bodies against the static model meshes
+    stats.meshQueries = 0;
+    stats.meshContacts = 0;
+    if (queryGeometry.getTriangleCount() > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!bodies.collisionEnabled[i] || bodies.isStatic[i] || bodies.isSleeping[i]) continue;
+            const Primitives* primitive = bodies.owner[i];
+            if (resolveMeshCollision(bodies.position[i], bodies.velocity[i], bodies.halfExtents[i], primitive->collisionHull,
+                                     primitive->collisionHullTransform)) {
+                bodies.updateBounds(i);
+                supported[i] = 1;
+            }
+        }
+    }
+    auto meshEnd = std::chrono::high_resolution_clock::now();
+
+    // Dynamic bodies against the terrain heightfield
+    if (terrain) {
+        for (size_t i = 0; i < count; ++i) {
+            if (resolveTerrainCollision(i, terrain)) {
+                supported[i] = 1;
+            }
+        }
+    }
+    auto terrainEnd = std::chrono::high_resolution_clock::now();
+
+    updateSleeping();
+
+    stats.pairTests = broadPhase.getPairTests();
+    stats.candidatePairs = pairs.size();
+    stats.islands = islandCount;
+    stats.broadPhaseMs = std::chrono::duration<float, std::milli>(broadEnd - start).count();
+    stats.narrowPhaseMs = std::chrono::duration<float, std::milli>(narrowEnd - broadEnd).count();
+    stats.meshMs = std::chrono::duration<float, std::milli>(meshEnd - narrowEnd).count();
+    stats.terrainMs = std::chrono::duration<float, std::milli>(terrainEnd - meshEnd).count();
+    stats.allocations = AllocationCounter::getCount() - allocationsStart;
+}
+
+void Collision::markGroupToWake(size_t body) {
+    bodies.isSleeping[body] = 0;
+    bodies.sleepTimer[body] = 0.0f;
+    int group = bodies.sleepGroup[body];
+    if (group >= 0 && static_cast<size_t>(group) < groupsToWake.size() && !groupsToWake[group]) {
+        groupsToWake[group] = 1;
+        markedGroups.push_back(group);
+    }
+    bodies.sleepGroup[body] = -1;
+}
+
+// Wake the sleeping bodies of every group marked since the last call
+void Collision::wakeMarkedGroups() {
+    if (markedGroups.empty()) return;
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        int group = bodies.sleepGroup[i];
+        if (group >= 0 && static_cast<size_t>(group) < groupsToWake.size() && groupsToWake[group]) {
+            bodies.isSleeping[i] = 0;
+            bodies.sleepTimer[i] = 0.0f;
+            bodies.sleepGroup[i] = -1;
+        }
+    }
+    for (size_t k = 0; k < markedGroups.size(); ++k) {
+        groupsToWake[markedGroups[k]] = 0;
     }
+    markedGroups.clear();
+}
+
+// A body slower than sleepVelocity with something under it builds up rest time.
+// Islands sleep as a whole once their least rested body reaches timeToSleep,
+// so a stack never sleeps with one of its bodies still moving
+void Collision::updateSleeping() {
+    size_t count = bodies.size();
+    float sleepSpeed = sleepVelocity * sleepVelocity;
+    islandSleepTimer.assign(count, std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!bodies.collisionEnabled[i] || bodies.isStatic[i] || bodies.isSleeping[i]) continue;
+        if (supported[i] && glm::dot(bodies.velocity[i], bodies.velocity[i]) < sleepSpeed) {
+            bodies.sleepTimer[i] += deltaTime;
+        } else {
+            bodies.sleepTimer[i] = 0.0f;
+        }
+        size_t root = findIsland(i);
+        islandSleepTimer[root] = std::min(islandSleepTimer[root], bodies.sleepTimer[i]);
+    }
+
+    stats.awakeBodies = 0;
+    stats.sleepingBodies = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!bodies.collisionEnabled[i] || bodies.isStatic[i]) continue;
+        if (!bodies.isSleeping[i]) {
+            size_t root = findIsland(i);
+            if (islandSleepTimer[root] < timeToSleep) {
+                stats.awakeBodies++;
+                continue;
+            }
+            bodies.isSleeping[i] = -1;
+            bodies.velocity[i] = glm::vec3(0.0f);
+            bodies.sleepGroup[i] = static_cast<int>(root);
+        }
+        stats.sleepingBodies++;
+    }
+}
 
-    // Then resolve collisions
+void Collision::gatherStatics() {
+    staticPrimitives.clear();
+    staticBodies.clear();
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (bodies.isStatic[i] && bodies.collisionEnabled[i]) {
+            staticPrimitives.push_back(bodies.owner[i]);
+            staticBodies.push_back(i);
+        }
+    }
+}
+
+// Slab test of the box center against the target grown by the box half extents
+bool Collision::sweepBox(const glm::vec3& center, const glm::vec3& halfExtents, const glm::vec3& displacement,
+                         const Primitives::Hitbox& target, float& timeOfImpact, glm::vec3& normal) {
+    glm::vec3 expandedMin = target.min - halfExtents;
+    glm::vec3 expandedMax = target.max + halfExtents;
+
+    float entry = -std::numeric_limits<float>::max();
+    float exit = std::numeric_limits<float>::max();
+    int entryAxis = -1;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (std::abs(displacement[axis]) < 1e-8f) {
+            // Not moving on this axis, must already be inside the slab
+            if (center[axis] < expandedMin[axis] || center[axis] > expandedMax[axis]) return false;
+            continue;
+        }
+        float inverse = 1.0f / displacement[axis];
+        float tNear = (expandedMin[axis] - center[axis]) * inverse;
+        float tFar = (expandedMax[axis] - center[axis]) * inverse;
+        if (tNear > tFar) std::swap(tNear, tFar);
+        if (tNear > entry) {
+            entry = tNear;
+            entryAxis = axis;
+        }
+        exit = std::min(exit, tFar);
+        if (entry > exit) return false;
+    }
+
+    // Already overlapping (the discrete resolution handles it) or hit after this move
+    if (entryAxis < 0 || entry < 0.0f || entry > 1.0f) return false;
+
+    timeOfImpact = entry;
+    normal = glm::vec3(0.0f);
+    normal[entryAxis] = displacement[entryAxis] > 0.0f ? -1.0f : 1.0f;
+    return true;
+}
+
+// Samples the path once per terrain cell, then refines the first crossing by bisection
+bool Collision::sweepTerrain(const glm::vec3& start, const glm::vec3& displacement, float& timeOfImpact, glm::vec3& normal) {
+    if (!terrain) return false;
+
+    float startHeight;
+    glm::vec3 startNormal;
+    // Starting under the ground is left to the discrete terrain check
+    if (terrain->getHeightAndNormal(start.x, start.z, startHeight, startNormal) && start.y <= startHeight) {
+        return false;
+    }
+
+    float horizontal = std::sqrt(displacement.x * displacement.x + displacement.z * displacement.z);
+    int samples = std::max(1, static_cast<int>(std::ceil(horizontal)));
+
+    float previous = 0.0f;
+    for (int i = 1; i <= samples; ++i) {
+        float t = static_cast<float>(i) / samples;
+        glm::vec3 point = start + displacement * t;
+        float terrainHeight;
+        glm::vec3 terrainNormal;
+        if (!terrain->getHeightAndNormal(point.x, point.z, terrainHeight, terrainNormal) || point.y > terrainHeight) {
+            previous = t;
+            continue;
+        }
+
+        // Crossing between previous and t
+        float low = previous;
+        float high = t;
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float middle = 0.5f * (low + high);
+            glm::vec3 middlePoint = start + displacement * middle;
+            float middleHeight;
+            glm::vec3 middleNormal;
+            if (terrain->getHeightAndNormal(middlePoint.x, middlePoint.z, middleHeight, middleNormal) && middlePoint.y <= middleHeight) {
+                high = middle;
+            } else {
+                low = middle;
+            }
+        }
+        glm::vec3 hitPoint = start + displacement * low;
+        float hitHeight;
+        if (!terrain->getHeightAndNormal(hitPoint.x, hitPoint.z, hitHeight, normal)) {
+            normal = terrainNormal;
+        }
+        timeOfImpact = low;
+        return true;
+    }
+    return false;
+}
+
+// A move shorter than a fraction of the body can't skip over anything
+bool Collision::isLongMove(const glm::vec3& displacement, const glm::vec3& halfExtents) const {
+    float smallestHalf = std::min(halfExtents.x, std::min(halfExtents.y, halfExtents.z));
+    float limit = sweepThreshold * smallestHalf;
+    return glm::dot(displacement, displacement) > limit * limit;
+}
+
+void Collision::moveSwept(glm::vec3& position, glm::vec3& velocity, const glm::vec3& halfExtents) {
+    glm::vec3 displacement = velocity * deltaTime;
+    if (!isLongMove(displacement, halfExtents)) {
+        position += displacement;
+        return;
+    }
+
+    stats.sweeps++;
+    float timeOfImpact = 1.0f;
+    glm::vec3 normal(0.0f);
+    bool hit = false;
+
+    for (size_t i = 0; i < staticBodies.size(); ++i) {
+        float t;
+        glm::vec3 n;
+        if (sweepBox(position, halfExtents, displacement, getBounds(staticBodies[i]), t, n) && t < timeOfImpact) {
+            timeOfImpact = t;
+            normal = n;
+            hit = true;
+        }
+    }
+
+    float t;
+    glm::vec3 n;
+    glm::vec3 bottom = position - glm::vec3(0.0f, halfExtents.y, 0.0f);
+    if (sweepTerrain(bottom, displacement, t, n) && t < timeOfImpact) {
+        timeOfImpact = t;
+        normal = n;
+        hit = true;
+    }
+
+    if (!hit) {
+        position += displacement;
+        return;
+    }
+
+    // Stop at the contact and keep only the velocity along the surface
+    stats.sweepHits++;
+    position += displacement * timeOfImpact + normal * 0.001f;
+    float into = glm::dot(velocity, normal);
+    if (into < 0.0f) {
+        velocity -= into * normal;
+    }
+}
+
+// Seen from b, a moved by the difference of their moves: sweeping a's start box
+// by it against b's start box gives the time they touched. Both go back there,
+// a hair apart, and lose the velocity going into each other like a discrete
+// dynamic contact. Only the two dynamic bodies of the pair are written
+bool Collision::resolveSweptPair(size_t a, size_t b) {
+    if (bodies.isStatic[a] || bodies.isStatic[b] || !bodies.collisionEnabled[a] || !bodies.collisionEnabled[b]) return false;
+
+    glm::vec3 moveA = bodies.position[a] - tickStart[a];
+    glm::vec3 moveB = bodies.position[b] - tickStart[b];
+    Primitives::Hitbox startB = { tickStart[b] - bodies.halfExtents[b], tickStart[b] + bodies.halfExtents[b] };
+    float timeOfImpact;
+    glm::vec3 normal;  // from b to a
+    if (!sweepBox(tickStart[a], bodies.halfExtents[a], moveA - moveB, startB, timeOfImpact, normal)) return false;
+
+    bodies.position[a] = tickStart[a] + moveA * timeOfImpact + normal * 0.001f;
+    bodies.position[b] = tickStart[b] + moveB * timeOfImpact - normal * 0.001f;
+    slideAlongSurface(bodies.velocity[a], normal);
+    slideAlongSurface(bodies.velocity[b], -normal);
+    bodies.updateBounds(a);
+    bodies.updateBounds(b);
+    return true;
+}
+
+// Fixed timestep loop: the frame time is accumulated and consumed in ticks of
+// deltaTime so the simulation runs at the same speed whatever the frame rate.
+// When a frame needs more than maxStepsPerFrame ticks the extra time is dropped
+// so a slow frame can't make the next one even slower.
+int Collision::step(float frameTime, std::vector<Primitives*>& primitives, Player* player) {
+    accumulator += frameTime;
+
+    int steps = 0;
+    while (accumulator >= deltaTime && steps < maxStepsPerFrame) {
+        bodies.sync(primitives);
+        bodies.previousPosition = bodies.position;
+        update(primitives);
+        updatePlayer(player, primitives);
+        accumulator -= deltaTime;
+        steps++;
+    }
+
+    stats.droppedSteps = 0;
+    if (accumulator >= deltaTime) {
+        stats.droppedSteps = static_cast<int>(accumulator / deltaTime);
+        accumulator -= stats.droppedSteps * deltaTime;
+    }
+    stats.steps = steps;
+
+    // Draw the primitives between the last two ticks
+    float alpha = accumulator / deltaTime;
     for (size_t i = 0; i < primitives.size(); ++i) {
-        for (size_t j = i + 1; j < primitives.size(); ++j) {
-            resolveCollision(primitives[i], primitives[j]);
+        primitives[i]->interpolate(alpha);
+    }
+    return steps;
+}
+
+void Collision::setTickRate(float ticksPerSecond) {
+    if (ticksPerSecond > 0.0f) {
+        deltaTime = 1.0f / ticksPerSecond;
+    }
+}
+
+float Collision::getTickRate() const {
+    return 1.0f / deltaTime;
+}
+
+void Collision::setMaxStepsPerFrame(int maxSteps) {
+    maxStepsPerFrame = std::max(1, maxSteps);
+}
+
+void Collision::setSolverThreads(unsigned int threadCount) {
+    solverThreads = threadCount;
+}
+
+unsigned int Collision::getSolverThreads() const {
+    return std::min(solverThreads, WorkerPool::shared().getThreadCount());
+}
+
+size_t Collision::findIsland(size_t body) {
+    while (islandParent[body] != body) {
+        islandParent[body] = islandParent[islandParent[body]];  // path halving
+        body = islandParent[body];
+    }
+    return body;
+}
+
+// Group the candidate pairs by island, keeping their sorted order inside each island.
+// The vectors only grow, so a steady frame doesn't allocate
+void Collision::buildIslands() {
+    const std::vector<std::pair<size_t, size_t>>& pairs = broadPhase.getPairs();
+    size_t count = bodies.size();
+
+    // Only the bodies of the last build's pairs were linked or numbered, putting
+    // them back is enough and keeps this from walking every body each tick
+    if (islandParent.size() != count) {
+        islandParent.resize(count);
+        islandOfRoot.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            islandParent[i] = i;
+            islandOfRoot[i] = SIZE_MAX;
+        }
+    } else {
+        for (size_t k = 0; k < islandBodies.size(); ++k) {
+            islandParent[islandBodies[k]] = islandBodies[k];
+            islandOfRoot[islandBodies[k]] = SIZE_MAX;
+        }
+    }
+    islandBodies.clear();
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        islandBodies.push_back(pairs[i].first);
+        islandBodies.push_back(pairs[i].second);
+    }
+
+    // Link the dynamic bodies touching each other, static ones stay apart
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        size_t a = pairs[i].first;
+        size_t b = pairs[i].second;
+        if (!bodies.isStatic[a] && !bodies.isStatic[b]) {
+            size_t rootA = findIsland(a);
+            size_t rootB = findIsland(b);
+            if (rootA != rootB) {
+                islandParent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+            }
+        }
+    }
+
+    // Number the islands in order of their first pair and count their pairs
+    islandCount = 0;
+    islandPairStart.clear();
+    islandPairs.resize(pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        size_t body = bodies.isStatic[pairs[i].first] ? pairs[i].second : pairs[i].first;
+        size_t root = findIsland(body);
+        if (islandOfRoot[root] == SIZE_MAX) {
+            islandOfRoot[root] = islandCount++;
+            islandPairStart.push_back(0);
         }
+        islandPairStart[islandOfRoot[root]]++;
     }
+
+    // Counts to offsets, then place the pairs
+    size_t offset = 0;
+    for (size_t island = 0; island < islandCount; ++island) {
+        size_t pairCount = islandPairStart[island];
+        islandPairStart[island] = offset;
+        offset += pairCount;
+    }
+    islandPairStart.push_back(offset);
+    islandContacts.resize(islandCount);
+
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        size_t body = bodies.isStatic[pairs[i].first] ? pairs[i].second : pairs[i].first;
+        size_t island = islandOfRoot[findIsland(body)];
+        // islandPairStart[island] is used as a cursor, then restored below
+        islandPairs[islandPairStart[island]++] = i;
+    }
+    for (size_t island = islandCount; island > 0; --island) {
+        islandPairStart[island] = islandPairStart[island - 1];
+    }
+    islandPairStart[0] = 0;
+
+    // Most islands are a pair or two, a job takes islands until it has enough
+    // pairs to be worth handing to a worker
+    islandJobStart.clear();
+    islandJobStart.push_back(0);
+    for (size_t island = 0; island < islandCount; ++island) {
+        if (islandPairStart[island + 1] - islandPairStart[islandJobStart.back()] >= minPairsPerJob) {
+            islandJobStart.push_back(island + 1);
+        }
+    }
+    if (islandJobStart.back() != islandCount) islandJobStart.push_back(islandCount);
 }
 
 bool Collision::checkPlayerCollision(Player* player, Primitives* primitive) {
-    if (!player->collisionEnabled || !primitive->collisionEnabled) {
+    if (!player->collisionEnabled || !primitive->isCollisionEnabled()) {
         return false;  // If collision is disabled for either object, no collision
     }
 
@@ -142,10 +717,10 @@ bool Collision::checkPlayerCollision(Player* player, Primitives* primitive) {
     primitive->updateHitbox();
 
     // Use the updated hitboxes to check for overlap
-    glm::vec3 playerMin = player->hitbox.min;
-    glm::vec3 playerMax = player->hitbox.max;
-    glm::vec3 primMin = primitive->hitbox.min;
-    glm::vec3 primMax = primitive->hitbox.max;
+    glm::vec3 playerMin = player->getHitbox().min;
+    glm::vec3 playerMax = player->getHitbox().max;
+    glm::vec3 primMin = primitive->getHitbox().min;
+    glm::vec3 primMax = primitive->getHitbox().max;
 
     // Check for overlap
     bool collisionDetected = (playerMin.x <= primMax.x && playerMax.x >= primMin.x) &&
@@ -169,38 +744,46 @@ void Collision::resolvePlayerCollision(Player* player, Primitives* primitive) {
 
     glm::vec3 overlap;
     // Use the hitboxes for calculations
-    glm::vec3 playerMin = player->hitbox.min;
-    glm::vec3 playerMax = player->hitbox.max;
-    glm::vec3 primMin = primitive->hitbox.min;
-    glm::vec3 primMax = primitive->hitbox.max;
+    Primitives::Hitbox playerBox = player->getHitbox();
+    Primitives::Hitbox primBox = primitive->getHitbox();
+    glm::vec3 playerMin = playerBox.min;
+    glm::vec3 playerMax = playerBox.max;
+    glm::vec3 primMin = primBox.min;
+    glm::vec3 primMax = primBox.max;
 
     // Compute overlap on each axis
     overlap.x = std::min(playerMax.x, primMax.x) - std::max(playerMin.x, primMin.x);
     overlap.y = std::min(playerMax.y, primMax.y) - std::max(playerMin.y, primMin.y);
     overlap.z = std::min(playerMax.z, primMax.z) - std::max(playerMin.z, primMin.z);
 
-    glm::vec3 normal = calculateNormal(player, primitive);
+    glm::vec3 normal = calculateNormal(playerBox, primBox);
 
     if (overlap.y < overlap.x && overlap.y < overlap.z) {
         player->position.y = primMax.y + player->scale.y / 2.0f;  // Move player out of primitive
         player->velocity.y = 0.0f; // Stop downward movement
-        slideAlongSurface(player, normal); // Slide the player along the surface
+        slideAlongSurface(player->velocity, normal); // Slide the player along the surface
     } else if (overlap.x < overlap.z) {
         player->position.x += (primMax.x < player->position.x) ? overlap.x : -overlap.x;
-        slideAlongSurface(player, normal);
+        slideAlongSurface(player->velocity, normal);
     } else {
         player->position.z += (primMax.z < player->position.z) ? overlap.z : -overlap.z;
-        slideAlongSurface(player, normal);
+        slideAlongSurface(player->velocity, normal);
     }
 }
 
 // Update function: Apply gravity and check collisions between the player and all primitives
-void Collision::updatePlayer(Player* player, std::vector<Primitives*>& primitives, std::vector<glm::vec3> vertices) {
+void Collision::updatePlayer(Player* player, std::vector<Primitives*>& primitives) {
+    size_t allocationsStart = AllocationCounter::getCount();
+    bodies.sync(primitives);
+    gatherStatics();
+
     // Apply gravity to the player
     applyGravity(player);
     
     // Check collision with terrain
-    bool onGround = checkPlayerTerrainCollision(player, terrain, vertices);
+    auto start = std::chrono::high_resolution_clock::now();
+    bool onGround = checkPlayerTerrainCollision(player, terrain);
+    stats.terrainMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 
     // If the player is grounded, reset jump state
     if (onGround) {
@@ -212,6 +795,18 @@ void Collision::updatePlayer(Player* player, std::vector<Primitives*>& primitive
     for (size_t i = 0; i < primitives.size(); ++i) {
         resolvePlayerCollision(player, primitives[i]);
     }
+
+    // Then with the static model meshes
+    if (player->collisionEnabled && queryGeometry.getTriangleCount() > 0) {
+        auto meshStart = std::chrono::high_resolution_clock::now();
+        if (resolveMeshCollision(player->position, player->velocity, player->scale / 2.0f, nullptr, glm::mat4(1.0f))) {
+            player->updateHitbox();
+            PlayerCollidingWithPrimitives = true;  // lets the player jump off models too
+        }
+        stats.meshMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - meshStart).count();
+    }
+
+    stats.allocations += AllocationCounter::getCount() - allocationsStart;
 }
 
 // Update gravity for player (added to support gravity application)
@@ -219,76 +814,171 @@ void Collision::applyGravity(Player* player) {
     if (player->collisionEnabled && !player->isStatic) {
         // Gravity affects the player's velocity over time if they're dynamic
         player->velocity += gravity * deltaTime;
-        player->position += player->velocity * deltaTime;
+        moveSwept(player->position, player->velocity, player->scale / 2.0f);
         // Update the player's hitbox
         player->updateHitbox();
     }
 }
 
 
-//maybe take juste surrounding of the player for the collision
-bool Collision::checkPlayerTerrainCollision(Player* player, Terrain* terrain, std::vector<glm::vec3> vertices) {
-    if (!player->collisionEnabled) return false;
+// Player against the terrain, using the heightfield cell under the player
+bool Collision::checkPlayerTerrainCollision(Player* player, Terrain* terrain) {
+    PlayerCollidingWithTerrain = false;
+    if (!player->collisionEnabled || !terrain) return false;
 
     // Update the player's hitbox
     player->updateHitbox();
 
-    // Define a search radius based on player size or desired sensitivity
-    float searchRadius = player->scale.x * 1.5f;  // Adjust as necessary
     float collisionTolerance = 0.1f;              // Small buffer for collision height tolerance
 
-    // Variables for weighted height calculation
-    float weightedHeightSum = 0.0f;
-    float weightSum = 0.0f;
-    float closestDistanceSquared = std::numeric_limits<float>::max();
-    glm::vec3 closestVertex(0.0f);
-
-    // Loop over terrain vertices to check those within the search radius
-    for (const auto& terrainVertex : vertices) {
-        float distanceX = player->position.x - terrainVertex.x;
-        float distanceZ = player->position.z - terrainVertex.z;
-        float distanceSquared = distanceX * distanceX + distanceZ * distanceZ;
-
-        if (distanceSquared <= searchRadius * searchRadius) {
-            // Use the inverse of the distance as a weight (closer vertices have more influence)
-            float weight = 1.0f / (distanceSquared + 0.001f);  // Small offset to avoid division by zero
-            weightedHeightSum += terrainVertex.y * weight;
-            weightSum += weight;
-
-            // Track the closest vertex for additional height accuracy
-            if (distanceSquared < closestDistanceSquared) {
-                closestDistanceSquared = distanceSquared;
-                closestVertex = terrainVertex;
-            }
-        }
+    float terrainHeight;
+    glm::vec3 terrainNormal;
+    stats.terrainQueries++;
+    if (!terrain->getHeightAndNormal(player->position.x, player->position.z, terrainHeight, terrainNormal)) {
+        return false;  // Player is outside the terrain
     }
 
-    if (weightSum > 0.0f) {
-        // Calculate the weighted average height based on surrounding vertices
-        float interpolatedHeight = weightedHeightSum / weightSum;
+    // Check if the player's height is within the tolerance range of the terrain height
+    if (player->position.y <= terrainHeight + player->scale.y / 2 + collisionTolerance &&
+        player->position.y >= terrainHeight - player->scale.y / 2) {
 
-        // Use a more advanced method to blend the heights
-        float blendedHeight = 0.7f * interpolatedHeight + 0.3f * closestVertex.y;
+        // Collision detected: put the player back on top of the terrain
+        player->position.y = terrainHeight + player->scale.y / 2 + collisionTolerance;
+        player->velocity.y = 0.0f;  // Stop downward movement
+        player->updateHitbox();
 
-        // Check if the player's height is within the tolerance range of this blended height
-        if (player->position.y <= blendedHeight + player->scale.y / 2 + collisionTolerance &&
-            player->position.y >= blendedHeight - player->scale.y / 2) {
+        PlayerCollidingWithTerrain = true;  // Collision detected
+        return true;  // Collision detected
+    }
+    return false;  // No collision detected
+}
 
-            // Collision detected: set player’s position smoothly to the blended height
-            player->position.y = blendedHeight + player->scale.y / 2 + collisionTolerance;
-            player->velocity.y = 0.0f;  // Stop downward movement
+// Dynamic primitive against the terrain, the hitbox bottom is kept above the ground
+bool Collision::resolveTerrainCollision(size_t body, Terrain* terrain) {
+    if (!bodies.collisionEnabled[body] || bodies.isStatic[body] || bodies.isSleeping[body] || !terrain) return false;
 
-            // Optionally adjust the player's position slightly based on distance from the terrain
-            float deltaY = player->position.y - blendedHeight;
-            if (std::abs(deltaY) < collisionTolerance) {
-                player->position.y -= deltaY * 0.5f;  // Adjust position slightly to smooth it out
-            }
-            PlayerCollidingWithTerrain = true;  // Collision detected
-            return true;  // Collision detected
+    float terrainHeight;
+    glm::vec3 terrainNormal;
+    stats.terrainQueries++;
+    glm::vec3& position = bodies.position[body];
+    if (!terrain->getHeightAndNormal(position.x, position.z, terrainHeight, terrainNormal)) {
+        return false;
+    }
+
+    float bottom = bodies.minY[body];
+    if (bottom > terrainHeight) return false;
+
+    position.y += terrainHeight - bottom;
+    slideAlongSurface(bodies.velocity[body], terrainNormal);  // Remove the velocity going into the ground
+    bodies.updateBounds(body);
+    return true;
+}
+
+bool Collision::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, QueryHit& hit) const {
+    QueryRay ray = {origin, direction, maxDistance};
+    return queryGeometry.raycast(ray, hit);
+}
+
+bool Collision::sphereCast(const glm::vec3& origin, float radius, const glm::vec3& direction, float maxDistance, QueryHit& hit) const {
+    QueryRay ray = {origin, direction, maxDistance};
+    return queryGeometry.sphereCast(ray, radius, hit);
+}
+
+size_t Collision::overlapBox(const glm::vec3& min, const glm::vec3& max, std::vector<QueryHit>& results) const {
+    return queryGeometry.overlapBox(min, max, results);
+}
+
+bool Collision::closestPoint(const glm::vec3& point, float maxDistance, QueryHit& hit) const {
+    return queryGeometry.closestPoint(point, maxDistance, hit);
+}
+
+// Rays are handed out in chunks so a job is worth the scheduling
+void Collision::raycastBatch(const std::vector<QueryRay>& rays, std::vector<QueryHit>& hits) {
+    const size_t chunkSize = 64;
+    hits.resize(rays.size());
+    size_t chunks = (rays.size() + chunkSize - 1) / chunkSize;
+    WorkerPool::shared().parallelFor(chunks, [this, &rays, &hits, chunkSize](size_t chunk) {
+        size_t end = std::min(rays.size(), (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; ++i) {
+            queryGeometry.raycast(rays[i], hits[i]);
+        }
+    }, solverThreads);
+}
+
+int Collision::addStaticMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                             const glm::mat4& transform) {
+    queryTreeDirty = true;
+    return queryGeometry.addMesh(positions, indices, transform);
+}
+
+int Collision::addStaticMesh(const CollisionMesh& mesh, const glm::mat4& transform) {
+    queryTreeDirty = true;
+    return queryGeometry.addMesh(mesh, transform);
+}
+
+bool Collision::resolveMeshCollision(glm::vec3& position, glm::vec3& velocity, const glm::vec3& halfExtents,
+                                     const std::vector<glm::vec3>* hull, const glm::mat4& hullTransform) {
+    stats.meshQueries++;
+    meshOverlaps.clear();
+    queryGeometry.overlapBox(position - halfExtents, position + halfExtents, meshOverlaps);
+
+    // Points that can touch a triangle, relative to position
+    meshSupport.clear();
+    if (hull) {
+        for (size_t k = 0; k < hull->size(); ++k) {
+            meshSupport.push_back(glm::vec3(hullTransform * glm::vec4((*hull)[k], 1.0f)));
+        }
+    } else {
+        for (int corner = 0; corner < 8; ++corner) {
+            meshSupport.push_back(glm::vec3(corner & 1 ? halfExtents.x : -halfExtents.x,
+                                            corner & 2 ? halfExtents.y : -halfExtents.y,
+                                            corner & 4 ? halfExtents.z : -halfExtents.z));
         }
     }
-    PlayerCollidingWithTerrain = false;  // Collision detected
-    return false;  // No collision detected
+
+    bool touched = false;
+    for (size_t i = 0; i < meshOverlaps.size(); ++i) {
+        const QueryHit& contact = meshOverlaps[i];
+        if (contact.mesh < 0) continue;  // static primitives and terrain have their own passes
+        glm::vec3 normal = contact.normal;
+        if (!(glm::dot(normal, normal) > 0.5f)) continue;  // degenerate triangle
+
+        // Meshes are two sided, push towards the side the center is on
+        if (glm::dot(position - contact.point, normal) < 0.0f) normal = -normal;
+
+        float depth = 0.0f;
+        for (size_t k = 0; k < meshSupport.size(); ++k) {
+            depth = std::max(depth, glm::dot(contact.point - (position + meshSupport[k]), normal));
+        }
+        if (depth <= 0.0f) continue;
+
+        position += normal * depth;
+        float into = glm::dot(velocity, normal);
+        if (into < 0.0f) {
+            velocity -= into * normal;  // slide along the triangle
+        }
+        stats.meshContacts++;
+        touched = true;
+    }
+    return touched;
+}
+
+void Collision::refitTerrain(int rowBegin, int rowEnd, int columnBegin, int columnEnd) {
+    if (!terrain || rowBegin >= rowEnd || columnBegin >= columnEnd) return;
+    // A rebuild is already coming, it will pick up the new heights
+    if (!queryTreeDirty && terrain == queryGeometry.getTerrain()) {
+        queryGeometry.refitTerrain(rowBegin, rowEnd, columnBegin, columnEnd);
+    }
+    float rowOffset = terrain->getTerrainHeight() / 2.0f;
+    float columnOffset = terrain->getTerrainWidth() / 2.0f;
+    terrainEdits.push_back(glm::vec4(rowBegin - 1 - rowOffset, rowEnd - rowOffset, columnBegin - 1 - columnOffset, columnEnd - columnOffset));
+}
+
+void Collision::buildQueryTree(const std::vector<Primitives*>& primitives) {
+    bodies.sync(primitives);
+    gatherStatics();
+    queryGeometry.build(staticPrimitives, terrain);
+    queryTreeDirty = false;
 }
 
 bool Collision::getCollisionWithPlayerwithPrimitives() {
@@ -297,4 +987,8 @@ bool Collision::getCollisionWithPlayerwithPrimitives() {
 
 bool Collision::getCollisionWithPlayerwithTerrain() {
     return PlayerCollidingWithTerrain;
+}
+
+const Collision::Stats& Collision::getStats() const {
+    return stats;
 }
\ No newline at end of file
@@ -4,7 +4,11 @@
 #include "../primitives/primitives.h"
 #include "../player/player.h"
 #include "../world_objects/terrain.h"
+#include "broadphase.h"
+#include "staticGeometry.h"
+#include "../threading/workerPool.h"
 #include <vector>
+#include <cstdint>
 #include <glm/glm.hpp>
 
 class Player;  // Forward declaration
@@ -12,43 +16,195 @@ class Player;  // Forward declaration
 class Collision {
 public:
     glm::vec3 gravity;  // Gravity vector (e.g., glm::vec3(0.0f, -9.81f, 0.0f))
-    float deltaTime;     // Time step for simulation
+    float deltaTime;     // Fixed time step of one physics tick
+    int maxStepsPerFrame; // Ticks allowed per frame before dropping time
+    float sweepThreshold; // Fraction of the smallest half extent a body may move per tick before it is swept
+    float sleepVelocity;  // Speed under which a body counts as resting
+    float timeToSleep;    // Seconds a whole island must rest before it is put to sleep
     //terrain
     Terrain* terrain;
 
+    // Counters of the last update, to measure the broad phase
+    struct Stats {
+        size_t primitives;      // primitives in the scene
+        size_t bruteForcePairs; // pairs the old n^2 loop would have tested
+        size_t pairTests;       // AABB tests done by the broad phase sweep
+        size_t candidatePairs;  // overlapping pairs sent to the narrow phase
+        size_t contacts;        // pairs that were actually resolved
+        size_t islands;         // groups of touching dynamic primitives solved in parallel
+        size_t terrainQueries;  // heightfield lookups for primitives and player
+        size_t allocations;     // heap allocations made by update and updatePlayer on the calling thread
+        size_t sweeps;          // fast moves checked with a swept test
+        size_t sweepHits;       // swept moves stopped at the time of impact
+        size_t meshQueries;     // primitive and player boxes checked against the static meshes
+        size_t meshContacts;    // mesh triangles they were pushed out of
+        float meshMs;
+        size_t awakeBodies;     // dynamic primitives simulated by the last update
+        size_t sleepingBodies;  // dynamic primitives skipped until something wakes them
+        int steps;              // physics ticks run by the last step() call
+        int droppedSteps;       // ticks skipped because of maxStepsPerFrame
+        float broadPhaseMs;
+        float narrowPhaseMs;
+        float terrainMs;
+    };
+
     // Constructor to initialize gravity and deltaTime
     Collision(glm::vec3 g = glm::vec3(0.0f, -9.81f, 0.0f), float dt = 0.016f);
 
     // Check for collision between two primitives (simplified AABB bounding box collision)
     bool checkCollision(Primitives* a, Primitives* b);
 
-    // Resolve collision between two primitives by modifying their velocities
-    void resolveCollision(Primitives* a, Primitives* b);
+    // Resolve collision between two bodies of the store by modifying their velocities
+    // Returns false if they were not overlapping
+    bool resolveCollision(size_t a, size_t b);
 
-    // Apply gravity to a primitive, modifying its velocity and position
-    void applyGravity(Primitives* primitive);
+    // Apply gravity to a body of the store, modifying its velocity and position
+    void applyGravity(size_t body);
     void applyGravity(Player* player);
 
-    // Update method to apply gravity and resolve collisions between all primitives
+    // Update method to apply gravity and resolve collisions between all primitives.
+    // Their physics state moves into the body store (primitive i is body i) and
+    // stays there, their accessors read it from there
     void update(std::vector<Primitives*>& primitives);
 
+    // Advance the simulation by the frame time with fixed ticks of deltaTime,
+    // then interpolate the primitives render positions. Returns the ticks run
+    int step(float frameTime, std::vector<Primitives*>& primitives, Player* player);
+
+    // Physics tick rate in Hz
+    void setTickRate(float ticksPerSecond);
+    float getTickRate() const;
+    void setMaxStepsPerFrame(int maxSteps);
+
+    // Workers of the shared pool that help solve the islands, 0 solves on the calling thread
+    void setSolverThreads(unsigned int threadCount);
+    unsigned int getSolverThreads() const;
+
 
 
     // Function to check and resolve player collisions
     bool checkPlayerCollision(Player* player, Primitives* primitive);
     void resolvePlayerCollision(Player* player, Primitives* primitive);
-    void updatePlayer(Player* player, std::vector<Primitives*>& primitives, std::vector<glm::vec3> vertices);
+    void updatePlayer(Player* player, std::vector<Primitives*>& primitives);
+
+    bool checkPlayerTerrainCollision(Player* player, Terrain* terrain);
+
+    // Keep a dynamic body above the terrain heightfield
+    bool resolveTerrainCollision(size_t body, Terrain* terrain);
+
+    // Time of impact in [0, 1] of a box (center, half extents) moving by displacement
+    // against a static box, returns false if it doesn't hit it during the move
+    static bool sweepBox(const glm::vec3& center, const glm::vec3& halfExtents, const glm::vec3& displacement,
+                         const Primitives::Hitbox& target, float& timeOfImpact, glm::vec3& normal);
 
-    bool checkPlayerTerrainCollision(Player* player, Terrain* terrain, std::vector<glm::vec3> vertices);
+    // Time of impact of a point moving by displacement against the terrain heightfield
+    bool sweepTerrain(const glm::vec3& start, const glm::vec3& displacement, float& timeOfImpact, glm::vec3& normal);
 
 
+    // Scene queries against the static geometry: static primitives, meshes added
+    // with addStaticMesh and the terrain. They only read the query tree and can
+    // be made from several threads at once, but not while update() rebuilds it
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, QueryHit& hit) const;
+    bool sphereCast(const glm::vec3& origin, float radius, const glm::vec3& direction, float maxDistance, QueryHit& hit) const;
+    size_t overlapBox(const glm::vec3& min, const glm::vec3& max, std::vector<QueryHit>& results) const;
+    bool closestPoint(const glm::vec3& point, float maxDistance, QueryHit& hit) const;
+
+    // Cast all the rays on the solver threads, hits[i] answers rays[i]
+    void raycastBatch(const std::vector<QueryRay>& rays, std::vector<QueryHit>& hits);
+
+    // Add a static triangle mesh to the queries, returns its id (QueryHit::mesh)
+    int addStaticMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                      const glm::mat4& transform);
+    int addStaticMesh(const CollisionMesh& mesh, const glm::mat4& transform);
+
+    // Terrain heights changed in rows [rowBegin, rowEnd) and columns [columnBegin,
+    // columnEnd) of its grid: refit the query tree there and wake the bodies
+    // sleeping over that part on the next update
+    void refitTerrain(int rowBegin, int rowEnd, int columnBegin, int columnEnd);
+
+    // Rebuild the query tree. update() does it when static primitives are added
+    // or removed or the terrain changes, call it after moving a static primitive
+    void buildQueryTree(const std::vector<Primitives*>& primitives);
+
     bool getCollisionWithPlayerwithPrimitives();
     bool getCollisionWithPlayerwithTerrain();
 
+    const Stats& getStats() const;
+
 private:
 
-    glm::vec3 calculateNormal(Primitives* a, Primitives* b);
-    void slideAlongSurface(Primitives* moving, glm::vec3 normal);
+    BodyStore bodies;
+    BroadPhase broadPhase;
+    Stats stats;
+    float accumulator;  // Frame time not yet simulated
+
+    // Contact islands: dynamic primitives linked by a candidate pair end up in
+    // the same island. Islands share nothing but static primitives, which
+    // are only read, so they can be solved on different threads and each
+    // island still resolves its pairs in the same order as a single thread.
+    unsigned int solverThreads;           // most workers of WorkerPool::shared() an update uses
+    std::vector<size_t> islandParent;     // union-find over the bodies
+    std::vector<size_t> islandOfRoot;     // island index of each union-find root
+    std::vector<size_t> islandPairStart;  // first entry of each island in islandPairs
+    std::vector<size_t> islandPairs;      // candidate pair indices grouped by island
+    std::vector<size_t> islandContacts;   // contacts resolved per island
+    std::vector<size_t> islandJobStart;   // first island of each solver job, islandCount at the end
+    std::vector<size_t> islandBodies;     // bodies of the pairs of the last build, reset by the next
+    size_t islandCount;
+    static const size_t minPairsPerJob = 32;
+
+    // Sleeping: an island resting for timeToSleep is skipped until an awake body
+    // touches it or one of its bodies is moved, then the whole group wakes
+    std::vector<uint8_t> supported;       // resolved against something or the terrain this tick
+    std::vector<uint8_t> groupsToWake;    // sleep groups to wake, indexed by group
+    std::vector<size_t> markedGroups;     // the groups set in groupsToWake
+    std::vector<float> islandSleepTimer;  // shortest rest time of each union-find root
+    std::vector<glm::vec4> terrainEdits;  // x / z ranges (minX, maxX, minZ, maxZ) edited since the last update
+    void markGroupToWake(size_t body);
+    void wakeMarkedGroups();
+    void updateSleeping();
+
+    // BVH answering the scene queries, rebuilt when the static geometry changes
+    StaticGeometry queryGeometry;
+    bool queryTreeDirty;
+
+    // Push a body (center, half extents) out of the static mesh triangles it overlaps.
+    // The deepest of the hull points (model space, hullTransform brings them
+    // relative to position) or of the box corners under each triangle gives
+    // the push. Returns true if it touched a mesh
+    std::vector<QueryHit> meshOverlaps;
+    std::vector<glm::vec3> meshSupport;
+    bool resolveMeshCollision(glm::vec3& position, glm::vec3& velocity, const glm::vec3& halfExtents,
+                              const std::vector<glm::vec3>* hull, const glm::mat4& hullTransform);
+
+    // Static bodies that fast moves are swept against, gathered each tick,
+    // and their primitives for the query tree
+    std::vector<size_t> staticBodies;
+    std::vector<Primitives*> staticPrimitives;
+    void gatherStatics();
+
+    // Move by velocity * deltaTime, stopping at the first static primitive or terrain hit
+    // on the way when the move is long enough to skip over something
+    void moveSwept(glm::vec3& position, glm::vec3& velocity, const glm::vec3& halfExtents);
+    bool isLongMove(const glm::vec3& displacement, const glm::vec3& halfExtents) const;
+
+    // Dynamic bodies against each other: a body making a long move enters the
+    // broad phase with the box covering its whole move, and a candidate pair
+    // whose boxes don't overlap at the end of the tick is swept from where both
+    // started, in the frame of the second one
+    std::vector<glm::vec3> tickStart;  // position of each body before this tick's move
+    std::vector<uint8_t> longMove;     // the move was long enough to be swept
+    bool resolveSweptPair(size_t a, size_t b);
+
+    size_t findIsland(size_t body);
+    void buildIslands();
+
+    // AABB overlap on the bounds in the store, without refreshing them
+    bool overlaps(size_t a, size_t b) const;
+    Primitives::Hitbox getBounds(size_t body) const;
+
+    glm::vec3 calculateNormal(const Primitives::Hitbox& a, const Primitives::Hitbox& b);
+    void slideAlongSurface(glm::vec3& velocity, glm::vec3 normal);
     bool PlayerCollidingWithPrimitives;
     bool PlayerCollidingWithTerrain;
 };
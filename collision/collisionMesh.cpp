@@ -0,0 +1,132 @@
+#include "collisionMesh.h"
+#include "../resources/sourceStamp.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <cstdint>
+
+// Bumped whenever the cooked layout or the cooking changes
+static const uint32_t COLLISION_MESH_MAGIC = 0x4D435244;  // "DRCM"
+static const uint32_t COLLISION_MESH_VERSION = 1;
+
+struct CollisionMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;      // the cache is stale when the source size or
+    int64_t sourceModified;   // modification time doesn't match anymore
+    uint32_t positionCount;
+    uint32_t indexCount;
+    uint32_t hullCount;
+    uint32_t padding;
+};
+
+CollisionMesh::CollisionMesh() : boundsMin(0.0f), boundsMax(0.0f) {}
+
+void CollisionMesh::cook() {
+    hull.clear();
+    if (positions.empty()) {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        return;
+    }
+
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        boundsMin = glm::min(boundsMin, positions[i]);
+        boundsMax = glm::max(boundsMax, positions[i]);
+    }
+
+    // Farthest vertex along the faces, edges and corners of a cube (a 26-DOP),
+    // each vertex kept once
+    std::vector<size_t> extremes;
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            for (int z = -1; z <= 1; ++z) {
+                if (x == 0 && y == 0 && z == 0) continue;
+                glm::vec3 direction(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                size_t best = 0;
+                float bestDistance = -std::numeric_limits<float>::max();
+                for (size_t i = 0; i < positions.size(); ++i) {
+                    float distance = glm::dot(positions[i], direction);
+                    if (distance > bestDistance) {
+                        bestDistance = distance;
+                        best = i;
+                    }
+                }
+                bool known = false;
+                for (size_t k = 0; k < extremes.size() && !known; ++k) {
+                    known = extremes[k] == best;
+                }
+                if (!known) extremes.push_back(best);
+            }
+        }
+    }
+    for (size_t k = 0; k < extremes.size(); ++k) {
+        hull.push_back(positions[extremes[k]]);
+    }
+}
+
+std::string CollisionMesh::getCachePath(const std::string& sourcePath) {
+    return sourcePath + ".colmesh";
+}
+
+bool CollisionMesh::loadCache(const std::string& sourcePath) {
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!SourceStamp::get(sourcePath, sourceSize, sourceModified)) return false;
+
+    std::ifstream file(getCachePath(sourcePath), std::ios::binary);
+    if (!file) return false;
+
+    CollisionMeshHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.magic != COLLISION_MESH_MAGIC || header.version != COLLISION_MESH_VERSION ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified) {
+        return false;
+    }
+
+    positions.resize(header.positionCount);
+    indices.resize(header.indexCount);
+    hull.resize(header.hullCount);
+    file.read(reinterpret_cast<char*>(&boundsMin), sizeof(glm::vec3));
+    file.read(reinterpret_cast<char*>(&boundsMax), sizeof(glm::vec3));
+    file.read(reinterpret_cast<char*>(positions.data()), positions.size() * sizeof(glm::vec3));
+    file.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(unsigned int));
+    file.read(reinterpret_cast<char*>(hull.data()), hull.size() * sizeof(glm::vec3));
+    if (!file) {
+        positions.clear();
+        indices.clear();
+        hull.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CollisionMesh::saveCache(const std::string& sourcePath) const {
+    CollisionMeshHeader header;
+    if (!SourceStamp::get(sourcePath, header.sourceSize, header.sourceModified)) return false;
+    header.magic = COLLISION_MESH_MAGIC;
+    header.version = COLLISION_MESH_VERSION;
+    header.positionCount = static_cast<uint32_t>(positions.size());
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    header.hullCount = static_cast<uint32_t>(hull.size());
+    header.padding = 0;
+
+    std::ofstream file(getCachePath(sourcePath), std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write collision mesh cache for " << sourcePath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&boundsMin), sizeof(glm::vec3));
+    file.write(reinterpret_cast<const char*>(&boundsMax), sizeof(glm::vec3));
+    file.write(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(glm::vec3));
+    file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(unsigned int));
+    file.write(reinterpret_cast<const char*>(hull.data()), hull.size() * sizeof(glm::vec3));
+    return static_cast<bool>(file);
+}
+
+size_t CollisionMesh::getTriangleCount() const {
+    return indices.size() / 3;
+}
@@ -0,0 +1,36 @@
+#ifndef COLLISION_MESH_H
+#define COLLISION_MESH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+
+// Collision representation of an imported model, in model space.
+// Static models use the triangles (added to the query BVH with
+// Collision::addStaticMesh), dynamic ones the convex hull approximation.
+// Cooking runs once, the result is cached next to the source asset and
+// reloaded as long as the source doesn't change.
+class CollisionMesh {
+public:
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;  // triangle list
+    std::vector<glm::vec3> hull;        // extreme points along 26 directions, their hull approximates the mesh
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    CollisionMesh();
+
+    // Compute the bounds and the hull from the positions
+    void cook();
+
+    // Load the cooked mesh cached for sourcePath, false if missing or out of date
+    bool loadCache(const std::string& sourcePath);
+    bool saveCache(const std::string& sourcePath) const;
+
+    // sourcePath + ".colmesh"
+    static std::string getCachePath(const std::string& sourcePath);
+
+    size_t getTriangleCount() const;
+};
+
+#endif // COLLISION_MESH_H
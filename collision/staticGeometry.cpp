@@ -0,0 +1,706 @@
+#include "staticGeometry.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Terrain cells per tile side, a tile is one BVH item
+static const int TILE_CELLS = 8;
+// Traversal stack kept on the thread's stack, deeper trees use the heap
+static const uint32_t STACK_SIZE = 128;
+// Iterations of conservative advancement per item in a sphere cast
+static const int SPHERE_CAST_ITERATIONS = 32;
+
+// Nodes still to visit, with a distance for the queries that sort them.
+// Popping one node and pushing its two children never holds more than one
+// pending sibling per level, so depth + 1 entries always fit
+namespace {
+struct TraversalStack {
+    uint32_t localNodes[STACK_SIZE];
+    float localDistances[STACK_SIZE];
+    std::vector<uint32_t> heapNodes;
+    std::vector<float> heapDistances;
+    uint32_t* nodes;
+    float* distances;
+    int top;
+
+    explicit TraversalStack(uint32_t depth) : nodes(localNodes), distances(localDistances), top(0) {
+        if (depth + 1 > STACK_SIZE) {
+            heapNodes.resize(depth + 1);
+            heapDistances.resize(depth + 1);
+            nodes = heapNodes.data();
+            distances = heapDistances.data();
+        }
+    }
+
+    bool empty() const { return top == 0; }
+
+    void push(uint32_t node, float distance = 0.0f) {
+        nodes[top] = node;
+        distances[top++] = distance;
+    }
+
+    uint32_t pop() { return nodes[--top]; }
+
+    uint32_t pop(float& distance) {
+        --top;
+        distance = distances[top];
+        return nodes[top];
+    }
+};
+}
+
+// Möller-Trumbore, two sided, the normal faces the ray
+static bool rayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1,
+                        const glm::vec3& v2, float maxDistance, float& distance, glm::vec3& normal) {
+    glm::vec3 edge1 = v1 - v0;
+    glm::vec3 edge2 = v2 - v0;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    if (std::abs(determinant) < 1e-12f) return false;  // parallel to the triangle
+
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = origin - v0;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = glm::dot(edge2, q) * inverse;
+    if (t < 0.0f || t > maxDistance) return false;
+
+    distance = t;
+    normal = glm::normalize(glm::cross(edge1, edge2));
+    if (glm::dot(normal, direction) > 0.0f) normal = -normal;
+    return true;
+}
+
+// Slab test that also gives the face hit, a ray starting inside hits at 0
+static bool rayBox(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& invDirection,
+                   const glm::vec3& min, const glm::vec3& max, float maxDistance, float& distance, glm::vec3& normal) {
+    float entry = -std::numeric_limits<float>::max();
+    float exit = std::numeric_limits<float>::max();
+    int entryAxis = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float tNear = (min[axis] - origin[axis]) * invDirection[axis];
+        float tFar = (max[axis] - origin[axis]) * invDirection[axis];
+        if (tNear > tFar) std::swap(tNear, tFar);
+        if (tNear > entry) {
+            entry = tNear;
+            entryAxis = axis;
+        }
+        exit = std::min(exit, tFar);
+    }
+    if (entry > exit || exit < 0.0f || entry > maxDistance) return false;
+
+    if (entry < 0.0f) {
+        distance = 0.0f;
+        normal = -direction;
+        return true;
+    }
+    distance = entry;
+    normal = glm::vec3(0.0f);
+    normal[entryAxis] = direction[entryAxis] > 0.0f ? -1.0f : 1.0f;
+    return true;
+}
+
+// Closest point on a triangle (Real-Time Collision Detection, 5.1.5)
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Separating axis test of a triangle against a box (center, half extents)
+static bool triangleBoxOverlap(const glm::vec3& center, const glm::vec3& half,
+                               const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+    glm::vec3 a = v0 - center;
+    glm::vec3 b = v1 - center;
+    glm::vec3 c = v2 - center;
+
+    // Box faces
+    for (int axis = 0; axis < 3; ++axis) {
+        if (std::min(a[axis], std::min(b[axis], c[axis])) > half[axis]) return false;
+        if (std::max(a[axis], std::max(b[axis], c[axis])) < -half[axis]) return false;
+    }
+
+    // Triangle plane
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    if (std::abs(glm::dot(normal, a)) > glm::dot(half, glm::abs(normal))) return false;
+
+    // Box axes crossed with the triangle edges
+    glm::vec3 edges[3] = {b - a, c - b, a - c};
+    for (int e = 0; e < 3; ++e) {
+        for (int axis = 0; axis < 3; ++axis) {
+            glm::vec3 unit(0.0f);
+            unit[axis] = 1.0f;
+            glm::vec3 separating = glm::cross(unit, edges[e]);
+            float p0 = glm::dot(a, separating);
+            float p1 = glm::dot(b, separating);
+            float p2 = glm::dot(c, separating);
+            float radius = glm::dot(half, glm::abs(separating));
+            if (std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius) return false;
+        }
+    }
+    return true;
+}
+
+StaticGeometry::StaticGeometry() : meshCount(0), terrain(nullptr), terrainRows(0), terrainColumns(0), firstTileItem(0), tileColumns(0) {}
+
+int StaticGeometry::addMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                            const glm::mat4& transform) {
+    int mesh = meshCount++;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Triangle triangle;
+        triangle.v0 = glm::vec3(transform * glm::vec4(positions[indices[i]], 1.0f));
+        triangle.v1 = glm::vec3(transform * glm::vec4(positions[indices[i + 1]], 1.0f));
+        triangle.v2 = glm::vec3(transform * glm::vec4(positions[indices[i + 2]], 1.0f));
+        triangle.mesh = mesh;
+        triangle.meshTriangle = static_cast<int>(i / 3);
+        triangles.push_back(triangle);
+    }
+    return mesh;
+}
+
+int StaticGeometry::addMesh(const CollisionMesh& mesh, const glm::mat4& transform) {
+    return addMesh(mesh.positions, mesh.indices, transform);
+}
+
+void StaticGeometry::clearMeshes() {
+    triangles.clear();
+    meshCount = 0;
+}
+
+void StaticGeometry::build(const std::vector<Primitives*>& statics, const Terrain* terrain) {
+    this->terrain = terrain;
+    boxes.clear();
+    tiles.clear();
+    itemList.clear();
+    itemMin.clear();
+    itemMax.clear();
+
+    for (size_t i = 0; i < statics.size(); ++i) {
+        Box box;
+        box.bounds = statics[i]->getHitbox();
+        box.primitive = statics[i];
+        Item item = {ITEM_BOX, static_cast<int>(boxes.size())};
+        boxes.push_back(box);
+        itemList.push_back(item);
+        itemMin.push_back(box.bounds.min);
+        itemMax.push_back(box.bounds.max);
+    }
+
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const Triangle& triangle = triangles[i];
+        Item item = {ITEM_TRIANGLE, static_cast<int>(i)};
+        itemList.push_back(item);
+        itemMin.push_back(glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2)));
+        itemMax.push_back(glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2)));
+    }
+
+    addTerrainTiles();
+    bvh.build(itemMin, itemMax);
+}
+
+// Terrain grid: row i is at x = i - rows / 2 and column j at z = j - columns / 2
+void StaticGeometry::addTerrainTiles() {
+    terrainRows = 0;
+    terrainColumns = 0;
+    if (!terrain) return;
+    const std::vector<glm::vec3>& vertices = terrain->getVertices();
+    int rows = terrain->getTerrainHeight();
+    int columns = terrain->getTerrainWidth();
+    if (rows < 2 || columns < 2 || vertices.size() < static_cast<size_t>(rows) * columns) return;
+    terrainRows = rows;
+    terrainColumns = columns;
+
+    firstTileItem = itemList.size();
+    tileColumns = (columns - 2) / TILE_CELLS + 1;
+    for (int firstRow = 0; firstRow < rows - 1; firstRow += TILE_CELLS) {
+        for (int firstColumn = 0; firstColumn < columns - 1; firstColumn += TILE_CELLS) {
+            Tile tile;
+            tile.firstRow = firstRow;
+            tile.firstColumn = firstColumn;
+            tile.rows = std::min(TILE_CELLS, rows - 1 - firstRow);
+            tile.columns = std::min(TILE_CELLS, columns - 1 - firstColumn);
+
+            Item item = {ITEM_TERRAIN_TILE, static_cast<int>(tiles.size())};
+            tiles.push_back(tile);
+            itemList.push_back(item);
+            itemMin.push_back(glm::vec3(0.0f));
+            itemMax.push_back(glm::vec3(0.0f));
+            tileBounds(tile, itemMin.back(), itemMax.back());
+        }
+    }
+}
+
+void StaticGeometry::tileBounds(const Tile& tile, glm::vec3& min, glm::vec3& max) const {
+    const std::vector<glm::vec3>& vertices = terrain->getVertices();
+    min = glm::vec3(std::numeric_limits<float>::max());
+    max = glm::vec3(-std::numeric_limits<float>::max());
+    for (int i = tile.firstRow; i <= tile.firstRow + tile.rows; ++i) {
+        for (int j = tile.firstColumn; j <= tile.firstColumn + tile.columns; ++j) {
+            min = glm::min(min, vertices[j + terrainColumns * i]);
+            max = glm::max(max, vertices[j + terrainColumns * i]);
+        }
+    }
+}
+
+void StaticGeometry::refitTerrain(int rowBegin, int rowEnd, int columnBegin, int columnEnd) {
+    if (terrainRows == 0 || rowBegin >= rowEnd || columnBegin >= columnEnd) return;
+
+    // A vertex on a tile border belongs to the tiles on both sides
+    int tileRowBegin = std::max(0, (rowBegin - 1) / TILE_CELLS);
+    int tileRowEnd = std::min((terrainRows - 2) / TILE_CELLS, (rowEnd - 1) / TILE_CELLS);
+    int tileColumnBegin = std::max(0, (columnBegin - 1) / TILE_CELLS);
+    int tileColumnEnd = std::min(tileColumns - 1, (columnEnd - 1) / TILE_CELLS);
+
+    changedItems.clear();
+    for (int tileRow = tileRowBegin; tileRow <= tileRowEnd; ++tileRow) {
+        for (int tileColumn = tileColumnBegin; tileColumn <= tileColumnEnd; ++tileColumn) {
+            size_t tileIndex = static_cast<size_t>(tileRow) * tileColumns + tileColumn;
+            uint32_t itemIndex = static_cast<uint32_t>(firstTileItem + tileIndex);
+            tileBounds(tiles[tileIndex], itemMin[itemIndex], itemMax[itemIndex]);
+            changedItems.push_back(itemIndex);
+        }
+    }
+    bvh.refit(changedItems, itemMin, itemMax);
+}
+
+// Each cell is split along its (row, column) - (row + 1, column + 1) diagonal
+void StaticGeometry::terrainTriangle(int row, int column, int half, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const {
+    const std::vector<glm::vec3>& vertices = terrain->getVertices();
+    int index = column + terrainColumns * row;
+    v0 = vertices[index];
+    if (half == 0) {
+        v1 = vertices[index + terrainColumns];
+        v2 = vertices[index + terrainColumns + 1];
+    } else {
+        v1 = vertices[index + terrainColumns + 1];
+        v2 = vertices[index + 1];
+    }
+}
+
+// Cells of the tile touching the x / z range, as [begin, end) rows and columns
+void StaticGeometry::tileCellRange(const Tile& tile, float minX, float maxX, float minZ, float maxZ,
+                                   int& rowBegin, int& rowEnd, int& columnBegin, int& columnEnd) const {
+    float rowOffset = terrainRows / 2.0f;
+    float columnOffset = terrainColumns / 2.0f;
+    rowBegin = std::max(tile.firstRow, static_cast<int>(std::floor(minX + rowOffset)));
+    rowEnd = std::min(tile.firstRow + tile.rows, static_cast<int>(std::floor(maxX + rowOffset)) + 1);
+    columnBegin = std::max(tile.firstColumn, static_cast<int>(std::floor(minZ + columnOffset)));
+    columnEnd = std::min(tile.firstColumn + tile.columns, static_cast<int>(std::floor(maxZ + columnOffset)) + 1);
+}
+
+void StaticGeometry::fillShape(const Item& item, int triangle, QueryHit& hit) const {
+    hit.primitive = nullptr;
+    hit.mesh = -1;
+    hit.triangle = -1;
+    hit.terrain = false;
+    if (item.type == ITEM_BOX) {
+        hit.primitive = boxes[item.index].primitive;
+    } else if (item.type == ITEM_TRIANGLE) {
+        hit.mesh = triangles[item.index].mesh;
+        hit.triangle = triangles[item.index].meshTriangle;
+    } else {
+        hit.terrain = true;
+        hit.triangle = triangle;
+    }
+}
+
+bool StaticGeometry::raycastItem(uint32_t itemIndex, const glm::vec3& origin, const glm::vec3& direction,
+                                 const glm::vec3& invDirection, float maxDistance, QueryHit& hit) const {
+    const Item& item = itemList[itemIndex];
+    float distance;
+    glm::vec3 normal;
+    int triangleIndex = -1;
+
+    if (item.type == ITEM_BOX) {
+        const Box& box = boxes[item.index];
+        if (!rayBox(origin, direction, invDirection, box.bounds.min, box.bounds.max, maxDistance, distance, normal)) return false;
+    } else if (item.type == ITEM_TRIANGLE) {
+        const Triangle& triangle = triangles[item.index];
+        if (!rayTriangle(origin, direction, triangle.v0, triangle.v1, triangle.v2, maxDistance, distance, normal)) return false;
+    } else {
+        // Only the cells under the part of the ray crossing the tile
+        const Tile& tile = tiles[item.index];
+        Bvh::Node bounds;
+        bounds.min = itemMin[itemIndex];
+        bounds.max = itemMax[itemIndex];
+        float entry;
+        if (!Bvh::intersectRay(bounds, origin, invDirection, maxDistance, entry)) return false;
+        glm::vec3 tBig = glm::max((bounds.min - origin) * invDirection, (bounds.max - origin) * invDirection);
+        float exit = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, maxDistance));
+        glm::vec3 start = origin + direction * entry;
+        glm::vec3 end = origin + direction * exit;
+
+        int rowBegin, rowEnd, columnBegin, columnEnd;
+        tileCellRange(tile, std::min(start.x, end.x), std::max(start.x, end.x), std::min(start.z, end.z),
+                      std::max(start.z, end.z), rowBegin, rowEnd, columnBegin, columnEnd);
+
+        distance = maxDistance;
+        bool found = false;
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            for (int column = columnBegin; column < columnEnd; ++column) {
+                for (int half = 0; half < 2; ++half) {
+                    glm::vec3 v0, v1, v2;
+                    terrainTriangle(row, column, half, v0, v1, v2);
+                    float t;
+                    glm::vec3 n;
+                    if (rayTriangle(origin, direction, v0, v1, v2, distance, t, n)) {
+                        distance = t;
+                        normal = n;
+                        triangleIndex = (column + (terrainColumns - 1) * row) * 2 + half;
+                        found = true;
+                    }
+                }
+            }
+        }
+        if (!found) return false;
+    }
+
+    hit.hit = true;
+    hit.distance = distance;
+    hit.point = origin + direction * distance;
+    hit.normal = normal;
+    fillShape(item, triangleIndex, hit);
+    return true;
+}
+
+// Distance from point to the item, -1 if it is further than maxDistance
+float StaticGeometry::closestPointOnItem(const Item& item, const glm::vec3& point, float maxDistance, QueryHit& hit) const {
+    glm::vec3 closest;
+    glm::vec3 faceNormal(0.0f, 1.0f, 0.0f);
+    int triangleIndex = -1;
+
+    if (item.type == ITEM_BOX) {
+        const Box& box = boxes[item.index];
+        closest = glm::clamp(point, box.bounds.min, box.bounds.max);
+    } else if (item.type == ITEM_TRIANGLE) {
+        const Triangle& triangle = triangles[item.index];
+        closest = closestPointOnTriangle(point, triangle.v0, triangle.v1, triangle.v2);
+        faceNormal = glm::normalize(glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0));
+    } else {
+        // Only the cells within maxDistance of the point on x / z
+        const Tile& tile = tiles[item.index];
+        int rowBegin, rowEnd, columnBegin, columnEnd;
+        tileCellRange(tile, point.x - maxDistance, point.x + maxDistance, point.z - maxDistance, point.z + maxDistance,
+                      rowBegin, rowEnd, columnBegin, columnEnd);
+        float best = std::numeric_limits<float>::max();
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            for (int column = columnBegin; column < columnEnd; ++column) {
+                for (int half = 0; half < 2; ++half) {
+                    glm::vec3 v0, v1, v2;
+                    terrainTriangle(row, column, half, v0, v1, v2);
+                    glm::vec3 candidate = closestPointOnTriangle(point, v0, v1, v2);
+                    glm::vec3 offset = point - candidate;
+                    float distanceSquared = glm::dot(offset, offset);
+                    if (distanceSquared < best) {
+                        best = distanceSquared;
+                        closest = candidate;
+                        faceNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+                        triangleIndex = (column + (terrainColumns - 1) * row) * 2 + half;
+                    }
+                }
+            }
+        }
+        if (triangleIndex < 0) return -1.0f;
+    }
+
+    glm::vec3 offset = point - closest;
+    float distance = glm::length(offset);
+    if (distance > maxDistance) return -1.0f;
+
+    hit.hit = true;
+    hit.distance = distance;
+    hit.point = closest;
+    if (distance > 1e-6f) {
+        hit.normal = offset / distance;
+    } else {
+        // On the surface, use the face normal
+        hit.normal = glm::dot(faceNormal, faceNormal) > 0.0f ? faceNormal : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    fillShape(item, triangleIndex, hit);
+    return distance;
+}
+
+// Triangles report the point closest to the box center and their face normal
+bool StaticGeometry::overlapItem(const Item& item, const glm::vec3& min, const glm::vec3& max,
+                                 std::vector<QueryHit>& results) const {
+    QueryHit hit;
+    hit.hit = true;
+    hit.distance = 0.0f;
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 halfExtents = (max - min) * 0.5f;
+
+    if (item.type == ITEM_BOX) {
+        // Leaf bounds are the box itself, the tree already tested them
+        const Box& box = boxes[item.index];
+        hit.point = glm::clamp(center, box.bounds.min, box.bounds.max);
+        hit.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        fillShape(item, -1, hit);
+        results.push_back(hit);
+        return true;
+    }
+    if (item.type == ITEM_TRIANGLE) {
+        const Triangle& triangle = triangles[item.index];
+        if (!triangleBoxOverlap(center, halfExtents, triangle.v0, triangle.v1, triangle.v2)) return false;
+        hit.point = closestPointOnTriangle(center, triangle.v0, triangle.v1, triangle.v2);
+        hit.normal = glm::normalize(glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0));
+        fillShape(item, -1, hit);
+        results.push_back(hit);
+        return true;
+    }
+
+    const Tile& tile = tiles[item.index];
+    int rowBegin, rowEnd, columnBegin, columnEnd;
+    tileCellRange(tile, min.x, max.x, min.z, max.z, rowBegin, rowEnd, columnBegin, columnEnd);
+    bool found = false;
+    for (int row = rowBegin; row < rowEnd; ++row) {
+        for (int column = columnBegin; column < columnEnd; ++column) {
+            for (int half = 0; half < 2; ++half) {
+                glm::vec3 v0, v1, v2;
+                terrainTriangle(row, column, half, v0, v1, v2);
+                if (!triangleBoxOverlap(center, halfExtents, v0, v1, v2)) continue;
+                hit.point = closestPointOnTriangle(center, v0, v1, v2);
+                hit.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+                fillShape(item, (column + (terrainColumns - 1) * row) * 2 + half, hit);
+                results.push_back(hit);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool StaticGeometry::raycast(const QueryRay& ray, QueryHit& hit) const {
+    hit.hit = false;
+    float length = glm::length(ray.direction);
+    if (bvh.empty() || length <= 0.0f) return false;
+    glm::vec3 direction = ray.direction / length;
+    glm::vec3 invDirection = 1.0f / direction;
+    float closest = ray.maxDistance;
+
+    // Nodes still to visit with their entry distance, the nearest child is popped first
+    TraversalStack stack(bvh.getDepth());
+    float entry;
+    if (!Bvh::intersectRay(bvh.nodes[0], ray.origin, invDirection, closest, entry)) return false;
+    stack.push(0, entry);
+
+    while (!stack.empty()) {
+        uint32_t nodeIndex = stack.pop(entry);
+        if (entry > closest) continue;
+        const Bvh::Node& node = bvh.nodes[nodeIndex];
+
+        if (node.count > 0) {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                if (raycastItem(bvh.items[i], ray.origin, direction, invDirection, closest, hit)) {
+                    closest = hit.distance;
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.leftOrFirst;
+        uint32_t farChild = node.leftOrFirst + 1;
+        float nearEntry, farEntry;
+        bool hitNear = Bvh::intersectRay(bvh.nodes[nearChild], ray.origin, invDirection, closest, nearEntry);
+        bool hitFar = Bvh::intersectRay(bvh.nodes[farChild], ray.origin, invDirection, closest, farEntry);
+        if (hitNear && hitFar && farEntry < nearEntry) {
+            std::swap(nearChild, farChild);
+            std::swap(nearEntry, farEntry);
+        } else if (!hitNear && hitFar) {
+            nearChild = farChild;
+            nearEntry = farEntry;
+            hitNear = true;
+            hitFar = false;
+        }
+        if (hitFar) {
+            stack.push(farChild, farEntry);
+        }
+        if (hitNear) {
+            stack.push(nearChild, nearEntry);
+        }
+    }
+    return hit.hit;
+}
+
+// Conservative advancement: the sphere center moves along the ray by the
+// distance to the item minus the radius, which can never pass through it
+bool StaticGeometry::sphereCast(const QueryRay& ray, float radius, QueryHit& hit) const {
+    hit.hit = false;
+    float length = glm::length(ray.direction);
+    if (bvh.empty() || length <= 0.0f) return false;
+    glm::vec3 direction = ray.direction / length;
+    glm::vec3 invDirection = 1.0f / direction;
+    glm::vec3 grow(radius);
+    float closest = ray.maxDistance;
+
+    TraversalStack stack(bvh.getDepth());
+    stack.push(0);
+
+    while (!stack.empty()) {
+        const Bvh::Node& node = bvh.nodes[stack.pop()];
+        Bvh::Node grown = node;
+        grown.min -= grow;
+        grown.max += grow;
+        float entry;
+        if (!Bvh::intersectRay(grown, ray.origin, invDirection, closest, entry)) continue;
+
+        if (node.count == 0) {
+            stack.push(node.leftOrFirst + 1);
+            stack.push(node.leftOrFirst);
+            continue;
+        }
+
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+            uint32_t itemIndex = bvh.items[i];
+            Bvh::Node itemBounds;
+            itemBounds.min = itemMin[itemIndex] - grow;
+            itemBounds.max = itemMax[itemIndex] + grow;
+            float t;
+            if (!Bvh::intersectRay(itemBounds, ray.origin, invDirection, closest, t)) continue;
+
+            for (int iteration = 0; iteration < SPHERE_CAST_ITERATIONS && t <= closest; ++iteration) {
+                glm::vec3 center = ray.origin + direction * t;
+                QueryHit contact;
+                // Nothing within the rest of the path means no hit at all
+                float distance = closestPointOnItem(itemList[itemIndex], center, radius + (closest - t), contact);
+                if (distance < 0.0f) break;
+                if (distance <= radius + 1e-4f) {
+                    closest = t;
+                    hit = contact;
+                    hit.distance = t;
+                    break;
+                }
+                t += distance - radius;
+            }
+        }
+    }
+    return hit.hit;
+}
+
+size_t StaticGeometry::overlapBox(const glm::vec3& min, const glm::vec3& max, std::vector<QueryHit>& results) const {
+    if (bvh.empty()) return 0;
+    size_t added = 0;
+
+    TraversalStack stack(bvh.getDepth());
+    stack.push(0);
+
+    while (!stack.empty()) {
+        const Bvh::Node& node = bvh.nodes[stack.pop()];
+        if (node.min.x > max.x || node.max.x < min.x ||
+            node.min.y > max.y || node.max.y < min.y ||
+            node.min.z > max.z || node.max.z < min.z) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            stack.push(node.leftOrFirst + 1);
+            stack.push(node.leftOrFirst);
+            continue;
+        }
+
+        for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+            uint32_t itemIndex = bvh.items[i];
+            const glm::vec3& itemLow = itemMin[itemIndex];
+            const glm::vec3& itemHigh = itemMax[itemIndex];
+            if (itemLow.x > max.x || itemHigh.x < min.x ||
+                itemLow.y > max.y || itemHigh.y < min.y ||
+                itemLow.z > max.z || itemHigh.z < min.z) {
+                continue;
+            }
+            size_t before = results.size();
+            overlapItem(itemList[itemIndex], min, max, results);
+            added += results.size() - before;
+        }
+    }
+    return added;
+}
+
+bool StaticGeometry::closestPoint(const glm::vec3& point, float maxDistance, QueryHit& hit) const {
+    hit.hit = false;
+    if (bvh.empty()) return false;
+    float best = maxDistance;
+
+    // Nodes with their squared distance, the nearest child is popped first
+    TraversalStack stack(bvh.getDepth());
+    stack.push(0, Bvh::distanceSquared(bvh.nodes[0], point));
+
+    while (!stack.empty()) {
+        float distanceSquared;
+        uint32_t nodeIndex = stack.pop(distanceSquared);
+        if (distanceSquared > best * best) continue;
+        const Bvh::Node& node = bvh.nodes[nodeIndex];
+
+        if (node.count > 0) {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                QueryHit candidate;
+                float distance = closestPointOnItem(itemList[bvh.items[i]], point, best, candidate);
+                if (distance >= 0.0f && (!hit.hit || distance < best)) {
+                    best = distance;
+                    hit = candidate;
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.leftOrFirst;
+        uint32_t farChild = node.leftOrFirst + 1;
+        float nearDistance = Bvh::distanceSquared(bvh.nodes[nearChild], point);
+        float farDistance = Bvh::distanceSquared(bvh.nodes[farChild], point);
+        if (farDistance < nearDistance) {
+            std::swap(nearChild, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+        stack.push(farChild, farDistance);
+        stack.push(nearChild, nearDistance);
+    }
+    return hit.hit;
+}
+
+size_t StaticGeometry::getBoxCount() const {
+    return boxes.size();
+}
+
+size_t StaticGeometry::getTriangleCount() const {
+    return triangles.size();
+}
+
+size_t StaticGeometry::getNodeCount() const {
+    return bvh.nodes.size();
+}
+
+const Terrain* StaticGeometry::getTerrain() const {
+    return terrain;
+}
@@ -0,0 +1,117 @@
+#ifndef STATIC_GEOMETRY_H
+#define STATIC_GEOMETRY_H
+
+#include "bvh.h"
+#include "collisionMesh.h"
+#include "../primitives/primitives.h"
+#include "../world_objects/terrain.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Ray for the scene queries, direction doesn't need to be normalized
+struct QueryRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+// Result of a scene query, only one of primitive, mesh or terrain is set
+struct QueryHit {
+    bool hit;
+    float distance;         // along the ray, or from the query point
+    glm::vec3 point;        // contact point on the geometry
+    glm::vec3 normal;       // surface normal, facing the query
+    Primitives* primitive;  // static primitive, nullptr otherwise
+    int mesh;               // id returned by addMesh, -1 otherwise
+    int triangle;           // triangle of the mesh or of the terrain grid, -1 otherwise
+    bool terrain;
+};
+
+// Static geometry of the scene gathered under one BVH: static primitive
+// hitboxes, triangle meshes and the terrain cut into tiles of cells.
+// Queries only read it and can be made from any thread.
+class StaticGeometry {
+public:
+    StaticGeometry();
+
+    // Add a triangle mesh placed with transform, returns its id.
+    // Only taken into account by the next build()
+    int addMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                const glm::mat4& transform);
+    int addMesh(const CollisionMesh& mesh, const glm::mat4& transform);
+    void clearMeshes();
+
+    // Rebuild the tree over the static primitives, the meshes and the terrain (can be null)
+    void build(const std::vector<Primitives*>& statics, const Terrain* terrain);
+
+    // Terrain heights changed in rows [rowBegin, rowEnd) and columns
+    // [columnBegin, columnEnd), refit the tiles over them
+    void refitTerrain(int rowBegin, int rowEnd, int columnBegin, int columnEnd);
+
+    // Closest hit along the ray
+    bool raycast(const QueryRay& ray, QueryHit& hit) const;
+
+    // Closest hit of a sphere of the given radius moving along the ray
+    bool sphereCast(const QueryRay& ray, float radius, QueryHit& hit) const;
+
+    // Append everything touching the box to results, returns the number added.
+    // Triangles give the point closest to the box center and their face normal
+    size_t overlapBox(const glm::vec3& min, const glm::vec3& max, std::vector<QueryHit>& results) const;
+
+    // Closest point of the geometry within maxDistance of point
+    bool closestPoint(const glm::vec3& point, float maxDistance, QueryHit& hit) const;
+
+    size_t getBoxCount() const;
+    size_t getTriangleCount() const;
+    size_t getNodeCount() const;
+    const Terrain* getTerrain() const;
+
+private:
+    enum ItemType { ITEM_BOX, ITEM_TRIANGLE, ITEM_TERRAIN_TILE };
+    struct Item {
+        ItemType type;
+        int index;  // into boxes, triangles or tiles
+    };
+    struct Box {
+        Primitives::Hitbox bounds;
+        Primitives* primitive;
+    };
+    struct Triangle {
+        glm::vec3 v0, v1, v2;
+        int mesh;
+        int meshTriangle;
+    };
+    // Block of terrain cells, each cell is split in two triangles
+    struct Tile {
+        int firstRow, firstColumn;
+        int rows, columns;
+    };
+
+    std::vector<Box> boxes;
+    std::vector<Triangle> triangles;
+    std::vector<Tile> tiles;
+    std::vector<Item> itemList;
+    std::vector<glm::vec3> itemMin, itemMax;
+    Bvh bvh;
+    int meshCount;
+
+    const Terrain* terrain;
+    int terrainRows, terrainColumns;
+    size_t firstTileItem;  // tiles are the last items, row by row
+    int tileColumns;
+    std::vector<uint32_t> changedItems;
+
+    void addTerrainTiles();
+    void tileBounds(const Tile& tile, glm::vec3& min, glm::vec3& max) const;
+    void terrainTriangle(int row, int column, int half, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const;
+    void tileCellRange(const Tile& tile, float minX, float maxX, float minZ, float maxZ,
+                       int& rowBegin, int& rowEnd, int& columnBegin, int& columnEnd) const;
+
+    bool raycastItem(uint32_t itemIndex, const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& invDirection,
+                     float maxDistance, QueryHit& hit) const;
+    float closestPointOnItem(const Item& item, const glm::vec3& point, float maxDistance, QueryHit& hit) const;
+    bool overlapItem(const Item& item, const glm::vec3& min, const glm::vec3& max, std::vector<QueryHit>& results) const;
+    void fillShape(const Item& item, int triangle, QueryHit& hit) const;
+};
+
+#endif // STATIC_GEOMETRY_H
@@ -0,0 +1,46 @@
+#include "allocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+// Plain thread_local, zero initialized without a constructor so it can be
+// used from operator new at any point of a thread's life
+static thread_local size_t allocationCount = 0;
+
+size_t AllocationCounter::getCount() {
+    return allocationCount;
+}
+
+static void* countedAlloc(std::size_t size) {
+    allocationCount++;
+    if (size == 0) size = 1;
+    if (void* ptr = std::malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Replacements of the global allocation functions, the nothrow and
+// aligned versions are left to the standard library
+void* operator new(std::size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size) {
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
@@ -0,0 +1,21 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+// Counts the heap allocations made through the global operator new, per thread.
+// Take a snapshot before and after a piece of code to know how many
+// allocations it made, e.g. to check that a physics frame allocates nothing.
+// Only the calling thread is counted, so the texture decoders or animation
+// workers running at the same time don't show up in the snapshot, and
+// neither do jobs the code hands to other threads.
+class AllocationCounter {
+public:
+    // Allocations made by the calling thread since it started
+    static size_t getCount();
+
+private:
+    AllocationCounter() { }
+};
+
+#endif // ALLOCATION_COUNTER_H
@@ -40,7 +40,7 @@ float lastFrame = 0.0f;
 
 Game game(SCR_WIDTH, SCR_HEIGHT);
 
-int main()
+int main(int argc, char** argv)
 {
     // glfw: initialize and configure
     glfwInit();
@@ -77,6 +77,15 @@ int main()
     game.SetWindow(window);
 
     game.Init();
+
+    // --benchmark prints the physics and animation benchmarks of the loaded scene and quits
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        game.PrintPhysicsBenchmarks();
+        game.PrintAnimationBenchmarks();
+        game.cleanup();
+        glfwTerminate();
+        return 0;
+    }
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
 
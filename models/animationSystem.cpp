@@ -0,0 +1,70 @@
+#include "animationSystem.h"
+#include <algorithm>
+#include <atomic>
+
+size_t AnimationSystem::addCharacter(Animation* animation, float startTime, const glm::mat4& transform) {
+    animators.push_back(Animator(animation));
+    animators.back().SetTime(startTime);
+    transforms.push_back(transform);
+    // Bones outside the skeleton keep the rest pose
+    palette.resize(animators.size() * MAX_BONES, glm::mat4(1.0f));
+    return animators.size() - 1;
+}
+
+void AnimationSystem::clear() {
+    animators.clear();
+    palette.clear();
+    transforms.clear();
+}
+
+size_t AnimationSystem::getCharacterCount() const {
+    return animators.size();
+}
+
+void AnimationSystem::update(float dt) {
+    // Characters only read their shared animation and write their own slice
+    // of the palette, so the jobs don't need to lock anything
+    size_t jobCount = (animators.size() + CHARACTERS_PER_JOB - 1) / CHARACTERS_PER_JOB;
+    std::atomic<size_t> evaluated(0);
+    WorkerPool::shared().parallelFor(jobCount, [this, dt, &evaluated](size_t job) {
+        size_t end = std::min(animators.size(), (job + 1) * CHARACTERS_PER_JOB);
+        size_t jobEvaluated = 0;
+        for (size_t character = job * CHARACTERS_PER_JOB; character < end; ++character) {
+            jobEvaluated += animators[character].UpdateAnimation(dt, &palette[character * MAX_BONES]) ? 1 : 0;
+        }
+        evaluated.fetch_add(jobEvaluated);
+    }, threadCount);
+    evaluatedCount = evaluated.load();
+}
+
+size_t AnimationSystem::getEvaluatedCount() const {
+    return evaluatedCount;
+}
+
+Animator& AnimationSystem::getAnimator(size_t character) {
+    return animators[character];
+}
+
+const glm::mat4* AnimationSystem::getPalette() const {
+    return palette.data();
+}
+
+const glm::mat4* AnimationSystem::getPalette(size_t character) const {
+    return &palette[character * MAX_BONES];
+}
+
+void AnimationSystem::setTransform(size_t character, const glm::mat4& transform) {
+    transforms[character] = transform;
+}
+
+const glm::mat4* AnimationSystem::getTransforms() const {
+    return transforms.data();
+}
+
+void AnimationSystem::setThreadCount(unsigned int threadCount) {
+    this->threadCount = threadCount;
+}
+
+unsigned int AnimationSystem::getThreadCount() const {
+    return std::min(threadCount, WorkerPool::shared().getThreadCount());
+}
@@ -0,0 +1,54 @@
+#ifndef ANIMATION_SYSTEM_H
+#define ANIMATION_SYSTEM_H
+
+#include "assimp/animator.h"
+#include "../threading/workerPool.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Animated characters sharing their Animation assets, one Animator each.
+// update() evaluates every pose in parallel on the shared worker pool and
+// writes them into one palette buffer, MAX_BONES matrices per character
+// in the order they were added, ready to be uploaded in one go (see
+// BonePaletteBuffer).
+class AnimationSystem {
+public:
+    // Add a character playing animation from startTime (in ticks), returns its index
+    size_t addCharacter(Animation* animation, float startTime = 0.0f, const glm::mat4& transform = glm::mat4(1.0f));
+    void clear();
+    size_t getCharacterCount() const;
+
+    // The character's player, to cross-fade or add layers
+    Animator& getAnimator(size_t character);
+
+    // Advance every character by dt and evaluate their poses. Characters
+    // whose pose didn't change keep their palette
+    void update(float dt);
+    // Characters the last update evaluated
+    size_t getEvaluatedCount() const;
+
+    // Final bone matrices of every character, the ones of a character start at
+    // character * MAX_BONES. Valid until the next update or addCharacter
+    const glm::mat4* getPalette() const;
+    const glm::mat4* getPalette(size_t character) const;
+
+    // Where each character is drawn, applied on top of the model matrix
+    void setTransform(size_t character, const glm::mat4& transform);
+    const glm::mat4* getTransforms() const;
+
+    // Workers of the shared pool that help the update, 0 updates on the calling thread
+    void setThreadCount(unsigned int threadCount);
+    unsigned int getThreadCount() const;
+
+private:
+    // Characters a job evaluates, enough to cover the cost of grabbing it
+    static const size_t CHARACTERS_PER_JOB = 4;
+
+    std::vector<Animator> animators;
+    std::vector<glm::mat4> palette;
+    std::vector<glm::mat4> transforms;
+    size_t evaluatedCount = 0;
+    unsigned int threadCount = WorkerPool::defaultThreadCount();
+};
+
+#endif // ANIMATION_SYSTEM_H
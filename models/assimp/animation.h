@@ -3,20 +3,12 @@
 #include <vector>
 #include <map>
 #include <glm/glm.hpp>
-#include <assimp/scene.h>
+#include <cassert>
 #include "bone.h"
 #include <functional>
 #include "animdata.h"
 #include "model_animation.h"
 
-struct AssimpNodeData
-{
-	glm::mat4 transformation;
-	std::string name;
-	int childrenCount;
-	std::vector<AssimpNodeData> children;
-};
-
 class Animation
 {
 public:
@@ -24,16 +16,17 @@ public:
 
 	Animation(const std::string& animationPath, Model* model)
 	{
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
-		assert(scene && scene->mRootNode);
-		auto animation = scene->mAnimations[0];
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		//globalTransformation = globalTransformation.Inverse();
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
+		// Cooked along with the model, mapped again instead of importing the file twice
+		CookedModel cooked;
+		if (!cooked.map(animationPath) && !ModelCooker::Cook(animationPath, cooked))
+		{
+			std::cout << "ERROR::ANIMATION:: failed to load " << animationPath << std::endl;
+			return;
+		}
+		m_Duration = cooked.getDuration();
+		m_TicksPerSecond = cooked.getTicksPerSecond();
+		ReadMissingBones(cooked, *model);
+		ReadSkeleton(cooked);
 	}
 
 	~Animation()
@@ -53,18 +46,87 @@ public:
 	}
 
 	
+	// For each node of skeleton's skeleton, the bone of this animation that
+	// drives it or -1, matched by name. Lets clips of the same rig exported
+	// separately play on one skeleton
+	std::vector<int> MapChannels(const Animation& skeleton) const
+	{
+		std::map<std::string, int> channels;
+		for (size_t i = 0; i < m_Bones.size(); i++)
+			channels[m_Bones[i].GetBoneName()] = static_cast<int>(i);
+
+		std::vector<int> mapped(skeleton.m_NodeNames.size(), -1);
+		for (size_t i = 0; i < mapped.size(); i++)
+		{
+			auto channel = channels.find(skeleton.m_NodeNames[i]);
+			if (channel != channels.end())
+				mapped[i] = channel->second;
+		}
+		return mapped;
+	}
+
+	// Per node weights, 1 for nodeName and everything under it, 0 elsewhere
+	// (an upper body mask from the spine for example)
+	std::vector<float> MakeMask(const std::string& nodeName) const
+	{
+		std::vector<float> mask(m_Skeleton.size(), 0.0f);
+		for (size_t i = 0; i < m_Skeleton.size(); i++)
+		{
+			int parent = m_Skeleton[i].parent;
+			if (m_NodeNames[i] == nodeName || (parent >= 0 && mask[parent] > 0.0f))
+				mask[i] = 1.0f;
+		}
+		return mask;
+	}
+
+	// mask, made for this animation's skeleton, moved onto the nodes of
+	// skeleton by name. Nodes this skeleton doesn't have take their parent's weight
+	std::vector<float> MapMask(const std::vector<float>& mask, const Animation& skeleton) const
+	{
+		std::map<std::string, int> nodes;
+		for (size_t i = 0; i < m_NodeNames.size(); i++)
+			nodes[m_NodeNames[i]] = static_cast<int>(i);
+
+		std::vector<float> mapped(skeleton.m_NodeNames.size(), 0.0f);
+		for (size_t i = 0; i < mapped.size(); i++)
+		{
+			auto node = nodes.find(skeleton.m_NodeNames[i]);
+			int parent = skeleton.m_Skeleton[i].parent;
+			if (node != nodes.end())
+				mapped[i] = mask[node->second];
+			else if (parent >= 0)
+				mapped[i] = mapped[parent];
+		}
+		return mapped;
+	}
+
+	// Same nodes under the same names in the same order, so tables per node
+	// of one animation hold for the other
+	bool SharesSkeleton(const Animation& other) const
+	{
+		return m_NodeNames == other.m_NodeNames;
+	}
+
+	// Evenly spaced keys for every bone, see Bone::Resample
+	void ResampleKeys(float keysPerTick)
+	{
+		for (Bone& bone : m_Bones)
+			bone.Resample(keysPerTick);
+	}
+
 	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
 	inline float GetDuration() { return m_Duration;}
-	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
+	inline const std::vector<SkeletonNode>& GetSkeleton() const { return m_Skeleton; }
+	inline const std::vector<Bone>& GetBones() const { return m_Bones; }
 	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
 	{ 
 		return m_BoneInfoMap;
 	}
 
 private:
-	void ReadMissingBones(const aiAnimation* animation, Model& model)
+	void ReadMissingBones(const CookedModel& cooked, Model& model)
 	{
-		int size = animation->mNumChannels;
+		int size = static_cast<int>(cooked.getChannelCount());
 
 		auto& boneInfoMap = model.GetBoneInfoMap();//getting m_BoneInfoMap from Model class
 		int& boneCount = model.GetBoneCount(); //getting the m_BoneCounter from Model class
@@ -72,40 +134,81 @@ private:
 		//reading channels(bones engaged in an animation and their keyframes)
 		for (int i = 0; i < size; i++)
 		{
-			auto channel = animation->mChannels[i];
-			std::string boneName = channel->mNodeName.data;
+			const CookedModel::ChannelRecord& channel = cooked.getChannels()[i];
+			std::string boneName = cooked.getString(channel.name);
 
 			if (boneInfoMap.find(boneName) == boneInfoMap.end())
 			{
 				boneInfoMap[boneName].id = boneCount;
 				boneCount++;
 			}
-			m_Bones.push_back(Bone(channel->mNodeName.data,
-				boneInfoMap[channel->mNodeName.data].id, channel));
+			m_Bones.push_back(Bone(boneName, boneInfoMap[boneName].id, cooked, channel));
 		}
 
 		m_BoneInfoMap = boneInfoMap;
 	}
 
-	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
+	// Flattened once here so the animator doesn't walk a tree of names every
+	// frame: the nodes are cooked depth first, so a parent is always before
+	// its children and one pass in order evaluates the whole skeleton
+	void ReadSkeleton(const CookedModel& cooked)
 	{
-		assert(src);
+		std::map<std::string, int> channels;
+		for (size_t i = 0; i < m_Bones.size(); i++)
+			channels[m_Bones[i].GetBoneName()] = static_cast<int>(i);
 
-		dest.name = src->mName.data;
-		dest.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(src->mTransformation);
-		dest.childrenCount = src->mNumChildren;
-		dest.children.reserve(src->mNumChildren);
-
-		for (int i = 0; i < src->mNumChildren; i++)
+		const CookedModel::NodeRecord* nodes = cooked.getNodes();
+		// the nodes that still have children to come, with how many
+		std::vector<std::pair<int, int>> open;
+		m_Skeleton.resize(cooked.getNodeCount());
+		m_NodeNames.resize(cooked.getNodeCount());
+		for (size_t i = 0; i < cooked.getNodeCount(); i++)
 		{
-			AssimpNodeData newData;
-			ReadHierarchyData(newData, src->mChildren[i]);
-			dest.children.push_back(newData);
+			while (!open.empty() && open.back().second == 0)
+				open.pop_back();
+
+			SkeletonNode& node = m_Skeleton[i];
+			node.parent = open.empty() ? -1 : open.back().first;
+			if (!open.empty())
+				open.back().second--;
+			node.transformation = nodes[i].transformation;
+			node.offset = glm::mat4(1.0f);
+			node.rest = SplitTransformation(node.transformation);
+
+			std::string& name = m_NodeNames[i];
+			name = cooked.getString(nodes[i].name);
+			auto channel = channels.find(name);
+			node.channel = (channel != channels.end()) ? channel->second : -1;
+			auto boneInfo = m_BoneInfoMap.find(name);
+			node.boneId = -1;
+			if (boneInfo != m_BoneInfoMap.end() && boneInfo->second.id < MAX_BONES)
+			{
+				node.boneId = boneInfo->second.id;
+				node.offset = boneInfo->second.offset;
+			}
+			open.push_back(std::make_pair(static_cast<int>(i), nodes[i].childrenCount));
 		}
 	}
-	float m_Duration;
-	int m_TicksPerSecond;
+
+	// Parts of a node transformation, assumed without shear
+	static NodePose SplitTransformation(const glm::mat4& transformation)
+	{
+		NodePose pose;
+		pose.position = glm::vec3(transformation[3]);
+		pose.scale = glm::vec3(glm::length(glm::vec3(transformation[0])),
+			glm::length(glm::vec3(transformation[1])),
+			glm::length(glm::vec3(transformation[2])));
+		glm::mat3 rotation(glm::vec3(transformation[0]) / pose.scale.x,
+			glm::vec3(transformation[1]) / pose.scale.y,
+			glm::vec3(transformation[2]) / pose.scale.z);
+		pose.rotation = glm::normalize(glm::quat_cast(rotation));
+		return pose;
+	}
+
+	float m_Duration = 0.0f;
+	int m_TicksPerSecond = 0;
 	std::vector<Bone> m_Bones;
-	AssimpNodeData m_RootNode;
+	std::vector<SkeletonNode> m_Skeleton;
+	std::vector<std::string> m_NodeNames;  // of m_Skeleton, for matching clips and masks
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
 };
@@ -1,16 +1,30 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <algorithm>
 #include <map>
 #include <vector>
-#include <assimp/scene.h>
-#include <assimp/Importer.hpp>
 #include "animation.h"
 #include "bone.h"
 
 class Animator
 {
 public:
+	// A clip played over the base animation, on its own clock. An override
+	// layer moves the pose weight of the way to the clip, an additive one adds
+	// how far the clip is from its first key. The mask scales the weight per
+	// node of the skeleton, see Animation::MakeMask
+	struct Layer
+	{
+		Animation* clip = nullptr;
+		float time = 0.0f;
+		float weight = 0.0f;
+		bool additive = false;
+		std::vector<float> mask;          // empty for every node
+		std::vector<int> channels;        // bone of the clip for each node, see Animation::MapChannels
+		std::vector<KeyCursor> cursors;   // one per bone of the clip
+		std::vector<NodePose> reference;  // additive layers, the clip at its first key
+	};
 
 	//default constructor
 	Animator()
@@ -24,54 +38,171 @@ public:
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
 
-		m_FinalBoneMatrices.reserve(100);
+		m_FinalBoneMatrices.reserve(MAX_BONES);
 
-		for (int i = 0; i < 100; i++)
+		for (int i = 0; i < MAX_BONES; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
 	}
 
-	void UpdateAnimation(float dt)
+	// Returns false when nothing moved since the last update, the bone
+	// matrices are then left as they were instead of evaluated again
+	bool UpdateAnimation(float dt)
+	{
+		return UpdateAnimation(dt, m_FinalBoneMatrices.data());
+	}
+
+	// Same as UpdateAnimation but the pose goes to finalBoneMatrices (MAX_BONES
+	// of them), for the animation system that keeps every pose in one buffer
+	bool UpdateAnimation(float dt, glm::mat4* finalBoneMatrices)
 	{
 		m_DeltaTime = dt;
-		if (m_CurrentAnimation)
+		if (!m_CurrentAnimation)
+			return false;
+
+		bool changed = m_PoseChanged || finalBoneMatrices != m_LastBoneMatrices;
+		changed |= Advance(m_CurrentAnimation, m_CurrentTime, dt);
+		if (m_FadeOut.clip)
 		{
-			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
-			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			Advance(m_FadeOut.clip, m_FadeOut.time, dt);
+			m_FadeElapsed += dt;
+			m_FadeOut.weight = 1.0f - m_FadeElapsed / m_FadeDuration;
+			if (m_FadeOut.weight <= 0.0f)
+				m_FadeOut.clip = nullptr;
+			changed = true;
 		}
+		for (Layer& layer : m_Layers)
+			changed |= Advance(layer.clip, layer.time, dt);
+
+		if (!changed)
+			return false;
+		CalculateBoneTransforms(finalBoneMatrices);
+		m_LastBoneMatrices = finalBoneMatrices;
+		m_PoseChanged = false;
+		return true;
 	}
 
+	// Switch to pAnimation at once. The layers stay, matched to its skeleton
+	// by node name
 	void PlayAnimation(Animation* pAnimation)
 	{
+		MapLayers(pAnimation);
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		m_Cursors.clear();
+		m_FadeOut.clip = nullptr;
+		m_PoseChanged = true;
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	// Start pAnimation and fade the one playing out over duration seconds,
+	// both keep playing meanwhile. A fade still going is cut short. The
+	// clips are matched by node name, a clip animating none of the nodes of
+	// pAnimation (another rig) can't be blended and switches at once
+	void CrossFade(Animation* pAnimation, float duration)
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
-
-		if (Bone)
+		if (!m_CurrentAnimation || duration <= 0.0f)
 		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
+			PlayAnimation(pAnimation);
+			return;
 		}
+		std::vector<int> channels = m_CurrentAnimation->MapChannels(*pAnimation);
+		if (std::none_of(channels.begin(), channels.end(), [](int channel) { return channel >= 0; }))
+		{
+			PlayAnimation(pAnimation);
+			return;
+		}
+
+		// the clip playing now becomes a layer over the new one, going from 1 to 0
+		MapLayers(pAnimation);
+		m_FadeOut.clip = m_CurrentAnimation;
+		m_FadeOut.time = m_CurrentTime;
+		m_FadeOut.weight = 1.0f;
+		m_FadeOut.channels = std::move(channels);
+		m_FadeOut.cursors = m_Cursors;
+		m_FadeOut.cursors.resize(m_CurrentAnimation->GetBones().size());
+		m_FadeElapsed = 0.0f;
+		m_FadeDuration = duration;
+
+		m_CurrentAnimation = pAnimation;
+		m_CurrentTime = 0.0f;
+		m_Cursors.clear();
+		m_PoseChanged = true;
+	}
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+	// Play clip over the current animation, returns the index of the layer.
+	// Its bones are matched to the nodes by name, a mask is per node of the
+	// current animation (see Animation::MakeMask). The tables are built here,
+	// updating the layer doesn't allocate
+	size_t AddLayer(Animation* clip, float weight, bool additive = false, const std::vector<float>& mask = std::vector<float>())
+	{
+		Layer layer;
+		layer.clip = clip;
+		layer.weight = weight;
+		layer.additive = additive;
+		layer.mask = mask;
+		layer.cursors.resize(clip->GetBones().size());
+		MapLayer(layer, *m_CurrentAnimation);
+		m_Layers.push_back(std::move(layer));
+		m_PoseChanged = true;
+		return m_Layers.size() - 1;
+	}
+
+	void SetLayerWeight(size_t layer, float weight)
+	{
+		m_Layers[layer].weight = weight;
+		m_PoseChanged = true;
+	}
+
+	// Jump the layer to time, in ticks of its clip
+	void SetLayerTime(size_t layer, float time)
+	{
+		m_Layers[layer].time = time;
+		m_PoseChanged = true;
+	}
+
+	void RemoveLayers()
+	{
+		m_Layers.clear();
+		m_PoseChanged = true;
+	}
+
+	// Playback rate of every clip, 0 holds the pose
+	void SetSpeed(float speed)
+	{
+		m_Speed = speed;
+	}
 
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
+	// Jump to time, in ticks of the animation
+	void SetTime(float time)
+	{
+		m_CurrentTime = time;
+		m_PoseChanged = true;
+	}
+	float GetTime() const { return m_CurrentTime; }
+
+	// One pass over the flat skeleton of the animation, parents come first so
+	// their global transform is ready when the children need it. When
+	// blending, each node is sampled in every clip and blended on the spot
+	void CalculateBoneTransforms(glm::mat4* finalBoneMatrices)
+	{
+		const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+		const std::vector<Bone>& bones = m_CurrentAnimation->GetBones();
+		m_GlobalTransforms.resize(skeleton.size());
+		m_Cursors.resize(bones.size());
+		bool blending = m_FadeOut.clip || !m_Layers.empty();
+
+		for (size_t i = 0; i < skeleton.size(); i++)
 		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
-		}
+			const SkeletonNode& node = skeleton[i];
+			glm::mat4 nodeTransform;
+			if (blending)
+				nodeTransform = BlendNode(node, i, bones);
+			else
+				nodeTransform = (node.channel >= 0) ? bones[node.channel].Evaluate(m_CurrentTime, m_Cursors[node.channel]) : node.transformation;
+			m_GlobalTransforms[i] = (node.parent >= 0) ? m_GlobalTransforms[node.parent] * nodeTransform : nodeTransform;
 
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
+			if (node.boneId >= 0)
+				finalBoneMatrices[node.boneId] = m_GlobalTransforms[i] * node.offset;
+		}
 	}
 
 	std::vector<glm::mat4> GetFinalBoneMatrices()
@@ -80,9 +211,102 @@ public:
 	}
 
 private:
+	// Move time on by dt in ticks of clip, looping. True if it moved
+	bool Advance(Animation* clip, float& time, float dt) const
+	{
+		float previous = time;
+		time += clip->GetTicksPerSecond() * dt * m_Speed;
+		time = fmod(time, clip->GetDuration());
+		return time != previous;
+	}
+
+	// Local transform of node i: the current animation sampled, then the
+	// fade and each layer blended over it in turn, all in one visit of the
+	// node: the pose goes from the first sample to the matrix without being
+	// stored and read back between the clips
+	glm::mat4 BlendNode(const SkeletonNode& node, size_t i, const std::vector<Bone>& bones)
+	{
+		int channel = node.channel;
+		bool animated = channel >= 0;  // whether a clip moved the node from its transformation
+		NodePose pose = animated ? bones[channel].Sample(m_CurrentTime, m_Cursors[channel]) : node.rest;
+		if (m_FadeOut.clip)
+			animated |= ApplyLayer(m_FadeOut, node, i, animated, pose);
+		for (Layer& layer : m_Layers)
+			animated |= ApplyLayer(layer, node, i, animated, pose);
+		// nodes nothing animates keep their exact transformation
+		return animated ? PoseMatrix(pose) : node.transformation;
+	}
+
+	// Blend layer into the pose of node i, true if it moved the node. Nodes
+	// the layer doesn't weigh on (weight 0 or masked out) aren't sampled
+	static bool ApplyLayer(Layer& layer, const SkeletonNode& node, size_t i, bool animated, NodePose& pose)
+	{
+		float weight = layer.mask.empty() ? layer.weight : layer.weight * layer.mask[i];
+		if (weight <= 0.0f)
+			return false;
+		int channel = layer.channels[i];
+		if (channel < 0)
+		{
+			// the clip holds the node at rest: nothing to add, nothing to blend if it is already there
+			if (layer.additive || !animated)
+				return false;
+			BlendPose(pose, node.rest, weight);
+			return true;
+		}
+
+		NodePose sample = layer.clip->GetBones()[channel].Sample(layer.time, layer.cursors[channel]);
+		if (layer.additive)
+			AddPose(pose, sample, layer.reference[i], weight);
+		else
+			BlendPose(pose, sample, weight);
+		return true;
+	}
+
+	// Tables of layer for the nodes of skeleton: the bone of its clip for
+	// each node by name, the mask moved over from the current animation and
+	// the reference pose of an additive layer
+	void MapLayer(Layer& layer, const Animation& skeleton) const
+	{
+		layer.channels = layer.clip->MapChannels(skeleton);
+		if (!layer.mask.empty() && m_CurrentAnimation != &skeleton)
+			layer.mask = m_CurrentAnimation->MapMask(layer.mask, skeleton);
+		layer.reference.clear();
+		if (!layer.additive)
+			return;
+		const std::vector<SkeletonNode>& nodes = skeleton.GetSkeleton();
+		layer.reference.resize(nodes.size());
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			int channel = layer.channels[i];
+			KeyCursor cursor;
+			layer.reference[i] = (channel >= 0) ? layer.clip->GetBones()[channel].Sample(0.0f, cursor) : nodes[i].rest;
+		}
+	}
+
+	// Every layer moved onto the skeleton of animation, before it becomes the current one
+	void MapLayers(Animation* animation)
+	{
+		if (!m_CurrentAnimation || m_CurrentAnimation->SharesSkeleton(*animation))
+			return;
+		for (Layer& layer : m_Layers)
+			MapLayer(layer, *animation);
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	std::vector<glm::mat4> m_GlobalTransforms;  // of every node of the skeleton, reused each frame
+	std::vector<KeyCursor> m_Cursors;  // one per channel of the animation
 	Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
+	float m_Speed = 1.0f;
+
+	std::vector<Layer> m_Layers;
+	Layer m_FadeOut;  // the clip being faded out, no clip when there is no fade
+	float m_FadeElapsed = 0.0f;
+	float m_FadeDuration = 0.0f;
 
+	// evaluation cache: the bone matrices written last and whether
+	// something other than time changed since
+	glm::mat4* m_LastBoneMatrices = nullptr;
+	bool m_PoseChanged = true;
 };
\ No newline at end of file
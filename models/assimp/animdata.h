@@ -1,6 +1,10 @@
 #pragma once
 
 #include<glm/glm.hpp>
+#include<glm/gtc/quaternion.hpp>
+
+/*bones of a character palette, MAX_BONES in shaders/animation.vs*/
+#define MAX_BONES 100
 
 struct BoneInfo
 {
@@ -11,4 +15,66 @@ struct BoneInfo
 	glm::mat4 offset;
 
 };
-#pragma once
\ No newline at end of file
+
+/*local transform of a node in parts, so poses can be blended before making the matrix*/
+struct NodePose
+{
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+
+/*translation * rotation * scale written out, without multiplying the three matrices*/
+inline glm::mat4 PoseMatrix(const NodePose& pose)
+{
+	const glm::quat& q = pose.rotation;
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	const glm::vec3& s = pose.scale;
+	return glm::mat4(
+		(1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f,
+		2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f,
+		2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f,
+		pose.position.x, pose.position.y, pose.position.z, 1.0f);
+}
+
+/*pose moved weight of the way to target, rotations along the shortest path*/
+inline void BlendPose(NodePose& pose, const NodePose& target, float weight)
+{
+	pose.position = glm::mix(pose.position, target.position, weight);
+	pose.scale = glm::mix(pose.scale, target.scale, weight);
+	// normalized lerp, close enough to slerp between poses of the same rig and cheaper
+	float side = glm::dot(pose.rotation, target.rotation) < 0.0f ? -1.0f : 1.0f;
+	pose.rotation = glm::normalize(pose.rotation * (1.0f - weight) + target.rotation * (side * weight));
+}
+
+/*adds weight of the difference between sample and reference to pose*/
+inline void AddPose(NodePose& pose, const NodePose& sample, const NodePose& reference, float weight)
+{
+	pose.position += (sample.position - reference.position) * weight;
+	pose.scale *= glm::mix(glm::vec3(1.0f), sample.scale / reference.scale, weight);
+	glm::quat delta = glm::inverse(reference.rotation) * sample.rotation;
+	glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+	float side = glm::dot(identity, delta) < 0.0f ? -1.0f : 1.0f;
+	pose.rotation = glm::normalize(pose.rotation * glm::normalize(identity * (1.0f - weight) + delta * (side * weight)));
+}
+
+/*node of the skeleton baked by Animation, parents come before their children*/
+struct SkeletonNode
+{
+	/*index of the parent node, -1 for the root*/
+	int parent;
+
+	/*index of the animated bone (channel) driving the node, -1 when it keeps its transformation*/
+	int channel;
+
+	/*index in finalBoneMatrices, -1 when no vertex is skinned to the node*/
+	int boneId;
+
+	glm::mat4 transformation;
+	glm::mat4 offset;
+
+	/*transformation split in parts, what blending uses when a clip doesn't animate the node*/
+	NodePose rest;
+};
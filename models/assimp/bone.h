@@ -3,122 +3,202 @@
 /* Container for bone data */
 
 #include <vector>
-#include <assimp/scene.h>
 #include <list>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <glm/glm.hpp>
 //#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
-#include "assimp_glm_helpers.h"
+#include "../cookedModel.h"
+#include "animdata.h"
 
-struct KeyPosition
+// Keys of one component, times and values in parallel arrays so the search
+// only walks the times
+template<typename T>
+struct KeyTrack
 {
-	glm::vec3 position;
-	float timeStamp;
-};
+	std::vector<float> times;
+	std::vector<T> values;
+	// set by Prepare when the keys are evenly spaced, the key is then found
+	// from the time without searching
+	bool uniform = false;
+	float start = 0.0f;
+	float keysPerTick = 0.0f;
 
-struct KeyRotation
-{
-	glm::quat orientation;
-	float timeStamp;
+	int Count() const { return static_cast<int>(times.size()); }
+
+	void Prepare()
+	{
+		uniform = false;
+		int count = Count();
+		if (count < 2)
+			return;
+		// a track that holds one value all along (most of them in a baked
+		// clip) is kept as its first key, sampled without a search
+		if (std::all_of(values.begin() + 1, values.end(), [this](const T& value) { return value == values[0]; }))
+		{
+			times.resize(1);
+			values.resize(1);
+			return;
+		}
+		float step = (times[count - 1] - times[0]) / (count - 1);
+		if (step <= 0.0f)
+			return;
+		for (int index = 1; index < count; ++index)
+		{
+			if (std::abs(times[index] - (times[0] + index * step)) > step * 0.01f)
+				return;
+		}
+		uniform = true;
+		start = times[0];
+		keysPerTick = 1.0f / step;
+	}
+
+	// Key to interpolate from at animationTime, clamped to the last pair.
+	// cursor is the key found last time: playback moves forward a key or
+	// less per frame so it is tried first, seeks fall back to a binary search
+	int Find(float animationTime, int& cursor) const
+	{
+		int last = Count() - 2;
+		if (uniform)
+		{
+			int index = static_cast<int>((animationTime - start) * keysPerTick);
+			index = index < 0 ? 0 : (index > last ? last : index);
+			// the keys are only nearly even, the right one is at most a step away
+			if (index > 0 && animationTime < times[index])
+				index--;
+			else if (index < last && animationTime >= times[index + 1])
+				index++;
+			return index;
+		}
+
+		if (cursor < 0 || cursor > last)
+			cursor = 0;
+		if (animationTime >= times[cursor])
+		{
+			if (cursor == last || animationTime < times[cursor + 1])
+				return cursor;
+			if (cursor + 1 == last || animationTime < times[cursor + 2])
+				return ++cursor;
+		}
+
+		int index = static_cast<int>(std::upper_bound(times.begin(), times.end(), animationTime) - times.begin()) - 1;
+		cursor = index < 0 ? 0 : (index > last ? last : index);
+		return cursor;
+	}
 };
 
-struct KeyScale
+// Where the last sample of a bone was, kept by whoever plays it
+struct KeyCursor
 {
-	glm::vec3 scale;
-	float timeStamp;
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
 };
 
 class Bone
 {
 public:
-	Bone(const std::string& name, int ID, const aiNodeAnim* channel)
+	// Keys of the channel in the cooked model, copied out of the mapping
+	Bone(const std::string& name, int ID, const CookedModel& model, const CookedModel::ChannelRecord& channel)
 		:
 		m_Name(name),
 		m_ID(ID),
 		m_LocalTransform(1.0f)
 	{
-		m_NumPositions = channel->mNumPositionKeys;
+		m_Positions.times.assign(model.getPositionTimes() + channel.firstPosition,
+			model.getPositionTimes() + channel.firstPosition + channel.positionCount);
+		m_Positions.values.assign(model.getPositionValues() + channel.firstPosition,
+			model.getPositionValues() + channel.firstPosition + channel.positionCount);
 
-		for (int positionIndex = 0; positionIndex < m_NumPositions; ++positionIndex)
+		m_Rotations.times.assign(model.getRotationTimes() + channel.firstRotation,
+			model.getRotationTimes() + channel.firstRotation + channel.rotationCount);
+		m_Rotations.values.resize(channel.rotationCount);
+		for (uint32_t rotationIndex = 0; rotationIndex < channel.rotationCount; ++rotationIndex)
 		{
-			aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
-			float timeStamp = channel->mPositionKeys[positionIndex].mTime;
-			KeyPosition data;
-			data.position = AssimpGLMHelpers::GetGLMVec(aiPosition);
-			data.timeStamp = timeStamp;
-			m_Positions.push_back(data);
+			const glm::vec4& orientation = model.getRotationValues()[channel.firstRotation + rotationIndex];
+			m_Rotations.values[rotationIndex] = glm::quat(orientation.w, orientation.x, orientation.y, orientation.z);
 		}
 
-		m_NumRotations = channel->mNumRotationKeys;
-		for (int rotationIndex = 0; rotationIndex < m_NumRotations; ++rotationIndex)
-		{
-			aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
-			float timeStamp = channel->mRotationKeys[rotationIndex].mTime;
-			KeyRotation data;
-			data.orientation = AssimpGLMHelpers::GetGLMQuat(aiOrientation);
-			data.timeStamp = timeStamp;
-			m_Rotations.push_back(data);
-		}
+		m_Scales.times.assign(model.getScaleTimes() + channel.firstScale,
+			model.getScaleTimes() + channel.firstScale + channel.scaleCount);
+		m_Scales.values.assign(model.getScaleValues() + channel.firstScale,
+			model.getScaleValues() + channel.firstScale + channel.scaleCount);
 
-		m_NumScalings = channel->mNumScalingKeys;
-		for (int keyIndex = 0; keyIndex < m_NumScalings; ++keyIndex)
-		{
-			aiVector3D scale = channel->mScalingKeys[keyIndex].mValue;
-			float timeStamp = channel->mScalingKeys[keyIndex].mTime;
-			KeyScale data;
-			data.scale = AssimpGLMHelpers::GetGLMVec(scale);
-			data.timeStamp = timeStamp;
-			m_Scales.push_back(data);
-		}
+		Prepare();
 	}
-	
-	void Update(float animationTime)
+
+	Bone(const std::string& name, int ID, KeyTrack<glm::vec3> positions, KeyTrack<glm::quat> rotations, KeyTrack<glm::vec3> scales)
+		:
+		m_Positions(std::move(positions)),
+		m_Rotations(std::move(rotations)),
+		m_Scales(std::move(scales)),
+		m_LocalTransform(1.0f),
+		m_Name(name),
+		m_ID(ID)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		Prepare();
 	}
-	glm::mat4 GetLocalTransform() const { return m_LocalTransform; }
-	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() const { return m_ID; }
-	
 
+	void Update(float animationTime)
+	{
+		m_LocalTransform = Evaluate(animationTime, m_Cursor);
+	}
 
-	int GetPositionIndex(float animationTime) const
+	// Local transform at animationTime, the bone isn't changed so animators
+	// can share it, each one with its own cursor
+	glm::mat4 Evaluate(float animationTime, KeyCursor& cursor) const
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return PoseMatrix(Sample(animationTime, cursor));
 	}
 
-	int GetRotationIndex(float animationTime) const
+	// Same as Evaluate with the parts kept apart, for blending
+	NodePose Sample(float animationTime, KeyCursor& cursor) const
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
+		NodePose pose;
+		if (m_SharedTimes)
 		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
+			// positions and rotations keyed at the same times (usual for baked
+			// clips), the key is found once for both
+			int p0Index = m_Positions.Find(animationTime, cursor.position);
+			float scaleFactor = GetScaleFactor(m_Positions.times[p0Index],
+				m_Positions.times[p0Index + 1], animationTime);
+			pose.position = glm::mix(m_Positions.values[p0Index], m_Positions.values[p0Index + 1], scaleFactor);
+			pose.rotation = MixRotations(p0Index, scaleFactor);
 		}
-		assert(0);
+		else
+		{
+			pose.position = InterpolatePosition(animationTime, cursor.position);
+			pose.rotation = InterpolateRotation(animationTime, cursor.rotation);
+		}
+		pose.scale = InterpolateScaling(animationTime, cursor.scale);
+		return pose;
 	}
 
-	int GetScaleIndex(float animationTime) const
+	// Resample every track with more than one key at keysPerTick, evenly
+	// spaced keys are then found without searching. Sampled with the same
+	// interpolation as playback, the keys in between are lost
+	void Resample(float keysPerTick)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		ResampleTrack(m_Positions, keysPerTick, [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); });
+		ResampleTrack(m_Rotations, keysPerTick, [](const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); });
+		ResampleTrack(m_Scales, keysPerTick, [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); });
+		Prepare();
 	}
 
+	const KeyTrack<glm::vec3>& GetPositions() const { return m_Positions; }
+	const KeyTrack<glm::quat>& GetRotations() const { return m_Rotations; }
+	const KeyTrack<glm::vec3>& GetScales() const { return m_Scales; }
+	glm::mat4 GetLocalTransform() const { return m_LocalTransform; }
+	const std::string& GetBoneName() const { return m_Name; }
+	int GetBoneID() const { return m_ID; }
+	
+
 
 private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime) const
+	static float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
 		float scaleFactor = 0.0f;
 		float midWayLength = animationTime - lastTimeStamp;
@@ -127,59 +207,131 @@ private:
 		return scaleFactor;
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	void Prepare()
 	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+		m_Positions.Prepare();
+		m_Rotations.Prepare();
+		m_Scales.Prepare();
+		m_SharedTimes = m_Positions.Count() > 1 && m_Positions.times == m_Rotations.times;
+		if (1 == m_Rotations.Count())
+			m_Rotations.values[0] = glm::normalize(m_Rotations.values[0]);
+		PrepareArcs();
+	}
 
-		int p0Index = GetPositionIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
+	// What glm::slerp works out from the two keys alone, once per pair
+	// instead of at every sample: the side to take, the angle between the
+	// keys and 1 / its sine
+	struct RotationArc
+	{
+		float side = 1.0f;
+		float angle = 0.0f;  // 0 when the keys are too close, mixed linearly
+		float inverseSin = 0.0f;
+	};
+
+	void PrepareArcs()
+	{
+		int count = m_Rotations.Count();
+		m_RotationArcs.assign(count > 1 ? count - 1 : 0, RotationArc());
+		for (int index = 0; index + 1 < count; ++index)
+		{
+			RotationArc& arc = m_RotationArcs[index];
+			float cosTheta = glm::dot(m_Rotations.values[index], m_Rotations.values[index + 1]);
+			if (cosTheta < 0.0f)
+			{
+				arc.side = -1.0f;
+				cosTheta = -cosTheta;
+			}
+			if (cosTheta > 1.0f - std::numeric_limits<float>::epsilon())
+				continue;
+			arc.angle = std::acos(cosTheta);
+			arc.inverseSin = 1.0f / std::sin(arc.angle);
+		}
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	template<typename T, typename Mix>
+	static void ResampleTrack(KeyTrack<T>& track, float keysPerTick, Mix mix)
 	{
-		if (1 == m_NumRotations)
+		int count = track.Count();
+		if (count < 2 || keysPerTick <= 0.0f)
+			return;
+		float first = track.times[0];
+		int resampledCount = static_cast<int>(std::ceil((track.times[count - 1] - first) * keysPerTick)) + 1;
+		if (resampledCount < 2)
+			return;
+
+		KeyTrack<T> resampled;
+		resampled.times.resize(resampledCount);
+		resampled.values.resize(resampledCount);
+		int cursor = 0;
+		for (int index = 0; index < resampledCount; ++index)
 		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
+			float time = first + index / keysPerTick;
+			int p0Index = track.Find(time, cursor);
+			float scaleFactor = GetScaleFactor(track.times[p0Index], track.times[p0Index + 1], time);
+			resampled.times[index] = time;
+			resampled.values[index] = mix(track.values[p0Index], track.values[p0Index + 1], std::min(scaleFactor, 1.0f));
 		}
+		resampled.Prepare();
+		track = std::move(resampled);
+	}
+
+	glm::vec3 InterpolatePosition(float animationTime, int& cursor) const
+	{
+		if (1 == m_Positions.Count())
+			return m_Positions.values[0];
 
-		int p0Index = GetRotationIndex(animationTime);
+		int p0Index = m_Positions.Find(animationTime, cursor);
 		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
+		float scaleFactor = GetScaleFactor(m_Positions.times[p0Index],
+			m_Positions.times[p1Index], animationTime);
+		return glm::mix(m_Positions.values[p0Index], m_Positions.values[p1Index]
 			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
+	}
+
+	glm::quat InterpolateRotation(float animationTime, int& cursor) const
+	{
+		if (1 == m_Rotations.Count())
+			return m_Rotations.values[0];  // normalized by Prepare
 
+		int p0Index = m_Rotations.Find(animationTime, cursor);
+		int p1Index = p0Index + 1;
+		float scaleFactor = GetScaleFactor(m_Rotations.times[p0Index],
+			m_Rotations.times[p1Index], animationTime);
+		return MixRotations(p0Index, scaleFactor);
+	}
+
+	// glm::slerp with the arc of the pair looked up, see PrepareArcs
+	glm::quat MixRotations(int p0Index, float scaleFactor) const
+	{
+		const RotationArc& arc = m_RotationArcs[p0Index];
+		const glm::quat& from = m_Rotations.values[p0Index];
+		glm::quat to = m_Rotations.values[p0Index + 1] * arc.side;
+		if (arc.angle == 0.0f)
+			return glm::normalize(from * (1.0f - scaleFactor) + to * scaleFactor);
+		float fromWeight = std::sin((1.0f - scaleFactor) * arc.angle) * arc.inverseSin;
+		float toWeight = std::sin(scaleFactor * arc.angle) * arc.inverseSin;
+		return glm::normalize(from * fromWeight + to * toWeight);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 InterpolateScaling(float animationTime, int& cursor) const
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+		if (1 == m_Scales.Count())
+			return m_Scales.values[0];
 
-		int p0Index = GetScaleIndex(animationTime);
+		int p0Index = m_Scales.Find(animationTime, cursor);
 		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
+		float scaleFactor = GetScaleFactor(m_Scales.times[p0Index],
+			m_Scales.times[p1Index], animationTime);
+		return glm::mix(m_Scales.values[p0Index], m_Scales.values[p1Index]
 			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
 	}
 
-	std::vector<KeyPosition> m_Positions;
-	std::vector<KeyRotation> m_Rotations;
-	std::vector<KeyScale> m_Scales;
-	int m_NumPositions;
-	int m_NumRotations;
-	int m_NumScalings;
+	KeyTrack<glm::vec3> m_Positions;
+	KeyTrack<glm::quat> m_Rotations;
+	KeyTrack<glm::vec3> m_Scales;
+	std::vector<RotationArc> m_RotationArcs;  // one per pair of rotation keys
+	KeyCursor m_Cursor;
+	bool m_SharedTimes = false;  // positions and rotations have the same key times
 
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
@@ -8,30 +8,12 @@
 
 #include "../../shaders/shader.h"
 #include "../../camera/camera.h"
+#include "vertex.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
@@ -41,24 +23,24 @@ struct Texture {
 class Mesh {
 public:
     // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
     vector<Texture>      textures;
+    unsigned int indexCount;
     unsigned int VAO;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, the vertices and indices are uploaded as they are (straight
+    // from the cooked model file) and not kept
+    Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
+        this->indexCount = static_cast<unsigned int>(indexCount);
         this->textures = textures;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(vertices, vertexCount, indices);
     }
 
-    // render the mesh
-    void Draw(Shader &shader, Camera &camera)
+    // render the mesh, instanceCount copies of it (the skinning shader picks
+    // the palette of each with gl_InstanceID)
+    void Draw(Shader &shader, Camera &camera, unsigned int instanceCount = 1)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -119,7 +101,7 @@ public:
         
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -131,7 +113,7 @@ private:
     unsigned int VBO, EBO;
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices)
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
@@ -144,10 +126,10 @@ private:
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);  
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -6,9 +6,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
 #include "mesh.h"
 #include "../../shaders/shader.h"
@@ -19,8 +16,12 @@
 #include <iostream>
 #include <map>
 #include <vector>
-#include "assimp_glm_helpers.h"
+#include <cstring>
 #include "animdata.h"
+#include "../../collision/collisionMesh.h"
+#include "../../resources/resource_manager.h"
+#include "../cookedModel.h"
+#include "../modelCooker.h"
 
 //using namespace std;
 
@@ -31,6 +32,7 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
+    string sourcePath;
     bool gammaCorrection;
 	
 	Model() : gammaCorrection(false) {}
@@ -41,8 +43,9 @@ public:
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes and take camera as parameter and Animator
-    void Draw(Shader &shader, Camera &camera)
+    // draws the model, and thus all its meshes and take camera as parameter,
+    // instanceCount characters at once from the bound bone palette
+    void Draw(Shader &shader, Camera &camera, unsigned int instanceCount = 1)
     {
 		//auto transforms = animator->GetFinalBoneMatrices();
 		////for loop transforms
@@ -53,10 +56,32 @@ public:
 
 
         for(unsigned int i = 0; i < meshes.size(); i++){
-            meshes[i].Draw(shader, camera);
+            meshes[i].Draw(shader, camera, instanceCount);
 		}
     }
     
+    // Triangles of every mesh in model space (bind pose), from the cache next
+    // to the model file when it is up to date, cooked and cached otherwise
+    bool GetCollisionMesh(CollisionMesh& mesh) const
+    {
+        if (mesh.loadCache(sourcePath))
+            return true;
+
+        // the meshes don't keep their vertices, taken from the cooked model again
+        CookedModel cooked;
+        if (!cooked.map(sourcePath) && !ModelCooker::Cook(sourcePath, cooked))
+            return false;
+        mesh.positions.clear();
+        mesh.indices.clear();
+        cooked.getTriangles(mesh.positions, mesh.indices);
+        if (mesh.indices.empty())
+            return false;
+
+        mesh.cook();
+        mesh.saveCache(sourcePath);
+        return true;
+    }
+
 	auto& GetBoneInfoMap() { return m_BoneInfoMap; }
 	int& GetBoneCount() { return m_BoneCounter; }
 	
@@ -66,152 +91,40 @@ private:
 	std::map<string, BoneInfo> m_BoneInfoMap;
 	int m_BoneCounter = 0;
 
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // loads the cooked model next to the file (cooked with ASSIMP on the first run) and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        CookedModel cooked;
+        if (!cooked.map(path) && !ModelCooker::Cook(path, cooked))
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            cout << "ERROR::MODEL:: failed to load " << path << endl;
             return;
         }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        sourcePath = path;
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
-    }
-
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
-    {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        const CookedModel::BoneRecord* bones = cooked.getBones();
+        for (size_t i = 0; i < cooked.getBoneCount(); i++)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            BoneInfo boneInfo;
+            boneInfo.id = bones[i].id;
+            boneInfo.offset = bones[i].offset;
+            m_BoneInfoMap[cooked.getString(bones[i].name)] = boneInfo;
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        m_BoneCounter = static_cast<int>(cooked.getBoneCount());
+
+        // the vertices are already in the layout of the buffers, uploaded straight from the mapping
+        const CookedModel::MeshRecord* records = cooked.getMeshes();
+        for (size_t i = 0; i < cooked.getMeshCount(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            const CookedModel::MeshRecord& record = records[i];
+            meshes.push_back(Mesh(cooked.getVertices() + record.firstVertex, record.vertexCount,
+                                  cooked.getIndices() + record.firstIndex, record.indexCount,
+                                  loadMaterialTextures(cooked, record)));
         }
-
     }
 
-	void SetVertexBoneDataToDefault(Vertex& vertex)
-	{
-		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
-		{
-			vertex.m_BoneIDs[i] = -1;
-			vertex.m_Weights[i] = 0.0f;
-		}
-	}
-
-
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene)
-	{
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
-
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-		{
-			Vertex vertex;
-			SetVertexBoneDataToDefault(vertex);
-			vertex.Position = AssimpGLMHelpers::GetGLMVec(mesh->mVertices[i]);
-			vertex.Normal = AssimpGLMHelpers::GetGLMVec(mesh->mNormals[i]);
-			
-			if (mesh->mTextureCoords[0])
-			{
-				glm::vec2 vec;
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.TexCoords = vec;
-			}
-			else
-				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-			vertices.push_back(vertex);
-		}
-		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-		{
-			aiFace face = mesh->mFaces[i];
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
-		}
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-		ExtractBoneWeightForVertices(vertices,mesh,scene);
-
-		return Mesh(vertices, indices, textures);
-	}
-
-	void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
-	{
-		for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
-		{
-			if (vertex.m_BoneIDs[i] < 0)
-			{
-				vertex.m_Weights[i] = weight;
-				vertex.m_BoneIDs[i] = boneID;
-				break;
-			}
-		}
-	}
-
-
-	void ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, aiMesh* mesh, const aiScene* scene)
-	{
-		auto& boneInfoMap = m_BoneInfoMap;
-		int& boneCount = m_BoneCounter;
-
-		for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
-		{
-			int boneID = -1;
-			std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
-			if (boneInfoMap.find(boneName) == boneInfoMap.end())
-			{
-				BoneInfo newBoneInfo;
-				newBoneInfo.id = boneCount;
-				newBoneInfo.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(mesh->mBones[boneIndex]->mOffsetMatrix);
-				boneInfoMap[boneName] = newBoneInfo;
-				boneID = boneCount;
-				boneCount++;
-			}
-			else
-			{
-				boneID = boneInfoMap[boneName].id;
-			}
-			assert(boneID != -1);
-			auto weights = mesh->mBones[boneIndex]->mWeights;
-			int numWeights = mesh->mBones[boneIndex]->mNumWeights;
-
-			for (int weightIndex = 0; weightIndex < numWeights; ++weightIndex)
-			{
-				int vertexId = weights[weightIndex].mVertexId;
-				float weight = weights[weightIndex].mWeight;
-				assert(vertexId <= vertices.size());
-				SetVertexBoneData(vertices[vertexId], boneID, weight);
-			}
-		}
-	}
-
-
 	unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false)
 	{
 		string filename = string(path);
@@ -232,58 +145,24 @@ private:
 		std::string newDirectory = "models/textures";
     	filename = newDirectory + '/' + filename;
 
-		//need ajustments for loading properly
-		
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
-
-		int width, height, nrComponents;
-		unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			GLenum format;
-			if (nrComponents == 1)
-				format = GL_RED;
-			else if (nrComponents == 3)
-				format = GL_RGB;
-			else if (nrComponents == 4)
-				format = GL_RGBA;
-
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			stbi_image_free(data);
-			std::cout << "Texture loaded successfully" << std::endl;
-		}
-		else
-		{
-			std::cout << "Texture failed to load at path: " << path << std::endl;
-			stbi_image_free(data);
-		}
-
-		return textureID;
+		// Through the texture cache, decoded in the background or the cooked version
+		return ResourceManager::AcquireTexture(filename);
 	}
     
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // checks all textures of a mesh and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(const CookedModel& cooked, const CookedModel::MeshRecord& record)
     {
         vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        const CookedModel::TextureRecord* records = cooked.getTextures() + record.firstTexture;
+        for(unsigned int i = 0; i < record.textureCount; i++)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
+            const char* path = cooked.getString(records[i].path);
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
             bool skip = false;
             for(unsigned int j = 0; j < textures_loaded.size(); j++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if(std::strcmp(textures_loaded[j].path.data(), path) == 0)
                 {
                     textures.push_back(textures_loaded[j]);
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
@@ -293,9 +172,9 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
+                texture.id = TextureFromFile(path, this->directory);
+                texture.type = cooked.getString(records[i].type);
+                texture.path = path;
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
             }
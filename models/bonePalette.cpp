@@ -0,0 +1,122 @@
+#include "bonePalette.h"
+#include <algorithm>
+#include <cstring>
+
+BonePaletteBuffer::BonePaletteBuffer()
+    : buffer(0), batchCharacters(1), batchDataSize(CHARACTER_DATA_SIZE), batchStride(0), batchCapacity(0), frame(0), characterCount(0) {
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        fences[i] = 0;
+    }
+}
+
+unsigned int BonePaletteBuffer::getMaxBatchCharacters() {
+    GLint maxBlockSize = 16384;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+    size_t characters = static_cast<size_t>(maxBlockSize) / CHARACTER_DATA_SIZE;
+    return static_cast<unsigned int>(std::max(static_cast<size_t>(1), std::min(characters, static_cast<size_t>(MAX_PALETTE_CHARACTERS))));
+}
+
+std::string BonePaletteBuffer::getShaderDefines(unsigned int batchCharacters) {
+    return "#define PALETTE_CHARACTERS " + std::to_string(batchCharacters) + "\n";
+}
+
+void BonePaletteBuffer::bindShader(const Shader& shader) {
+    GLuint blockIndex = glGetUniformBlockIndex(shader.ID, "BonePalette");
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.ID, blockIndex, BINDING);
+    }
+}
+
+void BonePaletteBuffer::setBatchCharacters(unsigned int batchCharacters) {
+    batchCharacters = std::max(1u, batchCharacters);
+    if (batchCharacters == this->batchCharacters) return;
+    destroy();
+    this->batchCharacters = batchCharacters;
+    batchDataSize = batchCharacters * CHARACTER_DATA_SIZE;
+}
+
+unsigned int BonePaletteBuffer::getBatchCharacters() const {
+    return batchCharacters;
+}
+
+// Every frame of the ring sized for batchCount batches, the old contents
+// are dropped so the fences go with them
+void BonePaletteBuffer::reserve(size_t batchCount) {
+    if (batchCount <= batchCapacity) return;
+    if (!buffer) {
+        glGenBuffers(1, &buffer);
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        batchStride = (batchDataSize + alignment - 1) / alignment * alignment;
+    }
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    batchCapacity = batchCount;
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, FRAME_COUNT * batchCapacity * batchStride, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void BonePaletteBuffer::upload(const glm::mat4* palette, const glm::mat4* transforms, size_t count) {
+    characterCount = count;
+    size_t batchCount = getBatchCount();
+    if (batchCount == 0) return;
+
+    // Everything drawn from the current frame was issued before this fence
+    if (buffer && !fences[frame]) {
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    reserve(batchCount);
+    frame = (frame + 1) % FRAME_COUNT;
+    if (fences[frame]) {
+        glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fences[frame]);
+        fences[frame] = 0;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    size_t frameSize = batchCapacity * batchStride;
+    unsigned char* mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, frame * frameSize, batchCount * batchStride,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if (mapped) {
+        for (size_t batch = 0; batch < batchCount; ++batch) {
+            size_t first = batch * batchCharacters;
+            size_t count = std::min(characterCount - first, static_cast<size_t>(batchCharacters));
+            unsigned char* destination = mapped + batch * batchStride;
+            std::memcpy(destination, palette + first * MAX_BONES, count * MAX_BONES * sizeof(glm::mat4));
+            std::memcpy(destination + MAX_BONES * batchCharacters * sizeof(glm::mat4), transforms + first, count * sizeof(glm::mat4));
+        }
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+size_t BonePaletteBuffer::getBatchCount() const {
+    return (characterCount + batchCharacters - 1) / batchCharacters;
+}
+
+unsigned int BonePaletteBuffer::bindBatch(size_t batch) const {
+    size_t offset = (frame * batchCapacity + batch) * batchStride;
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, buffer, offset, batchDataSize);
+    size_t first = batch * batchCharacters;
+    return static_cast<unsigned int>(std::min(characterCount - first, static_cast<size_t>(batchCharacters)));
+}
+
+void BonePaletteBuffer::destroy() {
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    if (buffer) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    batchCapacity = 0;
+    characterCount = 0;
+}
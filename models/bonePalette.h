@@ -0,0 +1,65 @@
+#ifndef BONE_PALETTE_H
+#define BONE_PALETTE_H
+
+#include "../glad/glad.h"
+#include "../shaders/shader.h"
+#include "assimp/animdata.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+
+/*most characters of one instanced draw, PALETTE_CHARACTERS in shaders/animation.vs is defined at load*/
+#define MAX_PALETTE_CHARACTERS 10
+
+// Bone palettes of every character uploaded once a frame into a uniform
+// buffer the skinning shader reads by gl_InstanceID. A uniform block is
+// only guaranteed 16 KB (GL_MAX_UNIFORM_BLOCK_SIZE), about two palettes, so
+// the characters are drawn in batches of as many as the driver's limit
+// holds, each batch a range of the buffer:
+//   mat4 finalBonesMatrices[MAX_BONES * PALETTE_CHARACTERS]
+//   mat4 characterTransforms[PALETTE_CHARACTERS]
+// The shader is compiled with getShaderDefines() of the same count.
+// The buffer is a ring of frames, a fence per frame says when the GPU is
+// done drawing from it so it is written without stalling.
+class BonePaletteBuffer {
+public:
+    BonePaletteBuffer();
+
+    // Characters per batch the uniform block limit allows, at most MAX_PALETTE_CHARACTERS
+    static unsigned int getMaxBatchCharacters();
+    // PALETTE_CHARACTERS for shaders/animation.vs, see ResourceManager::LoadShader
+    static std::string getShaderDefines(unsigned int batchCharacters);
+    // Link the BonePalette block of the shader to the buffer
+    static void bindShader(const Shader& shader);
+
+    // Characters per batch of the shader in use, drops the buffer if it changes
+    void setBatchCharacters(unsigned int batchCharacters);
+    unsigned int getBatchCharacters() const;
+
+    // MAX_BONES matrices then a transform per character, for the next frame
+    void upload(const glm::mat4* palette, const glm::mat4* transforms, size_t count);
+
+    // Batches of the last upload, bindBatch returns how many instances to draw
+    size_t getBatchCount() const;
+    unsigned int bindBatch(size_t batch) const;
+
+    void destroy();
+
+private:
+    static const unsigned int BINDING = 0;
+    static const size_t FRAME_COUNT = 3;
+    static const size_t CHARACTER_DATA_SIZE = (MAX_BONES + 1) * sizeof(glm::mat4);
+
+    GLuint buffer;
+    GLsync fences[FRAME_COUNT];
+    unsigned int batchCharacters;
+    size_t batchDataSize;   // the block of batchCharacters characters
+    size_t batchStride;     // batchDataSize rounded up to the offset alignment
+    size_t batchCapacity;   // batches per frame
+    size_t frame;           // written by the last upload
+    size_t characterCount;
+
+    void reserve(size_t batchCount);
+};
+
+#endif // BONE_PALETTE_H
@@ -0,0 +1,364 @@
+#include "cookedModel.h"
+#include "assimp/animdata.h"
+#include "../resources/sourceStamp.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bumped whenever the cooked layout or the cooking changes
+static const uint32_t COOKED_MODEL_MAGIC = 0x444D5244;  // "DRMD"
+static const uint32_t COOKED_MODEL_VERSION = 2;
+
+struct CookedModelHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;      // same staleness check as the collision mesh cache
+    int64_t sourceModified;
+    uint32_t vertexSize;      // sizeof(Vertex) of the build that cooked it
+    uint32_t sectionCount;
+    float duration;
+    float ticksPerSecond;
+    // followed by sectionCount (offset, count) pairs
+};
+
+uint32_t ModelData::addString(const std::string& text) {
+    // Offset 0 is the empty string, every string ends with a 0
+    if (strings.empty()) strings.push_back('\0');
+    std::string key = std::string(1, '\0') + text + '\0';
+    size_t found = strings.find(key);
+    if (found != std::string::npos) return static_cast<uint32_t>(found + 1);
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings += text;
+    strings.push_back('\0');
+    return offset;
+}
+
+CookedModel::CookedModel() : data(nullptr), size(0), mapping(nullptr), duration(0.0f), ticksPerSecond(0.0f) {
+    std::memset(sections, 0, sizeof(sections));
+}
+
+CookedModel::~CookedModel() {
+    unmap();
+}
+
+std::string CookedModel::getCachePath(const std::string& sourcePath) {
+    return sourcePath + ".dmodel";
+}
+
+size_t CookedModel::elementSize(Section index) {
+    switch (index) {
+    case SECTION_VERTICES: return sizeof(Vertex);
+    case SECTION_INDICES: return sizeof(unsigned int);
+    case SECTION_MESHES: return sizeof(MeshRecord);
+    case SECTION_TEXTURES: return sizeof(TextureRecord);
+    case SECTION_BONES: return sizeof(BoneRecord);
+    case SECTION_NODES: return sizeof(NodeRecord);
+    case SECTION_CHANNELS: return sizeof(ChannelRecord);
+    case SECTION_POSITION_VALUES: return sizeof(glm::vec3);
+    case SECTION_ROTATION_VALUES: return sizeof(glm::vec4);
+    case SECTION_SCALE_VALUES: return sizeof(glm::vec3);
+    case SECTION_STRINGS: return 1;
+    default: return sizeof(float);  // key times
+    }
+}
+
+template<typename T>
+const T* CookedModel::section(Section index) const {
+    return reinterpret_cast<const T*>(data + sections[index].offset);
+}
+
+bool CookedModel::map(const std::string& sourcePath) {
+    unmap();
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!SourceStamp::get(sourcePath, sourceSize, sourceModified)) return false;
+
+    int file = open(getCachePath(sourcePath).c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat info;
+    if (fstat(file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CookedModelHeader)) {
+        close(file);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED) return false;
+    mapping = mapped;
+    data = static_cast<const unsigned char*>(mapped);
+    size = fileSize;
+    if (!parse(sourceSize, sourceModified)) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+bool CookedModel::save(const std::string& sourcePath, const ModelData& model) {
+    unmap();
+    CookedModelHeader header;
+    if (!SourceStamp::get(sourcePath, header.sourceSize, header.sourceModified)) return false;
+    header.magic = COOKED_MODEL_MAGIC;
+    header.version = COOKED_MODEL_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.sectionCount = SECTION_COUNT;
+    header.duration = model.duration;
+    header.ticksPerSecond = model.ticksPerSecond;
+
+    const void* sources[SECTION_COUNT] = {
+        model.vertices.data(), model.indices.data(), model.meshes.data(), model.textures.data(), model.bones.data(),
+        model.nodes.data(), model.channels.data(), model.positionTimes.data(), model.positionValues.data(),
+        model.rotationTimes.data(), model.rotationValues.data(), model.scaleTimes.data(), model.scaleValues.data(),
+        model.strings.data()
+    };
+    const size_t counts[SECTION_COUNT] = {
+        model.vertices.size(), model.indices.size(), model.meshes.size(), model.textures.size(), model.bones.size(),
+        model.nodes.size(), model.channels.size(), model.positionTimes.size(), model.positionValues.size(),
+        model.rotationTimes.size(), model.rotationValues.size(), model.scaleTimes.size(), model.scaleValues.size(),
+        model.strings.size()
+    };
+
+    // Sections start on 16 bytes, like the levels of the cooked textures
+    size_t offset = sizeof(header) + sizeof(sections);
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        offset = (offset + 15) & ~size_t(15);
+        sections[i].offset = offset;
+        sections[i].count = counts[i];
+        offset += counts[i] * elementSize(static_cast<Section>(i));
+    }
+    memory.assign(offset, 0);
+    std::memcpy(memory.data(), &header, sizeof(header));
+    std::memcpy(memory.data() + sizeof(header), sections, sizeof(sections));
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        if (counts[i] > 0) {
+            std::memcpy(memory.data() + sections[i].offset, sources[i], counts[i] * elementSize(static_cast<Section>(i)));
+        }
+    }
+    data = memory.data();
+    size = memory.size();
+    if (!parse(header.sourceSize, header.sourceModified)) {
+        unmap();
+        return false;
+    }
+
+    std::ofstream file(getCachePath(sourcePath), std::ios::binary);
+    if (file) {
+        file.write(reinterpret_cast<const char*>(memory.data()), memory.size());
+    }
+    if (!file) {
+        std::cout << "Failed to write cooked model for " << sourcePath << std::endl;
+    }
+    return true;
+}
+
+bool CookedModel::parse(uint64_t sourceSize, int64_t sourceModified) {
+    CookedModelHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != COOKED_MODEL_MAGIC || header.version != COOKED_MODEL_VERSION ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified ||
+        header.vertexSize != sizeof(Vertex) || header.sectionCount != SECTION_COUNT ||
+        size < sizeof(header) + sizeof(sections)) {
+        return false;
+    }
+    duration = header.duration;
+    ticksPerSecond = header.ticksPerSecond;
+    std::memcpy(sections, data + sizeof(header), sizeof(sections));
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        const SectionRecord& record = sections[i];
+        if (record.offset % 16 != 0 || record.offset > size ||
+            record.count > (size - record.offset) / elementSize(static_cast<Section>(i))) {
+            return false;
+        }
+    }
+
+    // Everything the loaders index with is checked once here: ranges, indices,
+    // bone ids and the hierarchy, then they use them freely
+    const MeshRecord* meshes = getMeshes();
+    for (size_t i = 0; i < getMeshCount(); ++i) {
+        if (uint64_t(meshes[i].firstVertex) + meshes[i].vertexCount > getVertexCount() ||
+            uint64_t(meshes[i].firstIndex) + meshes[i].indexCount > getIndexCount() ||
+            uint64_t(meshes[i].firstTexture) + meshes[i].textureCount > sections[SECTION_TEXTURES].count) {
+            return false;
+        }
+    }
+    const ChannelRecord* channels = getChannels();
+    for (size_t i = 0; i < getChannelCount(); ++i) {
+        const ChannelRecord& channel = channels[i];
+        if (uint64_t(channel.firstPosition) + channel.positionCount > sections[SECTION_POSITION_TIMES].count ||
+            uint64_t(channel.firstRotation) + channel.rotationCount > sections[SECTION_ROTATION_TIMES].count ||
+            uint64_t(channel.firstScale) + channel.scaleCount > sections[SECTION_SCALE_TIMES].count) {
+            return false;
+        }
+    }
+    if (sections[SECTION_POSITION_VALUES].count != sections[SECTION_POSITION_TIMES].count ||
+        sections[SECTION_ROTATION_VALUES].count != sections[SECTION_ROTATION_TIMES].count ||
+        sections[SECTION_SCALE_VALUES].count != sections[SECTION_SCALE_TIMES].count) {
+        return false;
+    }
+    // Indices within their mesh's vertices, the buffers are drawn with the
+    // mesh's first vertex as base
+    const unsigned int* indices = getIndices();
+    for (size_t i = 0; i < getMeshCount(); ++i) {
+        const unsigned int* meshIndices = indices + meshes[i].firstIndex;
+        for (uint32_t j = 0; j < meshes[i].indexCount; ++j) {
+            if (meshIndices[j] >= meshes[i].vertexCount) return false;
+        }
+    }
+    // Bone ids index the final bone matrices (MAX_BONES of them), vertices
+    // use -1 for no bone
+    const BoneRecord* bones = getBones();
+    int64_t boneCount = std::min<int64_t>(static_cast<int64_t>(getBoneCount()), MAX_BONES);
+    for (size_t i = 0; i < getBoneCount(); ++i) {
+        if (bones[i].id < 0 || bones[i].id >= boneCount) return false;
+    }
+    const Vertex* vertices = getVertices();
+    for (size_t i = 0; i < getVertexCount(); ++i) {
+        for (int k = 0; k < MAX_BONE_INFLUENCE; ++k) {
+            if (vertices[i].m_BoneIDs[k] < -1 || vertices[i].m_BoneIDs[k] >= boneCount) return false;
+        }
+    }
+    // Depth first: each node is the child its parent is still waiting for,
+    // so walking the hierarchy from the root reads exactly the nodes there are
+    const NodeRecord* nodes = getNodes();
+    uint64_t waiting = 1;  // the root
+    for (size_t i = 0; i < getNodeCount(); ++i) {
+        if (waiting == 0 || nodes[i].childrenCount < 0) return false;
+        waiting += static_cast<uint64_t>(nodes[i].childrenCount) - 1;
+    }
+    if (getNodeCount() > 0 && waiting != 0) {
+        return false;
+    }
+    const SectionRecord& strings = sections[SECTION_STRINGS];
+    return strings.count == 0 || data[strings.offset + strings.count - 1] == '\0';
+}
+
+void CookedModel::unmap() {
+    if (mapping) {
+        munmap(mapping, size);
+    }
+    mapping = nullptr;
+    memory.clear();
+    memory.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    std::memset(sections, 0, sizeof(sections));
+    duration = 0.0f;
+    ticksPerSecond = 0.0f;
+}
+
+bool CookedModel::isLoaded() const {
+    return data != nullptr;
+}
+
+size_t CookedModel::getFileSize() const {
+    return size;
+}
+
+const Vertex* CookedModel::getVertices() const {
+    return section<Vertex>(SECTION_VERTICES);
+}
+
+size_t CookedModel::getVertexCount() const {
+    return sections[SECTION_VERTICES].count;
+}
+
+const unsigned int* CookedModel::getIndices() const {
+    return section<unsigned int>(SECTION_INDICES);
+}
+
+size_t CookedModel::getIndexCount() const {
+    return sections[SECTION_INDICES].count;
+}
+
+const CookedModel::MeshRecord* CookedModel::getMeshes() const {
+    return section<MeshRecord>(SECTION_MESHES);
+}
+
+size_t CookedModel::getMeshCount() const {
+    return sections[SECTION_MESHES].count;
+}
+
+const CookedModel::TextureRecord* CookedModel::getTextures() const {
+    return section<TextureRecord>(SECTION_TEXTURES);
+}
+
+const CookedModel::BoneRecord* CookedModel::getBones() const {
+    return section<BoneRecord>(SECTION_BONES);
+}
+
+size_t CookedModel::getBoneCount() const {
+    return sections[SECTION_BONES].count;
+}
+
+const CookedModel::NodeRecord* CookedModel::getNodes() const {
+    return section<NodeRecord>(SECTION_NODES);
+}
+
+size_t CookedModel::getNodeCount() const {
+    return sections[SECTION_NODES].count;
+}
+
+const CookedModel::ChannelRecord* CookedModel::getChannels() const {
+    return section<ChannelRecord>(SECTION_CHANNELS);
+}
+
+size_t CookedModel::getChannelCount() const {
+    return sections[SECTION_CHANNELS].count;
+}
+
+const float* CookedModel::getPositionTimes() const {
+    return section<float>(SECTION_POSITION_TIMES);
+}
+
+const glm::vec3* CookedModel::getPositionValues() const {
+    return section<glm::vec3>(SECTION_POSITION_VALUES);
+}
+
+const float* CookedModel::getRotationTimes() const {
+    return section<float>(SECTION_ROTATION_TIMES);
+}
+
+const glm::vec4* CookedModel::getRotationValues() const {
+    return section<glm::vec4>(SECTION_ROTATION_VALUES);
+}
+
+const float* CookedModel::getScaleTimes() const {
+    return section<float>(SECTION_SCALE_TIMES);
+}
+
+const glm::vec3* CookedModel::getScaleValues() const {
+    return section<glm::vec3>(SECTION_SCALE_VALUES);
+}
+
+const char* CookedModel::getString(uint32_t offset) const {
+    if (offset >= sections[SECTION_STRINGS].count) return "";
+    return section<char>(SECTION_STRINGS) + offset;
+}
+
+float CookedModel::getDuration() const {
+    return duration;
+}
+
+float CookedModel::getTicksPerSecond() const {
+    return ticksPerSecond;
+}
+
+void CookedModel::getTriangles(std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) const {
+    const Vertex* vertices = getVertices();
+    const unsigned int* meshIndices = getIndices();
+    const MeshRecord* meshes = getMeshes();
+    for (size_t i = 0; i < getMeshCount(); ++i) {
+        unsigned int firstVertex = static_cast<unsigned int>(positions.size());
+        for (uint32_t j = 0; j < meshes[i].vertexCount; ++j) {
+            positions.push_back(vertices[meshes[i].firstVertex + j].Position);
+        }
+        for (uint32_t j = 0; j < meshes[i].indexCount; ++j) {
+            indices.push_back(firstVertex + meshIndices[meshes[i].firstIndex + j]);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef COOKED_MODEL_H
+#define COOKED_MODEL_H
+
+#include "assimp/vertex.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct ModelData;
+
+// Model cooked by ModelCooker: the meshes already in the vertex and index
+// layout of the GPU buffers, the node hierarchy, the bones and the first
+// animation with its keys one array per component. Cached next to the
+// source like the collision mesh and the textures, loading it is a memory
+// map and the buffers are uploaded straight from it.
+class CookedModel {
+public:
+    // Strings are offsets in the string table
+    struct MeshRecord {
+        uint32_t firstVertex, vertexCount;
+        uint32_t firstIndex, indexCount;  // indices start at 0 for each mesh
+        uint32_t firstTexture, textureCount;
+    };
+    struct TextureRecord {
+        uint32_t type;  // "texture_diffuse", "texture_normal"...
+        uint32_t path;  // as written in the source, relative to its directory
+    };
+    struct BoneRecord {
+        uint32_t name;
+        int32_t id;  // in the final bone matrices
+        glm::mat4 offset;
+    };
+    // Depth first, children follow their parent
+    struct NodeRecord {
+        uint32_t name;
+        int32_t childrenCount;
+        glm::mat4 transformation;
+    };
+    // Keys of one node, ranges of the key arrays
+    struct ChannelRecord {
+        uint32_t name;
+        uint32_t firstPosition, positionCount;
+        uint32_t firstRotation, rotationCount;
+        uint32_t firstScale, scaleCount;
+    };
+
+    CookedModel();
+    ~CookedModel();
+
+    CookedModel(const CookedModel&) = delete;
+    CookedModel& operator=(const CookedModel&) = delete;
+
+    // Map the model cooked for sourcePath, false if missing or out of date
+    bool map(const std::string& sourcePath);
+    // Write data as the cooked model of sourcePath and keep it loaded.
+    // Still loaded from memory if the file can't be written
+    bool save(const std::string& sourcePath, const ModelData& data);
+    void unmap();
+
+    // sourcePath + ".dmodel"
+    static std::string getCachePath(const std::string& sourcePath);
+
+    bool isLoaded() const;
+    size_t getFileSize() const;
+
+    const Vertex* getVertices() const;
+    size_t getVertexCount() const;
+    const unsigned int* getIndices() const;
+    size_t getIndexCount() const;
+    const MeshRecord* getMeshes() const;
+    size_t getMeshCount() const;
+    const TextureRecord* getTextures() const;
+    const BoneRecord* getBones() const;
+    size_t getBoneCount() const;
+    const NodeRecord* getNodes() const;
+    size_t getNodeCount() const;
+    const ChannelRecord* getChannels() const;
+    size_t getChannelCount() const;
+    const float* getPositionTimes() const;
+    const glm::vec3* getPositionValues() const;
+    const float* getRotationTimes() const;
+    const glm::vec4* getRotationValues() const;  // quaternions, x y z w
+    const float* getScaleTimes() const;
+    const glm::vec3* getScaleValues() const;
+    const char* getString(uint32_t offset) const;
+
+    // First animation, 0 if there is none
+    float getDuration() const;
+    float getTicksPerSecond() const;
+
+    // Positions and triangle indices of every mesh together
+    void getTriangles(std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices) const;
+
+private:
+    enum Section {
+        SECTION_VERTICES, SECTION_INDICES, SECTION_MESHES, SECTION_TEXTURES, SECTION_BONES, SECTION_NODES,
+        SECTION_CHANNELS, SECTION_POSITION_TIMES, SECTION_POSITION_VALUES, SECTION_ROTATION_TIMES,
+        SECTION_ROTATION_VALUES, SECTION_SCALE_TIMES, SECTION_SCALE_VALUES, SECTION_STRINGS, SECTION_COUNT
+    };
+    struct SectionRecord {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    const unsigned char* data;
+    size_t size;
+    void* mapping;                      // of the file, or null when
+    std::vector<unsigned char> memory;  // the data was cooked but not written
+    SectionRecord sections[SECTION_COUNT];
+    float duration, ticksPerSecond;
+
+    bool parse(uint64_t sourceSize, int64_t sourceModified);
+    template<typename T> const T* section(Section index) const;
+    static size_t elementSize(Section index);
+};
+
+// What ModelCooker imports, written out with CookedModel::save
+struct ModelData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<CookedModel::MeshRecord> meshes;
+    std::vector<CookedModel::TextureRecord> textures;
+    std::vector<CookedModel::BoneRecord> bones;
+    std::vector<CookedModel::NodeRecord> nodes;
+    std::vector<CookedModel::ChannelRecord> channels;
+    std::vector<float> positionTimes, rotationTimes, scaleTimes;
+    std::vector<glm::vec3> positionValues, scaleValues;
+    std::vector<glm::vec4> rotationValues;
+    std::string strings;
+    float duration = 0.0f;
+    float ticksPerSecond = 0.0f;
+
+    // Offset of the string in the table, each one stored once
+    uint32_t addString(const std::string& text);
+};
+
+#endif // COOKED_MODEL_H
@@ -0,0 +1,395 @@
+#include "modelCooker.h"
+#include "assimp/assimp_glm_helpers.h"
+#include "../include/tiny_gltf.h"
+#include "../primitives/geometryUtils.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+bool ModelCooker::Import(const std::string& sourcePath, ModelData& data) {
+    std::string extension = sourcePath.substr(sourcePath.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == "gltf" || extension == "glb") {
+        return ImportGltf(sourcePath, data);
+    }
+    return ImportAssimp(sourcePath, data);
+}
+
+bool ModelCooker::Cook(const std::string& sourcePath, CookedModel& model) {
+    ModelData data;
+    if (!Import(sourcePath, data) || data.meshes.empty()) return false;
+    if (!model.save(sourcePath, data)) return false;
+    std::cout << "Cooked model: " << CookedModel::getCachePath(sourcePath) << " (" << data.vertices.size()
+              << " vertices, " << data.bones.size() << " bones, " << data.channels.size() << " channels)" << std::endl;
+    return true;
+}
+
+static Vertex makeVertex() {
+    Vertex vertex = {};
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+        vertex.m_BoneIDs[i] = -1;
+        vertex.m_Weights[i] = 0.0f;
+    }
+    return vertex;
+}
+
+// Assimp
+
+static void setVertexBoneData(Vertex& vertex, int boneID, float weight) {
+    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i) {
+        if (vertex.m_BoneIDs[i] < 0) {
+            vertex.m_Weights[i] = weight;
+            vertex.m_BoneIDs[i] = boneID;
+            break;
+        }
+    }
+}
+
+static void addAssimpTextures(aiMaterial* material, aiTextureType type, const char* typeName, ModelData& data) {
+    for (unsigned int i = 0; i < material->GetTextureCount(type); i++) {
+        aiString path;
+        material->GetTexture(type, i, &path);
+        CookedModel::TextureRecord texture;
+        texture.type = data.addString(typeName);
+        texture.path = data.addString(path.C_Str());
+        data.textures.push_back(texture);
+    }
+}
+
+static void addAssimpMesh(const aiMesh* mesh, const aiScene* scene, ModelData& data, std::map<std::string, int>& boneIds) {
+    CookedModel::MeshRecord record;
+    record.firstVertex = static_cast<uint32_t>(data.vertices.size());
+    record.vertexCount = mesh->mNumVertices;
+    record.firstIndex = static_cast<uint32_t>(data.indices.size());
+    record.firstTexture = static_cast<uint32_t>(data.textures.size());
+
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex vertex = makeVertex();
+        vertex.Position = AssimpGLMHelpers::GetGLMVec(mesh->mVertices[i]);
+        if (mesh->mNormals) vertex.Normal = AssimpGLMHelpers::GetGLMVec(mesh->mNormals[i]);
+        if (mesh->mTextureCoords[0]) {
+            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+        }
+        // Only there when the mesh has texture coordinates
+        if (mesh->mTangents && mesh->mBitangents) {
+            vertex.Tangent = AssimpGLMHelpers::GetGLMVec(mesh->mTangents[i]);
+            vertex.Bitangent = AssimpGLMHelpers::GetGLMVec(mesh->mBitangents[i]);
+        }
+        data.vertices.push_back(vertex);
+    }
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace& face = mesh->mFaces[i];
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+            data.indices.push_back(face.mIndices[j]);
+    }
+    record.indexCount = static_cast<uint32_t>(data.indices.size()) - record.firstIndex;
+
+    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    addAssimpTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data);
+    addAssimpTextures(material, aiTextureType_SPECULAR, "texture_specular", data);
+    addAssimpTextures(material, aiTextureType_HEIGHT, "texture_normal", data);
+    addAssimpTextures(material, aiTextureType_AMBIENT, "texture_height", data);
+    record.textureCount = static_cast<uint32_t>(data.textures.size()) - record.firstTexture;
+
+    // Ids in the order the bones are first met, like the model did
+    for (unsigned int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex) {
+        const aiBone* bone = mesh->mBones[boneIndex];
+        std::string boneName = bone->mName.C_Str();
+        auto found = boneIds.find(boneName);
+        int boneID;
+        if (found == boneIds.end()) {
+            boneID = static_cast<int>(data.bones.size());
+            boneIds[boneName] = boneID;
+            CookedModel::BoneRecord boneRecord;
+            boneRecord.name = data.addString(boneName);
+            boneRecord.id = boneID;
+            boneRecord.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
+            data.bones.push_back(boneRecord);
+        } else {
+            boneID = found->second;
+        }
+        for (unsigned int weightIndex = 0; weightIndex < bone->mNumWeights; ++weightIndex) {
+            unsigned int vertexId = bone->mWeights[weightIndex].mVertexId;
+            if (vertexId >= mesh->mNumVertices) continue;
+            setVertexBoneData(data.vertices[record.firstVertex + vertexId], boneID, bone->mWeights[weightIndex].mWeight);
+        }
+    }
+    data.meshes.push_back(record);
+}
+
+static void addAssimpMeshes(const aiNode* node, const aiScene* scene, ModelData& data, std::map<std::string, int>& boneIds) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        addAssimpMesh(scene->mMeshes[node->mMeshes[i]], scene, data, boneIds);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        addAssimpMeshes(node->mChildren[i], scene, data, boneIds);
+    }
+}
+
+static void addAssimpNodes(const aiNode* node, ModelData& data) {
+    CookedModel::NodeRecord record;
+    record.name = data.addString(node->mName.C_Str());
+    record.childrenCount = static_cast<int32_t>(node->mNumChildren);
+    record.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation);
+    data.nodes.push_back(record);
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        addAssimpNodes(node->mChildren[i], data);
+    }
+}
+
+static void addAssimpAnimation(const aiAnimation* animation, ModelData& data) {
+    data.duration = static_cast<float>(animation->mDuration);
+    data.ticksPerSecond = static_cast<float>(animation->mTicksPerSecond);
+    for (unsigned int i = 0; i < animation->mNumChannels; i++) {
+        const aiNodeAnim* channel = animation->mChannels[i];
+        CookedModel::ChannelRecord record;
+        record.name = data.addString(channel->mNodeName.C_Str());
+
+        record.firstPosition = static_cast<uint32_t>(data.positionTimes.size());
+        record.positionCount = channel->mNumPositionKeys;
+        for (unsigned int j = 0; j < channel->mNumPositionKeys; j++) {
+            data.positionTimes.push_back(static_cast<float>(channel->mPositionKeys[j].mTime));
+            data.positionValues.push_back(AssimpGLMHelpers::GetGLMVec(channel->mPositionKeys[j].mValue));
+        }
+
+        record.firstRotation = static_cast<uint32_t>(data.rotationTimes.size());
+        record.rotationCount = channel->mNumRotationKeys;
+        for (unsigned int j = 0; j < channel->mNumRotationKeys; j++) {
+            const aiQuaternion& rotation = channel->mRotationKeys[j].mValue;
+            data.rotationTimes.push_back(static_cast<float>(channel->mRotationKeys[j].mTime));
+            data.rotationValues.push_back(glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w));
+        }
+
+        record.firstScale = static_cast<uint32_t>(data.scaleTimes.size());
+        record.scaleCount = channel->mNumScalingKeys;
+        for (unsigned int j = 0; j < channel->mNumScalingKeys; j++) {
+            data.scaleTimes.push_back(static_cast<float>(channel->mScalingKeys[j].mTime));
+            data.scaleValues.push_back(AssimpGLMHelpers::GetGLMVec(channel->mScalingKeys[j].mValue));
+        }
+        data.channels.push_back(record);
+    }
+}
+
+// One import for the meshes, the skeleton and the animation, the model and
+// the animation used to read the file separately
+bool ModelCooker::ImportAssimp(const std::string& sourcePath, ModelData& data) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(sourcePath, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    std::map<std::string, int> boneIds;
+    addAssimpMeshes(scene->mRootNode, scene, data, boneIds);
+    addAssimpNodes(scene->mRootNode, data);
+    if (scene->mNumAnimations > 0) {
+        addAssimpAnimation(scene->mAnimations[0], data);
+    }
+    return true;
+}
+
+// glTF
+
+static const unsigned char* getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor, int& stride) {
+    const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+    stride = accessor.ByteStride(view);
+    return &model.buffers[view.buffer].data[view.byteOffset + accessor.byteOffset];
+}
+
+// Float attribute of the primitive, null if missing or stored otherwise
+static const unsigned char* getAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                                         const char* name, int components, size_t count, int& stride) {
+    auto attribute = primitive.attributes.find(name);
+    if (attribute == primitive.attributes.end()) return nullptr;
+    const tinygltf::Accessor& accessor = model.accessors[attribute->second];
+    if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.type != components ||
+        accessor.count != count || accessor.bufferView < 0) {
+        return nullptr;
+    }
+    return getAccessorData(model, accessor, stride);
+}
+
+static void addGltfTexture(const tinygltf::Model& model, int textureIndex, const char* typeName, ModelData& data) {
+    if (textureIndex < 0 || textureIndex >= static_cast<int>(model.textures.size())) return;
+    int source = model.textures[textureIndex].source;
+    if (source < 0 || source >= static_cast<int>(model.images.size())) return;
+    CookedModel::TextureRecord texture;
+    texture.type = data.addString(typeName);
+    texture.path = data.addString(model.images[source].uri);
+    data.textures.push_back(texture);
+}
+
+// Smooth normals and tangents from the texture coordinates when the file has none
+static void generateTangentSpace(ModelData& data, const CookedModel::MeshRecord& record, bool normals, bool tangents) {
+    Vertex* vertices = &data.vertices[record.firstVertex];
+    const unsigned int* indices = &data.indices[record.firstIndex];
+    for (uint32_t i = 0; i + 2 < record.indexCount; i += 3) {
+        Vertex& v0 = vertices[indices[i]];
+        Vertex& v1 = vertices[indices[i + 1]];
+        Vertex& v2 = vertices[indices[i + 2]];
+        if (normals) {
+            glm::vec3 normal = glm::cross(v1.Position - v0.Position, v2.Position - v0.Position);
+            v0.Normal += normal;
+            v1.Normal += normal;
+            v2.Normal += normal;
+        }
+        glm::vec2 deltaUV1 = v1.TexCoords - v0.TexCoords;
+        glm::vec2 deltaUV2 = v2.TexCoords - v0.TexCoords;
+        if (tangents && std::fabs(deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y) > 1e-12f) {
+            glm::vec3 tangent = GeometryUtils::calculateTangent(v0.Position, v1.Position, v2.Position,
+                                                                v0.TexCoords, v1.TexCoords, v2.TexCoords);
+            v0.Tangent += tangent;
+            v1.Tangent += tangent;
+            v2.Tangent += tangent;
+        }
+    }
+    for (uint32_t i = 0; i < record.vertexCount; ++i) {
+        Vertex& vertex = vertices[i];
+        if (normals && glm::dot(vertex.Normal, vertex.Normal) > 0.0f) {
+            vertex.Normal = glm::normalize(vertex.Normal);
+        }
+        if (tangents) {
+            // Orthogonal to the normal, the shaders rebuild the bitangent from both
+            glm::vec3 tangent = vertex.Tangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Tangent);
+            if (glm::dot(tangent, tangent) > 1e-12f) {
+                vertex.Tangent = glm::normalize(tangent);
+                vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent);
+            }
+        }
+    }
+}
+
+static bool addGltfPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, ModelData& data) {
+    if (primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1) return true;
+    auto position = primitive.attributes.find("POSITION");
+    if (position == primitive.attributes.end() || primitive.indices < 0) return true;
+
+    const tinygltf::Accessor& positionAccessor = model.accessors[position->second];
+    size_t count = positionAccessor.count;
+    int positionStride = 0, normalStride = 0, uvStride = 0, tangentStride = 0;
+    const unsigned char* positions = getAttribute(model, primitive, "POSITION", TINYGLTF_TYPE_VEC3, count, positionStride);
+    const unsigned char* normals = getAttribute(model, primitive, "NORMAL", TINYGLTF_TYPE_VEC3, count, normalStride);
+    const unsigned char* uvs = getAttribute(model, primitive, "TEXCOORD_0", TINYGLTF_TYPE_VEC2, count, uvStride);
+    const unsigned char* tangents = getAttribute(model, primitive, "TANGENT", TINYGLTF_TYPE_VEC4, count, tangentStride);
+    if (!positions) {
+        std::cout << "Can't cook glTF positions that aren't float vec3" << std::endl;
+        return false;
+    }
+
+    CookedModel::MeshRecord record;
+    record.firstVertex = static_cast<uint32_t>(data.vertices.size());
+    record.vertexCount = static_cast<uint32_t>(count);
+    record.firstIndex = static_cast<uint32_t>(data.indices.size());
+    record.firstTexture = static_cast<uint32_t>(data.textures.size());
+
+    for (size_t i = 0; i < count; ++i) {
+        Vertex vertex = makeVertex();
+        const float* p = reinterpret_cast<const float*>(positions + i * positionStride);
+        vertex.Position = glm::vec3(p[0], p[1], p[2]);
+        if (normals) {
+            const float* n = reinterpret_cast<const float*>(normals + i * normalStride);
+            vertex.Normal = glm::vec3(n[0], n[1], n[2]);
+        }
+        if (uvs) {
+            const float* uv = reinterpret_cast<const float*>(uvs + i * uvStride);
+            vertex.TexCoords = glm::vec2(uv[0], uv[1]);
+        }
+        if (tangents) {
+            const float* t = reinterpret_cast<const float*>(tangents + i * tangentStride);
+            vertex.Tangent = glm::vec3(t[0], t[1], t[2]);
+            vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * t[3];
+        }
+        data.vertices.push_back(vertex);
+    }
+
+    const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+    int indexStride = 0;
+    const unsigned char* indexData = getAccessorData(model, indexAccessor, indexStride);
+    for (size_t i = 0; i < indexAccessor.count; ++i) {
+        unsigned int index = 0;
+        if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+            index = indexData[i];
+        } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+            index = reinterpret_cast<const unsigned short*>(indexData)[i];
+        } else {
+            index = reinterpret_cast<const unsigned int*>(indexData)[i];
+        }
+        if (index >= count) {
+            std::cout << "glTF index out of range: " << index << std::endl;
+            return false;
+        }
+        data.indices.push_back(index);
+    }
+    record.indexCount = static_cast<uint32_t>(indexAccessor.count);
+
+    if (!normals || !tangents) {
+        generateTangentSpace(data, record, !normals, !tangents && uvs);
+    }
+
+    // Same order as the textures units of the PBR shader. glTF keeps roughness
+    // in G and metalness in B like an ARM map, occlusion often packed in R
+    if (primitive.material >= 0 && primitive.material < static_cast<int>(model.materials.size())) {
+        const tinygltf::Material& material = model.materials[primitive.material];
+        addGltfTexture(model, material.pbrMetallicRoughness.baseColorTexture.index, "texture_diffuse", data);
+        addGltfTexture(model, material.normalTexture.index, "texture_normal", data);
+        addGltfTexture(model, material.pbrMetallicRoughness.metallicRoughnessTexture.index, "texture_arm", data);
+    }
+    record.textureCount = static_cast<uint32_t>(data.textures.size()) - record.firstTexture;
+    data.meshes.push_back(record);
+    return true;
+}
+
+static bool addGltfNode(const tinygltf::Model& model, int nodeIndex, ModelData& data) {
+    if (nodeIndex < 0 || nodeIndex >= static_cast<int>(model.nodes.size())) return true;
+    const tinygltf::Node& node = model.nodes[nodeIndex];
+    if (node.mesh >= 0 && node.mesh < static_cast<int>(model.meshes.size())) {
+        for (const auto& primitive : model.meshes[node.mesh].primitives) {
+            if (!addGltfPrimitive(model, primitive, data)) return false;
+        }
+    }
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        if (!addGltfNode(model, node.children[i], data)) return false;
+    }
+    return true;
+}
+
+// Static meshes of the default scene, node transforms ignored like the glTF
+// loader does. Skins and animations aren't cooked, the loader only reads them
+bool ModelCooker::ImportGltf(const std::string& sourcePath, ModelData& data) {
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model model;
+    std::string err, warn;
+
+    // Image files next to the model are cooked on their own, the embedded
+    // ones need the glTF and can't be cooked
+    bool embeddedImages = false;
+    loader.SetImageLoader([](tinygltf::Image* image, const int, std::string*, std::string*,
+                             int, int, const unsigned char*, int, void* userData) {
+        if (image->uri.empty()) *static_cast<bool*>(userData) = true;
+        return true;
+    }, &embeddedImages);
+
+    bool isBinary = sourcePath.substr(sourcePath.find_last_of('.') + 1) == "glb";
+    bool res = isBinary ? loader.LoadBinaryFromFile(&model, &err, &warn, sourcePath) :
+                          loader.LoadASCIIFromFile(&model, &err, &warn, sourcePath);
+    if (!err.empty()) std::cout << "ERR: " << err << std::endl;
+    if (!res) return false;
+    if (embeddedImages) {
+        std::cout << "Not cooking " << sourcePath << ": embedded images" << std::endl;
+        return false;
+    }
+    if (model.scenes.empty()) return false;
+
+    const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+    for (size_t i = 0; i < scene.nodes.size(); ++i) {
+        if (!addGltfNode(model, scene.nodes[i], data)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef MODEL_COOKER_H
+#define MODEL_COOKER_H
+
+#include "cookedModel.h"
+#include <string>
+
+// Imports a source model (glTF with tinygltf, everything else with assimp)
+// into the cooked layout. The loaders call Cook when the cooked file is
+// missing or out of date, the model cooker tool runs it ahead of time
+class ModelCooker {
+public:
+    // Parse the source, false if it can't be imported
+    static bool Import(const std::string& sourcePath, ModelData& data);
+    // Import and save next to the source, model is left loaded
+    static bool Cook(const std::string& sourcePath, CookedModel& model);
+
+private:
+    ModelCooker() { }
+
+    static bool ImportAssimp(const std::string& sourcePath, ModelData& data);
+    static bool ImportGltf(const std::string& sourcePath, ModelData& data);
+};
+
+#endif
@@ -1,22 +1,42 @@
 #include "modelLoader.h"
+#include "modelCooker.h"
+#include <algorithm>
+#include <cstring>
 
-ModelLoader::ModelLoader() : vao(0), hasAnimation(false) {
+ModelLoader::ModelLoader() : isCooked(false), arenaBuffer(0), hasAnimation(false) {
     //animation duration and uration to 0
 
 
 }
 
 ModelLoader::~ModelLoader() {
-    //for (auto& vbo : vbos) {
-    //    glDeleteBuffers(1, &vbo.second);
-    //}
-    //glDeleteVertexArrays(1, &vao);
+    // Shared through the texture cache, the embedded images aren't in it and are skipped
+    for (size_t i = 0; i < textures_model.size(); ++i) {
+        ResourceManager::ReleaseTexture(textures_model[i]);
+    }
+    //glDeleteBuffers(1, &arenaBuffer);
+    //glDeleteVertexArrays(vaos.size(), vaos.data());
 }
 
 bool ModelLoader::loadModel(const char* filename) {
+    sourcePath = filename;
+    isCooked = cooked.map(sourcePath) || ModelCooker::Cook(sourcePath, cooked);
+    if (isCooked) {
+        std::cout << "Loaded cooked model: " << CookedModel::getCachePath(sourcePath) << std::endl;
+        return true;
+    }
+
     tinygltf::TinyGLTF loader;
     std::string err, warn;
 
+    // Image files next to the model go through the texture loader (and their
+    // cooked version), only the embedded ones are decoded here
+    loader.SetImageLoader([](tinygltf::Image* image, const int index, std::string* err, std::string* warn,
+                             int width, int height, const unsigned char* bytes, int size, void* data) {
+        if (!image->uri.empty()) return true;
+        return tinygltf::LoadImageData(image, index, err, warn, width, height, bytes, size, data);
+    }, nullptr);
+
     bool isBinary = std::string(filename).substr(std::string(filename).find_last_of(".") + 1) == "glb";
     bool res = isBinary ? loader.LoadBinaryFromFile(&model, &err, &warn, filename) :
                           loader.LoadASCIIFromFile(&model, &err, &warn, filename);
@@ -25,191 +45,366 @@ bool ModelLoader::loadModel(const char* filename) {
     if (!err.empty()) std::cout << "ERR: " << err << std::endl;
     if (!res) std::cout << "Failed to load glTF: " << filename << std::endl;
     else std::cout << "Loaded glTF: " << filename << std::endl;
+    sourcePath = filename;
 
     return res;
 }
 
-void ModelLoader::bindMesh(tinygltf::Mesh& mesh) {
-    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
-        const tinygltf::BufferView& bufferView = model.bufferViews[i];
-        if (bufferView.target == 0) {
-            std::cout << "WARN: bufferView.target is zero" << std::endl;
-            continue;
-        }
-
-        const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-
-        GLuint vbo;
-        glGenBuffers(1, &vbo);
-        vbos[i] = vbo;
-        glBindBuffer(bufferView.target, vbo);
+// Attribute locations of the PBR shaders
+static int getAttributeLocation(const std::string& name) {
+    if (name == "POSITION") return 0;
+    if (name == "NORMAL") return 1;
+    if (name == "TEXCOORD_0") return 2;
+    if (name == "TANGENT") return 3;
+    if (name == "COLOR_0") return 4;
+    if (name == "JOINTS_0") return 5;
+    if (name == "WEIGHTS_0") return 6;
+    return -1;
+}
 
-        glBufferData(bufferView.target, bufferView.byteLength,
-                     &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
-    }
+static size_t alignArena(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
 
-    for (auto& primitive : mesh.primitives) {
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-
-        for (auto& attrib : primitive.attributes) {
-            tinygltf::Accessor accessor = model.accessors[attrib.second];
-            int byteStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-            glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
-
-            int size = (accessor.type != TINYGLTF_TYPE_SCALAR) ? accessor.type : 1;
-            int vaa = -1;
-            if (attrib.first == "POSITION"){
-                vaa = 0;
-            } else if (attrib.first == "NORMAL"){
-                vaa = 1;
-            } else if (attrib.first == "TEXCOORD_0"){
-                vaa = 2;
-            } else if (attrib.first == "TANGENT"){
-                vaa = 3;
-            } else if (attrib.first == "COLOR_0"){
-                vaa = 4;
-            } else if (attrib.first == "JOINTS_0"){
-                vaa = 5;
-            } else if (attrib.first == "WEIGHTS_0"){
-                vaa = 6;
-            }
-            
-            if (vaa > -1) {
-                glEnableVertexAttribArray(vaa);
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
-            } else {
-                std::cout << "vaa missing: " << attrib.first << std::endl;
+GLuint ModelLoader::loadGltfTexture(int textureIndex, unsigned int placeholder) {
+    if (textureIndex < 0 || textureIndex >= static_cast<int>(model.textures.size())) return 0;
+    auto loaded = gltfTextures.find(textureIndex);
+    if (loaded != gltfTextures.end()) return loaded->second;
+
+    GLuint texid = 0;
+    const tinygltf::Texture& tex = model.textures[textureIndex];
+    if (tex.source > -1 && tex.source < static_cast<int>(model.images.size())) {
+        tinygltf::Image& image = model.images[tex.source];
+        if (!image.uri.empty()) {
+            // Flipped like the embedded ones
+            std::string directory = sourcePath.substr(0, sourcePath.find_last_of("/\\") + 1);
+            texid = ResourceManager::AcquireTexture(directory + image.uri, true, placeholder);
+        } else if (!image.image.empty()) {
+            glGenTextures(1, &texid);
+
+            // Flip the image vertically
+            int rowSize = image.width * image.component; // Row size in bytes
+            for (int y = 0; y < image.height / 2; ++y) {
+                // Pointers to the rows to be swapped
+                unsigned char* topRow = &image.image[y * rowSize];
+                unsigned char* bottomRow = &image.image[(image.height - 1 - y) * rowSize];
+
+                // Swap the rows
+                for (int x = 0; x < rowSize; ++x) {
+                    std::swap(topRow[x], bottomRow[x]);
+                }
             }
+
+            glBindTexture(GL_TEXTURE_2D, texid);
+            //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            GLenum format = (image.component == 3) ? GL_RGB : GL_RGBA;
+            GLenum type = (image.bits == 8) ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0,
+                         format, type, &image.image.at(0));
+            glGenerateMipmap(GL_TEXTURE_2D);
         }
-        //store the in vao
+    }
+    // Once per texture however many primitives use it
+    gltfTextures[textureIndex] = texid;
+    if (texid != 0) textures_model.push_back(texid);
+    return texid;
+}
 
-        if (!model.textures.empty()) {
-            int diffuseIndex = -1;
-            int normalIndex = -1;
-            int metallicIndex = -1;
-        
-            // Identify the indices for each texture type in the materials
-            for (const auto& material : model.materials) {
-                //std::cout << "Material: " << material.name << std::endl;
-                
-                // Check for diffuse texture
-                auto diffuseIt = material.pbrMetallicRoughness.baseColorTexture.index;
-                if (diffuseIt >= 0) {
-                    diffuseIndex = diffuseIt;
-                    //std::cout << "Diffuse Index: " << diffuseIndex << std::endl;
+void ModelLoader::collectPrimitives(int nodeIndex, std::vector<GltfPrimitive>& primitives,
+                                    std::map<int, size_t>& meshPrimitives, std::vector<VertexLayout>& layouts) {
+    if (nodeIndex < 0 || nodeIndex >= static_cast<int>(model.nodes.size())) return;
+    const tinygltf::Node& node = model.nodes[nodeIndex];
+    if (node.mesh >= 0 && node.mesh < static_cast<int>(model.meshes.size())) {
+        // A mesh used by several nodes is uploaded once and drawn for each
+        auto found = meshPrimitives.find(node.mesh);
+        if (found == meshPrimitives.end()) {
+            meshPrimitives[node.mesh] = primitives.size();
+            const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+            for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+                const tinygltf::Primitive& primitive = mesh.primitives[p];
+                GltfPrimitive pending;
+                pending.primitive = &primitive;
+                pending.mesh = node.mesh;
+                pending.layout = -1;
+                pending.vertexCount = 0;
+                auto position = primitive.attributes.find("POSITION");
+                if (position != primitive.attributes.end()) {
+                    pending.vertexCount = model.accessors[position->second].count;
                 }
-                
-                // Check for normal texture
-                auto normalIt = material.normalTexture.index;
-                if (normalIt >= 0) {
-                    normalIndex = normalIt;
-                    //std::cout << "Normal Index: " << normalIndex << std::endl;
+
+                VertexLayout layout;
+                for (const auto& attrib : primitive.attributes) {
+                    const tinygltf::Accessor& accessor = model.accessors[attrib.second];
+                    int location = getAttributeLocation(attrib.first);
+                    if (location < 0) {
+                        std::cout << "vaa missing: " << attrib.first << std::endl;
+                        continue;
+                    }
+                    if (accessor.bufferView < 0 || accessor.count != pending.vertexCount) continue;
+                    LayoutAttribute attribute;
+                    attribute.location = location;
+                    attribute.components = tinygltf::GetNumComponentsInType(accessor.type);
+                    attribute.componentType = accessor.componentType;
+                    attribute.normalized = accessor.normalized;
+                    attribute.elementSize = attribute.components * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+                    attribute.accessor = attrib.second;
+                    layout.attributes.push_back(attribute);
                 }
-                
-                // Check for metallic texture
-                auto metallicIt = material.pbrMetallicRoughness.metallicRoughnessTexture.index;
-                if (metallicIt >= 0) {
-                    metallicIndex = metallicIt;
-                    //std::cout << "Metallic Index: " << metallicIndex << std::endl;
+                std::sort(layout.attributes.begin(), layout.attributes.end(),
+                          [](const LayoutAttribute& a, const LayoutAttribute& b) { return a.location < b.location; });
+
+                // Same attributes stored the same way share the VAO
+                for (size_t l = 0; l < layouts.size() && pending.layout < 0; ++l) {
+                    if (layouts[l].sameFormat(layout)) pending.layout = static_cast<int>(l);
                 }
-            }
-        
-            // Load textures based on specified order
-            std::vector<int> loadOrder = {diffuseIndex, normalIndex, metallicIndex};
-            for (size_t i = 0; i < loadOrder.size(); ++i) {
-                int texIndex = loadOrder[i];
-                if (texIndex >= 0 && texIndex < model.textures.size()) {
-                    tinygltf::Texture& tex = model.textures[texIndex];
-                    if (tex.source > -1) {
-                        GLuint texid;
-                        glGenTextures(1, &texid);
-                        textures_model.push_back(texid); // Store texture IDs
-                        tinygltf::Image& image = model.images[tex.source];
-
-                        // Flip the image vertically
-                        int rowSize = image.width * image.component; // Row size in bytes
-                        for (int y = 0; y < image.height / 2; ++y) {
-                            // Pointers to the rows to be swapped
-                            unsigned char* topRow = &image.image[y * rowSize];
-                            unsigned char* bottomRow = &image.image[(image.height - 1 - y) * rowSize];
-                
-                            // Swap the rows
-                            for (int x = 0; x < rowSize; ++x) {
-                                std::swap(topRow[x], bottomRow[x]);
-                            }
-                        }
-
-
-                        glBindTexture(GL_TEXTURE_2D, texid);
-                        //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                        GLenum format = (image.component == 3) ? GL_RGB : GL_RGBA;
-                        GLenum type = (image.bits == 8) ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
-                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0,
-                                     format, type, &image.image.at(0));
-                        glGenerateMipmap(GL_TEXTURE_2D);
-                        
-                    }
+                if (pending.layout < 0) {
+                    pending.layout = static_cast<int>(layouts.size());
+                    layout.vertexCount = 0;
+                    layouts.push_back(layout);
                 }
+                pending.attributes = layout.attributes;
+                pending.baseVertex = layouts[pending.layout].vertexCount;
+                layouts[pending.layout].vertexCount += pending.vertexCount;
+                primitives.push_back(pending);
             }
         }
+        nodeMeshes.push_back(node.mesh);
+    }
+    for (size_t i = 0; i < node.children.size(); i++) {
+        collectPrimitives(node.children[i], primitives, meshPrimitives, layouts);
     }
+}
 
-    //unbind the buffer
-    glBindVertexArray(0);
+bool ModelLoader::VertexLayout::sameFormat(const VertexLayout& other) const {
+    if (attributes.size() != other.attributes.size()) return false;
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        const LayoutAttribute& a = attributes[i];
+        const LayoutAttribute& b = other.attributes[i];
+        if (a.location != b.location || a.components != b.components ||
+            a.componentType != b.componentType || a.normalized != b.normalized) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void ModelLoader::bindModelNodes(tinygltf::Node& node) {
-    if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-        bindMesh(model.meshes[node.mesh]);
+// Every primitive repacked into one arena buffer uploaded once: per layout
+// one tightly packed stream for each attribute, the primitives one after the
+// other in it, then the indices. A primitive is drawn by its base vertex in
+// the streams of its layout, so all the primitives of a layout share a VAO
+void ModelLoader::bindGltfModel() {
+    if (model.scenes.empty()) return;
+    std::vector<GltfPrimitive> primitives;
+    std::map<int, size_t> meshPrimitives;
+    std::vector<VertexLayout> layouts;
+    nodeMeshes.clear();
+    const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+    for (size_t i = 0; i < scene.nodes.size(); ++i) {
+        collectPrimitives(scene.nodes[i], primitives, meshPrimitives, layouts);
     }
 
-    for (size_t i = 0; i < node.children.size(); i++) {
-        bindModelNodes(model.nodes[node.children[i]]);
+    // Sub-allocate the streams and the index ranges
+    size_t arenaSize = 0;
+    for (size_t l = 0; l < layouts.size(); ++l) {
+        for (size_t a = 0; a < layouts[l].attributes.size(); ++a) {
+            LayoutAttribute& attribute = layouts[l].attributes[a];
+            arenaSize = alignArena(arenaSize, 16);
+            attribute.offset = arenaSize;
+            arenaSize += layouts[l].vertexCount * attribute.elementSize;
+        }
+    }
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        GltfPrimitive& primitive = primitives[i];
+        primitive.indexOffset = 0;
+        if (primitive.primitive->indices < 0) continue;
+        const tinygltf::Accessor& indexAccessor = model.accessors[primitive.primitive->indices];
+        size_t indexSize = tinygltf::GetComponentSizeInBytes(indexAccessor.componentType);
+        arenaSize = alignArena(arenaSize, 4);
+        primitive.indexOffset = arenaSize;
+        arenaSize += indexAccessor.count * indexSize;
     }
-}
 
-void ModelLoader::bindModel() {
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    std::vector<unsigned char> arena(arenaSize);
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        const GltfPrimitive& primitive = primitives[i];
+        const VertexLayout& layout = layouts[primitive.layout];
+        for (size_t a = 0; a < primitive.attributes.size(); ++a) {
+            const tinygltf::Accessor& accessor = model.accessors[primitive.attributes[a].accessor];
+            const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+            const unsigned char* source = &model.buffers[view.buffer].data[view.byteOffset + accessor.byteOffset];
+            int stride = accessor.ByteStride(view);
+            size_t elementSize = layout.attributes[a].elementSize;
+            unsigned char* destination = &arena[layout.attributes[a].offset + primitive.baseVertex * elementSize];
+            for (size_t v = 0; v < primitive.vertexCount; ++v) {
+                std::memcpy(destination + v * elementSize, source + v * stride, elementSize);
+            }
+        }
+        if (primitive.primitive->indices >= 0) {
+            const tinygltf::Accessor& indexAccessor = model.accessors[primitive.primitive->indices];
+            const tinygltf::BufferView& view = model.bufferViews[indexAccessor.bufferView];
+            size_t indexBytes = indexAccessor.count * tinygltf::GetComponentSizeInBytes(indexAccessor.componentType);
+            std::memcpy(&arena[primitive.indexOffset], &model.buffers[view.buffer].data[view.byteOffset + indexAccessor.byteOffset], indexBytes);
+        }
+    }
 
-    const tinygltf::Scene& scene = model.scenes[model.defaultScene];
-    for (size_t i = 0; i < scene.nodes.size(); ++i) {
-        bindModelNodes(model.nodes[scene.nodes[i]]);
+    glGenBuffers(1, &arenaBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+    glBufferData(GL_ARRAY_BUFFER, arena.size(), arena.data(), GL_STATIC_DRAW);
+
+    for (size_t l = 0; l < layouts.size(); ++l) {
+        GLuint layoutVao;
+        glGenVertexArrays(1, &layoutVao);
+        glBindVertexArray(layoutVao);
+        glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenaBuffer);
+        for (size_t a = 0; a < layouts[l].attributes.size(); ++a) {
+            const LayoutAttribute& attribute = layouts[l].attributes[a];
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.componentType,
+                                  attribute.normalized ? GL_TRUE : GL_FALSE, 0, BUFFER_OFFSET(attribute.offset));
+        }
+        vaos.push_back(layoutVao);
     }
+    glBindVertexArray(0);
 
+    // One draw per primitive of each node
+    for (size_t n = 0; n < nodeMeshes.size(); ++n) {
+        size_t first = meshPrimitives[nodeMeshes[n]];
+        for (size_t i = first; i < primitives.size() && primitives[i].mesh == nodeMeshes[n]; ++i) {
+            const GltfPrimitive& primitive = primitives[i];
+            if (primitive.vertexCount == 0) continue;
+            DrawRange range;
+            range.vao = vaos[primitive.layout];
+            range.mode = primitive.primitive->mode >= 0 ? primitive.primitive->mode : GL_TRIANGLES;
+            range.baseVertex = static_cast<GLint>(primitive.baseVertex);
+            range.indexOffset = primitive.indexOffset;
+            if (primitive.primitive->indices >= 0) {
+                const tinygltf::Accessor& indexAccessor = model.accessors[primitive.primitive->indices];
+                range.indexType = indexAccessor.componentType;
+                range.count = static_cast<GLsizei>(indexAccessor.count);
+            } else {
+                range.indexType = 0;
+                range.count = static_cast<GLsizei>(primitive.vertexCount);
+            }
+            range.textures[0] = range.textures[1] = range.textures[2] = 0;
+            int material = primitive.primitive->material;
+            if (material >= 0 && material < static_cast<int>(model.materials.size())) {
+                const tinygltf::Material& mat = model.materials[material];
+                range.textures[0] = loadGltfTexture(mat.pbrMetallicRoughness.baseColorTexture.index, TextureLoader::PLACEHOLDER_GREY);
+                range.textures[1] = loadGltfTexture(mat.normalTexture.index, TextureLoader::PLACEHOLDER_NORMAL);
+                range.textures[2] = loadGltfTexture(mat.pbrMetallicRoughness.metallicRoughnessTexture.index, TextureLoader::PLACEHOLDER_GREY);
+            }
+            drawRanges.push_back(range);
+        }
+    }
+    // Grouped by VAO, fewer state changes when drawing
+    std::stable_sort(drawRanges.begin(), drawRanges.end(),
+                     [](const DrawRange& a, const DrawRange& b) { return a.vao < b.vao; });
+    std::cout << "glTF arena: " << arena.size() / 1024 << " KB, " << layouts.size() << " vertex layouts, "
+              << drawRanges.size() << " draws" << std::endl;
+}
+
+void ModelLoader::bindCookedModel() {
+    // Every mesh in one buffer, the vertices as cooked then the indices
+    size_t vertexBytes = cooked.getVertexCount() * sizeof(Vertex);
+    size_t indexOffset = alignArena(vertexBytes, 16);
+    glGenBuffers(1, &arenaBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+    glBufferData(GL_ARRAY_BUFFER, indexOffset + cooked.getIndexCount() * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, cooked.getVertices());
+    glBufferSubData(GL_ARRAY_BUFFER, indexOffset, cooked.getIndexCount() * sizeof(unsigned int), cooked.getIndices());
+
+    GLuint cookedVao;
+    glGenVertexArrays(1, &cookedVao);
+    glBindVertexArray(cookedVao);
+    glBindBuffer(GL_ARRAY_BUFFER, arenaBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenaBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, Position)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, Normal)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, TexCoords)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, Tangent)));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(offsetof(Vertex, Bitangent)));
     glBindVertexArray(0);
+    vaos.push_back(cookedVao);
+
+    std::string directory = sourcePath.substr(0, sourcePath.find_last_of("/\\") + 1);
+    const CookedModel::MeshRecord* meshes = cooked.getMeshes();
+    for (size_t i = 0; i < cooked.getMeshCount(); ++i) {
+        DrawRange range;
+        range.vao = cookedVao;
+        range.mode = GL_TRIANGLES;
+        range.indexType = GL_UNSIGNED_INT;
+        range.count = static_cast<GLsizei>(meshes[i].indexCount);
+        range.indexOffset = indexOffset + meshes[i].firstIndex * sizeof(unsigned int);
+        range.baseVertex = static_cast<GLint>(meshes[i].firstVertex);
+        range.textures[0] = range.textures[1] = range.textures[2] = 0;
+
+        const CookedModel::TextureRecord* textures = cooked.getTextures() + meshes[i].firstTexture;
+        for (uint32_t j = 0; j < meshes[i].textureCount; ++j) {
+            std::string type = cooked.getString(textures[j].type);
+            int unit = (type == "texture_diffuse") ? 0 : (type == "texture_normal") ? 1 : (type == "texture_arm") ? 2 : -1;
+            if (unit < 0 || range.textures[unit] != 0) continue;
+            // Flipped like the embedded ones
+            unsigned int placeholder = (unit == 1) ? TextureLoader::PLACEHOLDER_NORMAL : TextureLoader::PLACEHOLDER_GREY;
+            range.textures[unit] = ResourceManager::AcquireTexture(directory + cooked.getString(textures[j].path), true, placeholder);
+            textures_model.push_back(range.textures[unit]);
+        }
+        drawRanges.push_back(range);
+    }
+
+    // On the GPU now, the mapping isn't needed anymore
+    cooked.unmap();
 }
 
-void ModelLoader::drawMesh(const tinygltf::Mesh& mesh) const {
-    for (auto& primitive : mesh.primitives) {
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
-        glDrawElements(primitive.mode, indexAccessor.count, indexAccessor.componentType,
-                       BUFFER_OFFSET(indexAccessor.byteOffset));
+void ModelLoader::bindModel() {
+    if (isCooked) {
+        bindCookedModel();
+    } else {
+        bindGltfModel();
     }
 }
 
-void ModelLoader::drawModelNodes(const tinygltf::Node& node) const {
-    if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-        drawMesh(model.meshes[node.mesh]);
+void ModelLoader::drawPrimitives() const {
+    GLuint boundVao = 0;
+    GLuint boundTextures[3] = { 0, 0, 0 };
+    for (int unit = 0; unit < 3; ++unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
-    for (size_t i = 0; i < node.children.size(); i++) {
-        drawModelNodes(model.nodes[node.children[i]]);
+    for (size_t i = 0; i < drawRanges.size(); ++i) {
+        const DrawRange& range = drawRanges[i];
+        if (range.vao != boundVao) {
+            glBindVertexArray(range.vao);
+            boundVao = range.vao;
+        }
+        for (int unit = 0; unit < 3; ++unit) {
+            if (range.textures[unit] == boundTextures[unit]) continue;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, range.textures[unit]);
+            boundTextures[unit] = range.textures[unit];
+        }
+        if (range.indexType != 0) {
+            glDrawElementsBaseVertex(range.mode, range.count, range.indexType, BUFFER_OFFSET(range.indexOffset), range.baseVertex);
+        } else {
+            glDrawArrays(range.mode, range.baseVertex, range.count);
+        }
     }
+    glBindVertexArray(0);
 }
 
 void ModelLoader::drawModel(Shader& shader, Camera& camera) {
     shader.Use();
 
-    glm::mat4 model_ = glm::mat4(1.0f);
-    model_ = glm::translate(model_, getPosition());  // Assuming getPosition() is a method that returns the model's position
-    model_ = glm::scale(model_, scale);  // Use the appropriate scale for your model
+    glm::mat4 model_ = getModelMatrix();
 
     //for (size_t i = 0; i < animation.boneTransforms.size(); ++i) {
     //    model_ *= animation.boneTransforms[i];
@@ -237,31 +432,18 @@ void ModelLoader::drawModel(Shader& shader, Camera& camera) {
     shader.SetFloat("material.brightness", 1.0f);
     shader.SetVector3f("material.fresnel_ior", glm::vec3(1.5f));
 
-    for (size_t i = 0; i < textures_model.size(); ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, textures_model[i]);
-        //cout texture id
-        //std::cout << "Texture ID: " << textures_model[i] << std::endl;
-    }
-//
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    // The metallicRoughness texture, laid out like an ARM map
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
 
-    glBindVertexArray(vao);
-
-    const tinygltf::Scene& scene = model.scenes[model.defaultScene];
-    for (size_t i = 0; i < scene.nodes.size(); ++i) {
-        drawModelNodes(model.nodes[scene.nodes[i]]);
-    }
-    glBindVertexArray(0);
+    // Textures bound per primitive
+    drawPrimitives();
 
     //unbind the texture
-    for (size_t i = 0; i < textures_model.size(); ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
+    for (int unit = 0; unit < 3; ++unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
 }
@@ -407,6 +589,68 @@ void ModelLoader::updateAnimation(float dt) {
 
 
 
+glm::mat4 ModelLoader::getModelMatrix() const {
+    glm::mat4 model_ = glm::mat4(1.0f);
+    model_ = glm::translate(model_, getPosition());  // Assuming getPosition() is a method that returns the model's position
+    model_ = glm::scale(model_, scale);  // Use the appropriate scale for your model
+    return model_;
+}
+
+bool ModelLoader::getCollisionMesh(CollisionMesh& mesh) const {
+    if (mesh.loadCache(sourcePath)) {
+        std::cout << "Loaded collision mesh: " << CollisionMesh::getCachePath(sourcePath) << std::endl;
+        return true;
+    }
+
+    mesh.positions.clear();
+    mesh.indices.clear();
+    if (isCooked) {
+        CookedModel triangles;
+        if (triangles.map(sourcePath) || ModelCooker::Cook(sourcePath, triangles)) {
+            triangles.getTriangles(mesh.positions, mesh.indices);
+        }
+    }
+    for (const auto& gltfMesh : model.meshes) {
+        for (const auto& primitive : gltfMesh.primitives) {
+            auto position = primitive.attributes.find("POSITION");
+            if (position == primitive.attributes.end() || primitive.indices < 0) continue;
+            if (primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1) continue;
+
+            // Positions, the stride can be larger than a vec3 when they are interleaved
+            const tinygltf::Accessor& positionAccessor = model.accessors[position->second];
+            const tinygltf::BufferView& positionView = model.bufferViews[positionAccessor.bufferView];
+            const unsigned char* positionData = &model.buffers[positionView.buffer].data[positionView.byteOffset + positionAccessor.byteOffset];
+            int positionStride = positionAccessor.ByteStride(positionView);
+            unsigned int firstVertex = static_cast<unsigned int>(mesh.positions.size());
+            for (size_t i = 0; i < positionAccessor.count; ++i) {
+                const float* p = reinterpret_cast<const float*>(positionData + i * positionStride);
+                mesh.positions.push_back(glm::vec3(p[0], p[1], p[2]));
+            }
+
+            const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+            const tinygltf::BufferView& indexView = model.bufferViews[indexAccessor.bufferView];
+            const unsigned char* indexData = &model.buffers[indexView.buffer].data[indexView.byteOffset + indexAccessor.byteOffset];
+            for (size_t i = 0; i < indexAccessor.count; ++i) {
+                unsigned int index = 0;
+                if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+                    index = indexData[i];
+                } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                    index = reinterpret_cast<const unsigned short*>(indexData)[i];
+                } else {
+                    index = reinterpret_cast<const unsigned int*>(indexData)[i];
+                }
+                mesh.indices.push_back(firstVertex + index);
+            }
+        }
+    }
+    if (mesh.indices.empty()) return false;
+
+    mesh.cook();
+    mesh.saveCache(sourcePath);
+    std::cout << "Cooked collision mesh: " << mesh.getTriangleCount() << " triangles" << std::endl;
+    return true;
+}
+
 glm::vec3 ModelLoader::getPosition() const {
     return position;
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include "../glad/glad.h"
 #include "../shaders/shader.h"
 #include "../camera/camera.h"
+#include "../collision/collisionMesh.h"
+#include "../resources/resource_manager.h"
+#include "cookedModel.h"
 #include <glm/glm.hpp>
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -28,20 +31,74 @@ public:
     void drawModel(Shader& shader, Camera& camera);
     void dbgModel() const;
 
+    // Triangles of every mesh primitive in model space, from the cache next
+    // to the glTF file when it is up to date, cooked and cached otherwise
+    bool getCollisionMesh(CollisionMesh& mesh) const;
+
+    // Transform used to draw the model
+    glm::mat4 getModelMatrix() const;
+
     //load animation
     void loadAnimation(int index);
     void updateAnimation(float dt);
 
 private:
-    void bindMesh(tinygltf::Mesh& mesh);
-    void bindModelNodes(tinygltf::Node& node);
-    void drawMesh(const tinygltf::Mesh& mesh) const;
-    void drawModelNodes(const tinygltf::Node& node) const;
+    // One attribute of a vertex layout, its stream in the arena buffer
+    struct LayoutAttribute {
+        int location;
+        int components;
+        int componentType;
+        bool normalized;
+        size_t elementSize;
+        size_t offset;
+        int accessor;  // of the primitive it was read from
+    };
+    // Primitives with the same attributes stored the same way share a VAO
+    struct VertexLayout {
+        std::vector<LayoutAttribute> attributes;
+        size_t vertexCount;
+        bool sameFormat(const VertexLayout& other) const;
+    };
+    struct GltfPrimitive {
+        const tinygltf::Primitive* primitive;
+        int mesh;
+        int layout;
+        std::vector<LayoutAttribute> attributes;
+        size_t vertexCount;
+        size_t baseVertex;   // in the streams of its layout
+        size_t indexOffset;  // bytes in the arena
+    };
+    // A primitive drawn by its range of the arena buffer
+    struct DrawRange {
+        GLuint vao;
+        GLenum mode;
+        GLenum indexType;    // 0 when not indexed
+        GLsizei count;       // indices, or vertices when not indexed
+        size_t indexOffset;
+        GLint baseVertex;
+        GLuint textures[3];  // diffuse, normal, metallic, 0 when missing
+    };
+
+    void bindCookedModel();
+    void bindGltfModel();
+    void collectPrimitives(int nodeIndex, std::vector<GltfPrimitive>& primitives,
+                           std::map<int, size_t>& meshPrimitives, std::vector<VertexLayout>& layouts);
+    GLuint loadGltfTexture(int textureIndex, unsigned int placeholder);
+    void drawPrimitives() const;
     glm::vec3 getPosition() const;
 
+    // Cooked next to the glTF on the first run, the tinygltf model is only
+    // parsed when it can't be (embedded images)
+    CookedModel cooked;
+    bool isCooked;
+    GLuint arenaBuffer;  // vertices and indices of every primitive, uploaded once
+    std::vector<GLuint> vaos;
+    std::vector<DrawRange> drawRanges;
+    std::vector<int> nodeMeshes;
+    std::map<int, GLuint> gltfTextures;
+
     tinygltf::Model model;
-    GLuint vao;
-    std::map<int, GLuint> vbos;
+    std::string sourcePath;
     std::vector<unsigned int> textures_model;
 
     struct Animation {
@@ -23,7 +23,7 @@ void Player::update(float deltaTime) {
 }
 
 //take window to pass to camera for checking spacebar
-void Player::jump(GLFWwindow* window, float deltaTime, Terrain* terrain, std::vector<glm::vec3> vertices, Collision &collision) {
+void Player::jump(GLFWwindow* window, float deltaTime, Terrain* terrain, const std::vector<glm::vec3>& vertices, Collision &collision) {
     
         // Only allow jumping if the player is not already jumping and is on the ground
         //if colliding with terrain or primitives
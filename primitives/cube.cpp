@@ -26,6 +26,13 @@ Cube::Cube() {
     material.fresnel_ior = glm::vec3(2.5f);            // Higher IOR for metals, as they tend to reflect more light at glancing angles
 }
 
+Cube::~Cube() {
+    // The textures are shared, the cache deletes them with the last reference
+    for (unsigned int i = 0; i < textures_cube.size(); i++) {
+        ResourceManager::ReleaseTexture(textures_cube[i]);
+    }
+}
+
 void Cube::setup() {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
@@ -56,161 +63,18 @@ void Cube::setup() {
     glBindVertexArray(0);
 
 
-    // Load diffuse texture
-    glGenTextures(1, &texture_diffuse);
-    glBindTexture(GL_TEXTURE_2D, texture_diffuse);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    //stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load("texture/PBR_textures_2/diff.jpg", &width, &height, &nrChannels, 0);
-    
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_diffuse);
-    } else {
-        std::cout << "Failed to load texture diff" << std::endl;
-    }
-    
-    stbi_image_free(data);
-
-    //texture normal
-    glGenTextures(1, &texture_normal);
-    glBindTexture(GL_TEXTURE_2D, texture_normal);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/norm.jpg", &width, &height, &nrChannels, 0);
-
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_normal);
-    } else {
-        std::cout << "Failed to load texture norm" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //texture metallic
-    glGenTextures(1, &texture_metalllic);
-    glBindTexture(GL_TEXTURE_2D, texture_metalllic);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/met.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_metalllic);
-    } else {
-        std::cout << "Failed to load texture met" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //tex roughness
-    glGenTextures(1, &texture_roughness);
-    glBindTexture(GL_TEXTURE_2D, texture_roughness);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/rough.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_roughness);
-    } else {
-        std::cout << "Failed to load texture rough" << std::endl;
-    }
-    stbi_image_free(data);
-
-    
-
-    glGenTextures(1, &texture_ao);
-    glBindTexture(GL_TEXTURE_2D, texture_ao);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/ao.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        // Check the number of channels and set the texture format accordingly
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_ao);
-    } else {
-        std::cout << "Failed to load AO texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //Displacement map
-    glGenTextures(1, &texture_disp);
-    glBindTexture(GL_TEXTURE_2D, texture_disp);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/disp.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        // Check the number of channels and set the texture format accordingly
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-        textures_cube.push_back(texture_disp);
-    } else {
-        std::cout << "Failed to load AO texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-
-
-
+    // Shared with the other objects using the same maps, decoded in the
+    // background the first time, they hold a placeholder until then
+    texture_diffuse = ResourceManager::AcquireTexture("texture/PBR_textures_2/diff.jpg");
+    texture_normal = ResourceManager::AcquireTexture("texture/PBR_textures_2/norm.jpg", false, TextureLoader::PLACEHOLDER_NORMAL);
+    // ao, rough and met packed in one texture, R G B
+    texture_arm = ResourceManager::AcquirePackedTexture("texture/PBR_textures_2/arm",
+        { "texture/PBR_textures_2/ao.jpg", "texture/PBR_textures_2/rough.jpg", "texture/PBR_textures_2/met.jpg" });
+    texture_disp = ResourceManager::AcquireTexture("texture/PBR_textures_2/disp.jpg");
+    textures_cube.push_back(texture_diffuse);
+    textures_cube.push_back(texture_normal);
+    textures_cube.push_back(texture_arm);
+    textures_cube.push_back(texture_disp);
 
     updateHitbox();
 }
@@ -219,7 +83,7 @@ void Cube::draw(Shader& shader, Camera& camera) {
     shader.Use();
     
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     model = glm::scale(model, scale);
 
     shader.SetMatrix4("model", model);
@@ -250,10 +114,8 @@ void Cube::draw(Shader& shader, Camera& camera) {
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
 
 for (unsigned int i = 0; i < textures_cube.size(); i++) {
         glActiveTexture(GL_TEXTURE0 + i);
@@ -282,7 +144,7 @@ void Cube::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap)
     shader.Use();
     
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     model = glm::scale(model, scale);
 
     shader.SetMatrix4("model", model);
@@ -313,10 +175,8 @@ void Cube::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap)
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
     shader.SetInteger("shadowMap", 6);
     shader.SetInteger("shadowMapCube", 7);
 
@@ -359,7 +219,7 @@ void Cube::drawTest(Shader& shader, Camera& camera){
     shader.Use();
     
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     model = glm::scale(model, scale);
 
     shader.SetMatrix4("model", model);
@@ -408,8 +268,7 @@ void Cube::drawTest(Shader& shader, Camera& camera){
 
 //set pos
 void Cube::setPosition(glm::vec3 pos) {
-    position = pos;
-    updateHitbox();
+    Primitives::setPosition(pos);
 }
 
 std::string Cube::getInfo() const {
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <glm/glm.hpp>
 #include "../shaders/shader.h"
+#include "../resources/resource_manager.h"
 //vector for texture
 #include <vector>
 #include "primitives.h"
@@ -14,6 +15,7 @@
 class Cube : public Primitives {
 public:
     Cube();
+    ~Cube();
     void draw(Shader& shader, Camera& camera) override;
     //draw with voxel shader
     void setPosition(glm::vec3 pos);
@@ -24,7 +26,7 @@ public:
 private:
     unsigned int VAO, VBO, EBO;
     //texture
-    unsigned int texture_diffuse, texture_normal, texture_metalllic, texture_roughness, texture_ao, texture_disp;
+    unsigned int texture_diffuse, texture_normal, texture_arm, texture_disp;
     std::vector<unsigned int> textures_cube;
 
     void setup() override;
@@ -16,6 +16,13 @@ Plane::Plane() {
 
 }
 
+Plane::~Plane() {
+    // The textures are shared, the cache deletes them with the last reference
+    for (unsigned int i = 0; i < textures_plane.size(); i++) {
+        ResourceManager::ReleaseTexture(textures_plane[i]);
+    }
+}
+
 void Plane::setup() {
 
     // positions at 25 and 0 for y
@@ -99,158 +106,19 @@ void Plane::setup() {
     
 
 
-    // Load texture
-    glGenTextures(1, &texture_diffuse);
-    glBindTexture(GL_TEXTURE_2D, texture_diffuse);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    //stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load("texture/PBR_textures/diff.jpg", &width, &height, &nrChannels, 0);
-    
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture diff" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //texture2
-    glGenTextures(1, &texture_normal);
-    glBindTexture(GL_TEXTURE_2D, texture_normal);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures/norm.jpg", &width, &height, &nrChannels, 0);
-
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture norm" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //texture mettalic
-    glGenTextures(1, &texture_metalllic);
-    glBindTexture(GL_TEXTURE_2D, texture_metalllic);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures/met.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture rough" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //texture roughness
-    glGenTextures(1, &texture_roughness);
-    glBindTexture(GL_TEXTURE_2D, texture_roughness);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures/rough.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture rough" << std::endl;
-    }
-    stbi_image_free(data);
-    
-//
-    glGenTextures(1, &texture_ao);
-    glBindTexture(GL_TEXTURE_2D, texture_ao);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures/ao.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        // Check the number of channels and set the texture format accordingly
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-    
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load AO texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //Displacement map
-    glGenTextures(1, &texture_disp);
-    glBindTexture(GL_TEXTURE_2D, texture_disp);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/disp.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        // Check the number of channels and set the texture format accordingly
-        if (nrChannels == 1) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 3) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else if (nrChannels == 4) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load AO texture" << std::endl;
-    }
-    stbi_image_free(data);
-
+    // Shared with the other objects using the same maps, decoded in the
+    // background the first time, they hold a placeholder until then
+    texture_diffuse = ResourceManager::AcquireTexture("texture/PBR_textures/diff.jpg");
+    texture_normal = ResourceManager::AcquireTexture("texture/PBR_textures/norm.jpg", false, TextureLoader::PLACEHOLDER_NORMAL);
+    // ao, rough and met packed in one texture, R G B
+    texture_arm = ResourceManager::AcquirePackedTexture("texture/PBR_textures/arm",
+        { "texture/PBR_textures/ao.jpg", "texture/PBR_textures/rough.jpg", "texture/PBR_textures/met.jpg" });
+    texture_disp = ResourceManager::AcquireTexture("texture/PBR_textures_2/disp.jpg");
 
     //add textures to vector
     textures_plane.push_back(texture_diffuse);
     textures_plane.push_back(texture_normal);
-    textures_plane.push_back(texture_metalllic);
-    textures_plane.push_back(texture_roughness);
-    textures_plane.push_back(texture_ao);
+    textures_plane.push_back(texture_arm);
     textures_plane.push_back(texture_disp);
 
     updateHitbox();
@@ -268,7 +136,7 @@ void Plane::draw(Shader& shader, Camera& camera) {
     shader.SetFloat("pitch", camera.getPitch());
     shader.SetFloat("yaw", camera.getYaw());
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     //scale more big
     model = glm::scale(model, scale);
     shader.SetMatrix4("model", model);
@@ -291,10 +159,8 @@ void Plane::draw(Shader& shader, Camera& camera) {
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
 
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 6); // 6 vertices for 2 triangles
@@ -315,7 +181,7 @@ void Plane::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap
     shader.Use();
     
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     model = glm::scale(model, scale);
 
     shader.SetMatrix4("model", model);
@@ -346,10 +212,8 @@ void Plane::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
     shader.SetInteger("shadowMap", 6);
     shader.SetInteger("shadowMapCube", 7);
 
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <glm/glm.hpp>
 #include "../shaders/shader.h"
+#include "../resources/resource_manager.h"
 #include <vector>
 #include "primitives.h"
 #include "../lights/lights.h"
@@ -13,13 +14,14 @@
 class Plane : public Primitives {
 public:
     Plane();
+    ~Plane();
     void draw(Shader& shader, Camera& camera) override;
     void drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap) override;
     void drawTest(Shader& shader, Camera& camera) override;
     
 private:
     unsigned int VAO, VBO;
-    unsigned int texture_diffuse, texture_normal, texture_metalllic, texture_roughness, texture_ao, texture_disp;
+    unsigned int texture_diffuse, texture_normal, texture_arm, texture_disp;
 
     std::vector<unsigned int> textures_plane;
     
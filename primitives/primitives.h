@@ -9,18 +9,21 @@
 #include "../camera/camera.h"
 #include "geometryUtils.h"
 #include "../lights/lights.h"
+#include "../collision/bodyStore.h"
 
 class Light;
 
 class Primitives {
 public:
-    glm::vec3 position;
-    glm::vec3 scale;
+    glm::vec3 scale;  // half extents of the hitbox too
     glm::vec4 color;
-    glm::vec3 velocity;
-    float mass;
-    bool isStatic;
-    bool collisionEnabled;
+
+    // Convex points used against static meshes instead of the hitbox corners
+    // (e.g. CollisionMesh::hull of a dynamic model), not owned. They are in model
+    // space, collisionHullTransform (the model's rotation and scale, plus any
+    // offset of its origin from position) brings them relative to position
+    const std::vector<glm::vec3>* collisionHull;
+    glm::mat4 collisionHullTransform;
 
     // PBR Material properties (as an example)
     struct Material {
@@ -38,11 +41,11 @@ public:
     struct Hitbox {
         glm::vec3 min;
         glm::vec3 max;
-    } hitbox;
+    };
 
     Primitives(glm::vec3 pos = glm::vec3(0.0f), glm::vec3 scl = glm::vec3(1.0f), glm::vec4 clr = glm::vec4(1.0f),
         bool moving = false, bool collision = false, float m = 1.0f, glm::vec3 vel = glm::vec3(0.0f)) 
-        : position(pos), scale(scl), color(clr), isStatic(moving), collisionEnabled(collision), mass(m), velocity(vel) {
+        : scale(scl), color(clr), position(pos), velocity(vel), mass(m), staticBody(moving), collidable(collision) {
             material.ambient = glm::vec3(1.0f);
             material.diffuse = glm::vec3(0.5f);
             material.specular = glm::vec3(1.0f);
@@ -51,9 +54,19 @@ public:
             material.occlusion = 1.0f;
             material.brightness = 1.0f;
             material.fresnel_ior = glm::vec3(1.5f);
+            previousPosition = position;
+            renderPosition = position;
+            collisionHull = nullptr;
+            collisionHullTransform = glm::mat4(1.0f);
+            bodyStore = nullptr;
+            body = 0;
             updateHitbox();
         }
 
+    // The body store keeps the handle, a copy would share it
+    Primitives(const Primitives&) = delete;
+    Primitives& operator=(const Primitives&) = delete;
+
     //setup function
     virtual void setup() = 0;
 
@@ -67,7 +80,15 @@ public:
     // Get information about the primitive
     virtual std::string getInfo() const = 0;
 
+    // Physics state: position, velocity, mass, flags and hitbox are held here
+    // until a Collision takes the primitive into its body store, from then on
+    // the accessors below read and write the store's arrays through the handle
+
     void updateHitbox() {
+        if (bodyStore) {
+            bodyStore->updateBounds(body);
+            return;
+        }
         hitbox.min = position - (scale);  // Calculate the min point of the bounding box
         hitbox.max = position + (scale);  // Calculate the max point of the bounding box
     }
@@ -80,43 +101,129 @@ public:
     // Set the scale of the primitive
     void setScale(const glm::vec3& scl) {
         scale = scl;
+        if (bodyStore) bodyStore->halfExtents[body] = scl;
         updateHitbox();
     }
 
-    //Set the position of the primitive
+    //Set the position of the primitive (teleport, no interpolation)
     void setPosition(const glm::vec3& pos) {
-        position = pos;
+        if (bodyStore) {
+            bodyStore->position[body] = pos;
+            bodyStore->previousPosition[body] = pos;
+        } else {
+            position = pos;
+            previousPosition = pos;
+        }
+        renderPosition = pos;
         updateHitbox();
+        wake();
+    }
+
+    // Resting bodies are put to sleep by the collision update and skipped
+    // until a contact, setPosition or setVelocity wakes them
+    bool isSleeping() const {
+        return bodyStore && bodyStore->isSleeping[body];
+    }
+
+    // Back to the simulation, the collision update wakes the rest of its group
+    void wake() {
+        if (!bodyStore) return;
+        bodyStore->isSleeping[body] = 0;
+        bodyStore->sleepTimer[body] = 0.0f;
+    }
+
+    // Blend between the last two physics steps, alpha in [0, 1]
+    void interpolate(float alpha) {
+        if (bodyStore) {
+            renderPosition = glm::mix(bodyStore->previousPosition[body], bodyStore->position[body], alpha);
+        } else {
+            renderPosition = glm::mix(previousPosition, position, alpha);
+        }
     }
 
     // Set the velocity of the primitive
     void setVelocity(const glm::vec3& vel) {
-        velocity = vel;
+        if (bodyStore) {
+            bodyStore->velocity[body] = vel;
+        } else {
+            velocity = vel;
+        }
+        wake();
+    }
+
+    glm::vec3 getVelocity() const {
+        return bodyStore ? bodyStore->velocity[body] : velocity;
+    }
+
+    // Collide against static meshes with these model space points instead of
+    // the hitbox, transform is the model matrix without the translation to
+    // position. scale should still cover them for the broad phase
+    void setCollisionHull(const std::vector<glm::vec3>* hull, const glm::mat4& transform = glm::mat4(1.0f)) {
+        collisionHull = hull;
+        collisionHullTransform = transform;
     }
 
     // Set the mass of the primitive
     void setMass(float m) {
-        mass = m;
+        if (bodyStore) {
+            bodyStore->mass[body] = m;
+        } else {
+            mass = m;
+        }
+    }
+
+    float getMass() const {
+        return bodyStore ? bodyStore->mass[body] : mass;
     }
 
     // Set the static property of the primitive
     void setStatic(bool moving) {
-        isStatic = moving;
+        if (bodyStore) {
+            bodyStore->isStatic[body] = moving ? -1 : 0;
+        } else {
+            staticBody = moving;
+        }
+    }
+
+    bool isStatic() const {
+        return bodyStore ? bodyStore->isStatic[body] != 0 : staticBody;
+    }
+
+    void setCollisionEnabled(bool collision) {
+        if (bodyStore) {
+            bodyStore->collisionEnabled[body] = collision ? -1 : 0;
+        } else {
+            collidable = collision;
+        }
+    }
+
+    bool isCollisionEnabled() const {
+        return bodyStore ? bodyStore->collisionEnabled[body] != 0 : collidable;
     }
 
     //get hitbox
     Hitbox getHitbox() const {
+        if (bodyStore) {
+            return { glm::vec3(bodyStore->minX[body], bodyStore->minY[body], bodyStore->minZ[body]),
+                     glm::vec3(bodyStore->maxX[body], bodyStore->maxY[body], bodyStore->maxZ[body]) };
+        }
         return hitbox;
     }
 
     //Get hibox position
     glm::vec3 getHitboxPosition() const {
-        return (hitbox.min + hitbox.max) / 2.0f;
+        Hitbox box = getHitbox();
+        return (box.min + box.max) / 2.0f;
     }
 
     //get position
     glm::vec3 getPosition() const {
-        return position;
+        return bodyStore ? bodyStore->position[body] : position;
+    }
+
+    //get interpolated position for drawing
+    glm::vec3 getRenderPosition() const {
+        return renderPosition;
     }
 
     //get scale
@@ -124,7 +231,40 @@ public:
         return scale;
     }
 
-    virtual ~Primitives() {}
+    // Store holding the physics state and the body's index in it, nullptr
+    // while no Collision has the primitive
+    BodyStore* getBodyStore() const {
+        return bodyStore;
+    }
+
+    size_t getBody() const {
+        return body;
+    }
+
+    virtual ~Primitives() {
+        if (bodyStore) bodyStore->detach(body);
+    }
+
+protected:
+    Hitbox hitbox;  // while in no store
+
+private:
+    friend class BodyStore;
+
+    BodyStore* bodyStore;
+    size_t body;
+
+    // State while in no store, the store copies it in and back out
+    glm::vec3 position;
+    glm::vec3 velocity;
+    glm::vec3 previousPosition;
+    float mass;
+    bool staticBody;
+    bool collidable;
+
+    // Physics runs at a fixed rate, draws use the position blended
+    // between the last two physics steps
+    glm::vec3 renderPosition;
 };
 
 #endif // PRIMITIVES_H
\ No newline at end of file
@@ -17,6 +17,13 @@ Sphere::Sphere() {
     material.fresnel_ior = glm::vec3(1.5f);
 }
 
+Sphere::~Sphere() {
+    // The textures are shared, the cache deletes them with the last reference
+    for (unsigned int i = 0; i < textures_sphere.size(); i++) {
+        ResourceManager::ReleaseTexture(textures_sphere[i]);
+    }
+}
+
 //ADD FUNCTION FOR HITBOX
 
 void Sphere::generateSphereVertices(unsigned int sectors, unsigned int stacks) {
@@ -85,47 +92,10 @@ void Sphere::setup() {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    // Load texture
-    glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    //stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load("texture/PBR_textures_2/diff.jpg", &width, &height, &nrChannels, 0);
-    
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture diff" << std::endl;
-    }
-    stbi_image_free(data);
-
-    //texture2
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load image, create texture and generate mipmaps
-    data = stbi_load("texture/PBR_textures_2/norm.jpg", &width, &height, &nrChannels, 0);
-
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture norm" << std::endl;
-    }
-    stbi_image_free(data);
+    // Shared with the other objects using the same maps, decoded in the
+    // background the first time, they hold a placeholder until then
+    texture1 = ResourceManager::AcquireTexture("texture/PBR_textures_2/diff.jpg");
+    texture2 = ResourceManager::AcquireTexture("texture/PBR_textures_2/norm.jpg", false, TextureLoader::PLACEHOLDER_NORMAL);
 
     textures_sphere.push_back(texture1);
     textures_sphere.push_back(texture2);
@@ -141,7 +111,7 @@ void Sphere::draw(Shader& shader, Camera& camera) {
     shader.SetMatrix4("view", view);
 
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     shader.SetMatrix4("model", model);
     //Materials
     shader.SetVector3f("material.ambient", material.ambient);
@@ -162,9 +132,7 @@ void Sphere::draw(Shader& shader, Camera& camera) {
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
+    shader.SetInteger("texture_arm", 2);
 
 
     glBindVertexArray(VAO);
@@ -183,7 +151,7 @@ void Sphere::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMa
     shader.Use();
     
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, getPosition());
+    model = glm::translate(model, getRenderPosition());
     model = glm::scale(model, scale);
 
     shader.SetMatrix4("model", model);
@@ -214,10 +182,8 @@ void Sphere::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMa
 
     shader.SetInteger("texture_diffuse", 0);
     shader.SetInteger("texture_normal", 1);
-    shader.SetInteger("texture_metallic", 2);
-    shader.SetInteger("texture_roughness", 3);
-    shader.SetInteger("texture_occlusion", 4);
-    shader.SetInteger("texture_disp", 5);
+    shader.SetInteger("texture_arm", 2);
+    shader.SetInteger("texture_disp", 3);
     shader.SetInteger("shadowMap", 6);
     shader.SetInteger("shadowMapCube", 7);
 
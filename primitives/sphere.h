@@ -6,6 +6,7 @@
 #include <iostream>
 #include <glm/glm.hpp>
 #include "../shaders/shader.h"
+#include "../resources/resource_manager.h"
 #include <vector>
 #include <cmath>
 #include "primitives.h"
@@ -13,6 +14,7 @@
 class Sphere : public Primitives {
 public:
     Sphere();
+    ~Sphere();
     void draw(Shader& shader, Camera& camera) override;
     void drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap) override;
     void drawTest(Shader& shader, Camera& camera) override;
@@ -3,22 +3,34 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <set>
 
 
-#include "../include/stb_image.h"
 #include "../texture/texture.h"
+#include "../texture/textureLoader.h"
 
 // Instantiate static variables
 std::map<std::string, Texture2D>    ResourceManager::Textures;
 std::map<std::string, Shader>       ResourceManager::Shaders;
+std::unordered_map<unsigned int, ResourceManager::TextureReference> ResourceManager::TextureReferences;
 
 
-Shader ResourceManager::LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name)
+Shader ResourceManager::LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name, const std::string& defines)
 {
-    Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
+    Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile, defines);
     return Shaders[name];
 }
 
+std::string ResourceManager::LoadShaderPrelude(const char *file)
+{
+    std::ifstream preludeFile(file);
+    if (!preludeFile)
+        std::cout << "ERROR::SHADER: Failed to read shader prelude " << file << std::endl;
+    std::stringstream preludeStream;
+    preludeStream << preludeFile.rdbuf();
+    return preludeStream.str();
+}
+
 Shader ResourceManager::GetShader(std::string name)
 {
     return ResourceManager::Shaders.at(name);
@@ -35,17 +47,106 @@ Texture2D ResourceManager::GetTexture(std::string name)
     return Textures[name];
 }
 
+// The file and every parameter that changes the texture, a different
+// placeholder still ends up as the same image
+std::string ResourceManager::textureKey(const std::string& file, bool flipVertically, int channels, bool srgb)
+{
+    std::ostringstream key;
+    key << file << "|flip=" << flipVertically << "|channels=" << channels << "|srgb=" << srgb;
+    return key.str();
+}
+
+unsigned int ResourceManager::AcquireTexture(const std::string& file, bool flipVertically, unsigned int placeholder,
+                                             int channels, bool srgb)
+{
+    std::string key = textureKey(file, flipVertically, channels, srgb);
+    auto cached = Textures.find(key);
+    if (cached != Textures.end())
+    {
+        TextureReferences[cached->second.ID].count++;
+        return cached->second.ID;
+    }
+    // Texture2D makes its own texture, the loader's replaces it
+    Texture2D texture;
+    glDeleteTextures(1, &texture.ID);
+    texture.ID = TextureLoader::Load(file, flipVertically, placeholder, channels, srgb);
+    Textures.insert(std::make_pair(key, texture));
+    TextureReferences[texture.ID] = { key, 1 };
+    return texture.ID;
+}
+
+unsigned int ResourceManager::AcquirePackedTexture(const std::string& name, const std::vector<std::string>& files,
+                                                   bool flipVertically)
+{
+    std::string key = textureKey(name, flipVertically, static_cast<int>(files.size()), false);
+    auto cached = Textures.find(key);
+    if (cached != Textures.end())
+    {
+        TextureReferences[cached->second.ID].count++;
+        return cached->second.ID;
+    }
+    Texture2D texture;
+    glDeleteTextures(1, &texture.ID);
+    texture.ID = TextureLoader::LoadPacked(name, files, flipVertically);
+    Textures.insert(std::make_pair(key, texture));
+    TextureReferences[texture.ID] = { key, 1 };
+    return texture.ID;
+}
+
+void ResourceManager::ReleaseTexture(unsigned int texture)
+{
+    // Unknown after Clear(), the texture is already gone
+    auto reference = TextureReferences.find(texture);
+    if (reference == TextureReferences.end() || --reference->second.count > 0)
+        return;
+    Textures.erase(reference->second.key);
+    TextureReferences.erase(reference);
+    TextureLoader::Delete(texture);
+}
+
+ResourceManager::TextureCacheStats ResourceManager::GetTextureCacheStats()
+{
+    TextureCacheStats stats = {};
+    for (const auto& reference : TextureReferences)
+    {
+        size_t bytes = TextureLoader::GetTextureBytes(reference.first);
+        stats.textures++;
+        stats.references += reference.second.count;
+        stats.bytesUploaded += bytes;
+        stats.bytesSaved += (reference.second.count - 1) * bytes;
+    }
+    return stats;
+}
+
 void ResourceManager::Clear()
 {
     // (properly) delete all shaders	
     for (auto iter : Shaders)
         glDeleteProgram(iter.second.ID);
-    // (properly) delete all textures
+    // (properly) delete all textures, named ones can share a cached texture
+    std::set<unsigned int> deleted;
     for (auto iter : Textures)
-        glDeleteTextures(1, &iter.second.ID);
+        if (deleted.insert(iter.second.ID).second)
+            TextureLoader::Delete(iter.second.ID);
+    Shaders.clear();
+    Textures.clear();
+    TextureReferences.clear();
+}
+
+// The defines go after the #version line, which has to come first
+static void insertDefines(std::string& code, const std::string& defines)
+{
+    if (defines.empty() || code.empty())
+        return;
+    size_t version = code.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+    if (lineEnd == std::string::npos)
+        code.insert(0, defines);
+    else
+        code.insert(lineEnd + 1, defines);
 }
 
-Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile)
+Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, const std::string& defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -80,6 +181,9 @@ Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *
     {
         std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
     }
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
+    insertDefines(geometryCode, defines);
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
     const char *gShaderCode = geometryCode.c_str();
@@ -98,12 +202,9 @@ Texture2D ResourceManager::loadTextureFromFile(const char *file, bool alpha)
         texture.Internal_Format = GL_RGBA;
         texture.Image_Format = GL_RGBA;
     }
-    // load image
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(file, &width, &height, &nrChannels, 0);
-    // now generate texture
-    texture.Generate(width, height, data);
-    // and finally free image data
-    stbi_image_free(data);
+    // shared with the other loads of the file, decoded and uploaded in the
+    // background. Width / Height stay 0 since the size isn't known yet
+    glDeleteTextures(1, &texture.ID);
+    texture.ID = AcquireTexture(file, false, TextureLoader::PLACEHOLDER_GREY, alpha ? 4 : 0);
     return texture;
 }
\ No newline at end of file
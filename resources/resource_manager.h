@@ -2,11 +2,14 @@
 #define RESOURCE_MANAGER_H
 
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "../glad/glad.h"
 
 #include "../texture/texture.h"
+#include "../texture/textureLoader.h"
 #include "../shaders/shader.h"
 
 
@@ -15,29 +18,59 @@
 // and/or shader is also stored for future reference by string
 // handles. All functions and resources are static and no 
 // public constructor is defined.
+// Textures acquired from files are shared: one GL texture per file and
+// load parameters, kept while anyone holds a reference to it.
 class ResourceManager
 {
 public:
+    struct TextureCacheStats {
+        size_t textures;       // in the cache
+        size_t references;     // held on them
+        size_t bytesUploaded;  // on the GPU, mipmaps included
+        size_t bytesSaved;     // the copies each reference would have uploaded on its own
+    };
+
     // resource storage
     static std::map<std::string, Shader>    Shaders;
     static std::map<std::string, Texture2D> Textures;
     // loads (and generates) a shader program from file loading vertex, fragment (and geometry) shader's source code. If gShaderFile is not nullptr, it also loads a geometry shader
-    static Shader    LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name);
+    // defines ("#define NAME value\n" lines, or the helpers of a prelude) are put after the #version line of every stage
+    static Shader    LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name, const std::string& defines = "");
+    // contents of a file of GLSL helpers, passed on as the defines of LoadShader
+    static std::string LoadShaderPrelude(const char *file);
     // retrieves a stored sader
     static Shader    GetShader(std::string name);
     // loads (and generates) a texture from file
     static Texture2D LoadTexture(const char *file, bool alpha, std::string name);
     // retrieves a stored texture
     static Texture2D GetTexture(std::string name);
+    // shared texture for the file loaded with these parameters, decoded and
+    // uploaded the first time only (see TextureLoader::Load). Each call adds a reference
+    static unsigned int AcquireTexture(const std::string& file, bool flipVertically = false,
+                                       unsigned int placeholder = TextureLoader::PLACEHOLDER_GREY, int channels = 0, bool srgb = false);
+    // shared texture packed from one image per channel (see TextureLoader::LoadPacked),
+    // name is what the cooker packed them under, the ARM map of a set is "<directory>/arm"
+    static unsigned int AcquirePackedTexture(const std::string& name, const std::vector<std::string>& files,
+                                             bool flipVertically = false);
+    // drops a reference, the texture is deleted with the last one
+    static void      ReleaseTexture(unsigned int texture);
+    static TextureCacheStats GetTextureCacheStats();
     // properly de-allocates all loaded resources
     static void      Clear();
 private:
     // private constructor, that is we do not want any actual resource manager objects. Its members and functions should be publicly available (static).
     ResourceManager() { }
     // loads and generates a shader from file
-    static Shader    loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile = nullptr);
+    static Shader    loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile = nullptr, const std::string& defines = "");
     // loads a single texture from file
     static Texture2D loadTextureFromFile(const char *file, bool alpha);
+    // references of the acquired textures, by GL id, and their key in Textures
+    struct TextureReference {
+        std::string key;
+        unsigned int count;
+    };
+    static std::unordered_map<unsigned int, TextureReference> TextureReferences;
+    static std::string textureKey(const std::string& file, bool flipVertically, int channels, bool srgb);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,10 @@
+#include "sourceStamp.h"
+#include <sys/stat.h>
+
+bool SourceStamp::get(const std::string& sourcePath, uint64_t& size, int64_t& modified) {
+    struct stat info;
+    if (stat(sourcePath.c_str(), &info) != 0) return false;
+    size = static_cast<uint64_t>(info.st_size);
+    modified = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
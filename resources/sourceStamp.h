@@ -0,0 +1,19 @@
+#ifndef SOURCE_STAMP_H
+#define SOURCE_STAMP_H
+
+#include <string>
+#include <cstdint>
+
+// Size and modification time of a source asset, stored in the header of the
+// caches cooked from it (collision meshes, textures, models). A cache is
+// stale when the stamp of its source doesn't match anymore.
+class SourceStamp {
+public:
+    // False if the source can't be read
+    static bool get(const std::string& sourcePath, uint64_t& size, int64_t& modified);
+
+private:
+    SourceStamp() { }
+};
+
+#endif // SOURCE_STAMP_H
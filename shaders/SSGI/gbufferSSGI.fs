@@ -16,9 +16,7 @@ in mat3 TBN;
 
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_metallic;
-uniform sampler2D texture_roughness;
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_arm;
 
 // Material struct
 struct Material {
@@ -41,35 +39,27 @@ void main(){
 
     vec3 normal = normalize(Normal);
     if (textureSize(texture_normal, 0).x > 0) {
-
-        normal = texture(texture_normal, TexCoords).xyz * 2.0 - 1.0;
+        normal = decodeNormalXY(texture(texture_normal, TexCoords).rg);
         normal = normalize(TBN * normal);
     }
     gNormal = normal;
 
     if (textureSize(texture_diffuse, 0).x > 0){
         gAlbedoMetallic.rgb = texture(texture_diffuse, TexCoords).rgb * material.diffuse;
-        gAlbedoMetallic.a = texture(texture_metallic, TexCoords).r * material.metallic;
     } else {
         gAlbedoMetallic.rgb = material.diffuse;
-        gAlbedoMetallic.a = material.metallic;
     }
 
-    if (textureSize(texture_roughness, 0).x > 0){
-        gSpecularRoughness.a = texture(texture_roughness, TexCoords).r * material.roughness;
-        gSpecularRoughness.rgb = material.specular;
-    } else {
-        gSpecularRoughness.a = material.roughness;
-        gSpecularRoughness.rgb = material.specular;
-    }
-
-    if (textureSize(texture_occlusion, 0).x > 0){
-        gFresnelOcclusion.rgb = material.fresnel_ior;
-        gFresnelOcclusion.a = texture(texture_occlusion, TexCoords).r * material.occlusion;
-    } else {
-        gFresnelOcclusion.rgb = material.fresnel_ior;
-        gFresnelOcclusion.a = material.occlusion;
+    // ao, roughness and metallic from one sample
+    vec3 arm = vec3(1.0);
+    if (textureSize(texture_arm, 0).x > 0){
+        arm = texture(texture_arm, TexCoords).rgb;
     }
+    gAlbedoMetallic.a = arm.b * material.metallic;
+    gSpecularRoughness.rgb = material.specular;
+    gSpecularRoughness.a = arm.g * material.roughness;
+    gFresnelOcclusion.rgb = material.fresnel_ior;
+    gFresnelOcclusion.a = arm.r * material.occlusion;
 
     gAmbiantBrightness = vec4(material.ambient, material.brightness);
 
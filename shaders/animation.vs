@@ -13,8 +13,17 @@ uniform mat4 view;
 uniform mat4 model;
 
 const int MAX_BONES = 100;
+// characters of one instanced draw, defined at load by BonePaletteBuffer
+// from GL_MAX_UNIFORM_BLOCK_SIZE. One palette fits the 16 KB every GL has
+#ifndef PALETTE_CHARACTERS
+#define PALETTE_CHARACTERS 1
+#endif
 
-uniform mat4 finalBonesMatrices[MAX_BONES];
+layout(std140) uniform BonePalette
+{
+    mat4 finalBonesMatrices[MAX_BONES * PALETTE_CHARACTERS];
+    mat4 characterTransforms[PALETTE_CHARACTERS];
+};
 
 out vec2 TexCoords;
 out vec3 Normal0;
@@ -24,21 +33,25 @@ void main()
 {
     mat4 BoneTransform = mat4(0.0); // Initialize BoneTransform to zero
 
-    // Compute the BoneTransform matrix based on the weights and bone IDs
-    BoneTransform += finalBonesMatrices[boneIds[0]] * weights[0];
-    BoneTransform += finalBonesMatrices[boneIds[1]] * weights[1];
-    BoneTransform += finalBonesMatrices[boneIds[2]] * weights[2];
-    BoneTransform += finalBonesMatrices[boneIds[3]] * weights[3];
+    // Compute the BoneTransform matrix based on the weights and bone IDs,
+    // from the palette of this instance
+    int paletteStart = gl_InstanceID * MAX_BONES;
+    BoneTransform += finalBonesMatrices[paletteStart + boneIds[0]] * weights[0];
+    BoneTransform += finalBonesMatrices[paletteStart + boneIds[1]] * weights[1];
+    BoneTransform += finalBonesMatrices[paletteStart + boneIds[2]] * weights[2];
+    BoneTransform += finalBonesMatrices[paletteStart + boneIds[3]] * weights[3];
 
     vec4 localPosition = BoneTransform * vec4(pos, 1.0);
-    
-    mat4 viewModel = view * model;
+
+    // where the character stands, then the scale of the model
+    mat4 world = characterTransforms[gl_InstanceID] * model;
+    mat4 viewModel = view * world;
     gl_Position = projection * viewModel * localPosition;
 
     TexCoords = tex;
 
     // Compute the normal in world space
     vec4 normalL = BoneTransform * vec4(norm, 0.0);
-    Normal0 = (model * normalL).xyz; // Use model matrix to transform the normal
-    WorldPos0 = (model * localPosition).xyz; // World position in world space
+    Normal0 = (world * normalL).xyz; // Use model matrix to transform the normal
+    WorldPos0 = (world * localPosition).xyz; // World position in world space
 }
\ No newline at end of file
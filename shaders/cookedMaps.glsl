@@ -0,0 +1,10 @@
+// Decoding of the texture layouts tools/textureCooker writes, put after the
+// #version line of the shaders that sample them (see Game::Init)
+//   texture_normal  X and Y of the tangent space normal, Z is rebuilt
+//   texture_arm     R ambient occlusion, G roughness, B metallic
+
+vec3 decodeNormalXY(vec2 encoded)
+{
+    vec2 normalXY = encoded * 2.0 - 1.0;
+    return vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+}
@@ -15,9 +15,7 @@ const float heightScale = 0.1;
 
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_metallic;
-uniform sampler2D texture_roughness;
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_arm;
 
 struct Light {
     int type; // 0: ambient light, 1: point light, 2: directional light, 3: spotlight
@@ -179,16 +177,16 @@ void main()
     //point light at 0,0 3
     vec3 lightPos = vec3(0.0, 3.0, 3.0);
 
-    vec3 N = texture(texture_normal, TexCoords).rgb;
-    N = normalize(N * 2.0 - 1.0);
+    vec3 N = decodeNormalXY(texture(texture_normal, TexCoords).rg);
     N = normalize(TBN * N);
     
     vec3 V = normalize(viewPos - FragPos);
 
     vec3 albedo = texture(texture_diffuse, TexCoords).rgb * material.diffuse;
-    float metallic = texture(texture_metallic, TexCoords).r * material.metallic;
-    float roughness = texture(texture_roughness, TexCoords).r * material.roughness;
-    float ao = texture(texture_occlusion, TexCoords).r * material.occlusion;
+    vec3 arm = texture(texture_arm, TexCoords).rgb;
+    float metallic = arm.b * material.metallic;
+    float roughness = arm.g * material.roughness;
+    float ao = arm.r * material.occlusion;
 
     vec3 lighting = vec3(0.0);
 
@@ -4,9 +4,12 @@ out vec4 FragColor;
 
 in float Height;
 in vec2 TexCoord; // Receive UV coordinates from the vertex shader
+in vec3 Normal;
 
 uniform sampler2D texture_diffuse; // Add a texture sampler
 
+const vec3 sunDirection = normalize(vec3(0.3, 1.0, 0.2));
+
 void main()
 {
     float h = (Height + 16) / 32.0f; // Shift and scale the height into a grayscale value
@@ -14,6 +17,9 @@ void main()
     // Sample the texture using UV coordinates
     vec4 textureColor = texture(texture_diffuse, TexCoord); 
     
+    // Slopes facing away from the sun get darker
+    float diffuse = max(dot(normalize(Normal), sunDirection), 0.0) * 0.6 + 0.4;
+
     // Combine height information with texture color
-    FragColor = vec4(h * textureColor.rgb, 1.0); // Modify the output color using height and texture
+    FragColor = vec4(h * diffuse * textureColor.rgb, 1.0); // Modify the output color using height and texture
 }
\ No newline at end of file
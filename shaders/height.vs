@@ -1,19 +1,65 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord; // Add UV coordinates input
+layout (location = 2) in vec2 aGrid;     // compact mode: vertex of the patch, in cells
+layout (location = 3) in vec3 aNormal;
+layout (location = 4) in vec3 aTangent;
 
 out float Height;
 out vec3 Position;
 out vec2 TexCoord; // Pass UV coordinates to the fragment shader
+out vec3 Normal;
+out vec3 Tangent;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Compact mode: one patch mesh instanced over the grid, heights come from
+// the R16 heightmap and x/z/uv from the grid position
+uniform bool heightFromTexture;
+uniform sampler2D heightMap;
+uniform int gridRows;
+uniform int gridColumns;
+uniform int patchCells;
+uniform int patchesPerRow;
+uniform float heightMin;
+uniform float heightRange;
+
+float heightAt(int row, int column)
+{
+    row = clamp(row, 0, gridRows - 1);
+    column = clamp(column, 0, gridColumns - 1);
+    return texelFetch(heightMap, ivec2(column, row), 0).r * heightRange + heightMin;
+}
+
 void main()
 {
-    Height = aPos.y;
-    Position = (view * model * vec4(aPos, 1.0)).xyz;
-    TexCoord = aTexCoord; // Assign UV coordinates
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    vec3 pos = aPos;
+    vec2 uv = aTexCoord;
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    if (heightFromTexture) {
+        ivec2 patchOrigin = ivec2(gl_InstanceID / patchesPerRow, gl_InstanceID % patchesPerRow) * patchCells;
+        // past the last row or column the vertices collapse onto the border
+        int row = min(patchOrigin.x + int(aGrid.x), gridRows - 1);
+        int column = min(patchOrigin.y + int(aGrid.y), gridColumns - 1);
+        float h = heightAt(row, column);
+        pos = vec3(row - gridRows / 2.0, h, column - gridColumns / 2.0);
+        uv = vec2(float(column) / (gridColumns - 1), float(row) / (gridRows - 1));
+
+        // Same central differences as Terrain::generateVertices
+        float rowScale = (row == 0 || row == gridRows - 1) ? 1.0 : 0.5;
+        float columnScale = (column == 0 || column == gridColumns - 1) ? 1.0 : 0.5;
+        float dx = (heightAt(row + 1, column) - heightAt(row - 1, column)) * rowScale;
+        float dz = (heightAt(row, column + 1) - heightAt(row, column - 1)) * columnScale;
+        normal = normalize(vec3(-dx, 1.0, -dz));
+        tangent = normalize(vec3(1.0, dx, 0.0));
+    }
+    Height = pos.y;
+    Position = (view * model * vec4(pos, 1.0)).xyz;
+    TexCoord = uv; // Assign UV coordinates
+    Normal = mat3(model) * normal;
+    Tangent = mat3(model) * tangent;
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+}
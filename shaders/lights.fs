@@ -44,9 +44,7 @@ uniform vec3 viewPos;   // Camera position
 // Textures
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_metallic;
-uniform sampler2D texture_roughness;
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_arm;
 
 // fonction de distribution des microfacettes (Trowbridge-Reitz)
 float trowbridge_reitz(vec3 n, vec3 h, float roughness)
@@ -167,9 +165,10 @@ void main() {
 
     
     vec3 texture_sample_diffuse = texture(texture_diffuse, TexCoords).rgb;
-    float texture_sample_metallic = texture(texture_metallic, TexCoords).r;
-    float texture_sample_roughness = texture(texture_roughness, TexCoords).r;
-    float texture_sample_occlusion = texture(texture_occlusion, TexCoords).r;
+    vec3 texture_sample_arm = texture(texture_arm, TexCoords).rgb;
+    float texture_sample_metallic = texture_sample_arm.b;
+    float texture_sample_roughness = texture_sample_arm.g;
+    float texture_sample_occlusion = texture_sample_arm.r;
 
     float metallic = material.metallic * texture_sample_metallic;
     float roughness = material.roughness * texture_sample_roughness;
@@ -181,8 +180,7 @@ void main() {
 
 
     //Normal mapping
-    vec3 normalMap = texture(texture_normal, TexCoords).xyz * 2.0 - 1.0;
-    normalMap = normalize(normalMap);
+    vec3 normalMap = decodeNormalXY(texture(texture_normal, TexCoords).rg);
 
     //Calculate TBN matrix
     vec3 T = normalize(Tangent);
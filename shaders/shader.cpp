@@ -8,7 +8,7 @@ Shader &Shader::Use()
     return *this;
 }
 
-void Shader::Compile(const char* vertexSource, const char* fragmentSource, const char* geometrySource)
+bool Shader::Compile(const char* vertexSource, const char* fragmentSource, const char* geometrySource)
 {
     unsigned int sVertex, sFragment, gShader;
     // vertex Shader
@@ -36,12 +36,13 @@ void Shader::Compile(const char* vertexSource, const char* fragmentSource, const
     if (geometrySource != nullptr)
         glAttachShader(this->ID, gShader);
     glLinkProgram(this->ID);
-    checkCompileErrors(this->ID, "PROGRAM");
+    this->Linked = checkCompileErrors(this->ID, "PROGRAM");
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(sVertex);
     glDeleteShader(sFragment);
     if (geometrySource != nullptr)
         glDeleteShader(gShader);
+    return this->Linked;
 }
 
 void Shader::SetFloat(const char *name, float value, bool useShader)
@@ -100,7 +101,7 @@ void Shader::SetMatrix4(const char *name, const glm::mat4 &matrix, bool useShade
 }
 
 
-void Shader::checkCompileErrors(unsigned int object, std::string type)
+bool Shader::checkCompileErrors(unsigned int object, std::string type)
 {
     int success;
     char infoLog[1024];
@@ -126,4 +127,5 @@ void Shader::checkCompileErrors(unsigned int object, std::string type)
                 << std::endl;
         }
     }
+    return success != 0;
 }
\ No newline at end of file
@@ -16,12 +16,14 @@ class Shader
 public:
     // state
     unsigned int ID; 
+    // false if the last Compile failed to link, ID is then no usable program
+    bool Linked = false;
     // constructor
     Shader() { }
     // sets the current shader as active
     Shader  &Use();
-    // compiles the shader from given source code
-    void    Compile(const char *vertexSource, const char *fragmentSource, const char *geometrySource = nullptr); // note: geometry source code is optional 
+    // compiles the shader from given source code, returns whether it linked
+    bool    Compile(const char *vertexSource, const char *fragmentSource, const char *geometrySource = nullptr); // note: geometry source code is optional 
     // utility functions
     void    SetFloat    (const char *name, float value, bool useShader = false);
     void    SetInteger  (const char *name, int value, bool useShader = false);
@@ -34,7 +36,7 @@ public:
     void    SetMatrix4  (const char *name, const glm::mat4 &matrix, bool useShader = false);
 private:
     // checks if compilation or linking failed and if so, print the error logs
-    void    checkCompileErrors(unsigned int object, std::string type); 
+    bool    checkCompileErrors(unsigned int object, std::string type); 
 };
 
 #endif
\ No newline at end of file
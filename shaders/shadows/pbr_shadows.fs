@@ -56,9 +56,7 @@ out vec4 FragColor;
 // Textures
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_metallic;
-uniform sampler2D texture_roughness;
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_arm;
 uniform sampler2D texture_disp;
 uniform sampler2D shadowMap;
 uniform samplerCube shadowMapCube;
@@ -245,7 +243,7 @@ mat3 CotangentFrame(in vec3 N, in vec3 p, in vec2 uv) {
 }
 
 vec3 getNormalFromMap(vec2 texcoord){
-    vec3 tangentNormal = texture(texture_normal, texcoord).xyz * 2.0 - 1.0;
+    vec3 tangentNormal = decodeNormalXY(texture(texture_normal, texcoord).rg);
 
     vec3 T = normalize(Tangent - dot(Tangent, Normal) * Normal);
     vec3 B = normalize(cross(Normal, T));
@@ -260,8 +258,7 @@ vec3 perturb_normal( vec3 N, vec3 V, vec2 texcoord )
 {
     // assume N, the interpolated vertex normal and
     // V, the view vector (vertex to eye)
-    vec3 map = texture(texture_normal, texcoord ).xyz;
-    map = map * 2.0 - 1.0;
+    vec3 map = decodeNormalXY(texture(texture_normal, texcoord ).rg);
     mat3 TBN = CotangentFrame(N, -V, texcoord);
     return normalize(TBN * map);
 }
@@ -419,24 +416,15 @@ void main()
     }
     
     float metallic = material.metallic; // Default to material metallic
-    
-    // Check if the metallic texture is available
-    if (textureSize(texture_metallic, 0).x > 0) {
-        metallic = texture(texture_metallic, newTexCoords).r * material.metallic;
-    }
-    
     float roughness = material.roughness; // Default to material roughness
-    
-    // Check if the roughness texture is available
-    if (textureSize(texture_roughness, 0).x > 0) {
-        roughness = texture(texture_roughness, newTexCoords).r * material.roughness;
-    }
-    
     float ao = material.occlusion; // Default to material occlusion
     
-    // Check if the occlusion texture is available
-    if (textureSize(texture_occlusion, 0).x > 0) {
-        ao = texture(texture_occlusion, newTexCoords).r * material.occlusion;
+    // Check if the ARM texture is available, one sample for the three
+    if (textureSize(texture_arm, 0).x > 0) {
+        vec3 arm = texture(texture_arm, newTexCoords).rgb;
+        ao = arm.r * material.occlusion;
+        roughness = arm.g * material.roughness;
+        metallic = arm.b * material.metallic;
     }
 
     // Apply normal mapping if normal map is provided
@@ -10,9 +10,7 @@ in VS_OUT {
 
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_normal;
-uniform sampler2D texture_metallic;
-uniform sampler2D texture_roughness;
-uniform sampler2D texture_occlusion;
+uniform sampler2D texture_arm;
 uniform sampler2D texture_disp;
 uniform sampler2D shadowMap;
 uniform samplerCube shadowMapCube;
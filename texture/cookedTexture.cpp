@@ -0,0 +1,270 @@
+#include "cookedTexture.h"
+#include "../resources/sourceStamp.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bumped whenever the cooked layout or the cooking changes
+static const uint32_t COOKED_TEXTURE_MAGIC = 0x58545244;  // "DRTX"
+static const uint32_t COOKED_TEXTURE_VERSION = 1;
+static const uint32_t COOKED_TEXTURE_MAX_LEVELS = 16;
+
+struct CookedTextureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;      // same staleness check as the collision mesh cache
+    int64_t sourceModified;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;      // followed by the level table, then the blocks
+};
+
+CookedTexture::CookedTexture() : format(FORMAT_BC1), width(0), height(0), mapping(nullptr), mappingSize(0) {}
+
+CookedTexture::~CookedTexture() {
+    unmap();
+}
+
+std::string CookedTexture::getCachePath(const std::string& sourcePath) {
+    return sourcePath + ".dtex";
+}
+
+size_t CookedTexture::getBlockBytes(Format format) {
+    return (format == FORMAT_BC1 || format == FORMAT_BC4) ? 8 : 16;
+}
+
+size_t CookedTexture::getLevelBytes(Format format, uint32_t width, uint32_t height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+// Sizes added up and the latest change, a single source keeps its own stamp
+static bool getSourcesStamp(const std::vector<std::string>& sourcePaths, uint64_t& size, int64_t& modified) {
+    if (sourcePaths.empty()) return false;
+    size = 0;
+    modified = 0;
+    for (size_t i = 0; i < sourcePaths.size(); ++i) {
+        uint64_t sourceSize;
+        int64_t sourceModified;
+        if (!SourceStamp::get(sourcePaths[i], sourceSize, sourceModified)) return false;
+        size += sourceSize;
+        modified = i == 0 ? sourceModified : std::max(modified, sourceModified);
+    }
+    return true;
+}
+
+bool CookedTexture::map(const std::string& sourcePath) {
+    return map(sourcePath, std::vector<std::string>(1, sourcePath));
+}
+
+bool CookedTexture::map(const std::string& name, const std::vector<std::string>& sourcePaths) {
+    unmap();
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!getSourcesStamp(sourcePaths, sourceSize, sourceModified)) return false;
+
+    int file = open(getCachePath(name).c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat info;
+    if (fstat(file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CookedTextureHeader)) {
+        close(file);
+        return false;
+    }
+    // Populated right away, the upload on the GL thread doesn't fault the pages in
+    size_t size = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) return false;
+    mapping = data;
+    mappingSize = size;
+
+    CookedTextureHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (header.magic != COOKED_TEXTURE_MAGIC || header.version != COOKED_TEXTURE_VERSION ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified ||
+        header.format < FORMAT_BC1 || header.format > FORMAT_BC5 ||
+        header.levelCount == 0 || header.levelCount > COOKED_TEXTURE_MAX_LEVELS ||
+        sizeof(header) + header.levelCount * sizeof(Level) > size) {
+        unmap();
+        return false;
+    }
+    format = static_cast<Format>(header.format);
+    width = header.width;
+    height = header.height;
+    levels.resize(header.levelCount);
+    std::memcpy(levels.data(), static_cast<const unsigned char*>(mapping) + sizeof(header), levels.size() * sizeof(Level));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        const Level& level = levels[i];
+        if (level.size != getLevelBytes(format, level.width, level.height) ||
+            level.offset > size || level.size > size - level.offset) {
+            unmap();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CookedTexture::unmap() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    levels.clear();
+}
+
+bool CookedTexture::save(const std::string& sourcePath, Format format, uint32_t width, uint32_t height,
+                         const std::vector<std::vector<unsigned char>>& levelData) {
+    return save(sourcePath, std::vector<std::string>(1, sourcePath), format, width, height, levelData);
+}
+
+bool CookedTexture::save(const std::string& name, const std::vector<std::string>& sourcePaths, Format format,
+                         uint32_t width, uint32_t height, const std::vector<std::vector<unsigned char>>& levelData) {
+    CookedTextureHeader header;
+    if (!getSourcesStamp(sourcePaths, header.sourceSize, header.sourceModified)) return false;
+    if (levelData.empty() || levelData.size() > COOKED_TEXTURE_MAX_LEVELS) return false;
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.levelCount = static_cast<uint32_t>(levelData.size());
+
+    // Levels start on 16 bytes, a block never straddles the alignment
+    std::vector<Level> table(levelData.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(Level);
+    uint32_t levelWidth = width, levelHeight = height;
+    for (size_t i = 0; i < table.size(); ++i) {
+        offset = (offset + 15) & ~uint64_t(15);
+        table[i].width = levelWidth;
+        table[i].height = levelHeight;
+        table[i].offset = offset;
+        table[i].size = levelData[i].size();
+        offset += table[i].size;
+        levelWidth = std::max(levelWidth / 2, 1u);
+        levelHeight = std::max(levelHeight / 2, 1u);
+    }
+
+    std::ofstream file(getCachePath(name), std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write cooked texture for " << name << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(Level));
+    const char padding[16] = {};
+    uint64_t written = sizeof(header) + table.size() * sizeof(Level);
+    for (size_t i = 0; i < table.size(); ++i) {
+        file.write(padding, static_cast<std::streamsize>(table[i].offset - written));
+        file.write(reinterpret_cast<const char*>(levelData[i].data()), levelData[i].size());
+        written = table[i].offset + table[i].size;
+    }
+    return static_cast<bool>(file);
+}
+
+CookedTexture::Format CookedTexture::getFormat() const {
+    return format;
+}
+
+uint32_t CookedTexture::getWidth() const {
+    return width;
+}
+
+uint32_t CookedTexture::getHeight() const {
+    return height;
+}
+
+size_t CookedTexture::getLevelCount() const {
+    return levels.size();
+}
+
+const CookedTexture::Level& CookedTexture::getLevel(size_t level) const {
+    return levels[level];
+}
+
+size_t CookedTexture::getDataSize() const {
+    size_t size = 0;
+    for (size_t i = 0; i < levels.size(); ++i) {
+        size += levels[i].size;
+    }
+    return size;
+}
+
+bool CookedTexture::canFlip() const {
+    for (size_t i = 0; i < levels.size(); ++i) {
+        if (levels[i].height > 4 && levels[i].height % 4 != 0) return false;
+    }
+    return true;
+}
+
+// Rows of a BC4 block are 12 bits each of the 48 bit index field
+static void flipAlphaBlock(const unsigned char* source, unsigned char* destination, uint32_t rows) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= static_cast<uint64_t>(source[2 + i]) << (8 * i);
+    }
+    uint64_t flipped = bits;
+    for (uint32_t row = 0; row < rows; ++row) {
+        uint64_t mask = uint64_t(0xFFF) << (12 * row);
+        uint64_t sourceRow = (bits >> (12 * (rows - 1 - row))) & 0xFFF;
+        flipped = (flipped & ~mask) | (sourceRow << (12 * row));
+    }
+    destination[0] = source[0];
+    destination[1] = source[1];
+    for (int i = 0; i < 6; ++i) {
+        destination[2 + i] = static_cast<unsigned char>(flipped >> (8 * i));
+    }
+}
+
+// Rows of a BC1 block are the last four bytes
+static void flipColorBlock(const unsigned char* source, unsigned char* destination, uint32_t rows) {
+    std::memcpy(destination, source, 8);
+    for (uint32_t row = 0; row < rows; ++row) {
+        destination[4 + row] = source[4 + rows - 1 - row];
+    }
+}
+
+void CookedTexture::flipBlock(Format format, const unsigned char* source, unsigned char* destination, uint32_t rows) {
+    switch (format) {
+    case FORMAT_BC1:
+        flipColorBlock(source, destination, rows);
+        break;
+    case FORMAT_BC3:
+        flipAlphaBlock(source, destination, rows);
+        flipColorBlock(source + 8, destination + 8, rows);
+        break;
+    case FORMAT_BC4:
+        flipAlphaBlock(source, destination, rows);
+        break;
+    case FORMAT_BC5:
+        flipAlphaBlock(source, destination, rows);
+        flipAlphaBlock(source + 8, destination + 8, rows);
+        break;
+    }
+}
+
+void CookedTexture::copyLevel(size_t levelIndex, unsigned char* destination, bool flipVertically) const {
+    const Level& level = levels[levelIndex];
+    const unsigned char* source = static_cast<const unsigned char*>(mapping) + level.offset;
+    if (!flipVertically) {
+        std::memcpy(destination, source, level.size);
+        return;
+    }
+    size_t blockBytes = getBlockBytes(format);
+    uint32_t blocksWide = (level.width + 3) / 4;
+    uint32_t blocksHigh = (level.height + 3) / 4;
+    uint32_t rows = std::min(level.height, 4u);
+    size_t rowBytes = blocksWide * blockBytes;
+    for (uint32_t y = 0; y < blocksHigh; ++y) {
+        const unsigned char* sourceRow = source + (blocksHigh - 1 - y) * rowBytes;
+        unsigned char* destinationRow = destination + y * rowBytes;
+        for (uint32_t x = 0; x < blocksWide; ++x) {
+            flipBlock(format, sourceRow + x * blockBytes, destinationRow + x * blockBytes, rows);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef COOKED_TEXTURE_H
+#define COOKED_TEXTURE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Texture cooked offline by the texture cooker (tools/textureCooker.cpp):
+// the full mip chain already compressed in GPU blocks, so loading is a
+// memory map and one glCompressedTexImage2D per level. Like the collision
+// mesh cache it sits next to the source image and is ignored once the
+// source changes.
+class CookedTexture {
+public:
+    // Block formats, 4x4 texels per block
+    enum Format {
+        FORMAT_BC1 = 1,  // RGB, 8 bytes per block
+        FORMAT_BC3 = 2,  // RGBA, 16 bytes
+        FORMAT_BC4 = 3,  // one channel, 8 bytes
+        FORMAT_BC5 = 4   // two channels (normal maps), 16 bytes
+    };
+
+    struct Level {
+        uint32_t width, height;
+        uint64_t offset;  // from the start of the file
+        uint64_t size;
+    };
+
+    CookedTexture();
+    ~CookedTexture();
+
+    CookedTexture(const CookedTexture&) = delete;
+    CookedTexture& operator=(const CookedTexture&) = delete;
+
+    // Map the texture cooked for sourcePath, false if missing or out of date
+    bool map(const std::string& sourcePath);
+    // Texture packed from several sources, one channel each (the ARM map of
+    // separate ao, rough and met images), cooked under name. Out of date once
+    // any of the sources changes
+    bool map(const std::string& name, const std::vector<std::string>& sourcePaths);
+    void unmap();
+
+    // Write the levels, largest first, each one already compressed in format
+    static bool save(const std::string& sourcePath, Format format, uint32_t width, uint32_t height,
+                     const std::vector<std::vector<unsigned char>>& levels);
+    static bool save(const std::string& name, const std::vector<std::string>& sourcePaths, Format format,
+                     uint32_t width, uint32_t height, const std::vector<std::vector<unsigned char>>& levels);
+
+    // sourcePath (or the name of a packed texture) + ".dtex"
+    static std::string getCachePath(const std::string& sourcePath);
+    static size_t getBlockBytes(Format format);
+    static size_t getLevelBytes(Format format, uint32_t width, uint32_t height);
+
+    Format getFormat() const;
+    uint32_t getWidth() const;
+    uint32_t getHeight() const;
+    size_t getLevelCount() const;
+    const Level& getLevel(size_t level) const;
+    // Bytes of every level together
+    size_t getDataSize() const;
+
+    // Copy a level to destination (getLevel(level).size bytes). Flipping
+    // reorders the blocks and the rows inside them, a level taller than a
+    // block needs a multiple of 4 rows for it (see canFlip)
+    void copyLevel(size_t level, unsigned char* destination, bool flipVertically) const;
+    bool canFlip() const;
+
+private:
+    Format format;
+    uint32_t width, height;
+    std::vector<Level> levels;
+    void* mapping;
+    size_t mappingSize;
+
+    static void flipBlock(Format format, const unsigned char* source, unsigned char* destination, uint32_t rows);
+};
+
+#endif // COOKED_TEXTURE_H
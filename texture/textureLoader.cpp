@@ -0,0 +1,473 @@
+#include "textureLoader.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <stb_image.h>
+
+// EXT_texture_compression_s3tc and EXT_texture_sRGB, not in the core profile headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+size_t TextureLoader::UploadBytesPerFrame = 16 * 1024 * 1024;
+bool TextureLoader::UseCooked = true;
+std::mutex TextureLoader::decodedMutex;
+std::condition_variable TextureLoader::decodedCondition;
+std::deque<TextureLoader::Image> TextureLoader::decoded;
+size_t TextureLoader::pending = 0;
+std::vector<TextureLoader::UploadBuffer> TextureLoader::uploadBuffers;
+size_t TextureLoader::nextBuffer = 0;
+std::unordered_map<unsigned int, size_t> TextureLoader::textureBytes;
+std::unordered_map<unsigned int, unsigned int> TextureLoader::pendingLoads;
+std::unordered_set<unsigned int> TextureLoader::cancelled;
+unsigned int TextureLoader::nextSerial = 0;
+std::unordered_set<unsigned int> TextureLoader::cookedTextures;
+int TextureLoader::bcSupport = -1;
+
+unsigned int TextureLoader::Load(const std::string& file, bool flipVertically, unsigned int placeholder, int channels, bool srgb)
+{
+    unsigned int texture = createPlaceholder(placeholder);
+    // A forced channel count needs the decoded pixels
+    bool useCooked = UseCooked && channels == 0;
+    bool s3tc = bcSupport == 1;
+
+    pending++;
+    unsigned int serial = nextSerial++;
+    pendingLoads[texture] = serial;
+    // Decoding is what takes the time, the shared pool keeps at least one worker
+    WorkerPool::shared().submit([texture, serial, file, flipVertically, channels, srgb, useCooked, s3tc] {
+        Image image = { texture, serial, file, 0, 0, 0, srgb, flipVertically, nullptr, nullptr };
+        if (useCooked) {
+            image.cooked = mapCooked(file, std::vector<std::string>(1, file), flipVertically, s3tc);
+        }
+        if (image.cooked) {
+            image.width = static_cast<int>(image.cooked->getWidth());
+            image.height = static_cast<int>(image.cooked->getHeight());
+        } else {
+            // The global flag is shared with the loads of the GL thread
+            stbi_set_flip_vertically_on_load_thread(flipVertically);
+            image.pixels = stbi_load(file.c_str(), &image.width, &image.height, &image.channels, channels);
+            if (channels != 0) {
+                image.channels = channels;
+            }
+        }
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        decoded.push_back(image);
+        decodedCondition.notify_all();
+    });
+    return texture;
+}
+
+unsigned int TextureLoader::LoadPacked(const std::string& name, const std::vector<std::string>& files, bool flipVertically,
+                                       unsigned int placeholder)
+{
+    unsigned int texture = createPlaceholder(placeholder);
+    bool useCooked = UseCooked;
+    bool s3tc = bcSupport == 1;
+
+    pending++;
+    unsigned int serial = nextSerial++;
+    pendingLoads[texture] = serial;
+    WorkerPool::shared().submit([texture, serial, name, files, flipVertically, useCooked, s3tc] {
+        Image image = { texture, serial, name, 0, 0, 0, false, flipVertically, nullptr, nullptr };
+        if (useCooked) {
+            image.cooked = mapCooked(name, files, flipVertically, s3tc);
+        }
+        if (image.cooked) {
+            image.width = static_cast<int>(image.cooked->getWidth());
+            image.height = static_cast<int>(image.cooked->getHeight());
+        } else {
+            image.pixels = decodePacked(files, flipVertically, image.width, image.height);
+            image.channels = static_cast<int>(files.size());
+        }
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        decoded.push_back(image);
+        decodedCondition.notify_all();
+    });
+    return texture;
+}
+
+unsigned int TextureLoader::LoadSync(const std::string& file, bool flipVertically, int channels, bool srgb)
+{
+    int width, height, fileChannels;
+    stbi_set_flip_vertically_on_load_thread(flipVertically);
+    unsigned char* data = stbi_load(file.c_str(), &width, &height, &fileChannels, channels);
+    if (!data) {
+        std::cout << "Failed to load texture " << file << std::endl;
+        return 0;
+    }
+    if (channels == 0) {
+        channels = fileChannels;
+    }
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormatFor(channels, srgb), width, height, 0, formatFor(channels), GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stbi_image_free(data);
+    textureBytes[texture] = mipChainBytes(width, height, channels);
+    return texture;
+}
+
+void TextureLoader::Delete(unsigned int texture)
+{
+    auto it = pendingLoads.find(texture);
+    if (it != pendingLoads.end()) {
+        cancelled.insert(it->second);
+        pendingLoads.erase(it);
+    }
+    textureBytes.erase(texture);
+    cookedTextures.erase(texture);
+    glDeleteTextures(1, &texture);
+}
+
+size_t TextureLoader::GetTextureBytes(unsigned int texture)
+{
+    auto it = textureBytes.find(texture);
+    return it != textureBytes.end() ? it->second : 0;
+}
+
+bool TextureLoader::IsCooked(unsigned int texture)
+{
+    return cookedTextures.count(texture) != 0;
+}
+
+void TextureLoader::Update()
+{
+    uploadDecoded(UploadBytesPerFrame, false);
+}
+
+void TextureLoader::Finish()
+{
+    while (pending > 0) {
+        {
+            std::unique_lock<std::mutex> lock(decodedMutex);
+            decodedCondition.wait(lock, [] { return !decoded.empty(); });
+        }
+        uploadDecoded(std::numeric_limits<size_t>::max(), true);
+    }
+}
+
+size_t TextureLoader::GetPendingCount()
+{
+    return pending;
+}
+
+unsigned int TextureLoader::GetDecodeThreads()
+{
+    return WorkerPool::shared().getThreadCount();
+}
+
+void TextureLoader::Clear()
+{
+    // Every queued decode hands back one image, wait for the ones still on the pool
+    {
+        std::unique_lock<std::mutex> lock(decodedMutex);
+        decodedCondition.wait(lock, [] { return decoded.size() >= pending; });
+    }
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        freeImage(decoded[i]);
+    }
+    decoded.clear();
+    pending = 0;
+    for (size_t i = 0; i < uploadBuffers.size(); ++i) {
+        if (uploadBuffers[i].fence) {
+            glDeleteSync(uploadBuffers[i].fence);
+        }
+        glDeleteBuffers(1, &uploadBuffers[i].pbo);
+    }
+    uploadBuffers.clear();
+    nextBuffer = 0;
+    textureBytes.clear();
+    cookedTextures.clear();
+    pendingLoads.clear();
+    cancelled.clear();
+}
+
+// Same wrap as the primitives always used. The placeholder is one level,
+// the upload turns trilinear filtering on with the mip chain
+unsigned int TextureLoader::createPlaceholder(unsigned int placeholder)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const unsigned char texel[4] = { static_cast<unsigned char>(placeholder), static_cast<unsigned char>(placeholder >> 8),
+                                     static_cast<unsigned char>(placeholder >> 16), static_cast<unsigned char>(placeholder >> 24) };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The workers have no GL context to look at the extensions
+    if (bcSupport < 0) {
+        bcSupport = 0;
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions; ++i) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) bcSupport = 1;
+        }
+    }
+    return texture;
+}
+
+// Worker thread: the cooked texture if it is up to date and can be uploaded
+// as asked, null to decode the images instead
+CookedTexture* TextureLoader::mapCooked(const std::string& name, const std::vector<std::string>& files, bool flipVertically,
+                                        bool s3tc)
+{
+    CookedTexture* cooked = new CookedTexture();
+    bool colorBlocks = false;
+    if (cooked->map(name, files)) {
+        CookedTexture::Format format = cooked->getFormat();
+        colorBlocks = format == CookedTexture::FORMAT_BC1 || format == CookedTexture::FORMAT_BC3;
+    }
+    if (cooked->getLevelCount() > 0 && (!flipVertically || cooked->canFlip()) && (s3tc || !colorBlocks)) {
+        return cooked;
+    }
+    delete cooked;
+    return nullptr;
+}
+
+// Worker thread: one image per channel, all of the same size. The first one
+// is decoded with every channel and the others are written over it, so the
+// pixels come from stbi_load like the other images. Null if one is missing
+unsigned char* TextureLoader::decodePacked(const std::vector<std::string>& files, bool flipVertically, int& width, int& height)
+{
+    int channels = static_cast<int>(files.size());
+    int fileChannels;
+    stbi_set_flip_vertically_on_load_thread(flipVertically);
+    unsigned char* pixels = stbi_load(files[0].c_str(), &width, &height, &fileChannels, channels);
+    for (int channel = 1; channel < channels && pixels; ++channel) {
+        int channelWidth, channelHeight;
+        unsigned char* source = stbi_load(files[channel].c_str(), &channelWidth, &channelHeight, &fileChannels, 1);
+        if (source && channelWidth == width && channelHeight == height) {
+            size_t texels = static_cast<size_t>(width) * height;
+            for (size_t i = 0; i < texels; ++i) {
+                pixels[i * channels + channel] = source[i];
+            }
+        } else {
+            std::cout << "Failed to pack " << files[channel] << " with " << files[0] << std::endl;
+            stbi_image_free(pixels);
+            pixels = nullptr;
+        }
+        stbi_image_free(source);
+    }
+    return pixels;
+}
+
+GLenum TextureLoader::formatFor(int channels)
+{
+    switch (channels) {
+    case 1: return GL_RED;
+    case 2: return GL_RG;
+    case 4: return GL_RGBA;
+    default: return GL_RGB;
+    }
+}
+
+GLenum TextureLoader::internalFormatFor(int channels, bool srgb)
+{
+    if (srgb && channels == 3) return GL_SRGB8;
+    if (srgb && channels == 4) return GL_SRGB8_ALPHA8;
+    return formatFor(channels);
+}
+
+GLenum TextureLoader::compressedFormatFor(CookedTexture::Format format, bool srgb)
+{
+    switch (format) {
+    case CookedTexture::FORMAT_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case CookedTexture::FORMAT_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case CookedTexture::FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+    default: return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+size_t TextureLoader::mipChainBytes(int width, int height, int channels)
+{
+    size_t bytes = 0;
+    while (true) {
+        bytes += static_cast<size_t>(width) * height * channels;
+        if (width == 1 && height == 1) return bytes;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+// What goes through the unpack buffer: the cooked mip chain, or the base level
+size_t TextureLoader::imageBytes(const Image& image)
+{
+    if (image.cooked) return image.cooked->getDataSize();
+    return static_cast<size_t>(image.width) * image.height * image.channels;
+}
+
+void TextureLoader::freeImage(Image& image)
+{
+    stbi_image_free(image.pixels);
+    delete image.cooked;
+    image.pixels = nullptr;
+    image.cooked = nullptr;
+}
+
+// Buffers are used in turn, so the next one is always the oldest upload.
+// Null if the GPU still reads it and wait is false
+TextureLoader::UploadBuffer* TextureLoader::nextUploadBuffer(bool wait)
+{
+    if (uploadBuffers.empty()) {
+        uploadBuffers.resize(UPLOAD_BUFFERS);
+        for (size_t i = 0; i < uploadBuffers.size(); ++i) {
+            glGenBuffers(1, &uploadBuffers[i].pbo);
+            uploadBuffers[i].size = 0;
+            uploadBuffers[i].fence = 0;
+        }
+    }
+    UploadBuffer& buffer = uploadBuffers[nextBuffer];
+    if (buffer.fence) {
+        GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+        GLuint64 timeout = wait ? 1000000000ull : 0;
+        GLenum status = glClientWaitSync(buffer.fence, flags, timeout);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) return nullptr;
+        glDeleteSync(buffer.fence);
+        buffer.fence = 0;
+    }
+    nextBuffer = (nextBuffer + 1) % uploadBuffers.size();
+    return &buffer;
+}
+
+void TextureLoader::uploadDecoded(size_t budget, bool wait)
+{
+    size_t uploaded = 0;
+    while (true) {
+        Image image;
+        {
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            if (decoded.empty()) return;
+            image = decoded.front();
+            size_t bytes = imageBytes(image);
+            if (uploaded > 0 && uploaded + bytes > budget) return;
+            decoded.pop_front();
+            uploaded += bytes;
+        }
+        if (cancelled.erase(image.serial) != 0) {
+            freeImage(image);
+            pending--;
+            continue;
+        }
+        if (!upload(image, wait)) {
+            // Every buffer is still in use, try again next frame
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            decoded.push_front(image);
+            return;
+        }
+        freeImage(image);
+        pendingLoads.erase(image.texture);
+        pending--;
+    }
+}
+
+// The image is copied into the unpack buffer and glTexImage2D reads it from
+// there, the copy to the GPU happens without blocking this thread
+bool TextureLoader::upload(const Image& image, bool wait)
+{
+    if (!image.pixels && !image.cooked) {
+        // Keeps the placeholder
+        std::cout << "Failed to load texture " << image.file << std::endl;
+        return true;
+    }
+    UploadBuffer* buffer = nextUploadBuffer(wait);
+    if (!buffer) return false;
+
+    size_t bytes = imageBytes(image);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->pbo);
+    if (buffer->size < bytes) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        buffer->size = bytes;
+    }
+    // The fence says the GPU is done with the old contents, no need to sync again
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (image.cooked) {
+        uploadCooked(image, static_cast<unsigned char*>(mapped));
+        buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        textureBytes[image.texture] = bytes;
+        cookedTextures.insert(image.texture);
+        return true;
+    }
+    const void* source = image.pixels;
+    if (mapped) {
+        std::memcpy(mapped, image.pixels, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        source = 0;  // offset in the unpack buffer
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, image.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormatFor(image.channels, image.srgb), image.width, image.height, 0,
+                 formatFor(image.channels), GL_UNSIGNED_BYTE, source);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    textureBytes[image.texture] = mipChainBytes(image.width, image.height, image.channels);
+    return true;
+}
+
+// The levels go one after the other in the mapped unpack buffer, flipped
+// during the copy if asked, the driver gets the blocks without recompressing
+void TextureLoader::uploadCooked(const Image& image, unsigned char* mapped)
+{
+    const CookedTexture& cooked = *image.cooked;
+    std::vector<unsigned char> copy;
+    unsigned char* destination = mapped;
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        copy.resize(cooked.getDataSize());
+        destination = copy.data();
+    }
+    size_t offset = 0;
+    for (size_t level = 0; level < cooked.getLevelCount(); ++level) {
+        cooked.copyLevel(level, destination + offset, image.flipVertically);
+        offset += cooked.getLevel(level).size;
+    }
+    if (mapped) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    GLenum format = compressedFormatFor(cooked.getFormat(), image.srgb);
+    glBindTexture(GL_TEXTURE_2D, image.texture);
+    offset = 0;
+    for (size_t level = 0; level < cooked.getLevelCount(); ++level) {
+        const CookedTexture::Level& info = cooked.getLevel(level);
+        const void* source = mapped ? reinterpret_cast<const void*>(offset) : copy.data() + offset;
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, info.width, info.height, 0,
+                               static_cast<GLsizei>(info.size), source);
+        offset += info.size;
+    }
+    // The chain may stop before 1x1, sampling stays within the levels uploaded
+    GLint lastLevel = static_cast<GLint>(cooked.getLevelCount()) - 1;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, lastLevel > 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,112 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include "../glad/glad.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include "../threading/workerPool.h"
+#include "cookedTexture.h"
+
+// Loads image files into GL textures without stalling the GL thread.
+// Load() returns a texture right away that holds a 1x1 placeholder texel,
+// the file is decoded on worker threads and Update() (GL thread, once per
+// frame) uploads the decoded images through a small ring of pixel unpack
+// buffers, a fence per buffer tells when the GPU is done reading it.
+// An image cooked by tools/textureCooker is mapped instead of decoded and
+// its compressed mip chain uploaded as is.
+// Static like ResourceManager, the primitives load from their constructors.
+class TextureLoader
+{
+public:
+    // Placeholder texels, RGBA in the low to high bytes
+    static const unsigned int PLACEHOLDER_GREY = 0xFF808080;
+    static const unsigned int PLACEHOLDER_NORMAL = 0xFFFF8080;  // flat normal, (0.5, 0.5, 1)
+
+    // Bytes uploaded per Update(), an image bigger than that still goes alone
+    static size_t UploadBytesPerFrame;
+    // Use the cooked .dtex next to an image when it is up to date
+    static bool UseCooked;
+
+    // Texture id right away, the image replaces the placeholder once decoded and uploaded.
+    // channels forces the component count (0 keeps the file's, or the cooked
+    // format), srgb stores 3 and 4 component images in an sRGB format
+    static unsigned int Load(const std::string& file, bool flipVertically = false, unsigned int placeholder = PLACEHOLDER_GREY,
+                             int channels = 0, bool srgb = false);
+    // Texture packed from single channel images, the first channel of files[i]
+    // goes to channel i: the ARM map (R ao, G rough, B met) of separate images.
+    // Maps the texture the cooker packed under name when there is one, the
+    // images are decoded and packed on the worker otherwise
+    static unsigned int LoadPacked(const std::string& name, const std::vector<std::string>& files, bool flipVertically = false,
+                                   unsigned int placeholder = PLACEHOLDER_GREY);
+    // Decode and upload on the calling thread, returns 0 if the file can't be read
+    static unsigned int LoadSync(const std::string& file, bool flipVertically = false, int channels = 0, bool srgb = false);
+    // Delete a texture of the loader, a pending image is dropped instead of uploaded
+    static void Delete(unsigned int texture);
+    // Bytes on the GPU with the mipmaps, 0 until uploaded
+    static size_t GetTextureBytes(unsigned int texture);
+    // Uploaded from a cooked file
+    static bool IsCooked(unsigned int texture);
+    // GL thread: upload the images decoded so far, up to UploadBytesPerFrame
+    static void Update();
+    // GL thread: wait for every pending image and upload it
+    static void Finish();
+    // Loads not uploaded yet
+    static size_t GetPendingCount();
+    static unsigned int GetDecodeThreads();
+    // Waits for the decodes and frees the upload buffers, needs the GL context
+    static void Clear();
+
+private:
+    TextureLoader() { }
+
+    struct Image {
+        unsigned int texture;
+        unsigned int serial;  // of the load, a deleted texture name can come back
+        std::string file;
+        int width, height, channels;
+        bool srgb;
+        bool flipVertically;
+        unsigned char* pixels;   // from stbi_load, null if the file couldn't be read
+        CookedTexture* cooked;   // mapped instead of pixels when there is one
+    };
+    struct UploadBuffer {
+        unsigned int pbo;
+        size_t size;
+        GLsync fence;  // after the last upload from it, null when unused
+    };
+    static const size_t UPLOAD_BUFFERS = 3;
+
+    static std::mutex decodedMutex;
+    static std::condition_variable decodedCondition;
+    static std::deque<Image> decoded;
+    static size_t pending;
+    static std::vector<UploadBuffer> uploadBuffers;
+    static size_t nextBuffer;
+    static std::unordered_map<unsigned int, size_t> textureBytes;         // uploaded textures
+    static std::unordered_map<unsigned int, unsigned int> pendingLoads;  // texture to load serial
+    static std::unordered_set<unsigned int> cancelled;                   // serials deleted before their upload
+    static unsigned int nextSerial;
+    static std::unordered_set<unsigned int> cookedTextures;
+    static int bcSupport;  // -1 until checked, BC1 and BC3 come from an extension
+
+    static unsigned int createPlaceholder(unsigned int placeholder);
+    static CookedTexture* mapCooked(const std::string& name, const std::vector<std::string>& files, bool flipVertically, bool s3tc);
+    static unsigned char* decodePacked(const std::vector<std::string>& files, bool flipVertically, int& width, int& height);
+    static GLenum formatFor(int channels);
+    static GLenum internalFormatFor(int channels, bool srgb);
+    static GLenum compressedFormatFor(CookedTexture::Format format, bool srgb);
+    static size_t mipChainBytes(int width, int height, int channels);
+    static size_t imageBytes(const Image& image);
+    static void freeImage(Image& image);
+    static UploadBuffer* nextUploadBuffer(bool wait);
+    static void uploadDecoded(size_t budget, bool wait);
+    static bool upload(const Image& image, bool wait);
+    static void uploadCooked(const Image& image, unsigned char* mapped);
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "workerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : stopping(false), batchJob(nullptr), batchCount(0), batchNext(0), batchGeneration(0), batchMaxWorkers(0),
+      batchWorkers(0), batchActive(0) {
+    start(threadCount);
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+WorkerPool& WorkerPool::shared() {
+    static WorkerPool pool(std::max(1u, defaultThreadCount()));
+    return pool;
+}
+
+unsigned int WorkerPool::defaultThreadCount() {
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+void WorkerPool::start(unsigned int threadCount) {
+    stopping = false;
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, batchGeneration);
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::setThreadCount(unsigned int threadCount) {
+    if (threadCount == threads.size()) return;
+    // stop() lets the old workers finish the queued jobs first
+    stop();
+    start(threadCount);
+}
+
+unsigned int WorkerPool::getThreadCount() const {
+    return static_cast<unsigned int>(threads.size());
+}
+
+// Grab indices of the current batch until there are none left
+void WorkerPool::runBatch() {
+    const std::function<void(size_t)>& job = *batchJob;
+    for (size_t i = batchNext.fetch_add(1); i < batchCount; i = batchNext.fetch_add(1)) {
+        job(i);
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& job, unsigned int maxWorkers) {
+    if (count == 0) return;
+    std::unique_lock<std::mutex> batchLock(batchMutex, std::try_to_lock);
+    if (threads.empty() || count == 1 || maxWorkers == 0 || !batchLock.owns_lock()) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batchJob = &job;
+        batchCount = count;
+        batchNext.store(0);
+        batchMaxWorkers = maxWorkers;
+        batchWorkers = 0;
+        batchActive = 0;
+        ++batchGeneration;
+    }
+    wakeCondition.notify_all();
+
+    // The calling thread takes its share too
+    runBatch();
+
+    // Every index is taken, wait for the workers still running one. Clearing
+    // batchJob in the same lock keeps late workers from joining
+    std::unique_lock<std::mutex> lock(mutex);
+    batchDoneCondition.wait(lock, [this] { return batchActive == 0; });
+    batchJob = nullptr;
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    if (threads.empty()) {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeCondition.notify_one();
+}
+
+void WorkerPool::workerLoop(unsigned int seenGeneration) {
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeCondition.wait(lock, [this, &seenGeneration] {
+            return stopping || (batchJob && batchGeneration != seenGeneration) || !jobs.empty();
+        });
+
+        // A batch has priority, the caller is blocked on it
+        if (batchJob && batchGeneration != seenGeneration) {
+            seenGeneration = batchGeneration;
+            if (batchWorkers == batchMaxWorkers) continue;
+            batchWorkers++;
+            batchActive++;
+            lock.unlock();
+            runBatch();
+            lock.lock();
+            if (--batchActive == 0) {
+                batchDoneCondition.notify_one();
+            }
+            continue;
+        }
+
+        if (!jobs.empty()) {
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+            continue;
+        }
+
+        if (stopping) return;
+    }
+}
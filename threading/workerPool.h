@@ -0,0 +1,74 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+
+// Fixed set of worker threads. The engine systems share one pool, shared(),
+// so they never have more threads than cores between them.
+// parallelFor() splits an index range over the workers and the calling
+// thread and waits for it, submit() queues a job and returns right away.
+// A parallelFor only waits for its own indices: workers busy with a long
+// submitted job (terrain streaming, texture decodes) don't join it and the
+// free workers and the calling thread do their share.
+class WorkerPool {
+public:
+    // threadCount worker threads on top of the calling thread, 0 runs everything inline
+    explicit WorkerPool(unsigned int threadCount = defaultThreadCount());
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // The engine-wide pool, created on first use. It keeps at least one
+    // worker so submitted jobs never run on the calling thread
+    static WorkerPool& shared();
+
+    // Run job(i) for every i in [0, count) and wait until all are done, with
+    // at most maxWorkers workers helping the calling thread. One batch runs
+    // at a time: a parallelFor made while another one runs (from another
+    // thread or from inside a job) runs inline on its calling thread
+    void parallelFor(size_t count, const std::function<void(size_t)>& job, unsigned int maxWorkers = ~0u);
+
+    // Queue a job to run on a worker, runs it inline if there are no workers
+    void submit(std::function<void()> job);
+
+    // Stop the workers and start threadCount new ones
+    void setThreadCount(unsigned int threadCount);
+    unsigned int getThreadCount() const;
+
+    // Hardware threads minus the calling thread
+    static unsigned int defaultThreadCount();
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable batchDoneCondition;
+    bool stopping;
+
+    // queued jobs from submit()
+    std::deque<std::function<void()>> jobs;
+
+    // current parallelFor batch, batchJob is null when there is none to join
+    std::mutex batchMutex;  // held by the thread running a batch
+    const std::function<void(size_t)>* batchJob;
+    size_t batchCount;
+    std::atomic<size_t> batchNext;
+    unsigned int batchGeneration;
+    unsigned int batchMaxWorkers;
+    unsigned int batchWorkers;  // workers that joined the batch
+    unsigned int batchActive;   // of those, the ones still running it
+
+    void start(unsigned int threadCount);
+    void stop();
+    void workerLoop(unsigned int seenGeneration);
+    void runBatch();
+};
+
+#endif // WORKER_POOL_H
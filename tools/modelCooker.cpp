@@ -0,0 +1,116 @@
+// Offline model cooker, built by the "Cook models" task:
+//   bin/modelCooker [--force] [directory or model ...]
+// Cooks every .fbx, .gltf and .glb under models/ (or the given paths) into a
+// .dmodel file next to it (see models/cookedModel.h), the same cook the
+// loaders run on a miss. glTF files with embedded images are skipped, they
+// stay on tinygltf. Prints the import time of each model against mapping the
+// cooked file.
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../include/tiny_gltf.h"
+
+#include "../models/modelCooker.h"
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static bool isModel(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".fbx" || extension == ".gltf" || extension == ".glb";
+}
+
+static float millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    bool force = false;
+    std::vector<fs::path> roots;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else {
+            roots.push_back(argv[i]);
+        }
+    }
+    if (roots.empty()) {
+        roots.push_back("models");
+    }
+
+    std::vector<fs::path> files;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        std::error_code error;
+        if (fs::is_directory(roots[i], error)) {
+            for (fs::recursive_directory_iterator it(roots[i], error), end; it != end; it.increment(error)) {
+                if (it->is_regular_file() && isModel(it->path())) files.push_back(it->path());
+            }
+        } else if (fs::is_regular_file(roots[i], error)) {
+            files.push_back(roots[i]);
+        } else {
+            std::printf("Skipping %s, not found\n", roots[i].string().c_str());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    // One model at a time, assimp's importer isn't shared between threads
+    const float MB = 1024.0f * 1024.0f;
+    uint64_t sourceBytes = 0, cookedBytes = 0;
+    float importMs = 0.0f, mapMs = 0.0f;
+    size_t cookedCount = 0;
+    std::printf("%-40s %9s %9s %9s %9s %9s\n", "model", "disk MB", "cooked", "vertices", "import ms", "map ms");
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string path = files[i].string();
+        CookedModel model;
+        bool upToDate = !force && model.map(path);
+        float cookMs = 0.0f;
+        if (!upToDate) {
+            auto start = std::chrono::high_resolution_clock::now();
+            ModelData data;
+            bool imported = ModelCooker::Import(path, data) && !data.meshes.empty();
+            cookMs = millisecondsSince(start);
+            if (!imported || !model.save(path, data)) {
+                std::printf("%-40s not cooked\n", path.c_str());
+                continue;
+            }
+        }
+
+        // What the loaders pay from now on
+        model.unmap();
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!model.map(path)) {
+            std::printf("%-40s failed to write %s\n", path.c_str(), CookedModel::getCachePath(path).c_str());
+            continue;
+        }
+        float cookedMs = millisecondsSince(start);
+        if (upToDate) {
+            start = std::chrono::high_resolution_clock::now();
+            ModelData data;
+            ModelCooker::Import(path, data);
+            cookMs = millisecondsSince(start);
+        }
+
+        std::error_code error;
+        uint64_t size = fs::file_size(files[i], error);
+        std::printf("%-40s %9.2f %9.2f %9zu %9.2f %9.3f%s\n", path.c_str(), size / MB, model.getFileSize() / MB,
+                    model.getVertexCount(), cookMs, cookedMs, upToDate ? "  (up to date)" : "");
+        sourceBytes += size;
+        cookedBytes += model.getFileSize();
+        importMs += cookMs;
+        mapMs += cookedMs;
+        cookedCount++;
+    }
+    std::printf("%zu of %zu models cooked\n", cookedCount, files.size());
+    std::printf("Disk: %.1f MB -> %.1f MB, load: %.1f ms -> %.2f ms\n", sourceBytes / MB, cookedBytes / MB, importMs, mapMs);
+    return cookedCount == files.size() ? 0 : 1;
+}
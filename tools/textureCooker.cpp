@@ -0,0 +1,477 @@
+// Offline texture cooker, built by the "Cook textures" task:
+//   bin/textureCooker [--force] [directory or image ...]
+// Cooks every image under texture/ and models/textures/ (or the given paths)
+// into a .dtex file next to it (see texture/cookedTexture.h): mip chain built
+// here, each level compressed to GPU blocks. The maps only keep the channels
+// the shaders read:
+//   normal maps (norm, nor, normal)          BC5, X and Y, Z is rebuilt in the shaders
+//   ao, rough and met maps of a set          packed into one ARM texture, BC1
+//   disp maps, ao, rough, met without a set  BC4, the first channel
+//   packed ARM maps and colors               BC1, or BC3 when the image has alpha
+// A set is an ao, a rough and a met image in the same directory whose names
+// only differ by that word. Its ARM texture (R ao, G rough, B met) is cooked
+// under the name with the word swapped for "arm": ao.jpg, rough.jpg and
+// met.jpg give arm.dtex, what the primitives load with AcquirePackedTexture.
+// Prints the disk, VRAM and CPU load time of each image before and after.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../texture/cookedTexture.h"
+#include "../threading/workerPool.h"
+#include <glm/glm.hpp>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum MapKind { MAP_COLOR, MAP_NORMAL, MAP_SINGLE };
+
+// One .dtex: an image, or the images of an ARM set packed one per channel
+struct CookJob {
+    std::string name;
+    std::vector<std::string> sources;
+};
+
+struct CookResult {
+    std::string path;
+    bool cooked;
+    bool skipped;              // cooked file already up to date
+    CookedTexture::Format format;
+    uint64_t sourceBytes, cookedBytes;
+    uint64_t decodedVramBytes, cookedVramBytes;
+    float decodeMs, mapMs;
+};
+
+// 8 bit image with 4 channels, whatever the file has
+struct Image {
+    int width, height;
+    std::vector<unsigned char> pixels;
+
+    const unsigned char* texel(int x, int y) const {
+        x = std::min(x, width - 1);
+        y = std::min(y, height - 1);
+        return &pixels[(static_cast<size_t>(y) * width + x) * 4];
+    }
+};
+
+// Underscore separated words of the file name, lower case
+static MapKind classify(const fs::path& path) {
+    std::string name = path.stem().string();
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('_', start);
+        if (end == std::string::npos) end = name.size();
+        std::string word = name.substr(start, end - start);
+        if (word == "norm" || word == "nor" || word == "normal") return MAP_NORMAL;
+        if (word == "ao" || word == "rough" || word == "roughness" || word == "met" || word == "metal" ||
+            word == "metallic" || word == "disp" || word == "height") {
+            return MAP_SINGLE;
+        }
+        start = end + 1;
+    }
+    return MAP_COLOR;
+}
+
+// Channel of the ARM texture an ao, rough or met image goes to, -1 for the
+// other images. name is the image's path with that word swapped for "arm"
+static int armChannel(const fs::path& path, std::string& name) {
+    std::string stem = path.stem().string();
+    std::string lower = stem;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    size_t start = 0;
+    while (start <= lower.size()) {
+        size_t end = lower.find('_', start);
+        if (end == std::string::npos) end = lower.size();
+        std::string word = lower.substr(start, end - start);
+        int channel = -1;
+        if (word == "ao") channel = 0;
+        if (word == "rough" || word == "roughness") channel = 1;
+        if (word == "met" || word == "metal" || word == "metallic") channel = 2;
+        if (channel >= 0) {
+            name = (path.parent_path() / (stem.substr(0, start) + "arm" + stem.substr(end))).string();
+            return channel;
+        }
+        start = end + 1;
+    }
+    return -1;
+}
+
+static bool isImage(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga";
+}
+
+// 2x2 box filter, normals are renormalized
+static Image downsample(const Image& source, MapKind kind) {
+    Image result;
+    result.width = std::max(source.width / 2, 1);
+    result.height = std::max(source.height / 2, 1);
+    result.pixels.resize(static_cast<size_t>(result.width) * result.height * 4);
+    for (int y = 0; y < result.height; ++y) {
+        for (int x = 0; x < result.width; ++x) {
+            const unsigned char* texels[4] = {
+                source.texel(2 * x, 2 * y), source.texel(2 * x + 1, 2 * y),
+                source.texel(2 * x, 2 * y + 1), source.texel(2 * x + 1, 2 * y + 1)
+            };
+            unsigned char* out = &result.pixels[(static_cast<size_t>(y) * result.width + x) * 4];
+            for (int c = 0; c < 4; ++c) {
+                int sum = texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c];
+                out[c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+            if (kind == MAP_NORMAL) {
+                glm::vec3 normal(0.0f);
+                for (int i = 0; i < 4; ++i) {
+                    normal += glm::vec3(texels[i][0], texels[i][1], texels[i][2]) / 127.5f - 1.0f;
+                }
+                float length = glm::length(normal);
+                normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+                for (int c = 0; c < 3; ++c) {
+                    out[c] = static_cast<unsigned char>(glm::clamp((normal[c] + 1.0f) * 127.5f + 0.5f, 0.0f, 255.0f));
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static uint16_t packColor565(const glm::vec3& color) {
+    int r = static_cast<int>(glm::clamp(color.r, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(glm::clamp(color.g, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(glm::clamp(color.b, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static glm::vec3 unpackColor565(uint16_t color) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// Endpoints at the ends of the principal axis of the block colors, pulled
+// in a little since the extremes rarely land on a palette entry
+static void encodeColorBlock(const glm::vec3 colors[16], unsigned char* out) {
+    glm::vec3 mean(0.0f);
+    for (int i = 0; i < 16; ++i) mean += colors[i];
+    mean /= 16.0f;
+    glm::mat3 covariance(0.0f);
+    for (int i = 0; i < 16; ++i) {
+        glm::vec3 d = colors[i] - mean;
+        covariance += glm::outerProduct(d, d);
+    }
+    glm::vec3 axis(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 next = covariance * axis;
+        float length = glm::length(next);
+        if (length < 1e-6f) break;
+        axis = next / length;
+    }
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float projection = glm::dot(colors[i] - mean, axis);
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    float inset = (maxProjection - minProjection) / 16.0f;
+    uint16_t color0 = packColor565(mean + axis * (maxProjection - inset));
+    uint16_t color1 = packColor565(mean + axis * (minProjection + inset));
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        // color0 > color1 is the 4 color mode
+        glm::vec3 palette[4];
+        palette[0] = unpackColor565(color0);
+        palette[1] = unpackColor565(color1);
+        palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+        palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDistance = 1e30f;
+            for (int p = 0; p < 4; ++p) {
+                glm::vec3 d = colors[i] - palette[p];
+                float distance = glm::dot(d, d);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    out[0] = static_cast<unsigned char>(color0);
+    out[1] = static_cast<unsigned char>(color0 >> 8);
+    out[2] = static_cast<unsigned char>(color1);
+    out[3] = static_cast<unsigned char>(color1 >> 8);
+    for (int i = 0; i < 4; ++i) out[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+// 8 value mode: the extremes and 6 steps between them
+static void encodeAlphaBlock(const unsigned char values[16], unsigned char* out) {
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        alpha0 = std::max(alpha0, static_cast<int>(values[i]));
+        alpha1 = std::min(alpha1, static_cast<int>(values[i]));
+    }
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        int palette[8] = { alpha0, alpha1 };
+        for (int p = 2; p < 8; ++p) {
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1 + 3) / 7;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = 256;
+            for (int p = 0; p < 8; ++p) {
+                int distance = std::abs(values[i] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    out[0] = static_cast<unsigned char>(alpha0);
+    out[1] = static_cast<unsigned char>(alpha1);
+    for (int i = 0; i < 6; ++i) out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+static std::vector<unsigned char> compress(const Image& image, CookedTexture::Format format) {
+    size_t blockBytes = CookedTexture::getBlockBytes(format);
+    int blocksWide = (image.width + 3) / 4;
+    int blocksHigh = (image.height + 3) / 4;
+    std::vector<unsigned char> blocks(static_cast<size_t>(blocksWide) * blocksHigh * blockBytes);
+    for (int by = 0; by < blocksHigh; ++by) {
+        for (int bx = 0; bx < blocksWide; ++bx) {
+            // Texels past the edge repeat the last row and column
+            glm::vec3 colors[16];
+            unsigned char channels[4][16];
+            for (int i = 0; i < 16; ++i) {
+                const unsigned char* texel = image.texel(bx * 4 + i % 4, by * 4 + i / 4);
+                colors[i] = glm::vec3(texel[0], texel[1], texel[2]);
+                for (int c = 0; c < 4; ++c) channels[c][i] = texel[c];
+            }
+            unsigned char* out = &blocks[(static_cast<size_t>(by) * blocksWide + bx) * blockBytes];
+            switch (format) {
+            case CookedTexture::FORMAT_BC1:
+                encodeColorBlock(colors, out);
+                break;
+            case CookedTexture::FORMAT_BC3:
+                encodeAlphaBlock(channels[3], out);
+                encodeColorBlock(colors, out + 8);
+                break;
+            case CookedTexture::FORMAT_BC4:
+                encodeAlphaBlock(channels[0], out);
+                break;
+            case CookedTexture::FORMAT_BC5:
+                encodeAlphaBlock(channels[0], out);
+                encodeAlphaBlock(channels[1], out + 8);
+                break;
+            }
+        }
+    }
+    return blocks;
+}
+
+static uint64_t mipChainTexels(int width, int height) {
+    uint64_t texels = 0;
+    while (true) {
+        texels += static_cast<uint64_t>(width) * height;
+        if (width == 1 && height == 1) return texels;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+static void cook(const CookJob& job, bool force, CookResult& result) {
+    result.path = job.name;
+    result.cooked = false;
+    result.skipped = false;
+    result.sourceBytes = 0;
+    result.cookedBytes = 0;
+    result.decodedVramBytes = 0;
+    result.cookedVramBytes = 0;
+    result.decodeMs = 0.0f;
+    result.mapMs = 0.0f;
+
+    // What the runtime did before: decode each file, the driver builds the mips
+    std::vector<Image> images(job.sources.size());
+    bool hasAlpha = false;
+    for (size_t i = 0; i < job.sources.size(); ++i) {
+        const std::string& source = job.sources[i];
+        result.sourceBytes += fs::file_size(source);
+        auto start = std::chrono::high_resolution_clock::now();
+        int fileChannels;
+        unsigned char* data = stbi_load(source.c_str(), &images[i].width, &images[i].height, &fileChannels, 4);
+        result.decodeMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (!data) {
+            std::printf("Failed to load %s\n", source.c_str());
+            return;
+        }
+        images[i].pixels.assign(data, data + static_cast<size_t>(images[i].width) * images[i].height * 4);
+        stbi_image_free(data);
+        result.decodedVramBytes += mipChainTexels(images[i].width, images[i].height) * fileChannels;
+        hasAlpha = hasAlpha || fileChannels == 4 || fileChannels == 2;
+        if (images[i].width != images[0].width || images[i].height != images[0].height) {
+            std::printf("Skipping %s, %s is not the size of %s\n", job.name.c_str(), source.c_str(), job.sources[0].c_str());
+            return;
+        }
+    }
+
+    CookedTexture existing;
+    if (!force && existing.map(job.name, job.sources)) {
+        result.skipped = true;
+    } else {
+        MapKind kind = MAP_COLOR;
+        CookedTexture::Format format = CookedTexture::FORMAT_BC1;
+        Image image = images[0];
+        if (job.sources.size() > 1) {
+            // First channel of each image, in order
+            for (size_t i = 0; i < image.pixels.size(); i += 4) {
+                for (size_t c = 0; c < 3; ++c) {
+                    image.pixels[i + c] = c < images.size() ? images[c].pixels[i] : 0;
+                }
+                image.pixels[i + 3] = 255;
+            }
+        } else {
+            kind = classify(job.sources[0]);
+            if (kind == MAP_NORMAL) {
+                format = CookedTexture::FORMAT_BC5;
+            } else if (kind == MAP_SINGLE) {
+                format = CookedTexture::FORMAT_BC4;
+            } else if (hasAlpha) {
+                for (size_t i = 3; i < image.pixels.size() && format == CookedTexture::FORMAT_BC1; i += 4) {
+                    if (image.pixels[i] != 255) format = CookedTexture::FORMAT_BC3;
+                }
+            }
+        }
+
+        std::vector<std::vector<unsigned char>> levels;
+        Image level = image;
+        while (true) {
+            levels.push_back(compress(level, format));
+            if (level.width == 1 && level.height == 1) break;
+            level = downsample(level, kind);
+        }
+        if (!CookedTexture::save(job.name, job.sources, format, image.width, image.height, levels)) return;
+    }
+
+    // What the runtime does now
+    auto start = std::chrono::high_resolution_clock::now();
+    CookedTexture cooked;
+    bool mapped = cooked.map(job.name, job.sources);
+    result.mapMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    if (!mapped) {
+        std::printf("Failed to map the cooked %s\n", job.name.c_str());
+        return;
+    }
+    result.cooked = true;
+    result.format = cooked.getFormat();
+    result.cookedBytes = fs::file_size(CookedTexture::getCachePath(job.name));
+    result.cookedVramBytes = cooked.getDataSize();
+}
+
+static const char* formatName(CookedTexture::Format format) {
+    switch (format) {
+    case CookedTexture::FORMAT_BC1: return "BC1";
+    case CookedTexture::FORMAT_BC3: return "BC3";
+    case CookedTexture::FORMAT_BC4: return "BC4";
+    case CookedTexture::FORMAT_BC5: return "BC5";
+    }
+    return "?";
+}
+
+int main(int argc, char** argv) {
+    bool force = false;
+    std::vector<fs::path> roots;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else {
+            roots.push_back(argv[i]);
+        }
+    }
+    if (roots.empty()) {
+        roots.push_back("texture");
+        roots.push_back("models/textures");
+    }
+
+    std::vector<fs::path> files;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        std::error_code error;
+        if (fs::is_directory(roots[i], error)) {
+            for (fs::recursive_directory_iterator it(roots[i], error), end; it != end; it.increment(error)) {
+                if (it->is_regular_file() && isImage(it->path())) files.push_back(it->path());
+            }
+        } else if (fs::is_regular_file(roots[i], error)) {
+            files.push_back(roots[i]);
+        } else {
+            std::printf("Skipping %s, not found\n", roots[i].string().c_str());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    // The complete ao, rough, met sets are packed, every other image cooks alone
+    std::map<std::string, std::vector<std::string>> sets;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string name;
+        int channel = armChannel(files[i], name);
+        if (channel < 0) continue;
+        std::vector<std::string>& set = sets[name];
+        set.resize(3);
+        set[channel] = files[i].string();
+    }
+    std::vector<CookJob> jobs;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string name;
+        int channel = armChannel(files[i], name);
+        const std::vector<std::string>* set = channel >= 0 ? &sets[name] : nullptr;
+        bool packed = set && !(*set)[0].empty() && !(*set)[1].empty() && !(*set)[2].empty();
+        if (!packed) {
+            jobs.push_back({ files[i].string(), std::vector<std::string>(1, files[i].string()) });
+        } else if (channel == 0) {
+            jobs.push_back({ name, *set });
+        }
+    }
+
+    // One texture per job, the block compression is what takes the time
+    std::vector<CookResult> results(jobs.size());
+    WorkerPool pool;
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.parallelFor(jobs.size(), [&](size_t i) { cook(jobs[i], force, results[i]); });
+    float totalMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    const float MB = 1024.0f * 1024.0f;
+    uint64_t sourceBytes = 0, cookedBytes = 0, decodedVram = 0, cookedVram = 0;
+    float decodeMs = 0.0f, mapMs = 0.0f;
+    size_t cookedCount = 0;
+    std::printf("%-44s %-6s %9s %9s %10s %10s %9s %9s\n", "image", "format", "disk MB", "cooked", "VRAM MB", "cooked",
+                "decode ms", "map ms");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const CookResult& result = results[i];
+        if (!result.cooked) continue;
+        std::printf("%-44s %-6s %9.2f %9.2f %10.2f %10.2f %9.2f %9.2f%s\n", result.path.c_str(), formatName(result.format),
+                    result.sourceBytes / MB, result.cookedBytes / MB, result.decodedVramBytes / MB, result.cookedVramBytes / MB,
+                    result.decodeMs, result.mapMs, result.skipped ? "  (up to date)" : "");
+        sourceBytes += result.sourceBytes;
+        cookedBytes += result.cookedBytes;
+        decodedVram += result.decodedVramBytes;
+        cookedVram += result.cookedVramBytes;
+        decodeMs += result.decodeMs;
+        mapMs += result.mapMs;
+        cookedCount++;
+    }
+    std::printf("%zu of %zu textures cooked from %zu images in %.0f ms on %u threads\n", cookedCount, results.size(),
+                files.size(), totalMs, pool.getThreadCount() + 1);
+    std::printf("Disk: %.1f MB -> %.1f MB, VRAM with mips: %.1f MB -> %.1f MB, CPU load: %.1f ms -> %.1f ms\n",
+                sourceBytes / MB, cookedBytes / MB, decodedVram / MB, cookedVram / MB, decodeMs, mapMs);
+    return cookedCount == results.size() ? 0 : 1;
+}
@@ -1,9 +1,41 @@
 #include "terrain.h"
-
-Terrain::Terrain(float gridSize) : gridSize(gridSize), width(0), height(0), rez(0.0f), numStrips(0), numTrisPerStrip(0) {
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+Terrain::Terrain(float gridSize) : VAO(0), VBO(0), EBO(0), gridSize(gridSize), width(0), height(0), rez(0.0f), numStrips(0), numTrisPerStrip(0) {
     generateTerrain(gridSize);
     loadTextures();
     setup();
+    setupLod();
+}
+
+Terrain::Terrain(int rows, int columns, const std::vector<float>& heights)
+    : VAO(0), VBO(0), EBO(0), heights(heights), height(rows), width(columns), rez(1.0f), numStrips(0), numTrisPerStrip(0) {
+    gpuHeights = false;
+    if (width < 2 || height < 2 || this->heights.size() != static_cast<size_t>(width) * height) {
+        width = height = 0;
+        this->heights.clear();
+        return;
+    }
+    snapHeights();
+    buildMesh();
+}
+
+Terrain::~Terrain() {
+    delete lod;
+    deleteVertexBuffer();
+    glDeleteVertexArrays(1, &patchVAO);
+    glDeleteBuffers(1, &patchVBO);
+    glDeleteBuffers(1, &patchEBO);
+    glDeleteTextures(1, &heightTexture);
+    for (size_t i = 0; i < textures.size(); ++i) {
+        ResourceManager::ReleaseTexture(textures[i]);
+    }
 }
 
 void Terrain::generateTerrain(float gridSize) {
@@ -18,40 +50,17 @@ void Terrain::generateTerrain(float gridSize) {
         rez = gridSize;
         unsigned bytesPerPixel = nrChannels;
 
-        // Populate vertices and UV coordinates
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                unsigned char* pixelOffset = data + (j + width * i) * bytesPerPixel;
-                unsigned char y = pixelOffset[0];
-
-                // Vertex Position
-                vertices.push_back(glm::vec3(-height / 2.0f + height * i / (float)height, (int)y * yScale - yShift, -width / 2.0f + width * j / (float)width));
-
-                // UV Coordinates
-                float u = static_cast<float>(j) / (width - 1);
-                float v = static_cast<float>(i) / (height - 1);
-                uvs.push_back(glm::vec2(u, v)); // Assuming you have a vector for UVs
-            }
+        size_t count = static_cast<size_t>(width) * height;
+        heights.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            heights[i] = data[i * bytesPerPixel] * yScale - yShift;
         }
-        std::cout << "Loaded " << vertices.size() << " vertices" << std::endl;
         stbi_image_free(data);
+        snapHeights();
 
-        // Populate indices
-        for (unsigned i = 0; i < height - 1; i += rez) {
-            for (unsigned j = 0; j < width; j += rez) {
-                for (unsigned k = 0; k < 2; k++) {
-                    indices.push_back(j + width * (i + k * rez));
-                }
-            }
-        }
+        buildMesh();
+        std::cout << "Loaded " << vertices.size() << " vertices" << std::endl;
         std::cout << "Loaded " << indices.size() << " indices" << std::endl;
-
-        numStrips = (height - 1) / rez;
-        numTrisPerStrip = (width / rez) * 2 - 2;
-        //store the height and width of the terrain
-        this->height = height;
-        this->width = width;
-
         std::cout << "Created lattice of " << numStrips << " strips with " << numTrisPerStrip << " triangles each" << std::endl;
         std::cout << "Created " << numStrips * numTrisPerStrip << " triangles total" << std::endl;
     } else {
@@ -59,105 +68,143 @@ void Terrain::generateTerrain(float gridSize) {
     }
 }
 
-void Terrain::loadTextures() {
-    // Load all PBR textures (diffuse, normal, metallic, roughness, AO, and displacement)
-    glGenTextures(1, &texture_diffuse);
-    glBindTexture(GL_TEXTURE_2D, texture_diffuse);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    // Assuming the first path is the diffuse texture
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load("texture/terrain/diff.jpg", &width, &height, &nrChannels, 0);
-    //unsigned char* data = stbi_load(texturePaths[0].c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture diffuse" << std::endl;
+// Heights snapped to the 16 bit steps of the height texture, the mesh,
+// the texture and collision all use these values
+void Terrain::snapHeights() {
+    float minY = std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < heights.size(); ++i) {
+        minY = std::min(minY, heights[i]);
+        maxY = std::max(maxY, heights[i]);
     }
-    stbi_image_free(data);
-
-    //load all other textures in a similar manner...
-    glGenTextures(1, &texture_normal);
-    glBindTexture(GL_TEXTURE_2D, texture_normal);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    data = stbi_load("texture/terrain/norm.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture normal" << std::endl;
+    heightMin = minY - EDIT_MARGIN;
+    heightRange = maxY - minY + 2.0f * EDIT_MARGIN;
+    for (size_t i = 0; i < heights.size(); ++i) {
+        float texel = std::floor((heights[i] - heightMin) / heightRange * 65535.0f + 0.5f);
+        heights[i] = heightMin + texel / 65535.0f * heightRange;
     }
-    stbi_image_free(data);
+}
 
-    glGenTextures(1, &texture_metalllic);
-    glBindTexture(GL_TEXTURE_2D, texture_metalllic);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Every buffer is sized up front and each row is written by one job, so
+// regenerating only costs the writes
+void Terrain::buildMesh() {
+    size_t count = static_cast<size_t>(width) * height;
+    vertices.resize(count);
+    uvs.resize(count);
+    normals.resize(count);
+    tangents.resize(count);
+    generateVertices(heights.data(), height, width, WorkerPool::shared(), vertices.data(), uvs.data(), normals.data(), tangents.data());
+
+    // Strips of every rez-th row and column, separated by the restart index
+    // so the whole lattice goes out in a single draw
+    unsigned step = std::max(1u, static_cast<unsigned>(rez));
+    numStrips = (height - 2) / step + 1;
+    stripLength = 2 * static_cast<int>((width - 1) / step + 1);
+    numTrisPerStrip = stripLength - 2;
+    indices.resize(static_cast<size_t>(numStrips) * (stripLength + 1) - 1);
+    WorkerPool::shared().parallelFor(numStrips, [&](size_t strip) {
+        unsigned i = static_cast<unsigned>(strip) * step;
+        unsigned next = std::min(i + step, static_cast<unsigned>(height - 1));
+        unsigned* out = indices.data() + strip * (stripLength + 1);
+        for (unsigned j = 0; j < static_cast<unsigned>(width); j += step) {
+            *out++ = j + width * i;
+            *out++ = j + width * next;
+        }
+        if (strip + 1 < static_cast<size_t>(numStrips)) {
+            *out = RESTART_INDEX;
+        }
+    });
+}
 
-    data = stbi_load("texture/terrain/met.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture metallic" << std::endl;
-    }
-    stbi_image_free(data);
+// Central differences, one sided on the borders. With h(x, z) the normal is
+// (-dh/dx, 1, -dh/dz) and the tangent follows the rows, (1, dh/dx, 0)
+static inline void heightfieldFrame(float dx, float dz, glm::vec3& normal, glm::vec3& tangent) {
+    float normalScale = 1.0f / std::sqrt(dx * dx + dz * dz + 1.0f);
+    float tangentScale = 1.0f / std::sqrt(dx * dx + 1.0f);
+    normal = glm::vec3(-dx * normalScale, normalScale, -dz * normalScale);
+    tangent = glm::vec3(tangentScale, dx * tangentScale, 0.0f);
+}
 
-    glGenTextures(1, &texture_roughness);
-    glBindTexture(GL_TEXTURE_2D, texture_roughness);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Vertices [columnBegin, columnEnd) of one row, the heights around them must be final
+static void generateRow(const float* heights, int rows, int columns, int i, int columnBegin, int columnEnd,
+                        glm::vec3* positions, glm::vec2* uvs, glm::vec3* normals, glm::vec3* tangents) {
+    const float* up = heights + static_cast<size_t>(std::max(i - 1, 0)) * columns;
+    const float* middle = heights + static_cast<size_t>(i) * columns;
+    const float* down = heights + static_cast<size_t>(std::min(i + 1, rows - 1)) * columns;
+    float rowScale = (i == 0 || i == rows - 1) ? 1.0f : 0.5f;
+    size_t base = static_cast<size_t>(i) * columns;
+
+    float x = i - rows / 2.0f;
+    float v = static_cast<float>(i) / (rows - 1);
+    float uScale = 1.0f / (columns - 1);
+    for (int j = columnBegin; j < columnEnd; ++j) {
+        positions[base + j] = glm::vec3(x, middle[j], j - columns / 2.0f);
+        uvs[base + j] = glm::vec2(j * uScale, v);
+    }
 
-    data = stbi_load("texture/terrain/rough.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture roughness" << std::endl;
+    // Borders, the neighbour outside the grid is replaced by the vertex itself
+    if (columnBegin == 0) {
+        heightfieldFrame((down[0] - up[0]) * rowScale, middle[1] - middle[0], normals[base], tangents[base]);
+    }
+    if (columnEnd == columns) {
+        heightfieldFrame((down[columns - 1] - up[columns - 1]) * rowScale, middle[columns - 1] - middle[columns - 2],
+                         normals[base + columns - 1], tangents[base + columns - 1]);
     }
 
-    stbi_image_free(data);
+    int j = std::max(columnBegin, 1);
+    int interiorEnd = std::min(columnEnd, columns - 1);
+#if defined(__SSE2__) || defined(_M_X64)
+    // Four columns at a time, then back to scalar for the rest
+    const __m128 rowScales = _mm_set1_ps(rowScale);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    for (; j + 4 <= interiorEnd; j += 4) {
+        __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)), rowScales);
+        __m128 dz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(middle + j + 1), _mm_loadu_ps(middle + j - 1)), half);
+        __m128 dx2 = _mm_mul_ps(dx, dx);
+        __m128 normalScale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(dx2, _mm_mul_ps(dz, dz)), one)));
+        __m128 tangentScale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(dx2, one)));
+
+        alignas(16) float nx[4], ny[4], nz[4], tx[4], ty[4];
+        _mm_store_ps(nx, _mm_xor_ps(_mm_mul_ps(dx, normalScale), signBit));
+        _mm_store_ps(ny, normalScale);
+        _mm_store_ps(nz, _mm_xor_ps(_mm_mul_ps(dz, normalScale), signBit));
+        _mm_store_ps(tx, tangentScale);
+        _mm_store_ps(ty, _mm_mul_ps(dx, tangentScale));
+        for (int k = 0; k < 4; ++k) {
+            normals[base + j + k] = glm::vec3(nx[k], ny[k], nz[k]);
+            tangents[base + j + k] = glm::vec3(tx[k], ty[k], 0.0f);
+        }
+    }
+#endif
+    for (; j < interiorEnd; ++j) {
+        heightfieldFrame((down[j] - up[j]) * rowScale, (middle[j + 1] - middle[j - 1]) * 0.5f,
+                         normals[base + j], tangents[base + j]);
+    }
+}
 
-    glGenTextures(1, &texture_ao);
-    glBindTexture(GL_TEXTURE_2D, texture_ao);
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Terrain::generateVertices(const float* heights, int rows, int columns, WorkerPool& pool,
+                               glm::vec3* positions, glm::vec2* uvs, glm::vec3* normals, glm::vec3* tangents) {
+    if (rows < 2 || columns < 2) return;
+    pool.parallelFor(rows, [=](size_t row) {
+        generateRow(heights, rows, columns, static_cast<int>(row), 0, columns, positions, uvs, normals, tangents);
+    });
+}
 
-    data = stbi_load("texture/terrain/ao.jpg", &width, &height, &nrChannels, 0);
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture AO" << std::endl;
-    }
-    stbi_image_free(data);
+void Terrain::loadTextures() {
+    // Shared with the other objects using the same maps, decoded in the
+    // background the first time, they hold a placeholder until then
+    texture_diffuse = ResourceManager::AcquireTexture("texture/terrain/diff.jpg", true);
+    texture_normal = ResourceManager::AcquireTexture("texture/terrain/norm.jpg", true, TextureLoader::PLACEHOLDER_NORMAL);
+    // ao, rough and met packed in one texture, R G B
+    texture_arm = ResourceManager::AcquirePackedTexture("texture/terrain/arm",
+        { "texture/terrain/ao.jpg", "texture/terrain/rough.jpg", "texture/terrain/met.jpg" }, true);
 
     //add textures to vector
     textures.push_back(texture_diffuse);
     textures.push_back(texture_normal);
-    textures.push_back(texture_metalllic);
-    textures.push_back(texture_roughness);
-    textures.push_back(texture_ao);
+    textures.push_back(texture_arm);
 
 
     //glGenTextures(1, &texture_disp);
@@ -179,6 +226,96 @@ void Terrain::loadTextures() {
 }
 
 void Terrain::setup() {
+    setupHeightTexture();
+    if (gpuHeights) {
+        // Out of date once the grid changes, rebuilt when switching back
+        deleteVertexBuffer();
+        setupPatch();
+    } else {
+        setupVertexBuffer();
+    }
+}
+
+// Heights quantized to 16 bits over their range. The CPU copy is snapped to
+// the same values so collision and rendering agree exactly
+// heights are already on the 16 bit steps, the texels store them exactly
+void Terrain::setupHeightTexture() {
+    if (heights.empty()) return;
+
+    // Texel (column, row) is height column + width * row
+    std::vector<unsigned short> texels(heights.size());
+    for (size_t i = 0; i < texels.size(); ++i) {
+        texels[i] = static_cast<unsigned short>(std::floor((heights[i] - heightMin) / heightRange * 65535.0f + 0.5f));
+    }
+
+    if (heightTexture == 0) {
+        glGenTextures(1, &heightTexture);
+    }
+    glBindTexture(GL_TEXTURE_2D, heightTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, height, 0, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// One PATCH_CELLS square of cells, instanced over the grid. A vertex is just
+// its cell coordinates in the patch, the shader finds the rest
+void Terrain::setupPatch() {
+    if (width < 2 || height < 2) return;
+    patchRows = (height - 2) / PATCH_CELLS + 1;
+    patchColumns = (width - 2) / PATCH_CELLS + 1;
+    if (patchVAO != 0) return;
+
+    const int side = PATCH_CELLS + 1;
+    std::vector<unsigned char> grid;
+    grid.reserve(side * side * 2);
+    for (int i = 0; i < side; ++i) {
+        for (int j = 0; j < side; ++j) {
+            grid.push_back(static_cast<unsigned char>(i));
+            grid.push_back(static_cast<unsigned char>(j));
+        }
+    }
+    std::vector<unsigned short> patchIndices;
+    patchIndices.reserve(PATCH_CELLS * PATCH_CELLS * 6);
+    for (int i = 0; i < PATCH_CELLS; ++i) {
+        for (int j = 0; j < PATCH_CELLS; ++j) {
+            unsigned short a = static_cast<unsigned short>(i * side + j);
+            unsigned short b = static_cast<unsigned short>(a + 1);
+            unsigned short c = static_cast<unsigned short>(a + side);
+            unsigned short d = static_cast<unsigned short>(c + 1);
+            patchIndices.insert(patchIndices.end(), { a, c, b, b, c, d });
+        }
+    }
+    patchIndexCount = patchIndices.size();
+    patchVertexBytes = grid.size();
+
+    glGenVertexArrays(1, &patchVAO);
+    glGenBuffers(1, &patchVBO);
+    glGenBuffers(1, &patchEBO);
+    glBindVertexArray(patchVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
+    glBufferData(GL_ARRAY_BUFFER, grid.size(), grid.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, patchIndices.size() * sizeof(unsigned short), patchIndices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_FALSE, 2, (void*)0);
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+}
+
+void Terrain::deleteVertexBuffer() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+}
+
+void Terrain::setupVertexBuffer() {
+    // Called again by setGridSize, the old buffers go first
+    deleteVertexBuffer();
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
@@ -187,10 +324,14 @@ void Terrain::setup() {
 
     // Bind and set vertex buffer data
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // Allocate space for both vertices and UVs
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3) + uvs.size() * sizeof(glm::vec2), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec3), vertices.data());
-    glBufferSubData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), uvs.size() * sizeof(glm::vec2), uvs.data());
+    // Allocate space for vertices, UVs, normals and tangents, one block each
+    size_t positionBytes = vertices.size() * sizeof(glm::vec3);
+    size_t uvBytes = uvs.size() * sizeof(glm::vec2);
+    glBufferData(GL_ARRAY_BUFFER, 3 * positionBytes + uvBytes, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, positionBytes, vertices.data());
+    glBufferSubData(GL_ARRAY_BUFFER, positionBytes, uvBytes, uvs.data());
+    glBufferSubData(GL_ARRAY_BUFFER, positionBytes + uvBytes, positionBytes, normals.data());
+    glBufferSubData(GL_ARRAY_BUFFER, 2 * positionBytes + uvBytes, positionBytes, tangents.data());
 
     // Bind and set element buffer data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -201,12 +342,79 @@ void Terrain::setup() {
     glEnableVertexAttribArray(0);
 
     // Set UV attribute pointer
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)(vertices.size() * sizeof(glm::vec3)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)positionBytes);
     glEnableVertexAttribArray(1);
 
+    // Normal and tangent attribute pointers
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(positionBytes + uvBytes));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(2 * positionBytes + uvBytes));
+    glEnableVertexAttribArray(4);
+
     glBindVertexArray(0); // Unbind the VAO
 }
 
+// Chunks sample the same heights as the full resolution mesh. The LOD reads
+// them on this thread and hands the workers a copy, so applyBrush can write
+// them while chunks are built; the chunks under an edit are built again
+void Terrain::setupLod() {
+    if (width < 2 || height < 2) return;
+    lod = new TerrainLod(height, width, [this](int row, int column) {
+        return heights[column + width * row];
+    });
+}
+
+void Terrain::update(Camera& camera) {
+    if (!lodEnabled || !lod) return;
+    lod->update(camera.Position, camera.GetProjectionMatrix() * camera.GetViewMatrix());
+}
+
+// Geometry only, the caller binds the shader, textures and VAO
+void Terrain::drawTerrain(Shader& shader, Camera& camera) {
+    auto start = std::chrono::high_resolution_clock::now();
+    shader.SetInteger("heightFromTexture", !(lodEnabled && lod) && gpuHeights);
+    if (lodEnabled && lod) {
+        lod->multiDraw = batchedDraw;
+        lod->draw();
+        drawStats.drawCalls = lod->getStats().drawCalls;
+        drawStats.triangles = lod->getStats().trianglesSubmitted;
+    } else if (gpuHeights) {
+        // The height texture goes after the material textures
+        glActiveTexture(GL_TEXTURE0 + textures.size());
+        glBindTexture(GL_TEXTURE_2D, heightTexture);
+        shader.SetInteger("heightMap", static_cast<int>(textures.size()));
+        shader.SetInteger("gridRows", height);
+        shader.SetInteger("gridColumns", width);
+        shader.SetInteger("patchCells", PATCH_CELLS);
+        shader.SetInteger("patchesPerRow", patchColumns);
+        shader.SetFloat("heightMin", heightMin);
+        shader.SetFloat("heightRange", heightRange);
+        glBindVertexArray(patchVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(patchIndexCount), GL_UNSIGNED_SHORT, 0,
+                                patchRows * patchColumns);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        drawStats.drawCalls = 1;
+        drawStats.triangles = patchIndexCount / 3 * patchRows * patchColumns;
+    } else if (batchedDraw) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(RESTART_INDEX);
+        glDrawElements(GL_TRIANGLE_STRIP, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDisable(GL_PRIMITIVE_RESTART);
+        drawStats.drawCalls = 1;
+        drawStats.triangles = static_cast<size_t>(numStrips) * numTrisPerStrip;
+    } else {
+        // One draw per strip, each strip is followed by a restart index
+        for (unsigned strip = 0; strip < numStrips; strip++) {
+            glDrawElements(GL_TRIANGLE_STRIP, stripLength, GL_UNSIGNED_INT, 
+                           (void*)(sizeof(unsigned) * (stripLength + 1) * strip)); // Offset to starting index
+        }
+        drawStats.drawCalls = numStrips;
+        drawStats.triangles = static_cast<size_t>(numStrips) * numTrisPerStrip;
+    }
+    drawStats.cpuMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 void Terrain::draw(Shader& shader, Camera& camera) {
     shader.Use();
     glBindVertexArray(VAO);
@@ -238,10 +446,7 @@ void Terrain::draw(Shader& shader, Camera& camera) {
     }
     
 
-    for (unsigned strip = 0; strip < numStrips; strip++) {
-        glDrawElements(GL_TRIANGLE_STRIP, numTrisPerStrip + 2, GL_UNSIGNED_INT, 
-                       (void*)(sizeof(unsigned) * (numTrisPerStrip + 2) * strip)); // Offset to starting index
-    }
+    drawTerrain(shader, camera);
     for (unsigned int i = 0; i < textures.size(); i++) {
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -277,10 +482,7 @@ void Terrain::drawWithShadow(Shader& shader, Camera& camera, unsigned int depthM
     } else {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
-    for (unsigned strip = 0; strip < numStrips; strip++) {
-        glDrawElements(GL_TRIANGLE_STRIP, numTrisPerStrip + 2, GL_UNSIGNED_INT, 
-                       (void*)(sizeof(unsigned) * (numTrisPerStrip + 2) * strip)); // Offset to starting index
-    }
+    drawTerrain(shader, camera);
     for (unsigned int i = 0; i < textures.size(); i++) {
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -292,7 +494,7 @@ std::string Terrain::getInfo() const {
 }
 
 //function to return the indices positions forcollision detection
-std::vector<glm::vec3> Terrain::getVertices() {
+const std::vector<glm::vec3>& Terrain::getVertices() const {
     return vertices;
 }
 
@@ -303,27 +505,62 @@ float Terrain::getGridSize() const {
 // Sets a new grid size and regenerates the terrain
 void Terrain::setGridSize(float newGridSize) {
     if (newGridSize > 0.0f && newGridSize != gridSize) {
+        // The chunk workers read the vertices, stop them before regenerating
+        delete lod;
+        lod = nullptr;
         generateTerrain(newGridSize);
         setup();
+        setupLod();
     }
 }
 
 float Terrain::getHeightAt(float x, float z) {
-    // Convert the world coordinates (x, z) to grid indices
-    int row = static_cast<int>((z + (height / 2.0f)) / (gridSize * (height / static_cast<float>(height))));
-    int col = static_cast<int>((x + (width / 2.0f)) / (gridSize * (width / static_cast<float>(width))));
-
-    // Ensure the indices are within the valid range
-    if (row < 0 || row >= height || col < 0 || col >= width) {
-        std::cout << "Coordinates out of bounds!" << std::endl;
+    float terrainHeight;
+    glm::vec3 normal;
+    if (!getHeightAndNormal(x, z, terrainHeight, normal)) {
         return 0.0f; // or some default height
     }
+    return terrainHeight;
+}
 
-    // Calculate the index of the vertex based on the row and column
-    int index = col + (row * width);
-    
-    // Return the height of the terrain at the specified coordinates
-    return vertices[index].y;
+// Vertices are laid out on a regular grid with a spacing of 1:
+// row i is at x = i - height / 2 and column j at z = j - width / 2,
+// so the cell under (x, z) is found directly without scanning.
+bool Terrain::getHeightAndNormal(float x, float z, float& outHeight, glm::vec3& outNormal) const {
+    return sampleHeights(heights.data(), height, width, x, z, outHeight, outNormal);
+}
+
+bool Terrain::sampleHeights(const float* heights, int rows, int columns, float x, float z,
+                            float& outHeight, glm::vec3& outNormal) {
+    if (columns < 2 || rows < 2) return false;
+
+    float gridX = x + rows / 2.0f;
+    float gridZ = z + columns / 2.0f;
+    if (gridX < 0.0f || gridZ < 0.0f || gridX > rows - 1 || gridZ > columns - 1) {
+        return false;
+    }
+
+    // Cell indices, the last row/column reuses the previous cell
+    int row = std::min(static_cast<int>(gridX), rows - 2);
+    int col = std::min(static_cast<int>(gridZ), columns - 2);
+    float fx = gridX - row;
+    float fz = gridZ - col;
+
+    float h00 = heights[col + columns * row];
+    float h10 = heights[col + columns * (row + 1)];
+    float h01 = heights[(col + 1) + columns * row];
+    float h11 = heights[(col + 1) + columns * (row + 1)];
+
+    // Bilinear interpolation of the four corners
+    float h0 = h00 + (h10 - h00) * fx;
+    float h1 = h01 + (h11 - h01) * fx;
+    outHeight = h0 + (h1 - h0) * fz;
+
+    // Normal from the partial derivatives of the bilinear patch
+    float dhdx = (h10 - h00) * (1.0f - fz) + (h11 - h01) * fz;
+    float dhdz = (h01 - h00) * (1.0f - fx) + (h11 - h10) * fx;
+    outNormal = glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+    return true;
 }
 
 // Function to get the terrain width
@@ -336,4 +573,171 @@ int Terrain::getTerrainHeight() const {
     return height; // Return the stored height
 }
 
-void Terrain::drawTest(Shader& shader, Camera& camera) {}
\ No newline at end of file
+void Terrain::drawTest(Shader& shader, Camera& camera) {}
+
+void Terrain::setLodEnabled(bool enabled) {
+    lodEnabled = enabled;
+}
+
+bool Terrain::isLodEnabled() const {
+    return lodEnabled;
+}
+
+TerrainLod* Terrain::getLod() const {
+    return lod;
+}
+
+void Terrain::setBatchedDraw(bool batched) {
+    batchedDraw = batched;
+}
+
+bool Terrain::isBatchedDraw() const {
+    return batchedDraw;
+}
+
+const Terrain::DrawStats& Terrain::getDrawStats() const {
+    return drawStats;
+}
+
+void Terrain::setGpuHeights(bool enabled) {
+    gpuHeights = enabled;
+    if (gpuHeights) {
+        setupPatch();
+    } else if (VAO == 0) {
+        setupVertexBuffer();
+    }
+}
+
+bool Terrain::isGpuHeights() const {
+    return gpuHeights;
+}
+
+size_t Terrain::getVertexMemory() const {
+    if (gpuHeights) {
+        return patchVertexBytes + patchIndexCount * sizeof(unsigned short) +
+               static_cast<size_t>(width) * height * sizeof(unsigned short);
+    }
+    return 3 * vertices.size() * sizeof(glm::vec3) + uvs.size() * sizeof(glm::vec2) + indices.size() * sizeof(unsigned int);
+}
+
+Terrain::Region Terrain::applyBrush(BrushMode mode, float x, float z, float radius, float strength, float targetHeight) {
+    auto start = std::chrono::high_resolution_clock::now();
+    Region edited = { 0, 0, 0, 0 };
+    if (width < 2 || height < 2 || radius <= 0.0f) return edited;
+
+    // Grid coordinates of the center, as in getHeightAndNormal
+    float centerRow = x + height / 2.0f;
+    float centerColumn = z + width / 2.0f;
+    edited.rowBegin = std::max(0, static_cast<int>(std::ceil(centerRow - radius)));
+    edited.rowEnd = std::min(height, static_cast<int>(std::floor(centerRow + radius)) + 1);
+    edited.columnBegin = std::max(0, static_cast<int>(std::ceil(centerColumn - radius)));
+    edited.columnEnd = std::min(width, static_cast<int>(std::floor(centerColumn + radius)) + 1);
+    if (edited.rowBegin >= edited.rowEnd || edited.columnBegin >= edited.columnEnd) {
+        return Region{ 0, 0, 0, 0 };
+    }
+
+    // The normals of the ring around the edit change too
+    Region rebuilt = { std::max(edited.rowBegin - 1, 0), std::min(edited.rowEnd + 1, height),
+                       std::max(edited.columnBegin - 1, 0), std::min(edited.columnEnd + 1, width) };
+    int sourceColumns = rebuilt.columnEnd - rebuilt.columnBegin;
+    if (mode == BRUSH_SMOOTH) {
+        // Averages of the heights before this edit
+        brushSource.resize(static_cast<size_t>(rebuilt.rowEnd - rebuilt.rowBegin) * sourceColumns);
+        for (int i = rebuilt.rowBegin; i < rebuilt.rowEnd; ++i) {
+            const float* row = heights.data() + static_cast<size_t>(i) * width;
+            std::copy(row + rebuilt.columnBegin, row + rebuilt.columnEnd,
+                      brushSource.begin() + static_cast<size_t>(i - rebuilt.rowBegin) * sourceColumns);
+        }
+    }
+
+    int editedColumns = edited.columnEnd - edited.columnBegin;
+    brushTexels.resize(static_cast<size_t>(edited.rowEnd - edited.rowBegin) * editedColumns);
+    float inverseRadius2 = 1.0f / (radius * radius);
+    float maxHeight = heightMin + heightRange;
+    for (int i = edited.rowBegin; i < edited.rowEnd; ++i) {
+        float di = i - centerRow;
+        for (int j = edited.columnBegin; j < edited.columnEnd; ++j) {
+            float dj = j - centerColumn;
+            float d2 = (di * di + dj * dj) * inverseRadius2;
+            float& h = heights[j + width * static_cast<size_t>(i)];
+            if (d2 < 1.0f) {
+                float falloff = (1.0f - d2) * (1.0f - d2);
+                switch (mode) {
+                case BRUSH_RAISE:
+                    h += strength * falloff;
+                    break;
+                case BRUSH_LOWER:
+                    h -= strength * falloff;
+                    break;
+                case BRUSH_SMOOTH: {
+                    float sum = 0.0f;
+                    for (int si = std::max(i - 1, 0); si <= std::min(i + 1, height - 1); ++si) {
+                        for (int sj = std::max(j - 1, 0); sj <= std::min(j + 1, width - 1); ++sj) {
+                            sum += brushSource[static_cast<size_t>(si - rebuilt.rowBegin) * sourceColumns + sj - rebuilt.columnBegin];
+                        }
+                    }
+                    int count = (std::min(i + 1, height - 1) - std::max(i - 1, 0) + 1) *
+                                (std::min(j + 1, width - 1) - std::max(j - 1, 0) + 1);
+                    h += (sum / count - h) * std::min(1.0f, strength * falloff);
+                    break;
+                }
+                case BRUSH_FLATTEN:
+                    h += (targetHeight - h) * std::min(1.0f, strength * falloff);
+                    break;
+                }
+                h = std::max(heightMin, std::min(h, maxHeight));
+            }
+            // Back on the 16 bit steps of the height texture
+            float texel = std::floor((h - heightMin) / heightRange * 65535.0f + 0.5f);
+            h = heightMin + texel / 65535.0f * heightRange;
+            brushTexels[static_cast<size_t>(i - edited.rowBegin) * editedColumns + j - edited.columnBegin] =
+                static_cast<unsigned short>(texel);
+        }
+    }
+
+    // Collision reads vertices, they are updated in place with the normals
+    for (int i = rebuilt.rowBegin; i < rebuilt.rowEnd; ++i) {
+        generateRow(heights.data(), height, width, i, rebuilt.columnBegin, rebuilt.columnEnd,
+                    vertices.data(), uvs.data(), normals.data(), tangents.data());
+    }
+    uploadRegion(edited, rebuilt);
+
+    lastEditMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return edited;
+}
+
+// Only the edited texels and the rebuilt vertex rows go to the GPU
+void Terrain::uploadRegion(const Region& edited, const Region& rebuilt) {
+    if (heightTexture != 0) {
+        glBindTexture(GL_TEXTURE_2D, heightTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, edited.columnBegin, edited.rowBegin, edited.columnEnd - edited.columnBegin,
+                        edited.rowEnd - edited.rowBegin, GL_RED, GL_UNSIGNED_SHORT, brushTexels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Blocks of setupVertexBuffer, the UVs never change
+    if (VBO != 0) {
+        size_t positionBytes = vertices.size() * sizeof(glm::vec3);
+        size_t normalOffset = positionBytes + uvs.size() * sizeof(glm::vec2);
+        size_t tangentOffset = normalOffset + positionBytes;
+        size_t rowBytes = (rebuilt.columnEnd - rebuilt.columnBegin) * sizeof(glm::vec3);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        for (int i = rebuilt.rowBegin; i < rebuilt.rowEnd; ++i) {
+            size_t first = rebuilt.columnBegin + static_cast<size_t>(width) * i;
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), rowBytes, &vertices[first]);
+            glBufferSubData(GL_ARRAY_BUFFER, normalOffset + first * sizeof(glm::vec3), rowBytes, &normals[first]);
+            glBufferSubData(GL_ARRAY_BUFFER, tangentOffset + first * sizeof(glm::vec3), rowBytes, &tangents[first]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (lod) {
+        lod->invalidateRegion(edited.rowBegin, edited.rowEnd, edited.columnBegin, edited.columnEnd);
+    }
+}
+
+float Terrain::getLastEditMs() const {
+    return lastEditMs;
+}
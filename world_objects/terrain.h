@@ -6,12 +6,35 @@
 #include <iostream>
 #include <glm/glm.hpp>
 #include "../shaders/shader.h"
+#include "../resources/resource_manager.h"
 #include <vector>
 #include "../primitives/primitives.h"
+#include "terrainLod.h"
+#include "../threading/workerPool.h"
 
 class Terrain : public Primitives {
 public:
+    // Last draw of the terrain, CPU time is the submission only
+    struct DrawStats {
+        size_t drawCalls;
+        size_t triangles;
+        float cpuMs;
+    };
+
+    enum BrushMode { BRUSH_RAISE, BRUSH_LOWER, BRUSH_SMOOTH, BRUSH_FLATTEN };
+
+    // Rows [rowBegin, rowEnd) and columns [columnBegin, columnEnd) of the grid
+    struct Region {
+        int rowBegin, rowEnd;
+        int columnBegin, columnEnd;
+    };
+
     Terrain(float gridSize);
+    // Heightfield only, rows x columns heights[column + columns * row]: no
+    // textures, GL objects or LOD, but the same mesh, queries and brushes as
+    // a loaded terrain, for the benchmarks
+    Terrain(int rows, int columns, const std::vector<float>& heights);
+    ~Terrain();
     void draw(Shader& shader, Camera& camera) override;
     void drawWithShadow(Shader& shader, Camera& camera, unsigned int depthMap) override;
     void drawTest(Shader& shader, Camera& camera) override;
@@ -19,36 +42,113 @@ public:
     std::vector<glm::vec3> vertices;
 
     //function to return the indices positions forcollision detection
-    std::vector<glm::vec3> getVertices();
+    //returned by reference, the terrain keeps the only copy
+    const std::vector<glm::vec3>& getVertices() const;
 
     float getGridSize() const;
     void setGridSize(float gridSize);
     float getHeightAt(float x, float z);
+    // Heightfield query: bilinear height and normal of the cell under (x, z)
+    // Returns false if the point is outside the terrain
+    bool getHeightAndNormal(float x, float z, float& outHeight, glm::vec3& outNormal) const;
+    // Same query on any rows x columns heightfield laid out as the terrain's
+    static bool sampleHeights(const float* heights, int rows, int columns, float x, float z,
+                              float& outHeight, glm::vec3& outNormal);
     int getTerrainWidth() const;
     int getTerrainHeight() const;
+
+    // Positions, UVs, normals and tangents of a rows x columns heightfield
+    // (heights[column + columns * row]), rows are split over the pool.
+    // Every output array must hold rows * columns entries
+    static void generateVertices(const float* heights, int rows, int columns, WorkerPool& pool,
+                                 glm::vec3* positions, glm::vec2* uvs, glm::vec3* normals, glm::vec3* tangents);
+
+    // Once per frame before the draws: pick the LOD chunks seen from the
+    // camera and upload the ones built since the last frame. draw() only
+    // submits them, so the shadow and other passes see the same selection
+    void update(Camera& camera);
+
+    // Draw through the chunked quadtree instead of the full resolution strips
+    void setLodEnabled(bool enabled);
+    bool isLodEnabled() const;
+    TerrainLod* getLod() const;
+
+    // Submit all the strips (or chunks) in one draw, one draw each otherwise
+    void setBatchedDraw(bool batched);
+    bool isBatchedDraw() const;
+    const DrawStats& getDrawStats() const;
+
+    // Compact mode for the full resolution terrain: heights in an R16 texture
+    // displaced in height.vs, one small patch mesh instanced over the grid
+    void setGpuHeights(bool enabled);
+    bool isGpuHeights() const;
+    // Bytes on the GPU for the geometry of the full resolution mode in use
+    size_t getVertexMemory() const;
+
+    // Edit the heights under a round brush centered on (x, z), with a smooth
+    // falloff to the radius. Raise and lower move by strength at the center,
+    // smooth and flatten blend toward the neighbour average or targetHeight
+    // by strength (0 to 1). Only the edited part is regenerated and uploaded.
+    // Returns the heights changed, for Collision::refitTerrain; empty when
+    // the brush is off the terrain
+    Region applyBrush(BrushMode mode, float x, float z, float radius, float strength, float targetHeight = 0.0f);
+    float getLastEditMs() const;
     
 private:
     unsigned int VAO, VBO, EBO;
-    unsigned int texture_diffuse, texture_normal, texture_metalllic, texture_roughness, texture_ao, texture_disp;
+    unsigned int texture_diffuse, texture_normal, texture_arm, texture_disp;
     unsigned int heightmap;
 
     std::vector<unsigned int> textures;
 
     void setup();
+    void setupHeightTexture();
+    void setupPatch();
+    void setupVertexBuffer();
+    void deleteVertexBuffer();
+    void setupLod();
+    void drawTerrain(Shader& shader, Camera& camera);
     void loadTextures();
     void generateTerrain(float gridSize = 1.0f);
+    void snapHeights();
+    void buildMesh();
+    void uploadRegion(const Region& edited, const Region& rebuilt);
 
     std::string getInfo() const override;
 
     
+    std::vector<float> heights;  // heights[column + width * row], what vertices[].y holds
     std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> tangents;
     std::vector<unsigned int> indices;
     int height, width;
     float rez;
     int numStrips, numTrisPerStrip;
+    int stripLength = 0;  // indices of a strip, without the restart index
+    static const unsigned int RESTART_INDEX = 0xFFFFFFFF;
 
     bool wireframe = false;
 
+    TerrainLod* lod = nullptr;
+    bool lodEnabled = true;
+    bool batchedDraw = true;
+
+    static const int PATCH_CELLS = 64;
+    unsigned int heightTexture = 0;
+    unsigned int patchVAO = 0, patchVBO = 0, patchEBO = 0;
+    size_t patchIndexCount = 0;
+    size_t patchVertexBytes = 0;
+    int patchRows = 0, patchColumns = 0;
+    float heightMin = 0.0f, heightRange = 1.0f;
+    // Room left under and over the loaded heights for the brushes
+    static constexpr float EDIT_MARGIN = 32.0f;
+    std::vector<float> brushSource;           // heights around the brush before a smooth
+    std::vector<unsigned short> brushTexels;  // edited texels, for the height texture
+    float lastEditMs = 0.0f;
+    bool gpuHeights = true;
+    DrawStats drawStats = {};
+
     float gridSize = 1.0f;
 
 };
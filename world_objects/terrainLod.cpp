@@ -0,0 +1,440 @@
+#include "terrainLod.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <cmath>
+
+TerrainLod::TerrainLod(int rows, int columns, HeightFunction heights, size_t capacity)
+    : rows(rows), columns(columns), rootLevel(0), heights(heights), VAO(0), VBO(0), EBO(0),
+      capacity(std::max<size_t>(capacity, 16)), indexCount(0), frame(0), stats(), jobsInFlight(0) {
+    // Smallest level whose single chunk covers the whole grid
+    int cells = std::max(rows, columns) - 1;
+    while ((CHUNK_CELLS << rootLevel) < cells) {
+        rootLevel++;
+    }
+    verticesPerChunk = (CHUNK_CELLS + 1) * (CHUNK_CELLS + 1) + 4 * (CHUNK_CELLS + 1);
+    buildBuffers();
+
+    // The root is always resident, there is always something to draw
+    ChunkData root;
+    sampleChunk(rootLevel, 0, 0, root);
+    buildChunk(rootLevel, 0, 0, root);
+    root.version = 0;
+    uploadChunk(root);
+}
+
+TerrainLod::~TerrainLod() {
+    // The jobs write into this object, let them finish first
+    {
+        std::unique_lock<std::mutex> lock(finishedMutex);
+        idleCondition.wait(lock, [this] { return jobsInFlight == 0; });
+    }
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
+
+// Three signed 10 bit components, for GL_INT_2_10_10_10_REV
+uint32_t TerrainLod::packUnitVector(const glm::vec3& v) {
+    const float components[3] = { v.x, v.y, v.z };
+    uint32_t packed = 0;
+    for (int k = 0; k < 3; ++k) {
+        float clamped = std::max(-1.0f, std::min(components[k], 1.0f));
+        int value = static_cast<int>(std::floor(clamped * 511.0f + 0.5f));
+        packed |= (static_cast<uint32_t>(value) & 0x3FFu) << (10 * k);
+    }
+    return packed;
+}
+
+uint64_t TerrainLod::makeKey(int level, int x, int z) {
+    return (static_cast<uint64_t>(level) << 48) | (static_cast<uint64_t>(x) << 24) | static_cast<uint64_t>(z);
+}
+
+bool TerrainLod::isOutside(int level, int x, int z) const {
+    int size = CHUNK_CELLS << level;
+    return x * size >= rows - 1 || z * size >= columns - 1;
+}
+
+// Rows (or columns) sampled by a chunk starting at first, with a ring of
+// neighbours around it for the normals, clamped to the grid
+static void sampleLines(int first, int stride, int count, int* lines) {
+    for (int k = 0; k < TerrainLod::CHUNK_CELLS + 3; ++k) {
+        lines[k] = std::max(0, std::min(first + (k - 1) * stride, count - 1));
+    }
+}
+
+// Copy of the heights the chunk is built from, taken on the calling thread:
+// the terrain edits its heights there while the workers build the chunks
+void TerrainLod::sampleChunk(int level, int x, int z, ChunkData& data) const {
+    const int ring = CHUNK_CELLS + 3;
+    int stride = 1 << level;
+    int sampleRows[ring];
+    int sampleColumns[ring];
+    sampleLines(x * (CHUNK_CELLS << level), stride, rows, sampleRows);
+    sampleLines(z * (CHUNK_CELLS << level), stride, columns, sampleColumns);
+    data.key = makeKey(level, x, z);
+    data.samples.resize(ring * ring);
+    for (int i = 0; i < ring; ++i) {
+        for (int j = 0; j < ring; ++j) {
+            data.samples[i * ring + j] = heights(sampleRows[i], sampleColumns[j]);
+        }
+    }
+}
+
+// Grid of (CHUNK_CELLS + 1)^2 vertices followed by the skirt, one vertex
+// under each border vertex, from the samples of sampleChunk. Samples past
+// the last row or column are clamped, the cells there collapse onto the border
+void TerrainLod::buildChunk(int level, int x, int z, ChunkData& data) const {
+    const int side = CHUNK_CELLS + 1;
+    const int ring = side + 2;
+    int stride = 1 << level;
+    int sampleRows[side + 2];
+    int sampleColumns[side + 2];
+    sampleLines(x * (CHUNK_CELLS << level), stride, rows, sampleRows);
+    sampleLines(z * (CHUNK_CELLS << level), stride, columns, sampleColumns);
+    const std::vector<float>& samples = data.samples;
+
+    data.vertices.resize(verticesPerChunk);
+    data.minY = std::numeric_limits<float>::max();
+    data.maxY = -std::numeric_limits<float>::max();
+
+    for (int i = 0; i < side; ++i) {
+        int row = sampleRows[i + 1];
+        int rowSpan = sampleRows[i + 2] - sampleRows[i];
+        for (int j = 0; j < side; ++j) {
+            int column = sampleColumns[j + 1];
+            int columnSpan = sampleColumns[j + 2] - sampleColumns[j];
+            const float* center = &samples[(i + 1) * ring + j + 1];
+            float y = *center;
+            float dx = rowSpan > 0 ? (center[ring] - center[-ring]) / rowSpan : 0.0f;
+            float dz = columnSpan > 0 ? (center[1] - center[-1]) / columnSpan : 0.0f;
+
+            Vertex& vertex = data.vertices[i * side + j];
+            vertex.position = glm::vec3(row - rows / 2.0f, y, column - columns / 2.0f);
+            vertex.uv = glm::vec2(static_cast<float>(column) / (columns - 1), static_cast<float>(row) / (rows - 1));
+            vertex.normal = packUnitVector(glm::normalize(glm::vec3(-dx, 1.0f, -dz)));
+            vertex.tangent = packUnitVector(glm::normalize(glm::vec3(1.0f, dx, 0.0f)));
+            data.minY = std::min(data.minY, y);
+            data.maxY = std::max(data.maxY, y);
+        }
+    }
+
+    // A neighbour of another level interpolates between samples of the shared
+    // border, so its edge never goes below the lowest sample of the chunk
+    float skirtY = data.minY - stride;
+    for (int k = 0; k < side; ++k) {
+        const int border[4] = { k, (side - 1) * side + k, k * side, k * side + side - 1 };
+        for (int edge = 0; edge < 4; ++edge) {
+            Vertex& skirt = data.vertices[side * side + edge * side + k];
+            skirt = data.vertices[border[edge]];
+            skirt.position.y = skirtY;
+        }
+    }
+}
+
+// Same topology for every chunk, one triangle list shared by all of them,
+// the base vertex of the draw picks the slot
+void TerrainLod::buildBuffers() {
+    const int side = CHUNK_CELLS + 1;
+    std::vector<unsigned short> indices;
+    indices.reserve(6 * CHUNK_CELLS * CHUNK_CELLS + 4 * 6 * CHUNK_CELLS);
+    for (int i = 0; i < CHUNK_CELLS; ++i) {
+        for (int j = 0; j < CHUNK_CELLS; ++j) {
+            unsigned short a = static_cast<unsigned short>(i * side + j);
+            unsigned short b = static_cast<unsigned short>(a + 1);
+            unsigned short c = static_cast<unsigned short>(a + side);
+            unsigned short d = static_cast<unsigned short>(c + 1);
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int k = 0; k < CHUNK_CELLS; ++k) {
+            const int border[4] = { k, (side - 1) * side + k, k * side, k * side + side - 1 };
+            const int nextBorder[4] = { k + 1, (side - 1) * side + k + 1, (k + 1) * side, (k + 1) * side + side - 1 };
+            unsigned short top0 = static_cast<unsigned short>(border[edge]);
+            unsigned short top1 = static_cast<unsigned short>(nextBorder[edge]);
+            unsigned short bottom0 = static_cast<unsigned short>(side * side + edge * side + k);
+            unsigned short bottom1 = static_cast<unsigned short>(bottom0 + 1);
+            indices.insert(indices.end(), { top0, bottom0, top1, top1, bottom0, bottom1 });
+        }
+    }
+    indexCount = indices.size();
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * verticesPerChunk * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+    // Same attributes as the full terrain, normal and tangent packed in 32 bits
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+    glEnableVertexAttribArray(4);
+    glBindVertexArray(0);
+
+    freeSlots.reserve(capacity);
+    for (size_t slot = capacity; slot > 0; --slot) {
+        freeSlots.push_back(static_cast<int>(slot - 1));
+    }
+    drawCounts.reserve(capacity);
+    drawOffsets.reserve(capacity);
+    drawBaseVertices.reserve(capacity);
+}
+
+// Needs a free slot, uploadFinished() checks. A chunk rebuilt after an edit keeps its slot
+void TerrainLod::uploadChunk(ChunkData& data) {
+    Chunk& chunk = chunks[data.key];
+    if (!chunk.resident) {
+        chunk.slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, chunk.slot * verticesPerChunk * sizeof(Vertex),
+                    data.vertices.size() * sizeof(Vertex), data.vertices.data());
+    chunk.resident = true;
+    chunk.uploadedVersion = data.version;
+    chunk.minY = data.minY;
+    chunk.maxY = data.maxY;
+    chunk.lastUsedFrame = frame;
+    stats.chunksUploaded++;
+}
+
+void TerrainLod::requestChunk(int level, int x, int z) {
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        if (jobsInFlight + finished.size() >= maxLoadingChunks) return;  // asked again on a later frame
+        jobsInFlight++;
+    }
+    // A resident chunk is rebuilt in place, it stays drawn until the new vertices arrive
+    Chunk& chunk = chunks[makeKey(level, x, z)];
+    if (!chunk.resident) {
+        chunk.slot = -1;
+    }
+    chunk.stale = false;
+    chunk.building = true;
+    chunk.lastUsedFrame = frame;
+
+    // The worker only sees its own copy of the heights
+    std::shared_ptr<ChunkData> data = std::make_shared<ChunkData>();
+    sampleChunk(level, x, z, *data);
+    data->version = chunk.version;
+
+    // Runs inline when the pool has no workers, the lock must not be held here
+    WorkerPool::shared().submit([this, level, x, z, data] {
+        buildChunk(level, x, z, *data);
+        std::vector<float>().swap(data->samples);
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.push_back(std::move(*data));
+        jobsInFlight--;
+        idleCondition.notify_all();
+    });
+}
+
+void TerrainLod::uploadFinished() {
+    std::vector<ChunkData> ready;
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        size_t count = std::min(std::min(uploadsPerFrame, freeSlots.size()), finished.size());
+        ready.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            ready.push_back(std::move(finished[i]));
+        }
+        finished.erase(finished.begin(), finished.begin() + count);
+        stats.chunksLoading = jobsInFlight + finished.size();
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+        auto it = chunks.find(ready[i].key);
+        if (it == chunks.end()) continue;  // evicted while it was rebuilt
+        // Built from heights edited since, it is still uploaded when newer
+        // than what the chunk draws and the chunk stays stale to be rebuilt.
+        // Under a brush moving every frame the chunk lags an edit or two
+        // behind instead of never updating
+        Chunk& chunk = it->second;
+        chunk.building = false;
+        if (chunk.resident && ready[i].version <= chunk.uploadedVersion) continue;
+        bool loaded = !chunk.resident;
+        uploadChunk(ready[i]);
+        if (loaded && chunk.version != ready[i].version) {
+            chunk.stale = true;
+        }
+    }
+}
+
+// Keeps enough free slots for the uploads of the next frame
+void TerrainLod::evictUnused() {
+    stats.chunksResident = capacity - freeSlots.size();
+    if (freeSlots.size() >= uploadsPerFrame) return;
+
+    // Oldest first, the root and the chunks of this frame stay
+    uint64_t rootKey = makeKey(rootLevel, 0, 0);
+    std::vector<std::pair<unsigned int, uint64_t>> candidates;
+    for (const auto& entry : chunks) {
+        if (entry.second.resident && entry.second.lastUsedFrame != frame && entry.first != rootKey) {
+            candidates.push_back(std::make_pair(entry.second.lastUsedFrame, entry.first));
+        }
+    }
+    size_t count = std::min(uploadsPerFrame - freeSlots.size(), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+    for (size_t i = 0; i < count; ++i) {
+        auto it = chunks.find(candidates[i].second);
+        freeSlots.push_back(it->second.slot);
+        chunks.erase(it);
+    }
+    stats.chunksEvicted = count;
+    stats.chunksResident -= count;
+}
+
+// Only called for resident chunks, the children are entered once all of them are loaded
+void TerrainLod::select(int level, int x, int z, const glm::vec3& viewPosition) {
+    stats.nodesVisited++;
+    Chunk& chunk = chunks[makeKey(level, x, z)];
+    chunk.lastUsedFrame = frame;
+    if (chunk.stale && !chunk.building) {
+        requestChunk(level, x, z);
+    }
+
+    int size = CHUNK_CELLS << level;
+    int lastRow = std::min((x + 1) * size, rows - 1);
+    int lastColumn = std::min((z + 1) * size, columns - 1);
+    glm::vec3 min(x * size - rows / 2.0f, chunk.minY, z * size - columns / 2.0f);
+    glm::vec3 max(lastRow - rows / 2.0f, chunk.maxY, lastColumn - columns / 2.0f);
+    if (!isVisible(min, max)) return;
+
+    if (level > 0) {
+        glm::vec3 closest = glm::clamp(viewPosition, min, max);
+        if (glm::length(viewPosition - closest) < lodDistance * size) {
+            bool childrenReady = true;
+            for (int child = 0; child < 4; ++child) {
+                int childX = 2 * x + (child & 1);
+                int childZ = 2 * z + (child >> 1);
+                if (isOutside(level - 1, childX, childZ)) continue;
+                auto it = chunks.find(makeKey(level - 1, childX, childZ));
+                if (it == chunks.end()) {
+                    requestChunk(level - 1, childX, childZ);
+                    childrenReady = false;
+                } else {
+                    it->second.lastUsedFrame = frame;
+                    childrenReady = childrenReady && it->second.resident;
+                }
+            }
+            if (childrenReady) {
+                for (int child = 0; child < 4; ++child) {
+                    int childX = 2 * x + (child & 1);
+                    int childZ = 2 * z + (child >> 1);
+                    if (!isOutside(level - 1, childX, childZ)) {
+                        select(level - 1, childX, childZ, viewPosition);
+                    }
+                }
+                return;
+            }
+        }
+    }
+    drawCounts.push_back(static_cast<GLsizei>(indexCount));
+    drawOffsets.push_back(nullptr);
+    drawBaseVertices.push_back(static_cast<GLint>(chunk.slot * verticesPerChunk));
+}
+
+// Box against the six frustum planes, outside when the corner furthest
+// along a plane normal is behind it
+bool TerrainLod::isVisible(const glm::vec3& min, const glm::vec3& max) const {
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4& plane = frustumPlanes[i];
+        glm::vec3 corner(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y, plane.z > 0.0f ? max.z : min.z);
+        if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TerrainLod::update(const glm::vec3& viewPosition, const glm::mat4& viewProjection) {
+    auto start = std::chrono::high_resolution_clock::now();
+    stats = Stats();
+    frame++;
+
+    // Planes from the rows of the view projection matrix (Gribb and Hartmann)
+    glm::vec4 rowX(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 rowY(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 rowZ(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 rowW(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    frustumPlanes[0] = rowW + rowX;
+    frustumPlanes[1] = rowW - rowX;
+    frustumPlanes[2] = rowW + rowY;
+    frustumPlanes[3] = rowW - rowY;
+    frustumPlanes[4] = rowW + rowZ;
+    frustumPlanes[5] = rowW - rowZ;
+
+    uploadFinished();
+    auto uploadEnd = std::chrono::high_resolution_clock::now();
+
+    drawCounts.clear();
+    drawOffsets.clear();
+    drawBaseVertices.clear();
+    select(rootLevel, 0, 0, viewPosition);
+    evictUnused();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    stats.uploadMs = std::chrono::duration<float, std::milli>(uploadEnd - start).count();
+    stats.selectMs = std::chrono::duration<float, std::milli>(end - uploadEnd).count();
+}
+
+void TerrainLod::draw() {
+    GLsizei drawCount = static_cast<GLsizei>(drawCounts.size());
+    glBindVertexArray(VAO);
+    if (multiDraw) {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_SHORT, drawOffsets.data(),
+                                      drawCount, drawBaseVertices.data());
+        stats.drawCalls++;
+    } else {
+        for (GLsizei i = 0; i < drawCount; ++i) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, drawCounts[i], GL_UNSIGNED_SHORT, drawOffsets[i], drawBaseVertices[i]);
+        }
+        stats.drawCalls += drawCount;
+    }
+    glBindVertexArray(0);
+    stats.chunksDrawn = drawCounts.size();
+    stats.trianglesSubmitted += drawCounts.size() * (indexCount / 3);
+}
+
+void TerrainLod::invalidateRegion(int rowBegin, int rowEnd, int columnBegin, int columnEnd) {
+    if (rowBegin >= rowEnd || columnBegin >= columnEnd) return;
+    for (auto& entry : chunks) {
+        int level = static_cast<int>(entry.first >> 48);
+        int x = static_cast<int>((entry.first >> 24) & 0xFFFFFF);
+        int z = static_cast<int>(entry.first & 0xFFFFFF);
+        // The ring of neighbours for the normals reaches one stride past the chunk
+        int size = CHUNK_CELLS << level;
+        int stride = 1 << level;
+        if (x * size - stride >= rowEnd || (x + 1) * size + stride < rowBegin ||
+            z * size - stride >= columnEnd || (z + 1) * size + stride < columnBegin) {
+            continue;
+        }
+        entry.second.version++;
+        entry.second.stale = entry.second.resident;
+    }
+}
+
+const TerrainLod::Stats& TerrainLod::getStats() const {
+    return stats;
+}
+
+int TerrainLod::getRows() const {
+    return rows;
+}
+
+int TerrainLod::getColumns() const {
+    return columns;
+}
+
+size_t TerrainLod::getFullTriangleCount() const {
+    return 2 * static_cast<size_t>(rows - 1) * static_cast<size_t>(columns - 1);
+}
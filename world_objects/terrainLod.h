@@ -0,0 +1,148 @@
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include "../glad/glad.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "../threading/workerPool.h"
+
+// Level of detail for a heightfield too big to draw at full resolution.
+// The grid is covered by a quadtree of chunks that all have CHUNK_CELLS
+// cells per side, a chunk of level L samples every 2^L-th height. Each frame
+// the nodes close to the viewer are split until the chunks are fine enough,
+// missing chunks are built on worker threads and uploaded a few per frame,
+// a node is drawn in place of its children until all of them are loaded.
+// Chunks hang a skirt down from their borders, it hides the cracks where
+// two levels meet. Chunks that weren't used for a while are evicted.
+// Same grid as Terrain: row i is at x = i - rows / 2, column j at z = j - columns / 2.
+class TerrainLod {
+public:
+    // Height of the sample at (row, column), called on the thread calling
+    // the constructor and update(), the workers build from a copy
+    typedef std::function<float(int row, int column)> HeightFunction;
+
+    static const int CHUNK_CELLS = 32;
+
+    struct Stats {
+        size_t nodesVisited;
+        size_t chunksDrawn;
+        size_t drawCalls;
+        size_t trianglesSubmitted;
+        size_t chunksResident;
+        size_t chunksLoading;
+        size_t chunksUploaded;   // this frame
+        size_t chunksEvicted;    // this frame
+        float selectMs;
+        float uploadMs;
+    };
+
+    // A node splits when the viewer is closer than lodDistance times its size
+    float lodDistance = 2.0f;
+    // Chunks built at the same time, and uploaded per update()
+    size_t maxLoadingChunks = 32;
+    size_t uploadsPerFrame = 8;
+    // All the chunks in one glMultiDrawElementsBaseVertex, one draw per chunk otherwise
+    bool multiDraw = true;
+
+    // Needs a current GL context, the root chunk is built right away.
+    // capacity chunks are kept on the GPU, the least recently used ones go first
+    TerrainLod(int rows, int columns, HeightFunction heights, size_t capacity = 1024);
+    ~TerrainLod();
+
+    TerrainLod(const TerrainLod&) = delete;
+    TerrainLod& operator=(const TerrainLod&) = delete;
+
+    // Select the chunks to draw for this view, queue the missing ones and
+    // upload the ones the workers finished
+    void update(const glm::vec3& viewPosition, const glm::mat4& viewProjection);
+
+    // Draw the selected chunks with the shader in use
+    void draw();
+
+    // Heights changed in rows [rowBegin, rowEnd) and columns [columnBegin, columnEnd).
+    // The chunks sampling them are rebuilt in the background, they keep
+    // drawing their old vertices until then
+    void invalidateRegion(int rowBegin, int rowEnd, int columnBegin, int columnEnd);
+
+    const Stats& getStats() const;
+    int getRows() const;
+    int getColumns() const;
+    // Triangles of the whole grid at full resolution
+    size_t getFullTriangleCount() const;
+
+private:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+        uint32_t normal;   // packed by packUnitVector
+        uint32_t tangent;
+    };
+    struct Chunk {
+        int slot;  // in the vertex buffer, -1 while loading
+        bool resident;
+        float minY, maxY;
+        unsigned int lastUsedFrame;
+        unsigned int version;          // bumped by each edit under the chunk
+        unsigned int uploadedVersion;  // of the vertices on the GPU
+        bool stale;                    // edited since its vertices were built, not requested again yet
+        bool building;                 // a worker is building it, one job per chunk at a time
+    };
+    // Vertices built by a worker, waiting for the upload
+    struct ChunkData {
+        uint64_t key;
+        std::vector<float> samples;  // heights with a ring of neighbours, (CHUNK_CELLS + 3)^2
+        std::vector<Vertex> vertices;
+        float minY, maxY;
+        unsigned int version;  // of the chunk when it was requested
+    };
+
+    int rows, columns;
+    int rootLevel;
+    HeightFunction heights;
+
+    // Every chunk has the same size, they all live in slots of one vertex
+    // buffer and share the index buffer
+    unsigned int VAO, VBO, EBO;
+    size_t capacity;
+    size_t verticesPerChunk;
+    size_t indexCount;
+    std::vector<int> freeSlots;
+    std::unordered_map<uint64_t, Chunk> chunks;
+
+    // Command buffer of the chunks selected by update()
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+
+    unsigned int frame;
+    Stats stats;
+
+    // finished chunks, filled by the workers
+    std::mutex finishedMutex;
+    std::condition_variable idleCondition;
+    std::vector<ChunkData> finished;
+    size_t jobsInFlight;  // built on WorkerPool::shared()
+
+    glm::vec4 frustumPlanes[6];
+
+    static uint32_t packUnitVector(const glm::vec3& v);
+    static uint64_t makeKey(int level, int x, int z);
+    bool isOutside(int level, int x, int z) const;
+    void sampleChunk(int level, int x, int z, ChunkData& data) const;
+    void buildChunk(int level, int x, int z, ChunkData& data) const;
+    void buildBuffers();
+    void uploadChunk(ChunkData& data);
+    void requestChunk(int level, int x, int z);
+    void uploadFinished();
+    void evictUnused();
+    void select(int level, int x, int z, const glm::vec3& viewPosition);
+    bool isVisible(const glm::vec3& min, const glm::vec3& max) const;
+};
+
+#endif // TERRAIN_LOD_H